@@ -0,0 +1,486 @@
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "Commands.hpp"
+
+#include "Config.h"
+#include "FramePool.hpp"
+#include "MasterBuilder.hpp"
+#include "SerWriter.hpp"
+#include "SpoolConverter.hpp"
+#include "StarDetector.hpp"
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QMap>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QPointF>
+#include <QTextStream>
+#include <QThread>
+#include <QThreadPool>
+#include <QVector>
+#include <random>
+
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
+
+namespace
+{
+/*!
+ * The positional arguments that follow the command's name.
+ */
+auto operands(const QCommandLineParser & parser) -> QStringList
+{
+   return parser.positionalArguments().mid(1);
+}
+
+/*!
+ * Flushes what was written to a file out of the page cache, and waits for the disk to have it.
+ *
+ * @return False if the file could not be opened or flushed.
+ */
+auto syncFile(const QString & path) -> bool
+{
+#ifdef Q_OS_UNIX
+   QFile file(path);
+   return file.open(QIODevice::ReadOnly) && fsync(file.handle()) == 0;
+#else
+   Q_UNUSED(path)
+   return true;
+#endif
+}
+} // namespace
+
+/* ***************************************************************************************************************** */
+// MARK: - Public methods
+/* ***************************************************************************************************************** */
+auto Commands::benchmarkSer(QCommandLineParser & parser, const QCoreApplication & application) -> int
+{
+   parser.setApplicationDescription(
+     QCoreApplication::translate("Commands", "Measures how fast SER files are written."));
+   const QCommandLineOption directory(QString("directory"),
+                                      QCoreApplication::translate("Commands", "Write the files in <directory>."),
+                                      QString("directory"));
+   const QCommandLineOption width(QString("width"),
+                                  QCoreApplication::translate("Commands", "The frame width, in pixels."),
+                                  QString("pixels"),
+                                  QString("1920"));
+   const QCommandLineOption height(QString("height"),
+                                   QCoreApplication::translate("Commands", "The frame height, in pixels."),
+                                   QString("pixels"),
+                                   QString("1080"));
+   const QCommandLineOption bits(QString("bits"),
+                                 QCoreApplication::translate("Commands", "8 or 16 bits per pixel."),
+                                 QString("bits"),
+                                 QString("8"));
+   const QCommandLineOption seconds(QString("seconds"),
+                                    QCoreApplication::translate("Commands", "How long to write for."),
+                                    QString("seconds"),
+                                    QString("10"));
+   parser.addOptions({ directory, width, height, bits, seconds });
+   parser.process(application);
+
+   QTextStream error(stderr);
+   const auto  frameWidth  = parser.value(width).toUInt();
+   const auto  frameHeight = parser.value(height).toUInt();
+   const auto  depth       = parser.value(bits).toUInt();
+   const auto  duration    = parser.value(seconds).toLongLong() * MillisecondsPerSecond;
+   if (frameWidth == 0 || frameHeight == 0 || (depth != 8 && depth != 16) || duration <= 0) {
+      error << parser.helpText();
+      return 1;
+   }
+
+   // A few buffers, re-used as a camera's would be; the content does not matter to the disk.
+   const auto frameLength = static_cast<qint64>(frameWidth) * frameHeight * (depth / 8);
+   auto       pool        = FramePool::create(frameLength, 4);
+
+   SerWriter   writer;
+   QStringList files;
+   quint64     frames{ 0 };
+   QObject::connect(&writer, &SerWriter::fileWritten, [&](const QString & path, int) { files.append(path); });
+   QObject::connect(&writer, &SerWriter::writeFailed, [&](const QString & reason) { error << reason << "\n"; });
+   if (!writer.open(parser.value(directory), QString("benchmark"), SerWriter::Header())) {
+      return 1;
+   }
+   QElapsedTimer timer;
+   timer.start();
+   while (timer.elapsed() < duration) {
+      auto frame = pool->acquire();
+      if (frame.isNull()) {
+         error << QCoreApplication::translate("Commands", "No memory for a frame of %1 bytes.").arg(frameLength)
+               << "\n";
+         break;
+      }
+      const auto now = QDateTime::currentMSecsSinceEpoch();
+      frame.setGeometry(frameWidth, frameHeight, depth, 1);
+      frame.setSequence(frames + 1);
+      frame.setTimestamps(now, now);
+      if (!writer.write(frame)) {
+         break;
+      }
+      ++frames;
+   }
+   auto finished = writer.close();
+   // Until then much of what was written may still be dirty in the page cache; a short run would never reach the disk.
+   for (const auto & file : qAsConst(files)) {
+      if (!syncFile(file)) {
+         error << QCoreApplication::translate("Commands", "%1 could not be synced.").arg(file) << "\n";
+         finished = false;
+      }
+   }
+   const auto elapsed = static_cast<double>(timer.elapsed()) / MillisecondsPerSecond;
+   for (const auto & file : files) {
+      QFile::remove(file);
+   }
+   if (!finished) {
+      return 1;
+   }
+
+   QTextStream out(stdout);
+   out << QCoreApplication::translate("Commands", "Wrote %1 frames of %2 × %3 × %4 bits to %5 files in %6 s.")
+            .arg(frames)
+            .arg(frameWidth)
+            .arg(frameHeight)
+            .arg(depth)
+            .arg(files.count())
+            .arg(elapsed, 0, 'f', 1)
+       << "\n";
+   out << QCoreApplication::translate("Commands", "%1 frames/s; %2 MB/s.")
+            .arg(static_cast<double>(frames) / elapsed, 0, 'f', 1)
+            .arg(static_cast<double>(frames) * static_cast<double>(frameLength) / BytesPerMegabyte / elapsed, 0, 'f', 1)
+       << "\n";
+   return 0;
+}
+
+auto Commands::benchmarkStars(QCommandLineParser & parser, const QCoreApplication & application) -> int
+{
+   parser.setApplicationDescription(
+     QCoreApplication::translate("Commands", "Measures the speed & accuracy of star detection."));
+   const QCommandLineOption width(QString("width"),
+                                  QCoreApplication::translate("Commands", "The frame width, in pixels."),
+                                  QString("pixels"),
+                                  QString("6252"));
+   const QCommandLineOption height(QString("height"),
+                                   QCoreApplication::translate("Commands", "The frame height, in pixels."),
+                                   QString("pixels"),
+                                   QString("4176"));
+   const QCommandLineOption stars(QString("stars"),
+                                  QCoreApplication::translate("Commands", "The number of stars."),
+                                  QString("count"),
+                                  QString("500"));
+   const QCommandLineOption seamStars(QString("seam-stars"),
+                                      QCoreApplication::translate("Commands", "How many of them sit on tile seams."),
+                                      QString("count"),
+                                      QString("40"));
+   const QCommandLineOption sigma(QString("sigma"),
+                                  QCoreApplication::translate("Commands", "The star width across, in pixels."),
+                                  QString("pixels"),
+                                  QString("2"));
+   const QCommandLineOption elongation(QString("elongation"),
+                                       QCoreApplication::translate("Commands", "The star height over its width."),
+                                       QString("ratio"),
+                                       QString("1"));
+   const QCommandLineOption background(QString("background"),
+                                       QCoreApplication::translate("Commands", "The sky background, in ADU."),
+                                       QString("ADU"),
+                                       QString("1000"));
+   const QCommandLineOption noise(QString("noise"),
+                                  QCoreApplication::translate("Commands", "The noise's standard deviation, in ADU."),
+                                  QString("ADU"),
+                                  QString("10"));
+   const QCommandLineOption threads(QString("threads"),
+                                    QCoreApplication::translate("Commands", "The threads to search with."),
+                                    QString("count"),
+                                    QString::number(QThread::idealThreadCount()));
+   const QCommandLineOption runs(QString("runs"),
+                                 QCoreApplication::translate("Commands", "How many times to search the field."),
+                                 QString("count"),
+                                 QString("5"));
+   parser.addOptions(
+     { width, height, stars, seamStars, sigma, elongation, background, noise, threads, runs });
+   parser.process(application);
+
+   QTextStream error(stderr);
+   const auto  frameWidth  = parser.value(width).toInt();
+   const auto  frameHeight = parser.value(height).toInt();
+   const auto  starCount   = parser.value(stars).toInt();
+   const auto  onSeams     = qMin(parser.value(seamStars).toInt(), starCount);
+   const auto  sigmaX      = parser.value(sigma).toDouble();
+   const auto  sigmaY      = sigmaX * parser.value(elongation).toDouble();
+   const auto  sky         = parser.value(background).toDouble();
+   const auto  noiseSigma  = parser.value(noise).toDouble();
+   const auto  threadCount = parser.value(threads).toInt();
+   const auto  runCount    = parser.value(runs).toInt();
+   const auto  margin      = static_cast<int>(std::ceil(6.0 * qMax(sigmaX, sigmaY)));
+   if (frameWidth <= 2 * margin || frameHeight <= 2 * margin || starCount <= 0 || sigmaX <= 0.0 || sigmaY <= 0.0
+       || noiseSigma <= 0.0 || threadCount <= 0 || runCount <= 0) {
+      error << parser.helpText();
+      return 1;
+   }
+
+   const auto frameLength = static_cast<qint64>(frameWidth) * frameHeight * 2;
+   auto       pool        = FramePool::create(frameLength, 1);
+   auto       frame       = pool->acquire();
+   if (frame.isNull()) {
+      error << QCoreApplication::translate("Commands", "No memory for a frame of %1 bytes.").arg(frameLength) << "\n";
+      return 1;
+   }
+   frame.setGeometry(static_cast<quint32>(frameWidth), static_cast<quint32>(frameHeight), 16, 1);
+   auto *                           pixels = reinterpret_cast<quint16 *>(frame.data()); // NOLINT
+   std::mt19937                     random(1);
+   std::normal_distribution<double> noiseDistribution(0.0, noiseSigma);
+   for (qint64 index = 0; index < static_cast<qint64>(frameWidth) * frameHeight; ++index) {
+      pixels[index] = static_cast<quint16>(qBound(0.0, std::round(sky + noiseDistribution(random)), SampleMaximum16));
+   }
+
+   // Peaks from 20 to 200 times the noise; the faintest still clear the detection threshold by a wide margin.
+   std::uniform_real_distribution<double> xDistribution(margin, frameWidth - margin - 1);
+   std::uniform_real_distribution<double> yDistribution(margin, frameHeight - margin - 1);
+   std::uniform_real_distribution<double> peakDistribution(20.0 * noiseSigma, 200.0 * noiseSigma);
+   const auto                             seams = qMax(1, (frameWidth - 2 * margin) / StarTileSize);
+   QVector<QPointF>                       truth;
+   for (int star = 0; star < starCount; ++star) {
+      auto x = xDistribution(random);
+      if (star < onSeams) {
+         x = qBound<double>(margin, (star % seams + 1) * StarTileSize - 0.5, frameWidth - margin - 1);
+      }
+      const auto y    = yDistribution(random);
+      const auto peak = peakDistribution(random);
+      truth.append(QPointF(x, y));
+      const auto radiusX = static_cast<int>(std::ceil(5.0 * sigmaX));
+      const auto radiusY = static_cast<int>(std::ceil(5.0 * sigmaY));
+      for (int row = qRound(y) - radiusY; row <= qRound(y) + radiusY; ++row) {
+         for (int column = qRound(x) - radiusX; column <= qRound(x) + radiusX; ++column) {
+            const auto dx    = (column - x) / sigmaX;
+            const auto dy    = (row - y) / sigmaY;
+            const auto value = std::round(peak * std::exp(-0.5 * (dx * dx + dy * dy)));
+            auto &     pixel = pixels[static_cast<qint64>(row) * frameWidth + column];
+            pixel            = static_cast<quint16>(qMin(SampleMaximum16, pixel + value));
+         }
+      }
+   }
+
+   QThreadPool::globalInstance()->setMaxThreadCount(threadCount);
+   QVector<double> times;
+   StarField       field;
+   for (int run = 0; run < runCount; ++run) {
+      QElapsedTimer timer;
+      timer.start();
+      field = StarDetector::detect(frame);
+      times.append(static_cast<double>(timer.nsecsElapsed()) / NanosecondsPerSecond * MillisecondsPerSecond);
+   }
+   auto median = [](QVector<double> values) {
+      if (values.isEmpty()) {
+         return 0.0;
+      }
+      std::sort(values.begin(), values.end());
+      return values.at(values.count() / 2);
+   };
+
+   // Each true star is matched to the nearest star found within a pixel.
+   QVector<double> fwhms;
+   QVector<double> eccentricities;
+   double          squaredErrors{ 0.0 };
+   for (const auto & position : qAsConst(truth)) {
+      const Star * nearest = nullptr;
+      double       distance{ 1.0 };
+      for (const auto & found : qAsConst(field.stars)) {
+         const auto separation = std::hypot(found.x - position.x(), found.y - position.y());
+         if (separation < distance) {
+            nearest  = &found;
+            distance = separation;
+         }
+      }
+      if (nearest != nullptr) {
+         fwhms.append(nearest->fwhm);
+         eccentricities.append(nearest->eccentricity);
+         squaredErrors += distance * distance;
+      }
+   }
+   const auto major = qMax(sigmaX, sigmaY);
+   const auto minor = qMin(sigmaX, sigmaY);
+
+   QTextStream out(stdout);
+   out << QCoreApplication::translate("Commands", "Found %1 of %2 stars in %3 × %4 pixels; %5 within a pixel of one.")
+            .arg(field.stars.count())
+            .arg(starCount)
+            .arg(frameWidth)
+            .arg(frameHeight)
+            .arg(fwhms.count())
+       << "\n";
+   out << QCoreApplication::translate("Commands",
+                                      "Median FWHM %1 (true %2), eccentricity %3 (true %4); RMS offset %5 px.")
+            .arg(median(fwhms), 0, 'f', 3)
+            .arg(FWHMPerSigma * std::sqrt((sigmaX * sigmaX + sigmaY * sigmaY) / 2.0), 0, 'f', 3)
+            .arg(median(eccentricities), 0, 'f', 3)
+            .arg(std::sqrt(1.0 - (minor * minor) / (major * major)), 0, 'f', 3)
+            .arg(fwhms.isEmpty() ? 0.0 : std::sqrt(squaredErrors / fwhms.count()), 0, 'f', 3)
+       << "\n";
+   out << QCoreApplication::translate("Commands", "%1 runs on %2 threads; fastest %3 ms, median %4 ms.")
+            .arg(runCount)
+            .arg(threadCount)
+            .arg(*std::min_element(times.cbegin(), times.cend()), 0, 'f', 1)
+            .arg(median(times), 0, 'f', 1)
+       << "\n";
+   return 0;
+}
+
+auto Commands::buildMaster(QCommandLineParser & parser, const QCoreApplication & application) -> int
+{
+   parser.setApplicationDescription(
+     QCoreApplication::translate("Commands", "Combines calibration frames into a master."));
+   const QCommandLineOption output(QString("output"),
+                                   QCoreApplication::translate("Commands", "Write the master to <file>."),
+                                   QString("file"));
+   const QCommandLineOption kind(QString("kind"),
+                                 QCoreApplication::translate("Commands", "bias, dark or flat; dark if not given."),
+                                 QString("kind"),
+                                 QString("dark"));
+   const QCommandLineOption method(
+     QString("method"),
+     QCoreApplication::translate("Commands", "average, median, sigma or winsorized; winsorized if not given."),
+     QString("method"),
+     QString("winsorized"));
+   const QCommandLineOption lowSigma(QString("low-sigma"),
+                                     QCoreApplication::translate("Commands", "The low rejection limit, in sigmas."),
+                                     QString("sigmas"),
+                                     QString::number(SigmaClipLimit));
+   const QCommandLineOption highSigma(QString("high-sigma"),
+                                      QCoreApplication::translate("Commands", "The high rejection limit, in sigmas."),
+                                      QString("sigmas"),
+                                      QString::number(SigmaClipLimit));
+   const QCommandLineOption memory(QString("memory"),
+                                   QCoreApplication::translate("Commands", "The memory for input, in MB."),
+                                   QString("MB"),
+                                   QString::number(MasterBuildMemoryBudget / BytesPerMegabyte));
+   parser.addOptions({ output, kind, method, lowSigma, highSigma, memory });
+   parser.addPositionalArgument(QString("inputs"),
+                                QCoreApplication::translate("Commands", "The FITS frames, or directories of them."),
+                                QString("inputs..."));
+   parser.process(application);
+
+   const QMap<QString, MasterFrame::Kind> kinds{ { QString("bias"), MasterFrame::Bias },
+                                                 { QString("dark"), MasterFrame::Dark },
+                                                 { QString("flat"), MasterFrame::Flat } };
+   const QMap<QString, MasterBuilder::Method> methods{ { QString("average"), MasterBuilder::Average },
+                                                       { QString("median"), MasterBuilder::Median },
+                                                       { QString("sigma"), MasterBuilder::SigmaClip },
+                                                       { QString("winsorized"), MasterBuilder::WinsorizedSigmaClip } };
+   QTextStream error(stderr);
+   if (!kinds.contains(parser.value(kind)) || !methods.contains(parser.value(method))) {
+      error << parser.helpText();
+      return 1;
+   }
+   MasterBuilder::Options options;
+   options.kind         = kinds.value(parser.value(kind));
+   options.method       = methods.value(parser.value(method));
+   options.lowSigma     = parser.value(lowSigma).toDouble();
+   options.highSigma    = parser.value(highSigma).toDouble();
+   options.memoryBudget = static_cast<qint64>(parser.value(memory).toDouble() * BytesPerMegabyte);
+
+   QStringList inputs;
+   for (const auto & input : operands(parser)) {
+      if (QFileInfo(input).isDir()) {
+         inputs.append(MasterBuilder::inputsIn(input));
+      } else {
+         inputs.append(input);
+      }
+   }
+
+   MasterBuilder builder;
+   QMutex        progressMutex;
+   int           reported{ 0 };
+   QObject::connect(&builder, &MasterBuilder::progress, [&](int rowsDone, int rows) {
+      // From the pool threads; only whole tens of percent are printed.
+      QMutexLocker locker(&progressMutex);
+      const auto   tens = rowsDone * 10 / rows;
+      if (tens > reported) {
+         reported = tens;
+         error << tens * 10 << "%\n";
+         error.flush();
+      }
+   });
+   const auto report = builder.build(inputs, parser.value(output), options);
+   if (!report.succeeded()) {
+      error << report.error << "\n";
+      return 1;
+   }
+
+   QTextStream out(stdout);
+   out << QCoreApplication::translate("Commands", "Combined %1 frames of %2 × %3 × %4 in bands of %5 rows.")
+            .arg(report.frames)
+            .arg(report.width)
+            .arg(report.height)
+            .arg(report.channels)
+            .arg(report.bandRows)
+       << "\n";
+   out << QCoreApplication::translate("Commands", "Read %1 MB in %2 s; %3 MB/s.")
+            .arg(static_cast<double>(report.bytesRead) / BytesPerMegabyte, 0, 'f', 0)
+            .arg(static_cast<double>(report.elapsed) / MillisecondsPerSecond, 0, 'f', 1)
+            .arg(report.throughput(), 0, 'f', 1)
+       << "\n";
+   out << QCoreApplication::translate("Commands", "Peak resident memory %1 MB; %2 samples rejected.")
+            .arg(static_cast<double>(report.peakResidentBytes) / BytesPerMegabyte, 0, 'f', 0)
+            .arg(report.rejectedSamples)
+       << "\n";
+   return 0;
+}
+
+auto Commands::convertSpool(QCommandLineParser & parser, const QCoreApplication & application) -> int
+{
+   parser.setApplicationDescription(QCoreApplication::translate("Commands", "Converts spool files to FITS or SER."));
+   const QCommandLineOption output(QString("output"),
+                                   QCoreApplication::translate("Commands", "Write the converted files in <directory>."),
+                                   QString("directory"));
+   const QCommandLineOption format(QString("format"),
+                                   QCoreApplication::translate("Commands", "fits or ser; fits if not given."),
+                                   QString("format"),
+                                   QString("fits"));
+   parser.addOptions({ output, format });
+   parser.addPositionalArgument(
+     QString("spools"), QCoreApplication::translate("Commands", "The spool files."), QString("spools..."));
+   parser.process(application);
+
+   const QMap<QString, SpoolConverter::Format> formats{ { QString("fits"), SpoolConverter::Fits },
+                                                        { QString("ser"), SpoolConverter::Ser } };
+   QTextStream error(stderr);
+   if (!formats.contains(parser.value(format)) || operands(parser).isEmpty()) {
+      error << parser.helpText();
+      return 1;
+   }
+
+   QTextStream out(stdout);
+   int         failures{ 0 };
+   for (const auto & spool : operands(parser)) {
+      SpoolConverter           converter;
+      SpoolConverter::Report   report;
+      const auto               to = formats.value(parser.value(format));
+      std::unique_ptr<QThread> thread(
+        QThread::create([&]() { report = converter.convert(spool, parser.value(output), to); }));
+      thread->start(QThread::IdlePriority);
+      thread->wait();
+      if (!report.succeeded()) {
+         error << spool << ": " << report.error << "\n";
+         ++failures;
+         continue;
+      }
+      const auto seconds = static_cast<double>(qMax(report.elapsed, Q_INT64_C(1))) / MillisecondsPerSecond;
+      out << QCoreApplication::translate("Commands", "%1: converted %2 frames, %3 lost, in %4 s; %5 MB/s.")
+               .arg(spool)
+               .arg(report.frames)
+               .arg(report.skipped)
+               .arg(seconds, 0, 'f', 1)
+               .arg(static_cast<double>(report.bytesRead) / BytesPerMegabyte / seconds, 0, 'f', 1)
+          << "\n";
+   }
+   return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+
+/*! \brief The commands of QHYAstroCLI: batch jobs & benchmarks that need no window.
+ *
+ * Each is handed the parser with the command's name as its first positional argument; it adds its own options,
+ * processes the command line, and returns the exit code.
+ */
+namespace Commands
+{
+   /*!
+    * Records synthetic frames to SER files for a while, and reports the rate the disk kept up; run it against a tmpfs
+    * such as /dev/shm and against the capture disk to see which one limits a recording.  The time includes syncing the
+    * files written, and only those, so the rate is the disk's, not the page cache's.  The files are removed afterwards.
+    */
+   auto benchmarkSer(QCommandLineParser & parser, const QCoreApplication & application) -> int;
+
+   /*!
+    * Renders a synthetic star field, finds its stars a few times over, and reports how fast and how well they were
+    * measured.  The stars are Gaussians of known width & elongation on a flat background with Gaussian noise, and some
+    * are centred on the seams between tiles, where blobs have to be joined.  The field is the same on every run, so the
+    * figures can be compared between builds & machines.
+    */
+   auto benchmarkStars(QCommandLineParser & parser, const QCoreApplication & application) -> int;
+
+   /*!
+    * Builds a master from the frames named on the command line.
+    */
+   auto buildMaster(QCommandLineParser & parser, const QCoreApplication & application) -> int;
+
+   /*!
+    * Converts the spool files named on the command line to FITS files or SER videos.  The conversion runs at idle
+    * priority, so it can be left to run alongside a capture.
+    */
+   auto convertSpool(QCommandLineParser & parser, const QCoreApplication & application) -> int;
+}
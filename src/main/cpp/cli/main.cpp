@@ -0,0 +1,51 @@
+#include "Commands.hpp"
+#include <functional>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QMap>
+#include <QTextStream>
+
+#include "Config.h"
+
+int main(int argc, char * argv[])
+{
+   QCoreApplication application(argc, argv);
+   QCoreApplication::setOrganizationName("Silverfields Technologies Incorporated");
+   QCoreApplication::setOrganizationDomain("silverfieldstech.com");
+   QCoreApplication::setApplicationName("QHYAstroCLI");
+   QCoreApplication::setApplicationVersion(VERSION);
+
+   using Command = std::function<int(QCommandLineParser &, const QCoreApplication &)>;
+   const QMap<QString, Command> commands{ { QString("benchmark-ser"), Commands::benchmarkSer },
+                                          { QString("benchmark-stars"), Commands::benchmarkStars },
+                                          { QString("build-master"), Commands::buildMaster },
+                                          { QString("convert-spool"), Commands::convertSpool } };
+
+   // The command is found first; its own options are only known, and checked, once it is.
+   QCommandLineParser parser;
+   parser.setApplicationDescription(
+     QCoreApplication::translate("main", "Batch jobs & benchmarks for QHYAstroImager, without a window."));
+   parser.addHelpOption();
+   parser.addVersionOption();
+   parser.addPositionalArgument(
+     QString("command"), QStringList(commands.keys()).join(QString(", ")), QString("<command> [options]"));
+   parser.parse(QCoreApplication::arguments());
+   const auto arguments = parser.positionalArguments();
+   const auto command   = arguments.isEmpty() ? QString() : arguments.first();
+   if (!commands.contains(command)) {
+      if (parser.isSet(QString("version"))) {
+         parser.showVersion();
+      }
+      if (parser.isSet(QString("help"))) {
+         parser.showHelp(0);
+      }
+      if (!command.isEmpty()) {
+         QTextStream(stderr) << QCoreApplication::translate("main", "Unknown command %1.").arg(command) << "\n";
+      }
+      parser.showHelp(1);
+   }
+
+   parser.clearPositionalArguments();
+   parser.addPositionalArgument(command, QCoreApplication::translate("main", "The command."), command);
+   return commands.value(command)(parser, application);
+}
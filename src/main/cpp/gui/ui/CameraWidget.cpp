@@ -8,10 +8,20 @@
 #include "ui_CameraWidget.h"
 
 #include <QAction>
+#include <QActionGroup>
 #include <QDebug>
+#include <QFileDialog>
 #include <QMenu>
 
+#include "Calibrator.hpp"
 #include "CameraInfoDialog.hpp"
+#include "CameraPipeline.hpp"
+#include "FitsWriter.hpp"
+#include "FrameScorer.hpp"
+#include "ImageViewer.hpp"
+#include "MasterFrame.hpp"
+#include <array>
+#include <utility>
 
 CameraWidget::CameraWidget(QHYCamera * camera, QWidget * parent)
    : QWidget(parent)
@@ -19,6 +29,7 @@ CameraWidget::CameraWidget(QHYCamera * camera, QWidget * parent)
    , camera(camera)
    , cameraMenu(new QMenu())
 {
+   auto * pipeline = camera->pipeline();
    ui->setupUi(this);
    connect(ui->comboBoxReadMode, &QComboBox::currentTextChanged, camera, [=]() {
       camera->setReadAndTransferModes(this->ui->comboBoxReadMode->currentText());
@@ -28,6 +39,25 @@ CameraWidget::CameraWidget(QHYCamera * camera, QWidget * parent)
    connect(camera, &QHYCamera::connectedChanged, this, &CameraWidget::cameraConnectionStatusChanged);
    connect(camera, &QHYCamera::readModeChanged, this, &CameraWidget::readModeChanged);
    connect(camera, &QHYCamera::transferModeChanged, this, &CameraWidget::transferModeChanged);
+   connect(camera, &QHYCamera::frameReady, this, [=](const Frame & frame) {
+      const auto quality = frame.quality();
+      if (quality.isRejected()) {
+         emit newStatusMessage(
+           tr("Frame %1 was rejected for %2.").arg(frame.sequence()).arg(quality.describeReasons()));
+      }
+   });
+   connect(camera, &QHYCamera::frameReady, ui->imageViewer, [=](Frame frame) {
+      // While stacking, the stack is shown instead.
+      if (!pipeline->isLiveStacking()) {
+         this->ui->imageViewer->showFrame(std::move(frame));
+      }
+   });
+   connect(pipeline, &CameraPipeline::liveStackUpdated, ui->imageViewer, &ImageViewer::showFrame);
+   connect(pipeline, &CameraPipeline::starsDetected, ui->imageViewer, &ImageViewer::setStars);
+   connect(camera, &QHYCamera::streamingChanged, ui->imageViewer, [=](bool streaming) {
+      const auto showLiveFrames = streaming && !pipeline->isLiveStacking();
+      this->ui->imageViewer->setFrameRing(showLiveFrames ? camera->liveFrames() : nullptr);
+   });
 
    this->setContextMenuPolicy(Qt::CustomContextMenu);
    connect(this, &CameraWidget::customContextMenuRequested, this, &CameraWidget::showContextMenu);
@@ -35,10 +65,267 @@ CameraWidget::CameraWidget(QHYCamera * camera, QWidget * parent)
    connect(action, &QAction::triggered, this, &CameraWidget::showCameraInfoDialog);
    action->setStatusTip(tr("This cameras capabilities."));
    cameraMenu->addAction(action);
+
+   action = new QAction(tr("&Guide camera")); // NOLINT(cppcoreguidelines-owning-memory)
+   action->setCheckable(true);
+   connect(action, &QAction::toggled, this, &CameraWidget::guidingChanged);
+   action->setStatusTip(tr("Give this camera's downloads priority on the USB bus."));
+   cameraMenu->addAction(action);
+
+   action = new QAction(tr("Detect &stars")); // NOLINT(cppcoreguidelines-owning-memory)
+   action->setCheckable(true);
+   connect(action, &QAction::toggled, this, [=](bool detect) {
+      pipeline->setStarDetection(detect);
+      if (!detect) {
+         this->ui->imageViewer->setStars(StarField());
+      }
+   });
+   action->setStatusTip(tr("Find and measure the stars of each frame, for focusing."));
+   cameraMenu->addAction(action);
+
+   action = new QAction(tr("Live stac&k")); // NOLINT(cppcoreguidelines-owning-memory)
+   action->setCheckable(true);
+   connect(action, &QAction::toggled, this, [=](bool stack) {
+      pipeline->setLiveStacking(stack);
+      this->ui->imageViewer->setFrameRing(!stack && camera->isStreaming() ? camera->liveFrames() : nullptr);
+   });
+   action->setStatusTip(tr("Register and stack frames as they arrive, and show the stack."));
+   cameraMenu->addAction(action);
+
+   action = new QAction(tr("&Reset stack")); // NOLINT(cppcoreguidelines-owning-memory)
+   connect(action, &QAction::triggered, pipeline, &CameraPipeline::resetLiveStack);
+   action->setStatusTip(tr("Start the live stack again from the next frame."));
+   cameraMenu->addAction(action);
+
+   action = new QAction(tr("&Lucky imaging")); // NOLINT(cppcoreguidelines-owning-memory)
+   action->setCheckable(true);
+   connect(action, &QAction::toggled, this, [=](bool lucky) {
+      if (!lucky) {
+         pipeline->stopLuckyImaging();
+      } else if (!pipeline->isLuckyImaging()) {
+         pipeline->startLuckyImaging(LuckyImager::Options());
+         action->setChecked(camera->isStreaming());
+      }
+   });
+   // Stopping live view stops lucky imaging too.
+   connect(pipeline, &CameraPipeline::luckyImagingChanged, action, &QAction::setChecked);
+   action->setStatusTip(tr("Rank live view frames by sharpness, and keep only the best of them."));
+   cameraMenu->addAction(action);
+   connect(pipeline, &CameraPipeline::luckyFramesSelected, this, [=](const QVector<Frame> & frames, int scored) {
+      emit newStatusMessage(tr("Kept the %1 sharpest of %2 frames.").arg(frames.count()).arg(scored));
+   });
+
+   action = new QAction(tr("Rec&ord video")); // NOLINT(cppcoreguidelines-owning-memory)
+   action->setCheckable(true);
+   connect(action, &QAction::toggled, this, [=](bool record) {
+      if (!record) {
+         pipeline->stopRecording();
+         return;
+      }
+      if (pipeline->isRecording()) {
+         return;
+      }
+      const auto directory = QFileDialog::getExistingDirectory(this, tr("Record video to"));
+      if (directory.isEmpty() || !camera->isStreaming()) {
+         action->setChecked(false);
+         return;
+      }
+      pipeline->startRecording(directory);
+   });
+   // Stopping live view stops recording too.
+   connect(pipeline, &CameraPipeline::recordingChanged, action, &QAction::setChecked);
+   action->setStatusTip(tr("Record live view to SER files; only the frames kept, while lucky imaging."));
+   cameraMenu->addAction(action);
+   connect(pipeline, &CameraPipeline::recordingFileWritten, this, [=](const QString & path, int frames) {
+      emit newStatusMessage(tr("Recorded %1 frames to %2.").arg(frames).arg(path));
+   });
+   connect(pipeline, &CameraPipeline::recordingFailed, this, [=](const QString & reason) {
+      emit newStatusMessage(tr("Recording failed: %1").arg(reason));
+   });
+
+   action = new QAction(tr("S&pool live view")); // NOLINT(cppcoreguidelines-owning-memory)
+   action->setCheckable(true);
+   connect(action, &QAction::toggled, this, [=](bool spool) {
+      if (!spool) {
+         pipeline->stopSpooling();
+         return;
+      }
+      if (pipeline->isSpooling()) {
+         return;
+      }
+      const auto directory = QFileDialog::getExistingDirectory(this, tr("Spool live view to"));
+      if (directory.isEmpty() || !camera->isStreaming()) {
+         action->setChecked(false);
+         return;
+      }
+      pipeline->startSpooling(directory);
+   });
+   // Stopping live view stops spooling too.
+   connect(pipeline, &CameraPipeline::spoolingChanged, action, &QAction::setChecked);
+   action->setStatusTip(tr("Write every live view frame, raw, to disk at the highest rates; convert the spool later."));
+   cameraMenu->addAction(action);
+   connect(pipeline, &CameraPipeline::spoolFileWritten, this, [=](const QString & path, int frames) {
+      emit newStatusMessage(tr("Spooled %1 frames to %2.").arg(frames).arg(path));
+   });
+   connect(pipeline, &CameraPipeline::spoolingFailed, this, [=](const QString & reason) {
+      emit newStatusMessage(tr("Spooling failed: %1").arg(reason));
+   });
+   connect(
+     pipeline, &CameraPipeline::spoolingStatisticsChanged, this, [=](quint64 frames, quint64 missed, double rate) {
+        emit newStatusMessage(
+          tr("Spooled %1 frames at %2 MB/s; %3 missed.").arg(frames).arg(rate, 0, 'f', 1).arg(missed));
+     });
+
+   action = new QAction(tr("Reject poor &frames")); // NOLINT(cppcoreguidelines-owning-memory)
+   action->setCheckable(true);
+   connect(action, &QAction::toggled, this, [=](bool reject) {
+      camera->setFrameScorer(reject ? std::make_shared<FrameScorer>(FrameScorer::Thresholds()) : nullptr);
+   });
+   action->setStatusTip(tr("Score each exposure, and set aside those spoilt by clouds, wind or guiding."));
+   cameraMenu->addAction(action);
+
+   // Applies to the frames saved from when it is chosen.
+   auto * compressionMenu = new QMenu(tr("Co&mpress saved exposures"), cameraMenu); // NOLINT
+   auto * compressions    = new QActionGroup(compressionMenu); // NOLINT(cppcoreguidelines-owning-memory)
+   const std::array<std::pair<QString, FitsWriter::Compression>, 3> choices{
+     { { tr("&None"), FitsWriter::Uncompressed },
+       { tr("&Rice"), FitsWriter::Rice },
+       { tr("&HCompress"), FitsWriter::HCompress } }
+   };
+   for (const auto & [name, compression] : choices) {
+      action = compressions->addAction(name);
+      action->setCheckable(true);
+      action->setChecked(compression == FitsWriter::Uncompressed);
+      action->setData(compression);
+      compressionMenu->addAction(action);
+   }
+   connect(compressions, &QActionGroup::triggered, this, [=](QAction * chosen) {
+      if (fitsWriter != nullptr) {
+         fitsWriter->setCompression(static_cast<FitsWriter::Compression>(chosen->data().toInt()));
+      }
+   });
+   compressionMenu->menuAction()->setStatusTip(
+     FitsWriter::isReentrant()
+       ? tr("Trade CPU time for disk space and bandwidth; lossless either way.")
+       : tr("Trade CPU time for disk space and bandwidth; lossless either way.  This CFITSIO is not reentrant, so "
+            "exposures are compressed one at a time, on a single thread."));
+
+   action = new QAction(tr("Calibrate e&xposures")); // NOLINT(cppcoreguidelines-owning-memory)
+   action->setCheckable(true);
+   connect(action, &QAction::toggled, this, [=](bool calibrate) {
+      if (!calibrate) {
+         camera->setCalibrator(nullptr);
+         return;
+      }
+      const auto paths = QFileDialog::getOpenFileNames(this, tr("Calibrate with the masters"));
+      std::shared_ptr<const MasterFrame> bias;
+      std::shared_ptr<const MasterFrame> dark;
+      std::shared_ptr<const MasterFrame> flat;
+      for (const auto & path : paths) {
+         auto master = MasterFrame::open(path);
+         if (!master) {
+            emit newStatusMessage(tr("%1 is not a master.").arg(path));
+            continue;
+         }
+         switch (master->kind()) {
+         case MasterFrame::Bias:
+            bias = std::move(master);
+            break;
+         case MasterFrame::Dark:
+            dark = std::move(master);
+            break;
+         case MasterFrame::Flat:
+            flat = std::move(master);
+            break;
+         }
+      }
+      if (!bias && !dark && !flat) {
+         action->setChecked(false);
+         return;
+      }
+      // 16 bit, so the calibrated frames can be saved compressed like the raw ones.
+      camera->setCalibrator(std::make_shared<Calibrator>(bias, dark, flat, Calibrator::Scaled16));
+      emit newStatusMessage(tr("Calibrating exposures with %1 kernels; the calibrated frames are the ones saved.")
+                              .arg(Calibrator::kernelName(Calibrator::kernel())));
+   });
+   action->setStatusTip(tr("Subtract a master bias or dark, and divide by a master flat, as each exposure arrives."));
+   cameraMenu->addAction(action);
+
+   action = new QAction(tr("Sa&ve exposures")); // NOLINT(cppcoreguidelines-owning-memory)
+   action->setCheckable(true);
+   connect(action, &QAction::toggled, this, [=](bool save) {
+      if (fitsWriter) {
+         // What is queued is still written, on the writer's threads.  The writer finishes, and deletes itself, once
+         // the exposure thread lets go of it too, should an exposure be queuing to it right now.
+         camera->setFitsWriter(nullptr);
+         fitsWriter.reset();
+      }
+      if (!save) {
+         return;
+      }
+      const auto directory = QFileDialog::getExistingDirectory(this, tr("Save exposures to"));
+      if (directory.isEmpty()) {
+         action->setChecked(false);
+         return;
+      }
+      fitsWriter = FitsWriter::create(directory, camera->id(), FitsWriterQueueLength, FitsWriterThreads);
+      fitsWriter->setInstrument(FitsWriter::Instrument::describe(*camera));
+      fitsWriter->setCompression(static_cast<FitsWriter::Compression>(compressions->checkedAction()->data().toInt()));
+      if (fitsWriter->threadCount() < FitsWriterThreads) {
+         emit newStatusMessage(tr("CFITSIO is not reentrant, so exposures are saved, and compressed, serially."));
+      }
+      // The camera queues each exposure to the writer from the exposure thread, calibrated while calibrating; the
+      // writer never blocks it, and the pool buffers do not wait on the window's event loop.
+      camera->setFitsWriter(fitsWriter);
+      connect(camera, &QHYCamera::readModeChanged, fitsWriter.get(), [camera = camera, writer = fitsWriter.get()]() {
+         writer->setInstrument(FitsWriter::Instrument::describe(*camera));
+      });
+      connect(fitsWriter.get(), &FitsWriter::frameDropped, this, [=](quint64 sequence) {
+         emit newStatusMessage(tr("Frame %1 was not saved; the disk is not keeping up.").arg(sequence));
+      });
+      connect(fitsWriter.get(), &FitsWriter::writeFailed, this, [=](const QString & path, const QString & reason) {
+         emit newStatusMessage(tr("Saving %1 failed: %2").arg(path, reason));
+      });
+      connect(fitsWriter.get(),
+              &FitsWriter::statisticsChanged,
+              this,
+              [=, reported = quint64{ 0 }](const FitsWriter::Statistics & statistics) mutable {
+                 if (statistics.written != reported) {
+                    reported = statistics.written;
+                    emit newStatusMessage(tr("Saved %1 exposures, %2 times smaller, at %3 ms of CPU each.")
+                                            .arg(statistics.written)
+                                            .arg(statistics.compressionRatio, 0, 'f', 2)
+                                            .arg(statistics.cpuMilliseconds, 0, 'f', 1));
+                 }
+              });
+   });
+   action->setStatusTip(tr("Save each exposure as a FITS file, as it arrives."));
+   cameraMenu->addAction(action);
+   cameraMenu->addMenu(compressionMenu);
+
+   action = new QAction(tr("Survey &defects")); // NOLINT(cppcoreguidelines-owning-memory)
+   connect(action, &QAction::triggered, pipeline, &CameraPipeline::surveyDefects);
+   action->setStatusTip(tr("Find the hot and cold pixels from live view, and correct them from then on."));
+   cameraMenu->addAction(action);
+   connect(pipeline, &CameraPipeline::defectSurveyProgress, this, [=](int frames, int of) {
+      emit newStatusMessage(tr("Surveyed %1 of %2 frames for defects.").arg(frames).arg(of));
+   });
+   connect(camera, &QHYCamera::defectMapChanged, this, [=](int defects) {
+      if (defects > 0) {
+         emit newStatusMessage(tr("Correcting %1 defective pixels.").arg(defects));
+      }
+   });
+
+   action = new QAction(tr("Auto-&tune USB")); // NOLINT(cppcoreguidelines-owning-memory)
+   connect(action, &QAction::triggered, this, &CameraWidget::autoTuneRequested);
+   action->setStatusTip(tr("Find the fastest USB traffic and speed settings this camera runs cleanly at."));
+   cameraMenu->addAction(action);
 }
 
 CameraWidget::~CameraWidget()
 {
+   // The camera outlives its tab; it must not go on saving to a writer that was the tab's.
+   camera->setFitsWriter(nullptr);
    delete ui;
 }
 
@@ -8,9 +8,11 @@
 
 #include <QPoint>
 #include <QWidget>
+#include <memory>
 
 #include "QHYCamera.hpp"
 
+class FitsWriter;
 class QMenu;
 
 namespace Ui
@@ -30,6 +32,15 @@ public:
    ~CameraWidget() override;
 
 signals:
+   /*!
+    * Emitted when the user asks for the camera's USB settings to be tuned.
+    */
+   void autoTuneRequested() const;
+
+   /*!
+    * Emitted when the user marks the camera as a guide camera, or back as an imaging camera.
+    */
+   void guidingChanged(bool guiding) const;
    void newStatusMessage(QString message) const;
 
 private slots:
@@ -42,7 +53,8 @@ private slots:
    void transferModeSelected(QString modeName) const;
 
 private:
-   Ui::CameraWidget * ui;
-   QHYCamera *        camera;
-   QMenu *            cameraMenu;
+   Ui::CameraWidget *          ui;
+   QHYCamera *                 camera;
+   QMenu *                     cameraMenu;
+   std::shared_ptr<FitsWriter> fitsWriter; // while exposures are being saved; the camera holds it too
 };
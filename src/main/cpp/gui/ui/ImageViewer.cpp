@@ -0,0 +1,372 @@
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "ImageViewer.hpp"
+
+#include <cmath>
+#include <QGuiApplication>
+#include <QMouseEvent>
+#include <QPainter>
+#include <QPen>
+#include <QPaintEvent>
+#include <QScreen>
+#include <QWheelEvent>
+#include <utility>
+
+#include "Config.h"
+#include "FrameRing.hpp"
+#include "PreviewPyramid.hpp"
+
+/* ***************************************************************************************************************** */
+// MARK: - ctors & dtors
+/* ***************************************************************************************************************** */
+ImageViewer::ImageViewer(QWidget * parent)
+   : QWidget(parent)
+   , m_renderer(new PreviewRenderer())
+{
+   setAttribute(Qt::WA_OpaquePaintEvent);
+   const auto * screen      = QGuiApplication::primaryScreen();
+   const auto   refreshRate = screen != nullptr && screen->refreshRate() > 0 ? screen->refreshRate()
+                                                                            : ViewerDefaultRefreshRate;
+   m_displayTimer.setTimerType(Qt::PreciseTimer);
+   m_displayTimer.setInterval(qMax(1, qRound(MillisecondsPerSecond / refreshRate)));
+   connect(&m_displayTimer, &QTimer::timeout, this, &ImageViewer::refresh);
+   m_rateTimer.start();
+
+   m_renderer->moveToThread(&m_rendererThread);
+   m_rendererThread.setObjectName("Preview Renderer");
+   connect(&m_rendererThread, &QThread::finished, m_renderer, &QObject::deleteLater);
+   connect(m_renderer, &PreviewRenderer::rendered, this, &ImageViewer::showPreview);
+   m_rendererThread.start();
+}
+
+ImageViewer::~ImageViewer()
+{
+   m_rendererThread.quit();
+   m_rendererThread.wait();
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Public methods
+/* ***************************************************************************************************************** */
+auto ImageViewer::renderRate() const -> double
+{
+   return m_renderRate;
+}
+
+auto ImageViewer::skippedFrames() const -> quint64
+{
+   return m_skippedFrames + m_renderer->droppedFrames();
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Public slots
+/* ***************************************************************************************************************** */
+void ImageViewer::setFrameRing(std::shared_ptr<FrameRing> frameRing)
+{
+   m_frameRing    = std::move(frameRing);
+   m_lastSequence = 0;
+}
+
+void ImageViewer::showFrame(Frame frame)
+{
+   if (!m_pendingFrame.isNull()) {
+      m_skippedFrames++;
+   }
+   m_pendingFrame = std::move(frame);
+}
+
+void ImageViewer::setStars(StarField field)
+{
+   m_stars = std::move(field);
+   update();
+}
+
+void ImageViewer::zoomToFit()
+{
+   m_fit  = true;
+   m_zoom = fitZoom(frameSize());
+   clampOffset();
+   update();
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Protected methods
+/* ***************************************************************************************************************** */
+void ImageViewer::hideEvent(QHideEvent * event)
+{
+   m_displayTimer.stop();
+   QWidget::hideEvent(event);
+}
+
+void ImageViewer::mouseDoubleClickEvent(QMouseEvent * event)
+{
+   if (m_fit) {
+      setZoom(1.0, event->pos());
+   } else {
+      zoomToFit();
+   }
+}
+
+void ImageViewer::mouseMoveEvent(QMouseEvent * event)
+{
+   if ((event->buttons() & Qt::LeftButton) != 0) {
+      panBy(event->pos() - m_dragPosition);
+      m_dragPosition = event->pos();
+   }
+}
+
+void ImageViewer::mousePressEvent(QMouseEvent * event)
+{
+   m_dragPosition = event->pos();
+   QWidget::mousePressEvent(event);
+}
+
+void ImageViewer::paintEvent(QPaintEvent * event)
+{
+   QPainter painter(this);
+   painter.fillRect(event->rect(), palette().color(QPalette::Dark));
+   if (!m_preview.isNull()) {
+      // The tiles to hand are drawn, scaled if the zoom has since moved to another level; those missing are asked for,
+      // and drawn when they arrive.
+      const auto   level   = m_preview.level;
+      const auto   scale   = m_zoom * (1 << level); // screen pixels per level pixel
+      const auto   origin  = -m_offset * m_zoom;    // the screen position of the level's origin
+      const QRectF exposed((QRectF(event->rect()).topLeft() - origin) / m_zoom, QSizeF(event->rect().size()) / m_zoom);
+      const auto   tiles   = m_preview.tilesCovering(level, exposed);
+      auto         missing = level != PreviewPyramid::levelFor(m_zoom);
+
+      painter.setRenderHint(QPainter::SmoothPixmapTransform, scale < 1.0);
+      for (int row = tiles.top(); row <= tiles.bottom(); ++row) {
+         for (int column = tiles.left(); column <= tiles.right(); ++column) {
+            const auto tile = m_preview.tiles.constFind(Preview::tileKey(column, row));
+            if (tile == m_preview.tiles.constEnd()) {
+               missing = true;
+               continue;
+            }
+            const auto   area = m_preview.tileArea(level, column, row);
+            const QRectF target(origin + QPointF(area.topLeft()) * scale, QSizeF(area.size()) * scale);
+            painter.drawImage(target, *tile);
+         }
+      }
+      if (missing) {
+         requestTiles();
+      }
+   }
+
+   if (!m_preview.isNull() && !m_stars.isEmpty()) {
+      painter.setRenderHint(QPainter::Antialiasing);
+      painter.setPen(QPen(Qt::green, 1.0));
+      painter.setBrush(Qt::NoBrush);
+      const QRectF exposed(event->rect());
+      for (const auto & star : m_stars.stars) {
+         const QPointF centre((QPointF(star.x, star.y) + QPointF(0.5, 0.5) - m_offset) * m_zoom);
+         const auto    radius = qMax(ViewerStarMarkerRadius, 2.0 * star.hfr * m_zoom);
+         if (exposed.intersects(QRectF(centre - QPointF(radius, radius), QSizeF(2 * radius, 2 * radius)))) {
+            painter.drawEllipse(centre, radius, radius);
+         }
+      }
+   }
+
+   const auto overlay = overlayRect();
+   if (event->rect().intersects(overlay)) {
+      painter.fillRect(overlay, QColor(0, 0, 0, ViewerOverlayAlpha));
+      painter.setPen(Qt::white);
+      painter.drawText(overlay, Qt::AlignCenter, overlayText(m_renderRate));
+   }
+}
+
+void ImageViewer::resizeEvent(QResizeEvent * event)
+{
+   if (m_fit) {
+      m_zoom = fitZoom(frameSize());
+   }
+   clampOffset();
+   QWidget::resizeEvent(event);
+}
+
+void ImageViewer::showEvent(QShowEvent * event)
+{
+   m_displayTimer.start();
+   QWidget::showEvent(event);
+}
+
+void ImageViewer::wheelEvent(QWheelEvent * event)
+{
+   const auto steps = static_cast<double>(event->angleDelta().y()) / ViewerWheelStep;
+   if (event->angleDelta().y() != 0) {
+      setZoom(m_zoom * std::pow(ViewerZoomStep, steps), event->pos());
+   }
+   event->accept();
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Private slots
+/* ***************************************************************************************************************** */
+void ImageViewer::refresh()
+{
+   Frame next;
+   if (m_frameRing) {
+      auto lease = m_frameRing->latest();
+      if (lease.isValid() && lease.frame().sequence() != m_lastSequence) {
+         const auto sequence = lease.frame().sequence();
+         if (m_lastSequence != 0 && sequence > m_lastSequence + 1) {
+            m_skippedFrames += sequence - m_lastSequence - 1;
+         }
+         m_lastSequence = sequence;
+         // Holding the handle, rather than the lease, lets the camera move on to a fresh buffer.
+         next = lease.frame();
+      }
+   }
+   if (next.isNull() && !m_pendingFrame.isNull()) {
+      next = std::move(m_pendingFrame);
+      m_pendingFrame = Frame();
+   }
+   if (!next.isNull()) {
+      prepareFrame(std::move(next));
+   }
+
+   if (m_rateTimer.elapsed() >= LiveStatisticsInterval) {
+      m_renderRate         = m_framesThisInterval * MillisecondsPerSecond / static_cast<double>(m_rateTimer.restart());
+      m_framesThisInterval = 0;
+      update(overlayRect());
+   }
+}
+
+void ImageViewer::showPreview(Preview preview)
+{
+   if (preview.generation < m_preview.generation) {
+      return;
+   }
+   const auto newFrame     = preview.generation != m_preview.generation;
+   const auto previousSize = frameSize();
+   m_preview               = std::move(preview);
+   if (newFrame) {
+      if (m_fit) {
+         m_zoom = fitZoom(frameSize());
+      }
+      if (frameSize() != previousSize) {
+         clampOffset();
+      }
+      m_framesThisInterval++;
+   }
+   update();
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Private methods
+/* ***************************************************************************************************************** */
+void ImageViewer::clampOffset()
+{
+   if (m_preview.isNull()) {
+      return;
+   }
+   // Centre an axis the frame does not fill; otherwise keep the frame against the edges.
+   const auto frameSize = QSizeF(m_preview.pyramid->size());
+   const auto viewSize  = QSizeF(size()) / m_zoom;
+   auto       clamp     = [](double offset, double frameLength, double viewLength) {
+      if (frameLength <= viewLength) {
+         return (frameLength - viewLength) / 2.0;
+      }
+      return qBound(0.0, offset, frameLength - viewLength);
+   };
+   m_offset = QPointF(clamp(m_offset.x(), frameSize.width(), viewSize.width()),
+                      clamp(m_offset.y(), frameSize.height(), viewSize.height()));
+}
+
+auto ImageViewer::fitZoom(const QSize & shown) const -> double
+{
+   if (shown.isEmpty() || size().isEmpty()) {
+      return 1.0;
+   }
+   return qMin(static_cast<double>(width()) / shown.width(), static_cast<double>(height()) / shown.height());
+}
+
+auto ImageViewer::frameSize() const -> QSize
+{
+   return m_preview.isNull() ? QSize() : m_preview.pyramid->size();
+}
+
+auto ImageViewer::overlayRect() const -> QRect
+{
+   // Sized for a three digit rate, so the box does not twitch as the rate changes.
+   const auto text = fontMetrics().boundingRect(QRect(), Qt::AlignCenter, overlayText(999.9));
+   return QRect(QPoint(ViewerOverlayMargin, height() - text.height() - 3 * ViewerOverlayMargin),
+                text.size() + QSize(2 * ViewerOverlayMargin, 2 * ViewerOverlayMargin));
+}
+
+auto ImageViewer::overlayText(double renderRate) const -> QString
+{
+   auto text = tr("%1 fps, %2 skipped").arg(renderRate, 0, 'f', 1).arg(m_skippedFrames);
+   if (!m_stars.isEmpty()) {
+      text += QString("\n")
+              + tr("%n star(s), HFR %1, FWHM %2", nullptr, m_stars.stars.count())
+                  .arg(m_stars.hfr, 0, 'f', 2)
+                  .arg(m_stars.fwhm, 0, 'f', 2);
+   }
+   return text;
+}
+
+void ImageViewer::panBy(const QPoint & delta)
+{
+   if (m_preview.isNull()) {
+      return;
+   }
+   const auto previous = m_offset;
+   m_offset -= QPointF(delta) / m_zoom;
+   clampOffset();
+   const auto moved = (previous - m_offset) * m_zoom;
+   if (moved == QPointF(delta)) {
+      // Only the strip that comes on screen is painted, and the overlay where it was and where it was scrolled to.
+      scroll(delta.x(), delta.y());
+      update(overlayRect());
+      update(overlayRect().translated(delta));
+   } else {
+      update();
+   }
+}
+
+void ImageViewer::prepareFrame(Frame frame)
+{
+   // Until the preview arrives, the frame is assumed to be drawn as the last one was; a frame of another size is
+   // prepared whole, as it is fitted or clamped on arrival.
+   const auto nextSize = QSize(static_cast<int>(frame.width()), static_cast<int>(frame.height()));
+   const auto zoom     = m_fit ? fitZoom(nextSize) : m_zoom;
+   const auto area     = m_fit || nextSize != frameSize() ? QRectF(QPointF(0, 0), QSizeF(nextSize)) : visibleArea();
+   m_renderer->prepare(std::move(frame), PreviewPyramid::levelFor(zoom), area);
+}
+
+void ImageViewer::requestTiles()
+{
+   const auto level = PreviewPyramid::levelFor(m_zoom);
+   const auto area  = visibleArea();
+   if (m_preview.generation == m_requestedGeneration && level == m_requestedLevel && area == m_requestedArea) {
+      return;
+   }
+   m_requestedGeneration = m_preview.generation;
+   m_requestedLevel      = level;
+   m_requestedArea       = area;
+   m_renderer->renderTiles(m_preview.generation, level, area);
+}
+
+void ImageViewer::setZoom(double zoom, const QPointF & anchor)
+{
+   if (m_preview.isNull()) {
+      return;
+   }
+   // Keep the frame pixel under the anchor where it is.
+   const auto anchored = m_offset + anchor / m_zoom;
+   m_zoom              = qBound(qMin(fitZoom(frameSize()), 1.0), zoom, ViewerMaximumZoom);
+   m_fit               = false;
+   m_offset            = anchored - anchor / m_zoom;
+   clampOffset();
+   update();
+}
+
+auto ImageViewer::visibleArea() const -> QRectF
+{
+   return QRectF(m_offset, QSizeF(size()) / m_zoom);
+}
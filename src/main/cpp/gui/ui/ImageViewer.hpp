@@ -0,0 +1,121 @@
+#pragma once
+
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include <memory>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QTimer>
+#include <QWidget>
+
+#include "Frame.hpp"
+#include "PreviewRenderer.hpp"
+#include "StarDetector.hpp"
+
+class FrameRing;
+
+/*! \brief Shows the latest frame of a camera, stretched for display, with pan & zoom.
+ *
+ * Frames are taken at the display's refresh rate, never as they arrive; a frame replaced before the next refresh is
+ * skipped on purpose, and counted.  Each frame is handed to a PreviewRenderer, on a thread of its own, which builds its
+ * PreviewPyramid and stretch, and converts the tiles on screen at the level that matches the zoom; the GUI thread only
+ * draws the tiles it is handed.  Tiles are only converted when they come on screen, so panning converts only the strip
+ * that was exposed; until they arrive, the tiles of the level drawn before are scaled in their place.  An 8 bit
+ * monochrome frame at full resolution is drawn straight from the frame's memory.
+ *
+ * The render rate and the count of skipped frames are drawn in a corner, with the focus figures of the last stars
+ * found; the stars themselves are circled.
+ */
+class ImageViewer : public QWidget
+{
+   Q_OBJECT
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+   Q_DISABLE_COPY_MOVE(ImageViewer)
+#endif
+
+public:
+   explicit ImageViewer(QWidget * parent = nullptr);
+   ~ImageViewer() override;
+
+   /*!
+    * Frames shown per second, over the last second.
+    */
+   [[nodiscard]] auto renderRate() const -> double;
+
+   /*!
+    * The count of frames that were replaced before they could be shown.
+    */
+   [[nodiscard]] auto skippedFrames() const -> quint64;
+
+public slots:
+   /*!
+    * Shows the live frames of a ring, until it is replaced or cleared.
+    *
+    * @param frameRing the ring, or nullptr to stop following one.
+    */
+   void setFrameRing(std::shared_ptr<FrameRing> frameRing);
+
+   /*!
+    * Shows a frame at the next refresh, unless another arrives first.
+    */
+   void showFrame(Frame frame);
+
+   /*!
+    * Circles the stars found in a frame; an empty field clears them.
+    */
+   void setStars(StarField field);
+   void zoomToFit();
+
+protected:
+   void hideEvent(QHideEvent * event) override;
+   void mouseDoubleClickEvent(QMouseEvent * event) override;
+   void mouseMoveEvent(QMouseEvent * event) override;
+   void mousePressEvent(QMouseEvent * event) override;
+   void paintEvent(QPaintEvent * event) override;
+   void resizeEvent(QResizeEvent * event) override;
+   void showEvent(QShowEvent * event) override;
+   void wheelEvent(QWheelEvent * event) override;
+
+private slots:
+   void refresh();
+   void showPreview(Preview preview);
+
+private:
+   void                       clampOffset();
+   [[nodiscard]] auto         fitZoom(const QSize & shown) const -> double;
+   [[nodiscard]] auto         frameSize() const -> QSize;
+   [[nodiscard]] auto         overlayRect() const -> QRect;
+   [[nodiscard]] auto         overlayText(double renderRate) const -> QString;
+   void                       panBy(const QPoint & delta);
+   void                       prepareFrame(Frame frame);
+   void                       requestTiles();
+   void                       setZoom(double zoom, const QPointF & anchor);
+   [[nodiscard]] auto         visibleArea() const -> QRectF; // in frame pixels
+
+   QTimer                     m_displayTimer;
+   std::shared_ptr<FrameRing> m_frameRing;
+   Frame                      m_pendingFrame;
+   quint64                    m_lastSequence{ 0 };
+   quint64                    m_skippedFrames{ 0 };
+
+   QThread                    m_rendererThread;
+   PreviewRenderer *          m_renderer;
+   Preview                    m_preview; // the frame drawn
+   quint64                    m_requestedGeneration{ 0 };
+   int                        m_requestedLevel{ -1 };
+   QRectF                     m_requestedArea;
+
+   double                     m_zoom{ 1.0 }; // screen pixels per frame pixel
+   bool                       m_fit{ true };
+   QPointF                    m_offset; // the frame pixel at the top left of the widget
+   QPoint                     m_dragPosition;
+   StarField                  m_stars;
+
+   QElapsedTimer              m_rateTimer;
+   int                        m_framesThisInterval{ 0 };
+   double                     m_renderRate{ 0.0 };
+};
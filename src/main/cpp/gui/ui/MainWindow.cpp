@@ -9,6 +9,7 @@
 
 #include "About.hpp"
 #include "CameraWidget.hpp"
+#include "CaptureScheduler.hpp"
 #include "Config.h"
 #include "QHYCamera.hpp"
 #include "QHYCCD.hpp"
@@ -19,13 +20,34 @@ MainWindow::MainWindow(QWidget * parent)
    : QMainWindow(parent)
    , ui(new Ui::MainWindow)
    , qhyccd(new QHYCCD(this))
+   , scheduler(new CaptureScheduler(this))
 {
    ui->setupUi(this);
    readSettings();
    createMenus();
    ui->statusbar->showMessage(tr("No cameras found."));
 
-   connect(qhyccd, &QHYCCD::camerasChanged, this, &MainWindow::updateCameraList);
+   connect(qhyccd, &QHYCCD::cameraAdded, this, &MainWindow::addCameraTab);
+   connect(qhyccd, &QHYCCD::cameraRemoved, this, &MainWindow::removeCameraTab);
+   connect(qhyccd, &QHYCCD::camerasChanged, this, &MainWindow::updateCameraCount);
+   connect(scheduler, &CaptureScheduler::statisticsChanged, this, [this](QString id, TransferStatistics statistics) {
+      if (statistics.stalls > 0) {
+         ui->statusbar->showMessage(tr("%1 stalled %2 times at %3 MB/s; the USB bus may be saturated.")
+                                      .arg(id)
+                                      .arg(statistics.stalls)
+                                      .arg(statistics.throughput() / BytesPerMegabyte, 0, 'f', 1));
+      }
+   });
+   connect(scheduler, &CaptureScheduler::autoTuneProgress, this, [this](QString id, int done, int total) {
+      ui->statusbar->showMessage(tr("Tuning %1: measured %2 of %3 settings.").arg(id).arg(done).arg(total));
+   });
+   connect(scheduler, &CaptureScheduler::autoTuneFinished, this, [this](QString id, AutoTuner::Setting setting) {
+      ui->statusbar->showMessage(
+        tr("Tuned %1 to USB traffic %2 and speed %3.").arg(id).arg(setting.usbTraffic).arg(setting.speed));
+   });
+   connect(scheduler, &CaptureScheduler::autoTuneFailed, this, [this](QString, QString reason) {
+      ui->statusbar->showMessage(reason);
+   });
    if (!qhyccd->initialize()) {
       ui->statusbar->showMessage(tr("Initialization of the QHYCCD driver failed."));
    }
@@ -49,18 +71,6 @@ void MainWindow::closeEvent(QCloseEvent * event)
 /* ***************************************************************************************************************** */
 // MARK: - Private methods
 /* ***************************************************************************************************************** */
-auto MainWindow::cameraTabExists(const QString & cameraName) const -> bool
-{
-   bool found = false;
-   for (int tabIndex = 0; tabIndex < ui->tabWidget->count(); ++tabIndex) {
-      if (ui->tabWidget->tabText(tabIndex) == cameraName) {
-         found = true;
-         break;
-      }
-   }
-   return found;
-}
-
 void MainWindow::createMenus()
 {
    auto * menu   = menuBar()->addMenu(tr("&File"));
@@ -99,30 +109,42 @@ void MainWindow::displayStatusMessage(QString message) const
    ui->statusbar->showMessage(message);
 }
 
-void MainWindow::updateCameraList(const QStringList & cameraNames)
+void MainWindow::addCameraTab(const QString & cameraName)
 {
-   for (const auto & cameraName : cameraNames) {
-      if (!cameraTabExists(cameraName)) {
-         QHYCamera * camera = qhyccd->cameraNamed(cameraName);
-         if (camera != nullptr) {
-            auto * cameraTab = new CameraWidget(camera);
-            connect(cameraTab, &CameraWidget::newStatusMessage, this, &MainWindow::displayStatusMessage);
-            ui->tabWidget->addTab(cameraTab, cameraName);
-         } else {
-            qWarning() << tr("The camera named %1 could not be found.").arg(cameraName);
-            ui->statusbar->showMessage(tr("The camera named %1 could not be found.").arg(cameraName));
-         }
-      }
+   if (cameraTabs.contains(cameraName)) {
+      return;
    }
+   QHYCamera * camera = qhyccd->cameraNamed(cameraName);
+   if (camera != nullptr) {
+      auto * cameraTab = new CameraWidget(camera);
+      scheduler->addCamera(camera);
+      connect(cameraTab, &CameraWidget::guidingChanged, this, [this, cameraName](bool guiding) {
+         scheduler->setRole(cameraName, guiding ? CaptureScheduler::Guiding : CaptureScheduler::Imaging);
+      });
+      connect(cameraTab, &CameraWidget::autoTuneRequested, this, [this, cameraName]() {
+         scheduler->autoTune(cameraName);
+      });
+      connect(cameraTab, &CameraWidget::newStatusMessage, this, &MainWindow::displayStatusMessage);
+      ui->tabWidget->addTab(cameraTab, cameraName);
+      cameraTabs.insert(cameraName, cameraTab);
+   } else {
+      qWarning() << tr("The camera named %1 could not be found.").arg(cameraName);
+      ui->statusbar->showMessage(tr("The camera named %1 could not be found.").arg(cameraName));
+   }
+}
 
-   // Check for any camera that has been removed
-   for (int tabIndex = 0; tabIndex < ui->tabWidget->count(); ++tabIndex) {
-      if (!cameraNames.contains(ui->tabWidget->tabText(tabIndex))) {
-         auto * cameraWidget = ui->tabWidget->widget(tabIndex);
-         ui->tabWidget->removeTab(tabIndex);
-         delete cameraWidget;
-      }
+void MainWindow::removeCameraTab(const QString & cameraName)
+{
+   auto * cameraTab = cameraTabs.take(cameraName);
+   if (cameraTab != nullptr) {
+      ui->tabWidget->removeTab(ui->tabWidget->indexOf(cameraTab));
+      delete cameraTab;
    }
+   scheduler->removeCamera(cameraName);
+}
+
+void MainWindow::updateCameraCount(const QStringList & cameraNames) const
+{
    if (cameraNames.count() == 0) {
       ui->statusbar->showMessage(tr("No cameras found."));
    } else {
@@ -8,12 +8,14 @@
 
 #include <QAction>
 #include <QActionGroup>
+#include <QHash>
 #include <QJsonArray>
 #include <QList>
 #include <QMainWindow>
 #include <QMenu>
 #include <QStringList>
 
+class CaptureScheduler;
 class QHYCCD;
 class QHYCamera;
 class CameraWidget;
@@ -38,16 +40,19 @@ protected:
    void closeEvent(QCloseEvent * event) override;
 
 private slots:
+   void addCameraTab(const QString & cameraName);
    void displayAboutDialog() const;
    void displayStatusMessage(QString message) const;
-   void updateCameraList(const QStringList & cameraNames);
+   void removeCameraTab(const QString & cameraName);
+   void updateCameraCount(const QStringList & cameraNames) const;
 
 private:
-   [[nodiscard]] auto    cameraTabExists(const QString & cameraName) const -> bool;
-   void                  createMenus();
-   void                  readSettings();
-   void                  writeSettings();
-
-   Ui::MainWindow *      ui;
-   QHYCCD *              qhyccd;
+   void                           createMenus();
+   void                           readSettings();
+   void                           writeSettings();
+
+   Ui::MainWindow *               ui;
+   QHYCCD *                       qhyccd;
+   CaptureScheduler *             scheduler;
+   QHash<QString, CameraWidget *> cameraTabs;
 };
@@ -0,0 +1,295 @@
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "AutoTuner.hpp"
+
+#include "Config.h"
+#include "FrameRing.hpp"
+#include <algorithm>
+#include <cmath>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QSettings>
+#include <QSysInfo>
+
+/* ***************************************************************************************************************** */
+// MARK: - Measurement
+/* ***************************************************************************************************************** */
+auto AutoTuner::Measurement::isStable() const -> bool
+{
+   return frames > 0 && corruptFrames == 0 &&
+          static_cast<double>(droppedFrames) <= static_cast<double>(frames) * AutoTuneDropTolerance;
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - ctors & dtors
+/* ***************************************************************************************************************** */
+AutoTuner::AutoTuner(QHYCamera * camera, QObject * parent)
+   : QObject(parent)
+   , m_camera(camera)
+   , m_cancelRequested(false)
+{
+   qRegisterMetaType<AutoTuner::Measurement>();
+   qRegisterMetaType<AutoTuner::Setting>();
+}
+
+AutoTuner::~AutoTuner()
+{
+   cancel();
+   if (m_thread) {
+      m_thread->wait();
+   }
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Public methods
+/* ***************************************************************************************************************** */
+auto AutoTuner::isRunning() const -> bool
+{
+   return m_thread && m_thread->isRunning();
+}
+
+auto AutoTuner::storedSetting(const QString & cameraId, Setting * setting) -> bool
+{
+   QSettings settings;
+   settings.beginGroup(settingsKey(cameraId));
+   if (!settings.contains(AUTO_TUNE_USB_TRAFFIC)) {
+      return false;
+   }
+   setting->usbTraffic = settings.value(AUTO_TUNE_USB_TRAFFIC).toInt();
+   setting->speed      = settings.value(AUTO_TUNE_SPEED).toInt();
+   return true;
+}
+
+void AutoTuner::storeSetting(const QString & cameraId, const Setting & setting)
+{
+   QSettings settings;
+   settings.beginGroup(settingsKey(cameraId));
+   settings.setValue(AUTO_TUNE_USB_TRAFFIC, setting.usbTraffic);
+   settings.setValue(AUTO_TUNE_SPEED, setting.speed);
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Public slots
+/* ***************************************************************************************************************** */
+void AutoTuner::cancel()
+{
+   m_cancelRequested = true;
+}
+
+void AutoTuner::start()
+{
+   if (isRunning()) {
+      return;
+   }
+   m_cancelRequested = false;
+   m_thread.reset(QThread::create([this]() { run(); }));
+   m_thread->setObjectName(QString("Auto-tune %1").arg(m_camera->id()));
+   m_thread->start();
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Private methods
+/* ***************************************************************************************************************** */
+auto AutoTuner::best(const QVector<Measurement> & measurements, Measurement * chosen) -> bool
+{
+   // A setting that never streamed says nothing about the link; it must not win by having lost no frames.
+   QVector<Measurement> streamed;
+   std::copy_if(measurements.cbegin(), measurements.cend(), std::back_inserter(streamed), [](const Measurement & m) {
+      return m.frames > 0;
+   });
+   if (streamed.isEmpty()) {
+      return false;
+   }
+   QVector<Measurement> stable;
+   std::copy_if(streamed.cbegin(), streamed.cend(), std::back_inserter(stable), [](const Measurement & m) {
+      return m.isStable();
+   });
+   if (stable.isEmpty()) {
+      // Nothing ran clean; the least damaged setting, then the gentlest on the bus, is the safest bet.
+      auto leastDamaged = [](const Measurement & a, const Measurement & b) {
+         auto aLost = a.corruptFrames + a.droppedFrames;
+         auto bLost = b.corruptFrames + b.droppedFrames;
+         return aLost != bLost ? aLost < bLost : a.setting.usbTraffic > b.setting.usbTraffic;
+      };
+      *chosen = *std::min_element(streamed.cbegin(), streamed.cend(), leastDamaged);
+      return true;
+   }
+
+   auto fastest = *std::max_element(stable.cbegin(), stable.cend(), [](const Measurement & a, const Measurement & b) {
+      return a.framesPerSecond < b.framesPerSecond;
+   });
+   // Among settings nearly as fast, more USB traffic and a lower speed leave more headroom on a marginal link.
+   *chosen = fastest;
+   for (const auto & measurement : qAsConst(stable)) {
+      auto nearlyAsFast = measurement.framesPerSecond >= fastest.framesPerSecond * (1.0 - AutoTuneRateTolerance);
+      auto gentler      = measurement.setting.usbTraffic > chosen->setting.usbTraffic ||
+                     (measurement.setting.usbTraffic == chosen->setting.usbTraffic &&
+                      measurement.setting.speed < chosen->setting.speed);
+      if (nearlyAsFast && gentler) {
+         *chosen = measurement;
+      }
+   }
+   return true;
+}
+
+auto AutoTuner::isCorrupt(const Frame & frame) -> bool
+{
+   if (frame.width() == 0 || frame.height() == 0 || frame.length() > frame.capacity()) {
+      return true;
+   }
+   // A sensor always reads some bias, so a black last row means the transfer came up short.
+   const auto   rowLength = static_cast<qint64>(frame.width()) * qMax(frame.channels(), 1U) * frame.bytesPerSample();
+   const auto * lastRow   = frame.constData() + (frame.length() - rowLength);
+   return std::all_of(lastRow, lastRow + rowLength, [](quint8 byte) { return byte == 0; });
+}
+
+auto AutoTuner::measure(const Setting & setting) -> Measurement
+{
+   Measurement measurement;
+   measurement.setting = setting;
+   m_camera->setReadoutSpeed(setting.speed).waitForFinished();
+   m_camera->setUSBTraffic(setting.usbTraffic).waitForFinished();
+   m_camera->startLiveView();
+   auto frames = m_camera->liveFrames();
+   if (!waitForStreaming(true) || !frames) {
+      qWarning() << "Live view did not start on" << m_camera->id() << "for speed" << setting.speed << "and USB traffic"
+                 << setting.usbTraffic;
+      // It may yet start; the next setting must not find it running.
+      m_camera->stopLiveView();
+      if (!waitForStreaming(false)) {
+         qWarning() << "Live view did not stop on" << m_camera->id();
+      }
+      return measurement;
+   }
+
+   // Skip the frames from before the stream settled.
+   QThread::msleep(AutoTuneSettleTime);
+   quint64 lastSequence{ 0 };
+   {
+      auto latest = frames->latest();
+      if (latest.isValid()) {
+         lastSequence = latest.frame().sequence();
+      }
+   }
+   const auto    droppedAtStart   = m_camera->droppedLiveFrames();
+   const auto    publishedAtStart = frames->publishedFrames();
+   QElapsedTimer measureTimer;
+   measureTimer.start();
+   while (measureTimer.elapsed() < AutoTuneMeasureTime && !m_cancelRequested) {
+      auto lease = frames->next(lastSequence);
+      if (lease.isValid()) {
+         lastSequence = lease.frame().sequence();
+         if (isCorrupt(lease.frame())) {
+            measurement.corruptFrames++;
+         }
+      } else {
+         QThread::usleep(LiveFramePollInterval);
+      }
+   }
+   const auto elapsed          = static_cast<double>(measureTimer.elapsed()) / MillisecondsPerSecond;
+   measurement.frames          = frames->publishedFrames() - publishedAtStart;
+   measurement.droppedFrames   = m_camera->droppedLiveFrames() - droppedAtStart;
+   measurement.framesPerSecond = elapsed > 0.0 ? static_cast<double>(measurement.frames) / elapsed : 0.0;
+
+   m_camera->stopLiveView();
+   if (!waitForStreaming(false)) {
+      qWarning() << "Live view did not stop on" << m_camera->id();
+   }
+   qDebug() << "Auto-tune" << m_camera->id() << "speed" << setting.speed << "USB traffic" << setting.usbTraffic << ":"
+            << measurement.framesPerSecond << "fps," << measurement.droppedFrames << "dropped,"
+            << measurement.corruptFrames << "corrupt";
+   return measurement;
+}
+
+void AutoTuner::run()
+{
+   const auto cameraId = m_camera->id();
+   const auto readMode = m_camera->readMode();
+   if (!m_camera->isConnected() || readMode.isEmpty()) {
+      emit failed(tr("Camera %1 must be connected, with a read mode set, to be tuned.").arg(cameraId));
+      return;
+   }
+   const auto originalMode = m_camera->transferMode();
+   if (originalMode != QHYCamera::LiveView &&
+       !m_camera->setReadAndTransferModes(readMode, QHYCamera::LiveView).result()) {
+      emit failed(tr("Camera %1 could not be switched to live view.").arg(cameraId));
+      return;
+   }
+
+   const auto capabilities = m_camera->capabilities();
+   const auto speeds       = sweep(capabilities.supportsHighSpeed, capabilities.rangeSpeed, AutoTuneSpeedSteps);
+   const auto traffics = sweep(capabilities.supportsUSBTraffic, capabilities.rangeUSBTraffic, AutoTuneTrafficSteps);
+   QVector<Measurement> measurements;
+   if (capabilities.supportsHighSpeed || capabilities.supportsUSBTraffic) {
+      const auto total = speeds.count() * traffics.count();
+      for (auto speed : speeds) {
+         for (auto traffic : traffics) {
+            if (m_cancelRequested) {
+               break;
+            }
+            measurements.append(measure(Setting{ traffic, speed }));
+            emit measured(measurements.last(), measurements.count(), total);
+         }
+      }
+   }
+
+   Measurement chosen;
+   const auto  swept    = !measurements.isEmpty() && !m_cancelRequested;
+   const auto  complete = swept && best(measurements, &chosen);
+   if (complete) {
+      storeSetting(cameraId, chosen.setting);
+      m_camera->setReadoutSpeed(chosen.setting.speed).waitForFinished();
+      m_camera->setUSBTraffic(chosen.setting.usbTraffic).waitForFinished();
+   }
+   if (originalMode != QHYCamera::LiveView) {
+      m_camera->setReadAndTransferModes(readMode, originalMode).waitForFinished();
+   }
+
+   if (complete) {
+      emit finished(chosen.setting);
+   } else if (swept) {
+      emit failed(tr("Camera %1 streamed no frames at any setting; nothing was stored.").arg(cameraId));
+   } else if (m_cancelRequested) {
+      emit failed(tr("Tuning camera %1 was cancelled.").arg(cameraId));
+   } else {
+      emit failed(tr("Camera %1 has no USB traffic or speed setting to tune.").arg(cameraId));
+   }
+}
+
+auto AutoTuner::settingsKey(const QString & cameraId) -> QString
+{
+   return QString("%1/%2/%3").arg(AUTO_TUNE_GROUP, QSysInfo::machineHostName(), cameraId);
+}
+
+auto AutoTuner::sweep(bool supported, const QHYCamera::Range & range, int steps) -> QVector<int>
+{
+   if (!supported || steps < 2) {
+      return { -1 };
+   }
+   QVector<int> values;
+   for (int step = 0; step < steps; ++step) {
+      auto value = range.min + (range.max - range.min) * step / (steps - 1);
+      if (range.step > 0.0) {
+         value = range.min + std::round((value - range.min) / range.step) * range.step;
+      }
+      auto rounded = static_cast<int>(std::lround(value));
+      if (!values.contains(rounded)) {
+         values.append(rounded);
+      }
+   }
+   return values;
+}
+
+auto AutoTuner::waitForStreaming(bool streaming) const -> bool
+{
+   QElapsedTimer waitTimer;
+   waitTimer.start();
+   while (m_camera->isStreaming() != streaming && waitTimer.elapsed() < FiveSeconds) {
+      QThread::msleep(1);
+   }
+   return m_camera->isStreaming() == streaming;
+}
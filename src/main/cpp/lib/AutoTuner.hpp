@@ -0,0 +1,123 @@
+#pragma once
+
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "QHYCamera.hpp"
+#include <atomic>
+#include <memory>
+#include <QObject>
+#include <QString>
+#include <QThread>
+#include <QVector>
+
+/*! \brief Finds the fastest readout a camera can sustain on this host, by trying the settings in turn.
+ *
+ * The fastest USB traffic and speed settings that work depend on the host, the hub and the cable, so they are
+ * measured rather than guessed.  Each combination of CONTROL_SPEED and CONTROL_USBTRAFFIC is streamed in live view
+ * for AutoTuneMeasureTime, counting the frames that arrive, those that are dropped, and those that are corrupt, which
+ * is to say truncated with their last row black.  The best setting is the fastest with no corrupt frames and few
+ * dropped; among settings that are nearly as fast, the gentlest on the bus wins.  It is stored per camera and host,
+ * and picked up by CaptureScheduler.  A setting that streams no frames is never chosen, and if none streams, nothing
+ * is stored.
+ *
+ * The sweep runs on a thread of its own.  The camera must be connected, with a read mode set; it is switched to live
+ * view for the sweep, and back afterwards.  A sweep that fails or is cancelled leaves the camera on the last setting
+ * tried, for the owner to put back.
+ */
+class AutoTuner : public QObject
+{
+   Q_OBJECT
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+   Q_DISABLE_COPY_MOVE(AutoTuner)
+#endif
+
+public:
+   struct Setting
+   {
+      int usbTraffic{ -1 }; // -1 when the camera has no such control
+      int speed{ -1 };      // -1 when the camera has no such control
+   };
+
+   struct Measurement
+   {
+      Setting setting;
+      double  framesPerSecond{ 0.0 };
+      quint64 frames{ 0 };
+      quint64 droppedFrames{ 0 };
+      quint64 corruptFrames{ 0 };
+
+      /*!
+       * Flag to tell if the setting delivered every frame intact, give or take AutoTuneDropTolerance.
+       */
+      [[nodiscard]] auto isStable() const -> bool;
+   };
+
+   /*!
+    * Creates a tuner for a camera; nothing happens until start() is called.
+    *
+    * @param camera the camera to tune; it must outlive the tuner.
+    * @param parent the owner of the tuner.
+    */
+   explicit AutoTuner(QHYCamera * camera, QObject * parent = nullptr);
+
+   /*!
+    * Cancels the sweep, if one is running, and waits for it to stop.
+    */
+   ~AutoTuner() override;
+
+   [[nodiscard]] auto        isRunning() const -> bool;
+
+   /*!
+    * Fetches the setting stored for a camera on this host.
+    *
+    * @param cameraId the id of the camera.
+    * @param setting filled in if one is stored.
+    * @return True if a setting is stored.
+    */
+   static auto               storedSetting(const QString & cameraId, Setting * setting) -> bool;
+   static void               storeSetting(const QString & cameraId, const Setting & setting);
+
+public slots:
+   void cancel();
+   void start();
+
+signals:
+   void failed(QString reason);
+   void finished(AutoTuner::Setting best);
+
+   /*!
+    * Emitted after each setting has been measured.
+    *
+    * @param measurement what was measured.
+    * @param done the number of settings measured so far.
+    * @param total the number of settings in the sweep.
+    */
+   void measured(AutoTuner::Measurement measurement, int done, int total);
+
+private:
+   /*!
+    * Picks the setting to keep from a sweep.
+    *
+    * @param measurements the sweep.
+    * @param chosen filled in with the best measurement, if there is one.
+    * @return False if no setting streamed a single frame.
+    */
+   [[nodiscard]] static auto best(const QVector<Measurement> & measurements, Measurement * chosen) -> bool;
+   [[nodiscard]] static auto isCorrupt(const Frame & frame) -> bool;
+   [[nodiscard]] static auto settingsKey(const QString & cameraId) -> QString;
+   [[nodiscard]] static auto sweep(bool supported, const QHYCamera::Range & range, int steps) -> QVector<int>;
+   [[nodiscard]] auto        measure(const Setting & setting) -> Measurement;
+   void                      run();
+   [[nodiscard]] auto        waitForStreaming(bool streaming) const -> bool;
+
+   QHYCamera *               m_camera;
+   std::unique_ptr<QThread>  m_thread;
+   std::atomic_bool          m_cancelRequested;
+};
+
+Q_DECLARE_METATYPE(AutoTuner::Measurement)
+Q_DECLARE_METATYPE(AutoTuner::Setting)
@@ -0,0 +1,69 @@
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "BusArbiter.hpp"
+
+#include "Config.h"
+#include "TransferMeter.hpp"
+#include <QMutexLocker>
+#include <utility>
+
+/* ***************************************************************************************************************** */
+// MARK: - Transfer
+/* ***************************************************************************************************************** */
+BusArbiter::Transfer::Transfer(std::shared_ptr<BusArbiter> arbiter, Priority priority, TransferMeter * meter)
+   : m_arbiter(std::move(arbiter))
+   , m_meter(meter)
+   , m_waitSeconds(0.0)
+   , m_priority(priority)
+{
+   m_timer.start();
+   if (m_arbiter) {
+      m_arbiter->acquire(m_priority);
+      m_waitSeconds = static_cast<double>(m_timer.restart()) / MillisecondsPerSecond;
+   }
+}
+
+BusArbiter::Transfer::~Transfer()
+{
+   if (m_arbiter) {
+      m_arbiter->release(m_priority);
+   }
+}
+
+void BusArbiter::Transfer::complete(qint64 bytes)
+{
+   if (m_meter != nullptr) {
+      m_meter->record(bytes, m_waitSeconds, static_cast<double>(m_timer.nsecsElapsed()) / NanosecondsPerSecond);
+   }
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Private methods
+/* ***************************************************************************************************************** */
+void BusArbiter::acquire(Priority priority)
+{
+   QMutexLocker locker(&m_mutex);
+   if (priority == Latency) {
+      m_latencyTransfers++;
+   } else {
+      QElapsedTimer waitTimer;
+      waitTimer.start();
+      while (m_latencyTransfers > 0 && waitTimer.elapsed() < BusPriorityWaitLimit) {
+         m_latencyIdle.wait(&m_mutex, static_cast<unsigned long>(BusPriorityWaitLimit - waitTimer.elapsed()));
+      }
+   }
+}
+
+void BusArbiter::release(Priority priority)
+{
+   if (priority == Latency) {
+      QMutexLocker locker(&m_mutex);
+      if (--m_latencyTransfers == 0) {
+         m_latencyIdle.wakeAll();
+      }
+   }
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include <memory>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QWaitCondition>
+
+class TransferMeter;
+
+/*! \brief Orders the downloads of cameras that share a USB bus.
+ *
+ * A guide camera's frames are small, but every millisecond they wait on the bus is a millisecond of guiding lag.
+ * Downloads are either Latency or Bulk: a Latency download starts at once, while a Bulk download holds off while any
+ * Latency download is in flight.  A Bulk download never holds off for longer than BusPriorityWaitLimit, so a guide
+ * camera streaming flat out cannot starve an imaging camera.  Downloads already under way are never interrupted.
+ *
+ * All methods are safe to call from any thread.
+ */
+class BusArbiter
+{
+public:
+   enum Priority
+   {
+      Bulk,
+      Latency
+   };
+
+   /*! \brief One download, from asking for the bus until the frame is in memory.
+    *
+    * Create it immediately before the driver's download call and destroy it straight after.  A null arbiter or meter
+    * is allowed; the download is then not ordered, or not accounted for.
+    */
+   class Transfer
+   {
+   public:
+      Transfer(std::shared_ptr<BusArbiter> arbiter, Priority priority, TransferMeter * meter);
+      Transfer(const Transfer &) = delete;
+      Transfer(Transfer &&)      = delete;
+      ~Transfer();
+
+      auto                        operator=(const Transfer &) -> Transfer & = delete;
+      auto                        operator=(Transfer &&) -> Transfer & = delete;
+
+      /*!
+       * Marks the download as successful, so it is accounted for.
+       *
+       * @param bytes the size of the frame downloaded.
+       */
+      void                        complete(qint64 bytes);
+
+   private:
+      std::shared_ptr<BusArbiter> m_arbiter;
+      TransferMeter *             m_meter;
+      QElapsedTimer               m_timer;
+      double                      m_waitSeconds;
+      Priority                    m_priority;
+   };
+
+   BusArbiter() = default;
+   BusArbiter(const BusArbiter &) = delete;
+   BusArbiter(BusArbiter &&)      = delete;
+   ~BusArbiter()                  = default;
+
+   auto           operator=(const BusArbiter &) -> BusArbiter & = delete;
+   auto           operator=(BusArbiter &&) -> BusArbiter & = delete;
+
+private:
+   void           acquire(Priority priority);
+   void           release(Priority priority);
+
+   QMutex         m_mutex;
+   QWaitCondition m_latencyIdle;
+   int            m_latencyTransfers{ 0 };
+};
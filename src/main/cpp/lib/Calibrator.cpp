@@ -0,0 +1,367 @@
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "Calibrator.hpp"
+
+#include "Config.h"
+#include "FramePool.hpp"
+#include "ParallelRows.hpp"
+#include <cmath>
+#include <cstring>
+#include <QMutexLocker>
+#include <utility>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CALIBRATOR_X86 1
+#include <immintrin.h>
+#endif
+
+namespace
+{
+/*! \brief What one pass subtracts and divides by; a null master is skipped.
+ */
+struct Masters
+{
+   const float * offset{ nullptr }; // the dark, or the bias
+   const float * flat{ nullptr };
+   float         flatMean{ 1.0F };
+   float         scale{ 1.0F }; // applied to 16 bit output only
+};
+
+constexpr float Maximum16 = 65535.0F;
+
+/* ***************************************************************************************************************** */
+// MARK: - Scalar
+/* ***************************************************************************************************************** */
+// Every kernel does the same operations in the same order, so all give the same result, to the bit.
+inline void put(float value, const Masters & /*masters*/, float * calibrated)
+{
+   *calibrated = value;
+}
+
+inline void put(float value, const Masters & masters, quint16 * calibrated)
+{
+   const auto scaled = value * masters.scale + static_cast<float>(CalibrationPedestal);
+   *calibrated       = static_cast<quint16>(std::lrint(std::min(std::max(scaled, 0.0F), Maximum16)));
+}
+
+template <class In, class Out, bool Offset, bool Flat>
+void calibrateScalar(const In * raw, qint64 first, qint64 last, const Masters & masters, Out * calibrated)
+{
+   for (auto index = first; index < last; ++index) {
+      auto value = static_cast<float>(raw[index]);
+      if (Offset) {
+         value = value - masters.offset[index];
+      }
+      if (Flat) {
+         // A dead flat pixel, 0 or below, would make the sample infinite; it is left uncorrected instead.
+         const auto flat = masters.flat[index];
+         value           = value * (flat > 0.0F ? masters.flatMean / flat : 1.0F);
+      }
+      put(value, masters, calibrated + index);
+   }
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - SIMD
+/* ***************************************************************************************************************** */
+#ifdef CALIBRATOR_X86
+constexpr qint64 Lanes128 = 4; // 32 bit lanes
+constexpr qint64 Lanes256 = 8;
+
+__attribute__((target("sse4.1"), always_inline)) inline auto load128(const quint8 * raw) -> __m128
+{
+   qint32 packed{ 0 };
+   std::memcpy(&packed, raw, sizeof(packed));
+   return _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(packed)));
+}
+
+__attribute__((target("sse4.1"), always_inline)) inline auto load128(const quint16 * raw) -> __m128
+{
+   return _mm_cvtepi32_ps(_mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(raw)))); // NOLINT
+}
+
+__attribute__((target("sse4.1"), always_inline)) inline void store128(__m128 value, const Masters & /*masters*/,
+                                                                      float * calibrated)
+{
+   _mm_storeu_ps(calibrated, value);
+}
+
+__attribute__((target("sse4.1"), always_inline)) inline void store128(__m128 value, const Masters & masters,
+                                                                      quint16 * calibrated)
+{
+   const auto scaled  = _mm_add_ps(_mm_mul_ps(value, _mm_set1_ps(masters.scale)),
+                                   _mm_set1_ps(static_cast<float>(CalibrationPedestal)));
+   const auto clamped = _mm_min_ps(_mm_max_ps(scaled, _mm_setzero_ps()), _mm_set1_ps(Maximum16));
+   const auto words   = _mm_packus_epi32(_mm_cvtps_epi32(clamped), _mm_setzero_si128());
+   _mm_storel_epi64(reinterpret_cast<__m128i *>(calibrated), words); // NOLINT
+}
+
+template <class In, class Out, bool Offset, bool Flat>
+__attribute__((target("sse4.1"))) void calibrateSSE41(const In * raw, qint64 first, qint64 last,
+                                                      const Masters & masters, Out * calibrated)
+{
+   const auto flatMean = _mm_set1_ps(masters.flatMean);
+   const auto one      = _mm_set1_ps(1.0F);
+   auto       index    = first;
+   for (; index + Lanes128 <= last; index += Lanes128) {
+      auto value = load128(raw + index);
+      if (Offset) {
+         value = _mm_sub_ps(value, _mm_loadu_ps(masters.offset + index));
+      }
+      if (Flat) {
+         const auto flat = _mm_loadu_ps(masters.flat + index);
+         const auto live = _mm_cmpgt_ps(flat, _mm_setzero_ps());
+         value           = _mm_mul_ps(value, _mm_blendv_ps(one, _mm_div_ps(flatMean, flat), live));
+      }
+      store128(value, masters, calibrated + index);
+   }
+   calibrateScalar<In, Out, Offset, Flat>(raw, index, last, masters, calibrated);
+}
+
+__attribute__((target("avx2"), always_inline)) inline auto load256(const quint8 * raw) -> __m256
+{
+   return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(raw)))); // NOLINT
+}
+
+__attribute__((target("avx2"), always_inline)) inline auto load256(const quint16 * raw) -> __m256
+{
+   return _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(raw)))); // NOLINT
+}
+
+__attribute__((target("avx2"), always_inline)) inline void store256(__m256 value, const Masters & /*masters*/,
+                                                                    float * calibrated)
+{
+   _mm256_storeu_ps(calibrated, value);
+}
+
+__attribute__((target("avx2"), always_inline)) inline void store256(__m256 value, const Masters & masters,
+                                                                    quint16 * calibrated)
+{
+   const auto scaled  = _mm256_add_ps(_mm256_mul_ps(value, _mm256_set1_ps(masters.scale)),
+                                      _mm256_set1_ps(static_cast<float>(CalibrationPedestal)));
+   const auto clamped = _mm256_min_ps(_mm256_max_ps(scaled, _mm256_setzero_ps()), _mm256_set1_ps(Maximum16));
+   // The pack works within each 128 bit lane; gathering the low half of both lanes puts the 8 words in order.
+   const auto words   = _mm256_packus_epi32(_mm256_cvtps_epi32(clamped), _mm256_setzero_si256());
+   _mm_storeu_si128(reinterpret_cast<__m128i *>(calibrated),                          // NOLINT
+                    _mm256_castsi256_si128(_mm256_permute4x64_epi64(words, 0x08))); // lanes 0 & 2
+}
+
+template <class In, class Out, bool Offset, bool Flat>
+__attribute__((target("avx2"))) void calibrateAVX2(const In * raw, qint64 first, qint64 last, const Masters & masters,
+                                                   Out * calibrated)
+{
+   const auto flatMean = _mm256_set1_ps(masters.flatMean);
+   const auto one      = _mm256_set1_ps(1.0F);
+   auto       index    = first;
+   for (; index + Lanes256 <= last; index += Lanes256) {
+      auto value = load256(raw + index);
+      if (Offset) {
+         value = _mm256_sub_ps(value, _mm256_loadu_ps(masters.offset + index));
+      }
+      if (Flat) {
+         const auto flat = _mm256_loadu_ps(masters.flat + index);
+         const auto live = _mm256_cmp_ps(flat, _mm256_setzero_ps(), _CMP_GT_OQ);
+         value           = _mm256_mul_ps(value, _mm256_blendv_ps(one, _mm256_div_ps(flatMean, flat), live));
+      }
+      store256(value, masters, calibrated + index);
+   }
+   calibrateScalar<In, Out, Offset, Flat>(raw, index, last, masters, calibrated);
+}
+#endif
+
+template <class In, class Out>
+using CalibrateSpan = void (*)(const In *, qint64, qint64, const Masters &, Out *);
+
+template <class In, class Out, bool Offset, bool Flat>
+auto calibrateSpan() -> CalibrateSpan<In, Out>
+{
+   switch (Calibrator::kernel()) {
+#ifdef CALIBRATOR_X86
+   case Calibrator::AVX2:
+      return &calibrateAVX2<In, Out, Offset, Flat>;
+   case Calibrator::SSE41:
+      return &calibrateSSE41<In, Out, Offset, Flat>;
+#endif
+   default:
+      return &calibrateScalar<In, Out, Offset, Flat>;
+   }
+}
+
+template <class In, class Out>
+void calibrateSamples(const In * raw, qint64 count, const Masters & masters, Out * calibrated)
+{
+   CalibrateSpan<In, Out> span{ nullptr };
+   if (masters.offset != nullptr) {
+      span = masters.flat != nullptr ? calibrateSpan<In, Out, true, true>() : calibrateSpan<In, Out, true, false>();
+   } else {
+      span = masters.flat != nullptr ? calibrateSpan<In, Out, false, true>() : calibrateSpan<In, Out, false, false>();
+   }
+   // Memory bound; blocks of samples are spread so that every thread streams its own stretch of the frame.
+   const auto blocks = static_cast<int>((count + SampleBlockLength - 1) / SampleBlockLength);
+   parallelRows(
+     blocks,
+     [&](int firstBlock, int lastBlock) {
+        span(raw,
+             static_cast<qint64>(firstBlock) * SampleBlockLength,
+             qMin(count, static_cast<qint64>(lastBlock) * SampleBlockLength),
+             masters,
+             calibrated);
+     },
+     1);
+}
+
+auto makeMasters(const std::shared_ptr<const MasterFrame> & offset,
+                 const std::shared_ptr<const MasterFrame> & flat,
+                 float                                      scale) -> Masters
+{
+   Masters masters;
+   if (offset) {
+      masters.offset = offset->samples();
+   }
+   if (flat && flat->mean() > 0.0) {
+      masters.flat     = flat->samples();
+      masters.flatMean = static_cast<float>(flat->mean());
+   }
+   masters.scale = scale;
+   return masters;
+}
+
+auto detectKernel() -> Calibrator::Kernel
+{
+#ifdef CALIBRATOR_X86
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("avx2")) {
+      return Calibrator::AVX2;
+   }
+   if (__builtin_cpu_supports("sse4.1")) {
+      return Calibrator::SSE41;
+   }
+#endif
+   return Calibrator::Scalar;
+}
+} // namespace
+
+/* ***************************************************************************************************************** */
+// MARK: - ctors & dtors
+/* ***************************************************************************************************************** */
+Calibrator::Calibrator(std::shared_ptr<const MasterFrame> bias,
+                       std::shared_ptr<const MasterFrame> dark,
+                       std::shared_ptr<const MasterFrame> flat,
+                       Output                             output)
+   : m_bias(std::move(bias))
+   , m_dark(std::move(dark))
+   , m_flat(std::move(flat))
+   , m_output(output)
+{
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Public methods
+/* ***************************************************************************************************************** */
+void Calibrator::apply(const quint8 * raw, qint64 count, float * calibrated) const
+{
+   calibrateSamples(raw, count, makeMasters(m_dark ? m_dark : m_bias, m_flat, 1.0F), calibrated);
+}
+
+void Calibrator::apply(const quint8 * raw, qint64 count, quint16 * calibrated) const
+{
+   const auto scale = (1 << BitDepth8) + 1.0F; // 255 × 257 = 65535
+   calibrateSamples(raw, count, makeMasters(m_dark ? m_dark : m_bias, m_flat, scale), calibrated);
+}
+
+void Calibrator::apply(const quint16 * raw, qint64 count, float * calibrated) const
+{
+   calibrateSamples(raw, count, makeMasters(m_dark ? m_dark : m_bias, m_flat, 1.0F), calibrated);
+}
+
+void Calibrator::apply(const quint16 * raw, qint64 count, quint16 * calibrated) const
+{
+   calibrateSamples(raw, count, makeMasters(m_dark ? m_dark : m_bias, m_flat, 1.0F), calibrated);
+}
+
+auto Calibrator::calibrate(const Frame & light) -> Frame
+{
+   if (!isCompatible(light)) {
+      return Frame();
+   }
+   const auto count        = static_cast<qint64>(light.width()) * light.height() * qMax(light.channels(), 1U);
+   const auto bitsPerPixel = m_output == Float32 ? BitDepthFloat : BitDepth16;
+   const auto length       = count * (bitsPerPixel / BitDepth8);
+
+   Frame calibrated;
+   {
+      QMutexLocker locker(&m_poolMutex);
+      if (!m_framePool || m_framePool->bufferLength() < length) {
+         m_framePool = FramePool::create(length, CalibratedFrameBuffers);
+      }
+      calibrated = m_framePool->acquire();
+   }
+   if (calibrated.isNull()) {
+      return calibrated;
+   }
+
+   if (light.bytesPerSample() == 1) {
+      if (m_output == Float32) {
+         apply(light.constData(), count, reinterpret_cast<float *>(calibrated.data())); // NOLINT
+      } else {
+         apply(light.constData(), count, reinterpret_cast<quint16 *>(calibrated.data())); // NOLINT
+      }
+   } else {
+      const auto * raw = reinterpret_cast<const quint16 *>(light.constData()); // NOLINT
+      if (m_output == Float32) {
+         apply(raw, count, reinterpret_cast<float *>(calibrated.data())); // NOLINT
+      } else {
+         apply(raw, count, reinterpret_cast<quint16 *>(calibrated.data())); // NOLINT
+      }
+   }
+   calibrated.setGeometry(light.width(), light.height(), static_cast<quint32>(bitsPerPixel), light.channels());
+   calibrated.setBayerPattern(light.bayerPattern());
+   calibrated.setExposureDuration(light.exposureDuration());
+   calibrated.setSequence(light.sequence());
+   calibrated.setQuality(light.quality());
+   calibrated.setTimestamps(light.startTimestamp(), light.readoutTimestamp());
+   return calibrated;
+}
+
+auto Calibrator::isCompatible(const Frame & light) const -> bool
+{
+   if (light.isNull() || light.isFloat()) {
+      return false;
+   }
+   for (const auto & master : { m_bias, m_dark, m_flat }) {
+      if (master
+          && (master->width() != static_cast<int>(light.width()) || master->height() != static_cast<int>(light.height())
+              || master->channels() != static_cast<int>(qMax(light.channels(), 1U)))) {
+         return false;
+      }
+   }
+   return true;
+}
+
+auto Calibrator::kernel() -> Kernel
+{
+   static const Kernel detected = detectKernel();
+   return detected;
+}
+
+auto Calibrator::kernelName(Kernel kernel) -> QString
+{
+   switch (kernel) {
+   case AVX2:
+      return QString("AVX2");
+   case SSE41:
+      return QString("SSE4.1");
+   case Scalar:
+      break;
+   }
+   return QString("scalar");
+}
+
+auto Calibrator::output() const -> Output
+{
+   return m_output;
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "Frame.hpp"
+#include "MasterFrame.hpp"
+#include <memory>
+#include <QMutex>
+#include <QString>
+
+class FramePool;
+
+/*! \brief Calibrates light frames as they are captured: subtracts a master dark or bias, and divides by a flat.
+ *
+ * Each sample is read once and written once; the subtraction, the flat division and the conversion to the output all
+ * happen in one pass, with SSE4.1 and AVX2 kernels picked once for the CPU, and a scalar kernel that gives identical
+ * results.  The rows are split across the global thread pool.  The masters are memory mapped, never copied.
+ *
+ * The flat is normalized by its mean on the fly, so the calibrated frame keeps the level of the light frame.  A dark
+ * already holds the bias, so when both are given only the dark is subtracted.  Samples under a dead flat pixel, of 0 or
+ * below, are left as they are rather than divided by it.
+ *
+ * A calibrator does not change once made, so one may be shared by threads.
+ */
+class Calibrator
+{
+public:
+   enum Output
+   {
+      Float32, // in the units of the light frame
+      Scaled16 // 16 bit, with 8 bit frames scaled to 16, and CalibrationPedestal added
+   };
+
+   enum Kernel
+   {
+      Scalar,
+      SSE41,
+      AVX2
+   };
+
+   /*!
+    * Creates a calibrator.
+    *
+    * @param bias the master bias, or nullptr.
+    * @param dark the master dark, or nullptr.
+    * @param flat the master flat, or nullptr.
+    * @param output the kind of frame calibrate() makes.
+    */
+   Calibrator(std::shared_ptr<const MasterFrame> bias,
+              std::shared_ptr<const MasterFrame> dark,
+              std::shared_ptr<const MasterFrame> flat,
+              Output                             output);
+   Calibrator(const Calibrator &) = delete;
+   Calibrator(Calibrator &&)      = delete;
+   ~Calibrator()                  = default;
+
+   auto                      operator=(const Calibrator &) -> Calibrator & = delete;
+   auto                      operator=(Calibrator &&) -> Calibrator & = delete;
+
+   /*!
+    * Calibrates 8 bit samples; see the 16 bit overload.
+    */
+   void                      apply(const quint8 * raw, qint64 count, float * calibrated) const;
+   void                      apply(const quint8 * raw, qint64 count, quint16 * calibrated) const;
+
+   /*!
+    * Calibrates samples that line up with the masters' samples from the first on.
+    *
+    * @param raw the light samples.
+    * @param count the number of samples; no more than the masters have.
+    * @param calibrated where the output goes; it may be raw itself.
+    */
+   void                      apply(const quint16 * raw, qint64 count, float * calibrated) const;
+   void                      apply(const quint16 * raw, qint64 count, quint16 * calibrated) const;
+
+   /*!
+    * Calibrates a light frame into a frame of the calibrator's own.
+    *
+    * @return The calibrated frame, with the light frame's metadata but for its statistics, which no longer hold; null
+    * if the masters do not match the frame, or no buffer is free.
+    */
+   [[nodiscard]] auto        calibrate(const Frame & light) -> Frame;
+
+   /*!
+    * If the masters have the geometry of a frame.
+    */
+   [[nodiscard]] auto        isCompatible(const Frame & light) const -> bool;
+
+   /*!
+    * The kernel the calibration runs with on this CPU.
+    */
+   [[nodiscard]] static auto kernel() -> Kernel;
+   [[nodiscard]] static auto kernelName(Kernel kernel) -> QString;
+   [[nodiscard]] auto        output() const -> Output;
+
+private:
+   std::shared_ptr<const MasterFrame> m_bias;
+   std::shared_ptr<const MasterFrame> m_dark;
+   std::shared_ptr<const MasterFrame> m_flat;
+   Output                             m_output;
+
+   QMutex                             m_poolMutex;
+   std::shared_ptr<FramePool>         m_framePool; // sized for the last frame calibrated
+};
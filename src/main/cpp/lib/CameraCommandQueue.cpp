@@ -0,0 +1,36 @@
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "CameraCommandQueue.hpp"
+
+/* ***************************************************************************************************************** */
+// MARK: - ctors & dtors
+/* ***************************************************************************************************************** */
+CameraCommandQueue::CameraCommandQueue(const QString & name, QObject * parent)
+   : QObject(parent)
+   , m_context(new QObject())
+{
+   m_thread.setObjectName(name);
+   m_context->moveToThread(&m_thread);
+   QObject::connect(&m_thread, &QThread::finished, m_context, &QObject::deleteLater);
+   m_thread.start();
+}
+
+CameraCommandQueue::~CameraCommandQueue()
+{
+   // Queued behind every pending command, so those all run before the thread stops.
+   QMetaObject::invokeMethod(
+     m_context, [this]() { m_thread.quit(); }, Qt::QueuedConnection);
+   m_thread.wait();
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Public methods
+/* ***************************************************************************************************************** */
+auto CameraCommandQueue::isQueueThread() const -> bool
+{
+   return QThread::currentThread() == &m_thread;
+}
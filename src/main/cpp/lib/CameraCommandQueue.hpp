@@ -0,0 +1,87 @@
+#pragma once
+
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include <QFuture>
+#include <QFutureInterface>
+#include <QMetaObject>
+#include <QObject>
+#include <QThread>
+#include <type_traits>
+#include <utility>
+
+/*! \brief Runs a camera's driver commands, one at a time and in order, on a thread of its own.
+ *
+ * Opening a camera, switching its read mode and InitQHYCCD can each take seconds on a large sensor.  Queuing them here
+ * keeps them off the GUI thread, lets several cameras do the work at the same time, and guarantees that one camera
+ * never sees two of these calls at once.  Each command's result is delivered through a QFuture.
+ *
+ * The queue is drained before it is destroyed; commands already queued still run.
+ */
+class CameraCommandQueue : public QObject
+{
+   Q_OBJECT
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+   Q_DISABLE_COPY_MOVE(CameraCommandQueue)
+#endif
+
+public:
+   /*!
+    * Creates the queue, and starts its thread.
+    *
+    * @param name the name of the thread, for debuggers & profilers.
+    * @param parent the owner of the queue.
+    */
+   explicit CameraCommandQueue(const QString & name, QObject * parent = nullptr);
+   ~CameraCommandQueue() override;
+
+   /*!
+    * Queues a command.
+    *
+    * @param command a callable taking no arguments; it runs on the queue's thread.
+    * @return The future for the command's result; a QFuture<void> if the command returns nothing.
+    */
+   template<typename Command>
+   auto               enqueue(Command command) -> QFuture<std::invoke_result_t<Command>>;
+
+   /*!
+    * Flag to tell if the caller is running on the queue's thread, that is, inside a command.  The methods that call the
+    * driver assert it, so a call that bypasses the queue is caught in debug builds.
+    * @return If the current thread is the queue's.
+    */
+   [[nodiscard]] auto isQueueThread() const -> bool;
+
+private:
+   QThread   m_thread;
+   QObject * m_context; // lives on m_thread, so queued calls to it run there
+};
+
+/* ***************************************************************************************************************** */
+// MARK: - Template implementation
+/* ***************************************************************************************************************** */
+template<typename Command>
+auto CameraCommandQueue::enqueue(Command command) -> QFuture<std::invoke_result_t<Command>>
+{
+   using Result = std::invoke_result_t<Command>;
+
+   QFutureInterface<Result> promise;
+   promise.reportStarted();
+   auto future = promise.future();
+   QMetaObject::invokeMethod(
+     m_context,
+     [promise, command = std::move(command)]() mutable {
+        if constexpr (std::is_void_v<Result>) {
+           command();
+        } else {
+           auto result = command();
+           promise.reportResult(result);
+        }
+        promise.reportFinished();
+     },
+     Qt::QueuedConnection);
+   return future;
+}
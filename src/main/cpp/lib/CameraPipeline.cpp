@@ -0,0 +1,470 @@
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "CameraPipeline.hpp"
+
+#include "DefectSurvey.hpp"
+#include "FitsWriter.hpp"
+#include "FrameRing.hpp"
+#include "QHYCamera.hpp"
+#include "SerWriter.hpp"
+#include "SpoolWriter.hpp"
+
+/* ***************************************************************************************************************** */
+// MARK: - ctors & dtors
+/* ***************************************************************************************************************** */
+CameraPipeline::CameraPipeline(QHYCamera & camera)
+   : m_camera(camera)
+{
+   qRegisterMetaType<QVector<Frame>>();
+   qRegisterMetaType<SerWriter::Header>();
+   qRegisterMetaType<StarField>();
+
+   m_defectSurveyTimer.setInterval(DefectSurveyInterval);
+}
+
+CameraPipeline::~CameraPipeline()
+{
+   blockSignals(true);
+   m_defectSurveyTimer.stop();
+   // The lucky imaging, recording & spool loops hold their threads' event loops; they must end before the threads can
+   // quit.  The files being written are finished first.
+   stopLiveView();
+   if (m_masterBuilder != nullptr) {
+      m_masterBuilder->cancel();
+   }
+   // The timers that sample live view are their workers' children, and stop with their threads.
+   for (auto * thread : { m_starDetectorThread.get(),
+                          m_liveStackerThread.get(),
+                          m_luckyImagerThread.get(),
+                          m_serWriterThread.get(),
+                          m_spoolWriterThread.get(),
+                          m_defectSurveyThread.get(),
+                          m_masterBuilderThread.get() }) {
+      if (thread != nullptr) {
+         thread->quit();
+         thread->wait();
+      }
+   }
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Public methods
+/* ***************************************************************************************************************** */
+void CameraPipeline::buildMaster(const QStringList & inputs, const QString & output, MasterBuilder::Options options)
+{
+   auto * builder = masterBuilder();
+   QMetaObject::invokeMethod(
+     builder, [builder, inputs, output, options]() { builder->start(inputs, output, options); }, Qt::QueuedConnection);
+}
+
+auto CameraPipeline::isDetectingStars() const -> bool
+{
+   return m_detectStars;
+}
+
+auto CameraPipeline::isLiveStacking() const -> bool
+{
+   return m_liveStacking;
+}
+
+auto CameraPipeline::isLuckyImaging() const -> bool
+{
+   return m_luckyImager != nullptr && m_luckyImager->isRunning();
+}
+
+auto CameraPipeline::isRecording() const -> bool
+{
+   return m_serWriter != nullptr && m_serWriter->isRecording();
+}
+
+auto CameraPipeline::isSpooling() const -> bool
+{
+   return m_spoolWriter != nullptr && m_spoolWriter->isSpooling();
+}
+
+auto CameraPipeline::isSurveyingDefects() const -> bool
+{
+   return m_surveyingDefects;
+}
+
+void CameraPipeline::setLiveStackMethod(LiveStacker::Method method)
+{
+   m_liveStackMethod = method;
+   if (m_liveStacker != nullptr) {
+      m_liveStacker->setMethod(method);
+      resetLiveStack();
+   }
+}
+
+void CameraPipeline::setLiveStacking(bool enabled)
+{
+   if (!enabled && m_liveStacker == nullptr) {
+      return;
+   }
+   if (enabled && !m_liveStacking) {
+      liveStacker();
+      resetLiveStack();
+   }
+   m_liveStacking = enabled;
+   QMetaObject::invokeMethod(
+     m_liveStackTimer,
+     [timer = m_liveStackTimer, enabled]() {
+        if (enabled) {
+           timer->start();
+        } else {
+           timer->stop();
+        }
+     },
+     Qt::QueuedConnection);
+}
+
+void CameraPipeline::setStarDetection(bool enabled)
+{
+   if (!enabled && m_starDetector == nullptr) {
+      return;
+   }
+   starDetector();
+   m_detectStars = enabled;
+   // The timer samples live view on the star detection thread, so is started & stopped there.
+   QMetaObject::invokeMethod(
+     m_starDetectionTimer,
+     [timer = m_starDetectionTimer, enabled]() {
+        if (enabled) {
+           timer->start();
+        } else {
+           timer->stop();
+        }
+     },
+     Qt::QueuedConnection);
+}
+
+void CameraPipeline::stopLiveView()
+{
+   stopLuckyImaging();
+   stopRecording();
+   stopSpooling();
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Public slots
+/* ***************************************************************************************************************** */
+void CameraPipeline::resetLiveStack()
+{
+   if (m_liveStacker != nullptr) {
+      QMetaObject::invokeMethod(
+        m_liveStacker, [stacker = m_liveStacker]() { stacker->reset(); }, Qt::QueuedConnection);
+   }
+}
+
+void CameraPipeline::surveyDefects()
+{
+   auto * survey = defectSurvey();
+   // The survey must see the pixels as read, not as corrected.
+   m_camera.setDefectMap(nullptr);
+   QMetaObject::invokeMethod(
+     survey, [survey]() { survey->reset(); }, Qt::QueuedConnection);
+   m_surveyingDefects = true;
+   m_defectSurveyTimer.start();
+}
+
+void CameraPipeline::startLuckyImaging(LuckyImager::Options options)
+{
+   auto frames = m_camera.liveFrames();
+   if (!frames || !m_camera.isStreaming()) {
+      emit m_camera.liveViewFailed(tr("Camera %1 is not streaming.").arg(m_camera.id()));
+   } else if (!isLuckyImaging()) {
+      auto * imager = luckyImager();
+      QMetaObject::invokeMethod(
+        imager, [imager, frames, options]() { imager->run(frames, options); }, Qt::QueuedConnection);
+   }
+}
+
+void CameraPipeline::stopLuckyImaging()
+{
+   if (m_luckyImager != nullptr) {
+      m_luckyImager->stop();
+   }
+}
+
+void CameraPipeline::startRecording(const QString & directory)
+{
+   auto frames = m_camera.liveFrames();
+   if (!frames || !m_camera.isStreaming()) {
+      emit m_camera.liveViewFailed(tr("Camera %1 is not streaming.").arg(m_camera.id()));
+   } else if (!isRecording()) {
+      const auto lucky       = isLuckyImaging();
+      m_recordingLuckyFrames = lucky;
+      SerWriter::Header header;
+      header.instrument = m_camera.model();
+      auto * writer     = serWriter();
+      QMetaObject::invokeMethod(
+        writer,
+        [writer, frames, directory, prefix = m_camera.id(), header, lucky]() {
+           if (writer->open(directory, prefix, header) && !lucky) {
+              writer->record(frames);
+           }
+        },
+        Qt::QueuedConnection);
+   }
+}
+
+void CameraPipeline::stopRecording()
+{
+   if (m_serWriter == nullptr) {
+      return;
+   }
+   // Ends record() at once; the close waits its turn behind it, and behind any lucky frames already queued.
+   m_serWriter->stop();
+   QMetaObject::invokeMethod(
+     m_serWriter, [writer = m_serWriter]() { writer->close(); }, Qt::QueuedConnection);
+}
+
+void CameraPipeline::startSpooling(const QString & directory)
+{
+   auto frames = m_camera.liveFrames();
+   if (!frames || !m_camera.isStreaming()) {
+      emit m_camera.liveViewFailed(tr("Camera %1 is not streaming.").arg(m_camera.id()));
+   } else if (!isSpooling()) {
+      const auto instrument = FitsWriter::Instrument::describe(m_camera);
+      auto *     writer     = spoolWriter();
+      QMetaObject::invokeMethod(
+        writer,
+        [writer, frames, directory, prefix = m_camera.id(), instrument]() {
+           if (writer->open(directory, prefix, instrument)) {
+              writer->record(frames);
+           }
+        },
+        Qt::QueuedConnection);
+   }
+}
+
+void CameraPipeline::stopSpooling()
+{
+   if (m_spoolWriter == nullptr) {
+      return;
+   }
+   m_spoolWriter->stop();
+   QMetaObject::invokeMethod(
+     m_spoolWriter, [writer = m_spoolWriter]() { writer->close(); }, Qt::QueuedConnection);
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Private methods
+/* ***************************************************************************************************************** */
+auto CameraPipeline::defectSurvey() -> DefectSurvey *
+{
+   if (m_defectSurvey != nullptr) {
+      return m_defectSurvey;
+   }
+   auto * survey  = new DefectSurvey();
+   m_defectSurvey = survey;
+   QObject::connect(survey, &DefectSurvey::progress, this, &CameraPipeline::defectSurveyProgress);
+   // The survey's map is applied from the survey thread; the camera's workers pick it up atomically.
+   QObject::connect(
+     survey,
+     &DefectSurvey::surveyed,
+     this,
+     [this](const std::shared_ptr<const DefectMap> & defectMap) {
+        if (m_surveyingDefects.exchange(false)) {
+           QMetaObject::invokeMethod(
+             &m_defectSurveyTimer, [timer = &m_defectSurveyTimer]() { timer->stop(); }, Qt::QueuedConnection);
+           m_camera.setDefectMap(defectMap);
+        }
+     },
+     Qt::DirectConnection);
+   QObject::connect(&m_defectSurveyTimer, &QTimer::timeout, this, [this, survey]() {
+      auto frames = m_camera.liveFrames();
+      if (!frames || !m_camera.isStreaming()) {
+         return;
+      }
+      auto lease = frames->latest();
+      if (lease.isValid() && lease.frame().sequence() != m_defectSurveySequence) {
+         m_defectSurveySequence = lease.frame().sequence();
+         survey->offer(lease.frame());
+      }
+   });
+   m_defectSurveyThread = startThread(survey, QString("Defects"), QThread::LowPriority);
+   return survey;
+}
+
+auto CameraPipeline::liveStacker() -> LiveStacker *
+{
+   if (m_liveStacker != nullptr) {
+      return m_liveStacker;
+   }
+   // Stacking runs beside the next exposure; a frame that arrives while two are waiting is dropped.
+   auto * stacker = new LiveStacker();
+   m_liveStacker  = stacker;
+   stacker->setMethod(m_liveStackMethod);
+   QObject::connect(stacker, &LiveStacker::stackUpdated, this, [this](const Frame & stack, int frames, int skipped) {
+      if (m_liveStacking) {
+         emit liveStackUpdated(stack, frames, skipped);
+      }
+   });
+   // Frames are offered from the thread they arrive on, so none waits behind the GUI's events.
+   QObject::connect(
+     &m_camera,
+     &QHYCamera::frameReady,
+     stacker,
+     [this, stacker](const Frame & frame) {
+        if (m_liveStacking) {
+           stacker->offer(frame);
+        }
+     },
+     Qt::DirectConnection);
+   m_liveStackTimer = new QTimer(stacker); // NOLINT(cppcoreguidelines-owning-memory)
+   m_liveStackTimer->setInterval(LiveStackSampleInterval);
+   QObject::connect(m_liveStackTimer, &QTimer::timeout, stacker, [this, stacker]() {
+      auto frames = m_camera.liveFrames();
+      if (!frames || !m_camera.isStreaming()) {
+         return;
+      }
+      auto lease = frames->latest();
+      if (lease.isValid() && lease.frame().sequence() != m_liveStackSequence) {
+         m_liveStackSequence = lease.frame().sequence();
+         stacker->offer(lease.frame());
+      }
+   });
+   m_liveStackerThread = startThread(stacker, QString("Stacking"), QThread::LowPriority);
+   return stacker;
+}
+
+auto CameraPipeline::luckyImager() -> LuckyImager *
+{
+   if (m_luckyImager != nullptr) {
+      return m_luckyImager;
+   }
+   auto * imager = new LuckyImager();
+   m_luckyImager = imager;
+   QObject::connect(imager, &LuckyImager::framesSelected, this, &CameraPipeline::luckyFramesSelected);
+   QObject::connect(imager, &LuckyImager::runningChanged, this, &CameraPipeline::luckyImagingChanged);
+   QObject::connect(imager, &LuckyImager::statisticsChanged, this, &CameraPipeline::luckyImagingStatisticsChanged);
+   if (m_serWriter != nullptr) {
+      recordLuckyFrames();
+   }
+   // Every live view frame is scored; the imager must keep up with the stream, so it does not run at low priority.
+   m_luckyImagerThread = startThread(imager, QString("Lucky"), QThread::NormalPriority);
+   return imager;
+}
+
+auto CameraPipeline::masterBuilder() -> MasterBuilder *
+{
+   if (m_masterBuilder != nullptr) {
+      return m_masterBuilder;
+   }
+   auto * builder  = new MasterBuilder();
+   m_masterBuilder = builder;
+   QObject::connect(builder, &MasterBuilder::progress, this, &CameraPipeline::masterBuildProgress);
+   QObject::connect(builder, &MasterBuilder::finished, this, &CameraPipeline::masterBuilt);
+   m_masterBuilderThread = startThread(builder, QString("Masters"), QThread::LowPriority);
+   return builder;
+}
+
+void CameraPipeline::recordLuckyFrames()
+{
+   QObject::connect(m_luckyImager,
+                    &LuckyImager::framesSelected,
+                    m_serWriter,
+                    [this, writer = m_serWriter](const QVector<Frame> & frames) {
+                       if (m_recordingLuckyFrames) {
+                          writer->writeFrames(frames);
+                       }
+                    });
+}
+
+auto CameraPipeline::serWriter() -> SerWriter *
+{
+   if (m_serWriter != nullptr) {
+      return m_serWriter;
+   }
+   auto * writer = new SerWriter();
+   m_serWriter   = writer;
+   QObject::connect(writer, &SerWriter::fileWritten, this, &CameraPipeline::recordingFileWritten);
+   QObject::connect(writer, &SerWriter::recordingChanged, this, [this](bool recording) {
+      if (!recording) {
+         m_recordingLuckyFrames = false;
+      }
+      emit recordingChanged(recording);
+   });
+   QObject::connect(writer, &SerWriter::statisticsChanged, this, &CameraPipeline::recordingStatisticsChanged);
+   QObject::connect(writer, &SerWriter::writeFailed, this, &CameraPipeline::recordingFailed);
+   if (m_luckyImager != nullptr) {
+      recordLuckyFrames();
+   }
+   // Recording must keep up with the stream too; at hundreds of frames a second, it is the disk that cannot.
+   m_serWriterThread = startThread(writer, QString("Recording"), QThread::NormalPriority);
+   return writer;
+}
+
+auto CameraPipeline::spoolWriter() -> SpoolWriter *
+{
+   if (m_spoolWriter != nullptr) {
+      return m_spoolWriter;
+   }
+   auto * writer = new SpoolWriter();
+   m_spoolWriter = writer;
+   QObject::connect(writer, &SpoolWriter::fileWritten, this, &CameraPipeline::spoolFileWritten);
+   QObject::connect(writer, &SpoolWriter::spoolingChanged, this, &CameraPipeline::spoolingChanged);
+   QObject::connect(writer, &SpoolWriter::statisticsChanged, this, &CameraPipeline::spoolingStatisticsChanged);
+   QObject::connect(writer, &SpoolWriter::writeFailed, this, &CameraPipeline::spoolingFailed);
+   // The spool only queues writes, and keeps the queue full with little CPU; it runs alongside the stream.
+   m_spoolWriterThread = startThread(writer, QString("Spool"), QThread::HighPriority);
+   return writer;
+}
+
+auto CameraPipeline::starDetector() -> StarDetector *
+{
+   if (m_starDetector != nullptr) {
+      return m_starDetector;
+   }
+   // Analysis must never hold up a download, so frames that arrive while one is analyzed are passed over.
+   auto * detector = new StarDetector();
+   m_starDetector  = detector;
+   QObject::connect(detector, &StarDetector::starsDetected, this, [this](const StarField & field) {
+      if (m_detectStars) {
+         emit starsDetected(field);
+      }
+   });
+   // Frames are offered from the thread they arrive on, so none waits behind the GUI's events.
+   QObject::connect(
+     &m_camera,
+     &QHYCamera::frameReady,
+     detector,
+     [this, detector](const Frame & frame) {
+        if (m_detectStars) {
+           detector->offer(frame);
+        }
+     },
+     Qt::DirectConnection);
+   m_starDetectionTimer = new QTimer(detector); // NOLINT(cppcoreguidelines-owning-memory)
+   m_starDetectionTimer->setInterval(StarDetectionInterval);
+   QObject::connect(m_starDetectionTimer, &QTimer::timeout, detector, [this, detector]() {
+      auto frames = m_camera.liveFrames();
+      if (!frames || !m_camera.isStreaming()) {
+         return;
+      }
+      // The lease is let go at once; the copied handle alone keeps the pixels.
+      auto lease = frames->latest();
+      if (lease.isValid()) {
+         detector->offer(lease.frame());
+      }
+   });
+   m_starDetectorThread = startThread(detector, QString("Stars"), QThread::LowPriority);
+   return detector;
+}
+
+auto CameraPipeline::startThread(QObject * worker, const QString & name, QThread::Priority priority)
+  -> std::unique_ptr<QThread>
+{
+   auto thread = std::make_unique<QThread>();
+   thread->setObjectName(QString("%1 %2").arg(name, m_camera.id()));
+   // Moves the worker's children, such as its sampling timer, with it.
+   worker->moveToThread(thread.get());
+   QObject::connect(thread.get(), &QThread::finished, worker, &QObject::deleteLater);
+   thread->start(priority);
+   return thread;
+}
@@ -0,0 +1,213 @@
+#pragma once
+
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "Frame.hpp"
+#include "LiveStacker.hpp"
+#include "LuckyImager.hpp"
+#include "MasterBuilder.hpp"
+#include "StarDetector.hpp"
+#include <atomic>
+#include <memory>
+#include <QObject>
+#include <QStringList>
+#include <QThread>
+#include <QTimer>
+#include <QVector>
+
+class DefectSurvey;
+class QHYCamera;
+class SerWriter;
+class SpoolWriter;
+
+/*! \brief What a camera's frames may go on to, beyond the exposure and live view threads.
+ *
+ * Star detection, live stacking, lucky imaging, recording, spooling, defect surveys and master building each run on a
+ * thread of their own.  Neither the worker nor its thread exists until its feature is first used, so a camera that only
+ * exposes runs no threads for them; once made, they are kept until the camera goes.
+ *
+ * The pipeline belongs to its camera, and lives on the camera's thread; call it from there.  Its signals may be emitted
+ * from the workers' threads.
+ */
+class CameraPipeline : public QObject
+{
+   Q_OBJECT
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+   Q_DISABLE_COPY_MOVE(CameraPipeline)
+#endif
+
+public:
+   explicit CameraPipeline(QHYCamera & camera);
+   ~CameraPipeline() override;
+
+   /*!
+    * Queues combining frames, such as a dark sequence just taken, into a master on the master building thread;
+    * masterBuildProgress() and masterBuilt() report on it.  Builds run one at a time, in the order queued.
+    *
+    * @param inputs the FITS files.
+    * @param output where the master goes.
+    * @param options how to combine the frames.
+    */
+   void               buildMaster(const QStringList & inputs, const QString & output, MasterBuilder::Options options);
+   [[nodiscard]] auto isDetectingStars() const -> bool;
+   [[nodiscard]] auto isLiveStacking() const -> bool;
+   [[nodiscard]] auto isLuckyImaging() const -> bool;
+   [[nodiscard]] auto isRecording() const -> bool;
+   [[nodiscard]] auto isSpooling() const -> bool;
+   [[nodiscard]] auto isSurveyingDefects() const -> bool;
+
+   /*!
+    * Sets how the live stack combines frames, and starts a new stack.
+    */
+   void               setLiveStackMethod(LiveStacker::Method method);
+
+   /*!
+    * Turns live stacking on or off.  While on, every exposure, and a live view frame every LiveStackSampleInterval, is
+    * registered and stacked on the live stacking thread, and liveStackUpdated() is emitted with the stack.  Turning it
+    * on starts a new stack.
+    */
+   void               setLiveStacking(bool enabled);
+
+   /*!
+    * Turns star detection on or off.  While on, every exposure, and a live view frame every StarDetectionInterval, is
+    * analyzed on the star detection thread, and starsDetected() is emitted for each.  A frame that arrives while the
+    * previous one is still being analyzed is not analyzed.
+    */
+   void               setStarDetection(bool enabled);
+
+   /*!
+    * Stops what reads live view: lucky imaging, recording and spooling.
+    */
+   void               stopLiveView();
+
+public slots:
+   /*!
+    * Empties the live stack; the next frame stacked starts a new one.
+    */
+   void resetLiveStack();
+
+   /*!
+    * Starts finding the bad pixels from live view, a frame every DefectSurveyInterval; see DefectSurvey.  Correction
+    * stops while the survey runs, and the map it makes then replaces the camera's.  The camera must be streaming.
+    */
+   void surveyDefects();
+
+   /*!
+    * Starts ranking every live view frame by its sharpness, on the lucky imaging thread; the best of each window are
+    * emitted through luckyFramesSelected().  See LuckyImager.  The camera must be streaming.
+    */
+   void startLuckyImaging(LuckyImager::Options options);
+
+   /*!
+    * Stops lucky imaging; the best of the window in progress are emitted first.
+    */
+   void stopLuckyImaging();
+
+   /*!
+    * Starts recording live view to SER files, on the recording thread.  Every frame is recorded; or, while lucky
+    * imaging, only the frames it selects.  See SerWriter.  The camera must be streaming.
+    *
+    * @param directory where the files go.
+    */
+   void startRecording(const QString & directory);
+
+   /*!
+    * Stops recording, and finishes the file being written.
+    */
+   void stopRecording();
+
+   /*!
+    * Starts spooling every live view frame, raw, to disk, on the spool thread; SpoolConverter makes FITS or SER files
+    * of the spool afterwards.  See SpoolWriter.  The camera must be streaming.
+    *
+    * @param directory where the files go.
+    */
+   void startSpooling(const QString & directory);
+
+   /*!
+    * Stops spooling, once the queued writes are done.
+    */
+   void stopSpooling();
+
+signals:
+   void defectSurveyProgress(int frames, int of);
+
+   /*!
+    * Emitted with the rendered live stack, while live stacking is on; see LiveStacker::stackUpdated().
+    */
+   void liveStackUpdated(Frame stack, int frames, int skipped);
+
+   /*!
+    * Emitted with the sharpest live view frames of each window, while lucky imaging; see LuckyImager::framesSelected().
+    */
+   void luckyFramesSelected(QVector<Frame> frames, int scored);
+   void luckyImagingChanged(bool running);
+   void luckyImagingStatisticsChanged(quint64 scored, quint64 missed);
+   void masterBuildProgress(int rowsDone, int rows);
+   void masterBuilt(MasterBuilder::Report report);
+
+   /*!
+    * Emitted each time a SER file has been finished; see SerWriter.
+    */
+   void recordingFileWritten(QString path, int frames);
+   void recordingChanged(bool recording);
+   void recordingFailed(QString reason);
+   void recordingStatisticsChanged(quint64 frames, quint64 missed, double megabytesPerSecond);
+
+   /*!
+    * Emitted each time a spool file has been finished; see SpoolWriter.
+    */
+   void spoolFileWritten(QString path, int frames);
+   void spoolingChanged(bool spooling);
+   void spoolingFailed(QString reason);
+   void spoolingStatisticsChanged(quint64 frames, quint64 missed, double megabytesPerSecond);
+
+   /*!
+    * Emitted with the stars of an analyzed frame, while star detection is on.
+    */
+   void starsDetected(StarField field);
+
+private:
+   // Each makes its worker, and starts its thread, on first use.
+   auto                     defectSurvey() -> DefectSurvey *;
+   auto                     liveStacker() -> LiveStacker *;
+   auto                     luckyImager() -> LuckyImager *;
+   auto                     masterBuilder() -> MasterBuilder *;
+   auto                     serWriter() -> SerWriter *;
+   auto                     spoolWriter() -> SpoolWriter *;
+   auto                     starDetector() -> StarDetector *;
+
+   void                     recordLuckyFrames();
+   auto                     startThread(QObject * worker, const QString & name, QThread::Priority priority)
+     -> std::unique_ptr<QThread>;
+
+   QHYCamera &              m_camera;
+   DefectSurvey *           m_defectSurvey{ nullptr };
+   std::unique_ptr<QThread> m_defectSurveyThread;
+   QTimer                   m_defectSurveyTimer; // samples live view
+   quint64                  m_defectSurveySequence{ 0 }; // of the last live view frame offered
+   std::atomic_bool         m_surveyingDefects{ false };
+   LiveStacker *            m_liveStacker{ nullptr };
+   std::unique_ptr<QThread> m_liveStackerThread;
+   QTimer *                 m_liveStackTimer{ nullptr }; // samples live view; the stacker's child
+   LiveStacker::Method      m_liveStackMethod{ LiveStacker::KappaSigma }; // for the stacker, once made
+   quint64                  m_liveStackSequence{ 0 }; // of the last live view frame offered
+   std::atomic_bool         m_liveStacking{ false };
+   LuckyImager *            m_luckyImager{ nullptr };
+   std::unique_ptr<QThread> m_luckyImagerThread;
+   MasterBuilder *          m_masterBuilder{ nullptr };
+   std::unique_ptr<QThread> m_masterBuilderThread;
+   SerWriter *              m_serWriter{ nullptr };
+   std::unique_ptr<QThread> m_serWriterThread;
+   std::atomic_bool         m_recordingLuckyFrames{ false }; // rather than every frame
+   SpoolWriter *            m_spoolWriter{ nullptr };
+   std::unique_ptr<QThread> m_spoolWriterThread;
+   StarDetector *           m_starDetector{ nullptr };
+   std::unique_ptr<QThread> m_starDetectorThread;
+   QTimer *                 m_starDetectionTimer{ nullptr }; // samples live view; the detector's child
+   std::atomic_bool         m_detectStars{ false };
+};
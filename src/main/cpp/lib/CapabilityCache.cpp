@@ -0,0 +1,252 @@
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "CapabilityCache.hpp"
+
+#include "Config.h"
+#include <array>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QStringBuilder>
+#include <utility>
+
+namespace
+{
+using Capabilities = QHYCamera::Capabilities;
+
+const QLatin1String KeyCapabilities("capabilities");
+const QLatin1String KeyFirmwareVersion("firmwareVersion");
+const QLatin1String KeyFormat("format");
+const QLatin1String KeyFPGA1Version("fpga1Version");
+const QLatin1String KeyFPGA2Version("fpga2Version");
+const QLatin1String KeyId("id");
+const QLatin1String KeyReadModes("readModes");
+
+// A field added to Capabilities must be added to these tables too, and CapabilityCacheFormat raised.
+const std::array<std::pair<const char *, bool Capabilities::*>, 23> BooleanFields{ {
+  { "supports16Bit", &Capabilities::supports16Bit },
+  { "supportsBinning", &Capabilities::supportsBinning },
+  { "supportsChipChamberCyclePump", &Capabilities::supportsChipChamberCyclePump },
+  { "supportsChipTempSensor", &Capabilities::supportsChipTempSensor },
+  { "supportsColor", &Capabilities::supportsColor },
+  { "supportsCooler", &Capabilities::supportsCooler },
+  { "supportsFPNCalibration", &Capabilities::supportsFPNCalibration },
+  { "supportsFilterWheel", &Capabilities::supportsFilterWheel },
+  { "supportsFineTone", &Capabilities::supportsFineTone },
+  { "supportsGPS", &Capabilities::supportsGPS },
+  { "supportsGain", &Capabilities::supportsGain },
+  { "supportsHighSpeed", &Capabilities::supportsHighSpeed },
+  { "supportsHumidity", &Capabilities::supportsHumidity },
+  { "supportsMechanicalShutter", &Capabilities::supportsMechanicalShutter },
+  { "supportsOffset", &Capabilities::supportsOffset },
+  { "supportsPressure", &Capabilities::supportsPressure },
+  { "supportsShutterMotorHeating", &Capabilities::supportsShutterMotorHeating },
+  { "supportsSignalClamp", &Capabilities::supportsSignalClamp },
+  { "supportsTECOverProtection", &Capabilities::supportsTECOverProtection },
+  { "supportsTransferBit", &Capabilities::supportsTransferBit },
+  { "supportsTrigger", &Capabilities::supportsTrigger },
+  { "supportsUSBSpeedSetting", &Capabilities::supportsUSBSpeedSetting },
+  { "supportsUSBTraffic", &Capabilities::supportsUSBTraffic },
+} };
+
+const std::array<std::pair<const char *, double Capabilities::*>, 4> DoubleFields{ {
+  { "chipHeight", &Capabilities::chipHeight },
+  { "chipWidth", &Capabilities::chipWidth },
+  { "pixelHeight", &Capabilities::pixelHeight },
+  { "pixelWidth", &Capabilities::pixelWidth },
+} };
+
+const std::array<std::pair<const char *, int Capabilities::*>, 6> IntegerFields{ {
+  { "bayerMatrix", &Capabilities::bayerMatrix },
+  { "bitsPerPixel", &Capabilities::bitsPerPixel },
+  { "filterWheelCapacity", &Capabilities::filterWheelCapacity },
+  { "imageHeight", &Capabilities::imageHeight },
+  { "imageWidth", &Capabilities::imageWidth },
+  { "maxFrameLength", &Capabilities::maxFrameLength },
+} };
+
+const std::array<std::pair<const char *, QHYCamera::Range Capabilities::*>, 4> RangeFields{ {
+  { "rangeGain", &Capabilities::rangeGain },
+  { "rangeOffset", &Capabilities::rangeOffset },
+  { "rangeSpeed", &Capabilities::rangeSpeed },
+  { "rangeUSBTraffic", &Capabilities::rangeUSBTraffic },
+} };
+
+auto rangeToJson(const QHYCamera::Range & range) -> QJsonObject
+{
+   return QJsonObject{ { "min", range.min }, { "max", range.max }, { "step", range.step } };
+}
+
+auto rangeFromJson(const QJsonObject & json) -> QHYCamera::Range
+{
+   QHYCamera::Range range;
+   range.min  = json.value("min").toDouble();
+   range.max  = json.value("max").toDouble();
+   range.step = json.value("step").toDouble();
+   return range;
+}
+
+auto capabilitiesToJson(const Capabilities & capabilities) -> QJsonObject
+{
+   QJsonObject json;
+   for (const auto & [key, field] : BooleanFields) {
+      json.insert(key, capabilities.*field);
+   }
+   for (const auto & [key, field] : DoubleFields) {
+      json.insert(key, capabilities.*field);
+   }
+   for (const auto & [key, field] : IntegerFields) {
+      json.insert(key, capabilities.*field);
+   }
+   for (const auto & [key, field] : RangeFields) {
+      json.insert(key, rangeToJson(capabilities.*field));
+   }
+   const auto & binning = capabilities.binningInfo;
+   json.insert("binningInfo",
+               QJsonObject{ { "oneByOne", binning.oneByOne },
+                            { "twoByTwo", binning.twoByTwo },
+                            { "threeByThree", binning.threeByThree },
+                            { "fourByFour", binning.fourByFour },
+                            { "binXMaximum", binning.binXMaximum },
+                            { "binYMaximum", binning.binYMaximum } });
+   return json;
+}
+
+auto capabilitiesFromJson(const QJsonObject & json) -> Capabilities
+{
+   Capabilities capabilities{};
+   for (const auto & [key, field] : BooleanFields) {
+      capabilities.*field = json.value(key).toBool();
+   }
+   for (const auto & [key, field] : DoubleFields) {
+      capabilities.*field = json.value(key).toDouble();
+   }
+   for (const auto & [key, field] : IntegerFields) {
+      capabilities.*field = json.value(key).toInt();
+   }
+   for (const auto & [key, field] : RangeFields) {
+      capabilities.*field = rangeFromJson(json.value(key).toObject());
+   }
+   auto   binningJson   = json.value("binningInfo").toObject();
+   auto & binning       = capabilities.binningInfo;
+   binning.oneByOne     = binningJson.value("oneByOne").toBool();
+   binning.twoByTwo     = binningJson.value("twoByTwo").toBool();
+   binning.threeByThree = binningJson.value("threeByThree").toBool();
+   binning.fourByFour   = binningJson.value("fourByFour").toBool();
+   binning.binXMaximum  = binningJson.value("binXMaximum").toInt(1);
+   binning.binYMaximum  = binningJson.value("binYMaximum").toInt(1);
+   return capabilities;
+}
+} // namespace
+
+/* ***************************************************************************************************************** */
+// MARK: - ctors & dtors
+/* ***************************************************************************************************************** */
+CapabilityCache::CapabilityCache(QByteArray cameraId)
+   : m_cameraId(std::move(cameraId))
+{
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Public methods
+/* ***************************************************************************************************************** */
+auto CapabilityCache::load(const QString & firmwareVersion, const QString & fpga1Version, const QString & fpga2Version)
+  -> bool
+{
+   QJsonObject stored;
+   QFile       cacheFile(path());
+   if (cacheFile.open(QIODevice::ReadOnly)) {
+      stored = QJsonDocument::fromJson(cacheFile.readAll()).object();
+   }
+   auto matches = stored.value(KeyFormat).toInt() == CapabilityCacheFormat &&
+                  stored.value(KeyId).toString() == QLatin1String(m_cameraId) &&
+                  stored.value(KeyFirmwareVersion).toString() == firmwareVersion &&
+                  stored.value(KeyFPGA1Version).toString() == fpga1Version &&
+                  stored.value(KeyFPGA2Version).toString() == fpga2Version;
+   if (matches) {
+      m_entry = stored;
+   } else {
+      if (!stored.isEmpty()) {
+         qDebug() << "The cached capabilities of" << m_cameraId << "are for other firmware; probing again.";
+      }
+      m_entry = QJsonObject{ { KeyFormat, CapabilityCacheFormat },
+                             { KeyId, QLatin1String(m_cameraId) },
+                             { KeyFirmwareVersion, firmwareVersion },
+                             { KeyFPGA1Version, fpga1Version },
+                             { KeyFPGA2Version, fpga2Version } };
+   }
+   return matches;
+}
+
+auto CapabilityCache::capabilities(const QString & readMode, QHYCamera::Capabilities * capabilities) const -> bool
+{
+   auto readModeCapabilities = m_entry.value(KeyCapabilities).toObject().value(readMode);
+   if (!readModeCapabilities.isObject()) {
+      return false;
+   }
+   *capabilities = capabilitiesFromJson(readModeCapabilities.toObject());
+   return true;
+}
+
+auto CapabilityCache::readModes() const -> QMap<QString, quint32>
+{
+   QMap<QString, quint32> readModes;
+   auto                   readModesJson = m_entry.value(KeyReadModes).toObject();
+   for (auto readMode = readModesJson.constBegin(); readMode != readModesJson.constEnd(); ++readMode) {
+      readModes.insert(readMode.key(), static_cast<quint32>(readMode.value().toInt()));
+   }
+   return readModes;
+}
+
+auto CapabilityCache::path() const -> QString
+{
+   // Camera ids are the model and serial number, joined by a '-', so are safe as file names.
+   return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) % "/capabilities/" %
+          QLatin1String(m_cameraId) % ".json";
+}
+
+void CapabilityCache::setCapabilities(const QString & readMode, const QHYCamera::Capabilities & capabilities)
+{
+   auto allCapabilities = m_entry.value(KeyCapabilities).toObject();
+   allCapabilities.insert(readMode, capabilitiesToJson(capabilities));
+   m_entry.insert(KeyCapabilities, allCapabilities);
+   save();
+}
+
+void CapabilityCache::setReadModes(const QMap<QString, quint32> & readModes)
+{
+   QJsonObject readModesJson;
+   for (auto readMode = readModes.constBegin(); readMode != readModes.constEnd(); ++readMode) {
+      readModesJson.insert(readMode.key(), static_cast<qint64>(readMode.value()));
+   }
+   m_entry.insert(KeyReadModes, readModesJson);
+   save();
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Private methods
+/* ***************************************************************************************************************** */
+void CapabilityCache::save() const
+{
+   // A cache that cannot be written only costs the next session a probe.
+   auto cachePath = path();
+   if (!QDir().mkpath(QFileInfo(cachePath).absolutePath())) {
+      qWarning() << "Cannot create the capability cache directory for" << cachePath;
+      return;
+   }
+   QSaveFile cacheFile(cachePath);
+   if (cacheFile.open(QIODevice::WriteOnly)) {
+      cacheFile.write(QJsonDocument(m_entry).toJson());
+      if (!cacheFile.commit()) {
+         qWarning() << "Cannot write the capability cache" << cachePath;
+      }
+   }
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "QHYCamera.hpp"
+#include <QJsonObject>
+#include <QMap>
+#include <QString>
+
+/*! \brief What was learnt by probing one camera, kept on disk between sessions.
+ *
+ * Probing a camera's read modes and controls takes dozens of driver calls, yet the answers only change with the
+ * firmware.  The cache holds the read mode table, and the capabilities of each read mode once it has been used, in a
+ * JSON file per camera under the user's cache directory.  It is keyed by the camera id and the firmware & FPGA
+ * versions; when any of those differ, the old entry is dropped and the camera is probed again.
+ *
+ * Not thread safe; a camera only uses its cache from its command queue.
+ */
+class CapabilityCache
+{
+public:
+   /*!
+    * Creates the cache for one camera; nothing is read until load() is called.
+    *
+    * @param cameraId the id of the camera, as reported by the driver.
+    */
+   explicit CapabilityCache(QByteArray cameraId);
+
+   /*!
+    * Reads the camera's entry, if its versions match.
+    *
+    * @param firmwareVersion the camera's firmware version.
+    * @param fpga1Version the version of the camera's first FPGA.
+    * @param fpga2Version the version of the camera's second FPGA.
+    * @return True if the entry on disk is for these versions; otherwise the cache starts empty for them.
+    */
+   auto               load(const QString & firmwareVersion, const QString & fpga1Version, const QString & fpga2Version)
+     -> bool;
+
+   /*!
+    * Fetches the capabilities stored for a read mode.  The version strings are not part of the entry.
+    *
+    * @param readMode the name of the read mode.
+    * @param capabilities filled in if the read mode has an entry.
+    * @return True if the read mode has an entry.
+    */
+   auto               capabilities(const QString & readMode, QHYCamera::Capabilities * capabilities) const -> bool;
+
+   /*!
+    * The read mode table, name to index; empty if not cached.
+    */
+   [[nodiscard]] auto readModes() const -> QMap<QString, quint32>;
+
+   /*!
+    * The file the camera's entry is kept in.
+    */
+   [[nodiscard]] auto path() const -> QString;
+
+   void               setCapabilities(const QString & readMode, const QHYCamera::Capabilities & capabilities);
+   void               setReadModes(const QMap<QString, quint32> & readModes);
+
+private:
+   void               save() const;
+
+   QByteArray         m_cameraId;
+   QJsonObject        m_entry;
+};
@@ -0,0 +1,211 @@
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "CaptureScheduler.hpp"
+
+#include "Config.h"
+#include <cmath>
+#include <QDebug>
+
+/* ***************************************************************************************************************** */
+// MARK: - ctors & dtors
+/* ***************************************************************************************************************** */
+CaptureScheduler::CaptureScheduler(QObject * parent)
+   : QObject(parent)
+   , m_busArbiter(std::make_shared<BusArbiter>())
+   , m_busBandwidth(DefaultBusBandwidth)
+{
+   qRegisterMetaType<TransferStatistics>();
+   m_statisticsTimer.setInterval(static_cast<int>(LiveStatisticsInterval));
+   QObject::connect(&m_statisticsTimer, &QTimer::timeout, this, &CaptureScheduler::reportStatistics);
+}
+
+CaptureScheduler::~CaptureScheduler()
+{
+   // Deleted here, rather than as children, so none is left half destroyed while another still downloads.
+   for (const auto & scheduled : qAsConst(m_cameras)) {
+      delete scheduled.tuner;
+      delete scheduled.camera;
+   }
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Public methods
+/* ***************************************************************************************************************** */
+void CaptureScheduler::addCamera(QHYCamera * camera, Role role)
+{
+   if (camera == nullptr || m_cameras.contains(camera->id())) {
+      return;
+   }
+   camera->setParent(nullptr);
+   camera->setBusArbiter(m_busArbiter, role == Guiding ? BusArbiter::Latency : BusArbiter::Bulk);
+
+   ScheduledCamera scheduled;
+   scheduled.camera   = camera;
+   scheduled.role     = role;
+   scheduled.reported = camera->transferStatistics();
+   AutoTuner::storedSetting(camera->id(), &scheduled.tuned);
+   m_cameras.insert(camera->id(), scheduled);
+
+   // The USB traffic range is only known once the camera is initialized, which is signalled by transferModeChanged.
+   QObject::connect(camera, &QHYCamera::transferModeChanged, this, &CaptureScheduler::allocateBandwidth);
+   allocateBandwidth();
+   if (!m_statisticsTimer.isActive()) {
+      m_statisticsTimer.start();
+   }
+}
+
+void CaptureScheduler::autoTune(const QString & id)
+{
+   auto scheduled = m_cameras.find(id);
+   if (scheduled == m_cameras.end() || scheduled->tuner != nullptr) {
+      return;
+   }
+   auto * tuner     = new AutoTuner(scheduled->camera, this);
+   scheduled->tuner = tuner;
+   QObject::connect(tuner, &AutoTuner::measured, this, [this, id](AutoTuner::Measurement, int done, int total) {
+      emit autoTuneProgress(id, done, total);
+   });
+   QObject::connect(tuner, &AutoTuner::finished, this, [this, id](AutoTuner::Setting setting) {
+      auto tuned = m_cameras.find(id);
+      if (tuned != m_cameras.end()) {
+         tuned->tuned = setting;
+      }
+      finishAutoTune(id);
+      emit autoTuneFinished(id, setting);
+   });
+   QObject::connect(tuner, &AutoTuner::failed, this, [this, id](QString reason) {
+      finishAutoTune(id);
+      emit autoTuneFailed(id, reason);
+   });
+   tuner->start();
+}
+
+auto CaptureScheduler::busBandwidth() const -> double
+{
+   return m_busBandwidth;
+}
+
+auto CaptureScheduler::camera(const QString & id) const -> QHYCamera *
+{
+   return m_cameras.value(id).camera;
+}
+
+auto CaptureScheduler::cameras() const -> QList<QHYCamera *>
+{
+   QList<QHYCamera *> cameras;
+   for (const auto & scheduled : m_cameras) {
+      cameras.append(scheduled.camera);
+   }
+   return cameras;
+}
+
+void CaptureScheduler::removeCamera(const QString & id)
+{
+   auto scheduled = m_cameras.take(id);
+   if (scheduled.camera == nullptr) {
+      return;
+   }
+   QObject::disconnect(scheduled.camera, nullptr, this, nullptr);
+   delete scheduled.tuner;
+   delete scheduled.camera;
+   allocateBandwidth();
+   if (m_cameras.isEmpty()) {
+      m_statisticsTimer.stop();
+   }
+}
+
+auto CaptureScheduler::role(const QString & id) const -> Role
+{
+   return m_cameras.value(id).role;
+}
+
+void CaptureScheduler::setBusBandwidth(double share)
+{
+   m_busBandwidth = qBound(0.0, share, 1.0);
+   allocateBandwidth();
+}
+
+void CaptureScheduler::setRole(const QString & id, Role role)
+{
+   auto scheduled = m_cameras.find(id);
+   if (scheduled == m_cameras.end() || scheduled->role == role) {
+      return;
+   }
+   scheduled->role = role;
+   scheduled->camera->setBusArbiter(m_busArbiter, role == Guiding ? BusArbiter::Latency : BusArbiter::Bulk);
+   allocateBandwidth();
+}
+
+auto CaptureScheduler::statistics(const QString & id) const -> TransferStatistics
+{
+   return m_cameras.value(id).lastInterval;
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Private methods
+/* ***************************************************************************************************************** */
+void CaptureScheduler::allocateBandwidth()
+{
+   int guideCount{ 0 };
+   for (const auto & scheduled : qAsConst(m_cameras)) {
+      if (scheduled.role == Guiding) {
+         guideCount++;
+      }
+   }
+   const auto imagingCount = m_cameras.count() - guideCount;
+   const auto guideReserve = imagingCount > 0 ? qMin(GuideBandwidthShare * guideCount, MaximumGuideReserve) : 0.0;
+   const auto imagingShare = imagingCount > 0 ? (1.0 - guideReserve) / imagingCount : 0.0;
+
+   for (const auto & scheduled : qAsConst(m_cameras)) {
+      const auto capabilities = scheduled.camera->capabilities();
+      if (scheduled.tuner != nullptr) {
+         continue;
+      }
+      if (scheduled.tuned.speed >= 0) {
+         scheduled.camera->setReadoutSpeed(scheduled.tuned.speed);
+      }
+      if (!capabilities.supportsUSBTraffic) {
+         continue;
+      }
+      const auto share   = m_busBandwidth * (scheduled.role == Guiding ? 1.0 : imagingShare);
+      const auto traffic = qMax(usbTraffic(capabilities.rangeUSBTraffic, share), scheduled.tuned.usbTraffic);
+      qDebug() << "USB traffic for" << scheduled.camera->id() << "set to" << traffic << "for a share of" << share;
+      scheduled.camera->setUSBTraffic(traffic);
+   }
+}
+
+void CaptureScheduler::finishAutoTune(const QString & id)
+{
+   auto scheduled = m_cameras.find(id);
+   if (scheduled != m_cameras.end() && scheduled->tuner != nullptr) {
+      scheduled->tuner->deleteLater();
+      scheduled->tuner = nullptr;
+      allocateBandwidth();
+   }
+}
+
+void CaptureScheduler::reportStatistics()
+{
+   for (auto scheduled = m_cameras.begin(); scheduled != m_cameras.end(); ++scheduled) {
+      auto totals             = scheduled->camera->transferStatistics();
+      scheduled->lastInterval = totals - scheduled->reported;
+      scheduled->reported     = totals;
+      if (scheduled->lastInterval.frames > 0 || scheduled->lastInterval.stalls > 0) {
+         emit statisticsChanged(scheduled.key(), scheduled->lastInterval);
+      }
+   }
+}
+
+auto CaptureScheduler::usbTraffic(const QHYCamera::Range & range, double share) -> int
+{
+   // Higher USB traffic values insert more idle time between packets, so a full share is the range's minimum.
+   auto traffic = range.min + (1.0 - qBound(0.0, share, 1.0)) * (range.max - range.min);
+   if (range.step > 0.0) {
+      traffic = range.min + std::round((traffic - range.min) / range.step) * range.step;
+   }
+   return static_cast<int>(qBound(range.min, traffic, range.max));
+}
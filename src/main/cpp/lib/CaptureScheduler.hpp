@@ -0,0 +1,131 @@
+#pragma once
+
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "AutoTuner.hpp"
+#include "BusArbiter.hpp"
+#include "QHYCamera.hpp"
+#include "TransferMeter.hpp"
+#include <memory>
+#include <QList>
+#include <QMap>
+#include <QObject>
+#include <QString>
+#include <QTimer>
+
+/*! \brief Runs several cameras that share one host, such as an imaging camera and a guide camera.
+ *
+ * The scheduler owns the cameras given to it.  Each camera already captures on threads of its own; the scheduler
+ * coordinates them on the USB bus they share:
+ *
+ * - The bus bandwidth the cameras may use together is split between them with CONTROL_USBTRAFFIC, scaled to each
+ *   camera's Capabilities::rangeUSBTraffic.  Guide cameras run at the full budget, as their frames are small and
+ *   their latency matters; GuideBandwidthShare of the budget is held back from the imaging cameras for each of them.
+ *   The imaging cameras split the rest evenly.
+ * - Guide camera downloads are ordered ahead of imaging downloads; see BusArbiter.
+ * - The throughput and stalls of each camera are reported every LiveStatisticsInterval, so a saturated bus shows up.
+ *
+ * The split is worked out again whenever a camera is added, removed, changes role, or is re-initialized.  A camera
+ * that has been auto-tuned on this host never runs faster than its tuned USB traffic, and keeps its tuned speed.
+ */
+class CaptureScheduler : public QObject
+{
+   Q_OBJECT
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+   Q_DISABLE_COPY_MOVE(CaptureScheduler)
+#endif
+   Q_PROPERTY(double busBandwidth READ busBandwidth WRITE setBusBandwidth)
+
+public:
+   enum Role
+   {
+      Imaging = 0x00,
+      Guiding = 0x01
+   };
+   Q_ENUM(Role)
+
+   explicit CaptureScheduler(QObject * parent = nullptr);
+   ~CaptureScheduler() override;
+
+   /*!
+    * Hands a camera to the scheduler, which takes ownership of it.
+    *
+    * @param camera the camera; it need not be connected yet.
+    * @param role what the camera is used for.
+    */
+   void               addCamera(QHYCamera * camera, Role role = Imaging);
+
+   /*!
+    * Sweeps a camera's USB traffic and speed settings to find the fastest it sustains; see AutoTuner.  The camera is
+    * left out of the bandwidth split until the sweep is done.
+    *
+    * @param id the id of the camera.
+    */
+   void               autoTune(const QString & id);
+
+   /*!
+    * The share of the USB bus the cameras may use together, from 0 to 1.
+    */
+   [[nodiscard]] auto busBandwidth() const -> double;
+
+   /*!
+    * Looks up a camera by id.
+    *
+    * @param id the id of the camera.
+    * @return The camera, or nullptr if the scheduler does not have it.
+    */
+   [[nodiscard]] auto camera(const QString & id) const -> QHYCamera *;
+   [[nodiscard]] auto cameras() const -> QList<QHYCamera *>;
+
+   /*!
+    * Takes a camera away from the scheduler, and deletes it; which closes it.
+    *
+    * @param id the id of the camera.
+    */
+   void               removeCamera(const QString & id);
+   [[nodiscard]] auto role(const QString & id) const -> Role;
+   void               setBusBandwidth(double share);
+   void               setRole(const QString & id, Role role);
+
+   /*!
+    * The figures for a camera over the last statistics interval.
+    *
+    * @param id the id of the camera.
+    */
+   [[nodiscard]] auto statistics(const QString & id) const -> TransferStatistics;
+
+signals:
+   void autoTuneFailed(QString id, QString reason);
+   void autoTuneFinished(QString id, AutoTuner::Setting setting);
+   void autoTuneProgress(QString id, int done, int total);
+
+   /*!
+    * Emitted every LiveStatisticsInterval for each camera that downloaded anything, with the figures for the interval.
+    */
+   void statisticsChanged(QString id, TransferStatistics statistics);
+
+private:
+   struct ScheduledCamera
+   {
+      QHYCamera *        camera{ nullptr };
+      AutoTuner *        tuner{ nullptr }; // while a sweep runs
+      AutoTuner::Setting tuned;
+      Role               role{ Imaging };
+      TransferStatistics reported;     // the camera's totals when last reported
+      TransferStatistics lastInterval; // what was reported
+   };
+
+   void                           allocateBandwidth();
+   void                           finishAutoTune(const QString & id);
+   void                           reportStatistics();
+   [[nodiscard]] static auto      usbTraffic(const QHYCamera::Range & range, double share) -> int;
+
+   std::shared_ptr<BusArbiter>    m_busArbiter;
+   QMap<QString, ScheduledCamera> m_cameras;
+   QTimer                         m_statisticsTimer;
+   double                         m_busBandwidth;
+};
@@ -0,0 +1,405 @@
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "Debayer.hpp"
+
+#include "ParallelRows.hpp"
+#include <array>
+#include <cstddef>
+#include <limits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define DEBAYER_X86 1
+#include <immintrin.h>
+#endif
+
+namespace
+{
+/*!
+ * Where the colour sites of one row are; the rest of the row is green.
+ */
+struct RowLayout
+{
+   bool colourOnEvenColumns;
+   bool redRow; // otherwise the colour sites are blue
+};
+
+auto rowLayout(Frame::BayerPattern pattern, int row) -> RowLayout
+{
+   const bool oddRow              = (row & 1) != 0;
+   const bool colourOddInEvenRows = pattern == Frame::GRBG || pattern == Frame::GBRG;
+   const bool redOnEvenRows       = pattern == Frame::RGGB || pattern == Frame::GRBG;
+   return RowLayout{ colourOddInEvenRows == oddRow, redOnEvenRows != oddRow };
+}
+
+/*!
+ * Reflects an index that has run off either end, which keeps the colour filter phase.
+ */
+auto mirror(int index, int count) -> int
+{
+   if (index < 0) {
+      return -index;
+   }
+   return index < count ? index : 2 * (count - 1) - index;
+}
+
+template <class T>
+auto rowAt(const T * raw, int width, int height, int row) -> const T *
+{
+   return raw + static_cast<std::ptrdiff_t>(mirror(row, height)) * width;
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Bilinear, scalar
+/* ***************************************************************************************************************** */
+// Every average rounds half up, like the SIMD average instructions, so all kernels give the same result.
+template <class T>
+inline auto average(T a, T b) -> T
+{
+   return static_cast<T>((static_cast<unsigned>(a) + static_cast<unsigned>(b) + 1U) >> 1U);
+}
+
+template <class T>
+void bilinearRowScalar(const T * up, const T * mid, const T * down, int width, int first, int last, RowLayout layout,
+                       T * rgb)
+{
+   for (int x = first; x < last; ++x) {
+      const auto left       = mirror(x - 1, width);
+      const auto right      = mirror(x + 1, width);
+      const auto horizontal = average(mid[left], mid[right]);
+      const auto vertical   = average(up[x], down[x]);
+      const bool colourSite = ((x & 1) == 0) == layout.colourOnEvenColumns;
+      T          own;
+      T          green;
+      T          other;
+      if (colourSite) {
+         own   = mid[x];
+         green = average(horizontal, vertical);
+         other = average(average(up[left], up[right]), average(down[left], down[right]));
+      } else {
+         own   = horizontal; // the row's colour sits either side of a green site
+         green = mid[x];
+         other = vertical;
+      }
+      auto * pixel = rgb + 3 * static_cast<std::ptrdiff_t>(x);
+      pixel[0]     = layout.redRow ? own : other;
+      pixel[1]     = green;
+      pixel[2]     = layout.redRow ? other : own;
+   }
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Bilinear, SIMD
+/* ***************************************************************************************************************** */
+#ifdef DEBAYER_X86
+constexpr int Lanes128 = 8; // 16 bit lanes
+constexpr int Lanes256 = 16;
+
+// pshufb masks that interleave 8 red, 8 green and 8 blue 16 bit samples into three vectors of RGB triples.
+using InterleaveMask = std::array<qint8, 16>;
+constexpr auto interleaveMasks() -> std::array<std::array<InterleaveMask, 3>, 3>
+{
+   std::array<std::array<InterleaveMask, 3>, 3> masks{};
+   for (int vector = 0; vector < 3; ++vector) {
+      for (int channel = 0; channel < 3; ++channel) {
+         for (int lane = 0; lane < Lanes128; ++lane) {
+            const auto sample = vector * Lanes128 + lane;
+            const auto pixel  = sample / 3;
+            const bool mine   = sample % 3 == channel;
+            masks[vector][channel][2 * lane]     = static_cast<qint8>(mine ? 2 * pixel : -128);
+            masks[vector][channel][2 * lane + 1] = static_cast<qint8>(mine ? 2 * pixel + 1 : -128);
+         }
+      }
+   }
+   return masks;
+}
+alignas(16) constexpr auto InterleaveMasks = interleaveMasks();
+
+__attribute__((target("sse4.1"), always_inline)) inline auto interleave(int vector, __m128i r, __m128i g, __m128i b)
+  -> __m128i
+{
+   const auto & masks = InterleaveMasks[vector];
+   auto         red   = _mm_shuffle_epi8(r, _mm_load_si128(reinterpret_cast<const __m128i *>(masks[0].data())));
+   auto         green = _mm_shuffle_epi8(g, _mm_load_si128(reinterpret_cast<const __m128i *>(masks[1].data())));
+   auto         blue  = _mm_shuffle_epi8(b, _mm_load_si128(reinterpret_cast<const __m128i *>(masks[2].data())));
+   return _mm_or_si128(_mm_or_si128(red, green), blue);
+}
+
+__attribute__((target("sse4.1"), always_inline)) inline void storeRGB(quint16 * rgb, __m128i r, __m128i g, __m128i b)
+{
+   for (int vector = 0; vector < 3; ++vector) {
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(rgb + vector * Lanes128), interleave(vector, r, g, b));
+   }
+}
+
+__attribute__((target("sse4.1"), always_inline)) inline void storeRGB(quint8 * rgb, __m128i r, __m128i g, __m128i b)
+{
+   const auto last = interleave(2, r, g, b);
+   _mm_storeu_si128(reinterpret_cast<__m128i *>(rgb), _mm_packus_epi16(interleave(0, r, g, b), interleave(1, r, g, b)));
+   _mm_storel_epi64(reinterpret_cast<__m128i *>(rgb + 2 * Lanes128), _mm_packus_epi16(last, last));
+}
+
+__attribute__((target("sse4.1"), always_inline)) inline auto loadLanes128(const quint8 * samples) -> __m128i
+{
+   return _mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(samples)));
+}
+
+__attribute__((target("sse4.1"), always_inline)) inline auto loadLanes128(const quint16 * samples) -> __m128i
+{
+   return _mm_loadu_si128(reinterpret_cast<const __m128i *>(samples));
+}
+
+__attribute__((target("avx2"), always_inline)) inline auto loadLanes256(const quint8 * samples) -> __m256i
+{
+   return _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(samples)));
+}
+
+__attribute__((target("avx2"), always_inline)) inline auto loadLanes256(const quint16 * samples) -> __m256i
+{
+   return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(samples));
+}
+
+template <class T>
+__attribute__((target("sse4.1"))) void bilinearRowSSE41(const T * up, const T * mid, const T * down, int width,
+                                                         RowLayout layout, T * rgb)
+{
+   // The vector loop starts at column 1, so the first lane is a colour site when the odd columns are.
+   const auto colourSites = layout.colourOnEvenColumns ? _mm_setr_epi16(0, -1, 0, -1, 0, -1, 0, -1)
+                                                       : _mm_setr_epi16(-1, 0, -1, 0, -1, 0, -1, 0);
+   bilinearRowScalar(up, mid, down, width, 0, 1, layout, rgb);
+   int x = 1;
+   for (; x + Lanes128 < width; x += Lanes128) {
+      const auto centre     = loadLanes128(mid + x);
+      const auto horizontal = _mm_avg_epu16(loadLanes128(mid + x - 1), loadLanes128(mid + x + 1));
+      const auto vertical   = _mm_avg_epu16(loadLanes128(up + x), loadLanes128(down + x));
+      const auto diagonal   = _mm_avg_epu16(_mm_avg_epu16(loadLanes128(up + x - 1), loadLanes128(up + x + 1)),
+                                          _mm_avg_epu16(loadLanes128(down + x - 1), loadLanes128(down + x + 1)));
+      const auto own        = _mm_blendv_epi8(horizontal, centre, colourSites);
+      const auto green      = _mm_blendv_epi8(centre, _mm_avg_epu16(horizontal, vertical), colourSites);
+      const auto other      = _mm_blendv_epi8(vertical, diagonal, colourSites);
+      auto *     pixels     = rgb + 3 * static_cast<std::ptrdiff_t>(x);
+      if (layout.redRow) {
+         storeRGB(pixels, own, green, other);
+      } else {
+         storeRGB(pixels, other, green, own);
+      }
+   }
+   bilinearRowScalar(up, mid, down, width, x, width, layout, rgb);
+}
+
+template <class T>
+__attribute__((target("avx2"))) void bilinearRowAVX2(const T * up, const T * mid, const T * down, int width,
+                                                     RowLayout layout, T * rgb)
+{
+   const auto colourSites =
+     layout.colourOnEvenColumns
+       ? _mm256_setr_epi16(0, -1, 0, -1, 0, -1, 0, -1, 0, -1, 0, -1, 0, -1, 0, -1)
+       : _mm256_setr_epi16(-1, 0, -1, 0, -1, 0, -1, 0, -1, 0, -1, 0, -1, 0, -1, 0);
+   bilinearRowScalar(up, mid, down, width, 0, 1, layout, rgb);
+   int x = 1;
+   for (; x + Lanes256 < width; x += Lanes256) {
+      const auto centre     = loadLanes256(mid + x);
+      const auto horizontal = _mm256_avg_epu16(loadLanes256(mid + x - 1), loadLanes256(mid + x + 1));
+      const auto vertical   = _mm256_avg_epu16(loadLanes256(up + x), loadLanes256(down + x));
+      const auto diagonal   = _mm256_avg_epu16(_mm256_avg_epu16(loadLanes256(up + x - 1), loadLanes256(up + x + 1)),
+                                             _mm256_avg_epu16(loadLanes256(down + x - 1), loadLanes256(down + x + 1)));
+      const auto own        = _mm256_blendv_epi8(horizontal, centre, colourSites);
+      const auto green      = _mm256_blendv_epi8(centre, _mm256_avg_epu16(horizontal, vertical), colourSites);
+      const auto other      = _mm256_blendv_epi8(vertical, diagonal, colourSites);
+      const auto red        = layout.redRow ? own : other;
+      const auto blue       = layout.redRow ? other : own;
+      // pshufb cannot cross the 128 bit halves, so each half is interleaved on its own.
+      auto *     pixels     = rgb + 3 * static_cast<std::ptrdiff_t>(x);
+      storeRGB(pixels, _mm256_castsi256_si128(red), _mm256_castsi256_si128(green), _mm256_castsi256_si128(blue));
+      storeRGB(pixels + 3 * Lanes128,
+               _mm256_extracti128_si256(red, 1),
+               _mm256_extracti128_si256(green, 1),
+               _mm256_extracti128_si256(blue, 1));
+   }
+   bilinearRowScalar(up, mid, down, width, x, width, layout, rgb);
+}
+#endif
+
+template <class T>
+using BilinearRow = void (*)(const T *, const T *, const T *, int, RowLayout, T *);
+
+template <class T>
+void bilinearRowScalarWhole(const T * up, const T * mid, const T * down, int width, RowLayout layout, T * rgb)
+{
+   bilinearRowScalar(up, mid, down, width, 0, width, layout, rgb);
+}
+
+template <class T>
+auto bilinearRow() -> BilinearRow<T>
+{
+   switch (Debayer::kernel()) {
+#ifdef DEBAYER_X86
+   case Debayer::AVX2:
+      return &bilinearRowAVX2<T>;
+   case Debayer::SSE41:
+      return &bilinearRowSSE41<T>;
+#endif
+   default:
+      return &bilinearRowScalarWhole<T>;
+   }
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Malvar, He & Cutler
+/* ***************************************************************************************************************** */
+// The filters of "High-Quality Linear Interpolation for Demosaicing of Bayer-Patterned Color Images", doubled so every
+// weight is an integer; each sums to 16.
+template <class T>
+inline auto weighted(int sum) -> T
+{
+   constexpr int Maximum = std::numeric_limits<T>::max();
+   return static_cast<T>(qBound(0, (sum + 8) / 16, Maximum));
+}
+
+template <class T>
+void malvarRow(const std::array<const T *, 5> & rows, int width, RowLayout layout, T * rgb)
+{
+   const T * upper2 = rows[0];
+   const T * upper1 = rows[1];
+   const T * mid    = rows[2];
+   const T * lower1 = rows[3];
+   const T * lower2 = rows[4];
+   for (int x = 0; x < width; ++x) {
+      const bool interior = x >= 2 && x < width - 2;
+      const auto left2    = interior ? x - 2 : mirror(x - 2, width);
+      const auto left1    = interior ? x - 1 : mirror(x - 1, width);
+      const auto right1   = interior ? x + 1 : mirror(x + 1, width);
+      const auto right2   = interior ? x + 2 : mirror(x + 2, width);
+
+      const int  centre      = mid[x];
+      const int  horizontal  = mid[left1] + mid[right1];
+      const int  vertical    = upper1[x] + lower1[x];
+      const int  horizontal2 = mid[left2] + mid[right2];
+      const int  vertical2   = upper2[x] + lower2[x];
+      const int  diagonal    = upper1[left1] + upper1[right1] + lower1[left1] + lower1[right1];
+      const bool colourSite  = ((x & 1) == 0) == layout.colourOnEvenColumns;
+      T          own;
+      T          green;
+      T          other;
+      if (colourSite) {
+         own   = mid[x];
+         green = weighted<T>(8 * centre + 4 * (horizontal + vertical) - 2 * (horizontal2 + vertical2));
+         other = weighted<T>(12 * centre + 4 * diagonal - 3 * (horizontal2 + vertical2));
+      } else {
+         own   = weighted<T>(10 * centre + 8 * horizontal - 2 * horizontal2 - 2 * diagonal + vertical2);
+         green = mid[x];
+         other = weighted<T>(10 * centre + 8 * vertical - 2 * vertical2 - 2 * diagonal + horizontal2);
+      }
+      auto * pixel = rgb + 3 * static_cast<std::ptrdiff_t>(x);
+      pixel[0]     = layout.redRow ? own : other;
+      pixel[1]     = green;
+      pixel[2]     = layout.redRow ? other : own;
+   }
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Rows
+/* ***************************************************************************************************************** */
+template <class T>
+void debayerMosaic(const T * raw, int width, int height, Frame::BayerPattern pattern, Debayer::Method method, T * rgb)
+{
+   if (raw == nullptr || rgb == nullptr || width < 2 || height < 2 || pattern == Frame::Monochrome) {
+      return;
+   }
+   // The high quality filters reach two pixels out, so need three to mirror into.
+   const bool highQuality = method == Debayer::HighQuality && width >= 3 && height >= 3;
+   const auto rowKernel   = bilinearRow<T>();
+   parallelRows(height, [=](int firstRow, int lastRow) {
+      for (int y = firstRow; y < lastRow; ++y) {
+         auto * rgbRow = rgb + 3 * static_cast<std::ptrdiff_t>(y) * width;
+         if (highQuality) {
+            const std::array<const T *, 5> rows{ rowAt(raw, width, height, y - 2),
+                                                 rowAt(raw, width, height, y - 1),
+                                                 rowAt(raw, width, height, y),
+                                                 rowAt(raw, width, height, y + 1),
+                                                 rowAt(raw, width, height, y + 2) };
+            malvarRow(rows, width, rowLayout(pattern, y), rgbRow);
+         } else {
+            rowKernel(rowAt(raw, width, height, y - 1),
+                      rowAt(raw, width, height, y),
+                      rowAt(raw, width, height, y + 1),
+                      width,
+                      rowLayout(pattern, y),
+                      rgbRow);
+         }
+      }
+   });
+}
+
+auto detectKernel() -> Debayer::Kernel
+{
+#ifdef DEBAYER_X86
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("avx2")) {
+      return Debayer::AVX2;
+   }
+   if (__builtin_cpu_supports("sse4.1")) {
+      return Debayer::SSE41;
+   }
+#endif
+   return Debayer::Scalar;
+}
+} // namespace
+
+/* ***************************************************************************************************************** */
+// MARK: - Public methods
+/* ***************************************************************************************************************** */
+auto Debayer::debayer(const Frame & raw, Method method, quint8 * rgb) -> bool
+{
+   const auto width  = static_cast<int>(raw.width());
+   const auto height = static_cast<int>(raw.height());
+   if (raw.isNull() || raw.isFloat() || raw.channels() > 1 || raw.bayerPattern() == Frame::Monochrome || width < 2
+       || height < 2) {
+      return false;
+   }
+   if (raw.bytesPerSample() == 1) {
+      debayer(raw.constData(), width, height, raw.bayerPattern(), method, rgb);
+   } else {
+      debayer(reinterpret_cast<const quint16 *>(raw.constData()),
+              width,
+              height,
+              raw.bayerPattern(),
+              method,
+              reinterpret_cast<quint16 *>(rgb));
+   }
+   return true;
+}
+
+void Debayer::debayer(const quint8 * raw, int width, int height, Frame::BayerPattern pattern, Method method,
+                      quint8 * rgb)
+{
+   debayerMosaic(raw, width, height, pattern, method, rgb);
+}
+
+void Debayer::debayer(const quint16 * raw, int width, int height, Frame::BayerPattern pattern, Method method,
+                      quint16 * rgb)
+{
+   debayerMosaic(raw, width, height, pattern, method, rgb);
+}
+
+auto Debayer::kernel() -> Kernel
+{
+   static const Kernel detected = detectKernel();
+   return detected;
+}
+
+auto Debayer::kernelName(Kernel kernel) -> QString
+{
+   switch (kernel) {
+   case AVX2:
+      return QString("AVX2");
+   case SSE41:
+      return QString("SSE4.1");
+   case Scalar:
+      break;
+   }
+   return QString("scalar");
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "Frame.hpp"
+#include <QString>
+
+/*! \brief Converts the raw mosaic of a one shot colour camera into RGB.
+ *
+ * The output is interleaved RGB with the sample size of the input; three 8 bit samples per pixel for 8 bit frames,
+ * three 16 bit samples for 16 bit frames.  Edge pixels mirror the mosaic, so the output has the same size as the input.
+ *
+ * The bilinear method has SSE4.1 and AVX2 kernels, picked once for the CPU the program runs on, and a scalar kernel
+ * that gives identical results.  The high quality method is the gradient corrected interpolation of Malvar, He &
+ * Cutler, which is slower and scalar only.  Both methods split the rows across the global thread pool.
+ */
+class Debayer
+{
+public:
+   enum Method
+   {
+      Bilinear,
+      HighQuality
+   };
+
+   enum Kernel
+   {
+      Scalar,
+      SSE41,
+      AVX2
+   };
+
+   Debayer() = delete;
+
+   /*!
+    * Debayers a raw frame.
+    *
+    * @param raw a single channel frame with a colour filter array.
+    * @param method the interpolation to use.
+    * @param rgb the output; width × height × 3 × the frame's bytesPerSample() bytes.
+    * @return False if the frame is monochrome, not a single channel, or smaller than 2 × 2.
+    */
+   static auto               debayer(const Frame & raw, Method method, quint8 * rgb) -> bool;
+
+   /*!
+    * Debayers an 8 bit mosaic.
+    *
+    * @param raw width × height samples, with no padding between rows.
+    * @param width the width, at least 2.
+    * @param height the height, at least 2.
+    * @param pattern the colour filter array, as seen from the first pixel; not Monochrome.
+    * @param method the interpolation to use.
+    * @param rgb width × height × 3 samples.
+    */
+   static void               debayer(const quint8 * raw, int width, int height, Frame::BayerPattern pattern,
+                                     Method method, quint8 * rgb);
+
+   /*!
+    * Debayers a 16 bit mosaic; see the 8 bit overload.
+    */
+   static void               debayer(const quint16 * raw, int width, int height, Frame::BayerPattern pattern,
+                                     Method method, quint16 * rgb);
+
+   /*!
+    * The kernel the bilinear method runs with on this CPU.
+    */
+   [[nodiscard]] static auto kernel() -> Kernel;
+   [[nodiscard]] static auto kernelName(Kernel kernel) -> QString;
+};
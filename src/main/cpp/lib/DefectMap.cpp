@@ -0,0 +1,339 @@
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "DefectMap.hpp"
+
+#include "Config.h"
+#include "MasterFrame.hpp"
+#include "ParallelRows.hpp"
+#include <algorithm>
+#include <cmath>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QStringBuilder>
+#include <type_traits>
+
+namespace
+{
+/*! \brief The start of a defect map's file; the pixel indices follow, as quint32s.
+ */
+struct Header
+{
+   std::array<char, 8> magic;
+   quint32             format;
+   quint32             width;
+   quint32             height;
+   quint32             channels;
+   quint32             step;
+   quint32             count;
+};
+
+const std::array<char, 8> Magic{ { 'Q', 'A', 'I', 'D', 'E', 'F', 'M', '\0' } };
+
+const float NormalDeviationPerMAD = 1.4826F; // the standard deviation of normal data over its median deviation
+
+/*!
+ * The median of a few values; reorders them.
+ */
+template <typename Sample>
+auto median(Sample * values, int count) -> Sample
+{
+   std::sort(values, values + count);
+   if (count % 2 == 1) {
+      return values[count / 2];
+   }
+   const auto middle = (static_cast<double>(values[count / 2 - 1]) + values[count / 2]) / 2.0;
+   if constexpr (std::is_floating_point<Sample>::value) {
+      return static_cast<Sample>(middle);
+   } else {
+      return static_cast<Sample>(std::lround(middle));
+   }
+}
+
+auto stepFor(Frame::BayerPattern bayerPattern) -> int
+{
+   return bayerPattern == Frame::Monochrome ? 1 : 2;
+}
+} // namespace
+
+/* ***************************************************************************************************************** */
+// MARK: - ctors & dtors
+/* ***************************************************************************************************************** */
+DefectMap::DefectMap(int width, int height, int channels, int step, std::vector<quint32> pixels)
+   : m_width(width)
+   , m_height(height)
+   , m_channels(channels)
+   , m_step(step)
+   , m_offsets()
+{
+   std::sort(pixels.begin(), pixels.end());
+   pixels.erase(std::unique(pixels.begin(), pixels.end()), pixels.end());
+
+   std::array<int, 8> dx{};
+   std::array<int, 8> dy{};
+   int                neighbour{ 0 };
+   for (int y = -1; y <= 1; ++y) {
+      for (int x = -1; x <= 1; ++x) {
+         if (x != 0 || y != 0) {
+            dx[neighbour]        = x * step;
+            dy[neighbour]        = y * step;
+            m_offsets[neighbour] = static_cast<qint64>(dy[neighbour]) * width + dx[neighbour];
+            ++neighbour;
+         }
+      }
+   }
+
+   // A neighbour that is bad itself, or off the sensor, is left out of the median.
+   m_defects.reserve(pixels.size());
+   for (const auto pixel : pixels) {
+      const auto x = static_cast<int>(pixel % static_cast<quint32>(width));
+      const auto y = static_cast<int>(pixel / static_cast<quint32>(width));
+      Defect     defect{ pixel, 0 };
+      for (neighbour = 0; neighbour < static_cast<int>(m_offsets.size()); ++neighbour) {
+         const auto nx = x + dx[neighbour];
+         const auto ny = y + dy[neighbour];
+         if (nx >= 0 && nx < width && ny >= 0 && ny < height
+             && !std::binary_search(
+               pixels.cbegin(), pixels.cend(), static_cast<quint32>(ny) * static_cast<quint32>(width) + nx)) {
+            defect.neighbours |= static_cast<quint8>(1U << neighbour);
+         }
+      }
+      m_defects.push_back(defect);
+   }
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Public methods
+/* ***************************************************************************************************************** */
+auto DefectMap::channels() const -> int
+{
+   return m_channels;
+}
+
+auto DefectMap::correct(Frame & frame) const -> bool
+{
+   if (!isCompatible(frame)) {
+      return false;
+   }
+   if (frame.isFloat()) {
+      correctSamples(reinterpret_cast<float *>(frame.data())); // NOLINT
+   } else if (frame.bytesPerSample() == 2) {
+      correctSamples(reinterpret_cast<quint16 *>(frame.data())); // NOLINT
+   } else {
+      correctSamples(frame.data());
+   }
+   return true;
+}
+
+auto DefectMap::count() const -> int
+{
+   return static_cast<int>(m_defects.size());
+}
+
+auto DefectMap::fromMaster(const MasterFrame & master, Frame::BayerPattern bayerPattern)
+  -> std::shared_ptr<const DefectMap>
+{
+   const auto   width    = master.width();
+   const auto   height   = master.height();
+   const auto   channels = master.channels();
+   const auto * samples  = master.samples();
+   const auto   step     = stepFor(bayerPattern);
+
+   // The level and spread of a bias or dark, from a sample of it; the deviation from the median absolute deviation, so
+   // the hot pixels being looked for do not inflate it.
+   std::vector<float> sampled;
+   sampled.reserve(static_cast<size_t>(master.sampleCount() / DefectSampleStride + 1));
+   for (qint64 index = 0; index < master.sampleCount(); index += DefectSampleStride) {
+      sampled.push_back(samples[index]);
+   }
+   if (sampled.empty()) {
+      return nullptr;
+   }
+   const auto middle = sampled.begin() + static_cast<std::ptrdiff_t>(sampled.size() / 2);
+   std::nth_element(sampled.begin(), middle, sampled.end());
+   const auto level = *middle;
+   std::transform(sampled.cbegin(), sampled.cend(), sampled.begin(), [=](float value) {
+      return std::abs(value - level);
+   });
+   std::nth_element(sampled.begin(), middle, sampled.end());
+   const auto deviation = NormalDeviationPerMAD * *middle;
+   const auto isFlat    = master.kind() == MasterFrame::Flat;
+
+   QMutex               pixelsMutex;
+   std::vector<quint32> pixels;
+   parallelRows(height, [&](int firstRow, int lastRow) {
+      std::vector<quint32> found;
+      std::array<float, 8> neighbours{};
+      for (int y = firstRow; y < lastRow; ++y) {
+         for (int x = 0; x < width; ++x) {
+            const auto pixel = static_cast<qint64>(y) * width + x;
+            for (int channel = 0; channel < channels; ++channel) {
+               const auto value = samples[pixel * channels + channel];
+               auto       bad{ false };
+               if (isFlat) {
+                  // Vignetting and dust change slowly, so a flat pixel is judged against its own neighbourhood.
+                  int count{ 0 };
+                  for (int ny = y - step; ny <= y + step; ny += step) {
+                     for (int nx = x - step; nx <= x + step; nx += step) {
+                        if ((nx != x || ny != y) && nx >= 0 && nx < width && ny >= 0 && ny < height) {
+                           neighbours[count++] = samples[(static_cast<qint64>(ny) * width + nx) * channels + channel];
+                        }
+                     }
+                  }
+                  const auto local = count > 0 ? median(neighbours.data(), count) : 0.0F;
+                  bad              = local > 0.0F && (value < DefectFlatLow * local || value > DefectFlatHigh * local);
+               } else {
+                  bad = deviation > 0.0F && std::abs(value - level) > DefectMasterSigma * deviation;
+               }
+               if (bad) {
+                  found.push_back(static_cast<quint32>(pixel));
+                  break;
+               }
+            }
+         }
+      }
+      QMutexLocker locker(&pixelsMutex);
+      pixels.insert(pixels.end(), found.cbegin(), found.cend());
+   });
+
+   if (static_cast<double>(pixels.size()) > DefectMaximumFraction * width * height) {
+      qWarning() << "The master" << master.path() << "has" << pixels.size()
+                 << "bad looking pixels; too many to be defects.";
+      return nullptr;
+   }
+   return std::shared_ptr<const DefectMap>(new DefectMap(width, height, channels, step, std::move(pixels)));
+}
+
+auto DefectMap::fromPixels(int                  width,
+                           int                  height,
+                           int                  channels,
+                           Frame::BayerPattern  bayerPattern,
+                           std::vector<quint32> pixels) -> std::shared_ptr<const DefectMap>
+{
+   return std::shared_ptr<const DefectMap>(
+     new DefectMap(width, height, qMax(channels, 1), stepFor(bayerPattern), std::move(pixels)));
+}
+
+auto DefectMap::height() const -> int
+{
+   return m_height;
+}
+
+auto DefectMap::isCompatible(const Frame & frame) const -> bool
+{
+   return !frame.isNull() && static_cast<int>(frame.width()) == m_width
+          && static_cast<int>(frame.height()) == m_height
+          && static_cast<int>(qMax(frame.channels(), 1U)) == m_channels;
+}
+
+auto DefectMap::open(const QString & path) -> std::shared_ptr<const DefectMap>
+{
+   QFile file(path);
+   if (!file.open(QIODevice::ReadOnly)) {
+      return nullptr;
+   }
+   Header header{};
+   if (file.read(reinterpret_cast<char *>(&header), sizeof(header)) != sizeof(header) // NOLINT
+       || header.magic != Magic || header.format != DefectMapFormat || header.width == 0 || header.height == 0) {
+      qWarning() << "The defect map" << path << "is not of this version's format";
+      return nullptr;
+   }
+   std::vector<quint32> pixels(header.count);
+   const auto           length = static_cast<qint64>(pixels.size() * sizeof(quint32));
+   if (file.read(reinterpret_cast<char *>(pixels.data()), length) != length) { // NOLINT
+      qWarning() << "The defect map" << path << "is truncated";
+      return nullptr;
+   }
+   const auto sensorPixels = static_cast<quint64>(header.width) * header.height;
+   if (std::any_of(pixels.cbegin(), pixels.cend(), [=](quint32 pixel) { return pixel >= sensorPixels; })) {
+      qWarning() << "The defect map" << path << "has pixels off the sensor";
+      return nullptr;
+   }
+   return std::shared_ptr<const DefectMap>(new DefectMap(static_cast<int>(header.width),
+                                                         static_cast<int>(header.height),
+                                                         static_cast<int>(qMax(header.channels, 1U)),
+                                                         static_cast<int>(qMax(header.step, 1U)),
+                                                         std::move(pixels)));
+}
+
+auto DefectMap::path(const QString & cameraId, const QString & readMode, int binning) -> QString
+{
+   // Camera ids are safe as file names; read mode names have spaces, and might have anything.
+   QString mode;
+   for (const auto character : readMode) {
+      mode.append(character.isLetterOrNumber() ? character : QChar('_'));
+   }
+   return QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) % "/defects/" % cameraId % "/" % mode
+          % QString("-bin%1.defects").arg(binning);
+}
+
+auto DefectMap::save(const QString & path) const -> bool
+{
+   Header header{};
+   header.magic    = Magic;
+   header.format   = DefectMapFormat;
+   header.width    = static_cast<quint32>(m_width);
+   header.height   = static_cast<quint32>(m_height);
+   header.channels = static_cast<quint32>(m_channels);
+   header.step     = static_cast<quint32>(m_step);
+   header.count    = static_cast<quint32>(m_defects.size());
+   std::vector<quint32> pixels(m_defects.size());
+   std::transform(m_defects.cbegin(), m_defects.cend(), pixels.begin(), [](const Defect & defect) {
+      return defect.pixel;
+   });
+
+   if (!QDir().mkpath(QFileInfo(path).absolutePath())) {
+      qWarning() << "Cannot create the directory for the defect map" << path;
+      return false;
+   }
+   QSaveFile file(path);
+   if (!file.open(QIODevice::WriteOnly)) {
+      qWarning() << "Cannot write the defect map" << path;
+      return false;
+   }
+   const auto length = static_cast<qint64>(pixels.size() * sizeof(quint32));
+   file.write(reinterpret_cast<const char *>(&header), sizeof(header)); // NOLINT
+   file.write(reinterpret_cast<const char *>(pixels.data()), length); // NOLINT
+   if (!file.commit()) {
+      qWarning() << "Cannot write the defect map" << path;
+      return false;
+   }
+   return true;
+}
+
+auto DefectMap::width() const -> int
+{
+   return m_width;
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Private methods
+/* ***************************************************************************************************************** */
+template <typename Sample>
+void DefectMap::correctSamples(Sample * samples) const
+{
+   std::array<Sample, 8> values{};
+   for (const auto & defect : m_defects) {
+      for (int channel = 0; channel < m_channels; ++channel) {
+         int count{ 0 };
+         for (size_t neighbour = 0; neighbour < m_offsets.size(); ++neighbour) {
+            if ((defect.neighbours & (1U << neighbour)) != 0) {
+               values[count++] = samples[(defect.pixel + m_offsets[neighbour]) * m_channels + channel];
+            }
+         }
+         // A pixel in a cluster of bad ones is left as it is.
+         if (count > 0) {
+            samples[static_cast<qint64>(defect.pixel) * m_channels + channel] = median(values.data(), count);
+         }
+      }
+   }
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "Frame.hpp"
+#include <array>
+#include <memory>
+#include <QString>
+#include <vector>
+
+class MasterFrame;
+
+/*! \brief The hot and cold pixels of a sensor, and their correction.
+ *
+ * The map is a sorted index of the bad pixels alone, with a mask of the neighbours of the same colour that are good, so
+ * correcting a frame walks the index, never the frame; each bad pixel is replaced by the median of its good neighbours.
+ * The cost follows the number of defects, not the frame size, so correction keeps up with live view at any rate.
+ *
+ * A map is made from a master dark, bias or flat, or by a DefectSurvey of live frames, and kept in a small file per
+ * camera, read mode and binning; see path().
+ *
+ * A map does not change once made, so one may be shared by threads.
+ */
+class DefectMap
+{
+public:
+   DefectMap(const DefectMap &) = delete;
+   DefectMap(DefectMap &&)      = delete;
+   ~DefectMap()                 = default;
+
+   auto                      operator=(const DefectMap &) -> DefectMap & = delete;
+   auto                      operator=(DefectMap &&) -> DefectMap & = delete;
+
+   [[nodiscard]] auto        channels() const -> int;
+
+   /*!
+    * Replaces each bad pixel of a frame by the median of its good neighbours of the same colour, in place.  For the
+    * producer of the frame only, before it is handed out; live view leaves it to Frame::correctDefects().
+    *
+    * @return False if the map is not for frames of this geometry.
+    */
+   auto                      correct(Frame & frame) const -> bool;
+
+   /*!
+    * The number of bad pixels.
+    */
+   [[nodiscard]] auto        count() const -> int;
+
+   /*!
+    * Finds the bad pixels of a master.  In a bias or dark, a pixel DefectMasterSigma deviations above or below the
+    * median is bad; in a flat, a pixel below DefectFlatLow or above DefectFlatHigh of the median of its neighbours is.
+    *
+    * @param master the master.
+    * @param bayerPattern the colour filter array of the sensor the master was taken with.
+    * @return The map, or nullptr if more than DefectMaximumFraction of the pixels look bad.
+    */
+   [[nodiscard]] static auto fromMaster(const MasterFrame & master, Frame::BayerPattern bayerPattern)
+     -> std::shared_ptr<const DefectMap>;
+
+   /*!
+    * Makes a map from a list of bad pixels.
+    *
+    * @param pixels the indices of the bad pixels, y × width + x; in any order.
+    * @param bayerPattern the colour filter array of the sensor; a mosaic is corrected from pixels two apart.
+    */
+   [[nodiscard]] static auto fromPixels(int                   width,
+                                        int                   height,
+                                        int                   channels,
+                                        Frame::BayerPattern   bayerPattern,
+                                        std::vector<quint32>  pixels) -> std::shared_ptr<const DefectMap>;
+   [[nodiscard]] auto        height() const -> int;
+
+   /*!
+    * If the map is for frames of this geometry.
+    */
+   [[nodiscard]] auto        isCompatible(const Frame & frame) const -> bool;
+
+   /*!
+    * Reads a map's file.
+    *
+    * @return The map, or nullptr if the file is missing or of another format.
+    */
+   [[nodiscard]] static auto open(const QString & path) -> std::shared_ptr<const DefectMap>;
+
+   /*!
+    * The file the map of a camera is kept in, under the user's data directory.
+    *
+    * @param cameraId the id of the camera, as reported by the driver.
+    * @param readMode the name of the read mode.
+    * @param binning the binning, the same on both axes.
+    */
+   [[nodiscard]] static auto path(const QString & cameraId, const QString & readMode, int binning) -> QString;
+
+   /*!
+    * Writes the map's file, replacing any earlier one.
+    *
+    * @return The success of writing the file.
+    */
+   [[nodiscard]] auto        save(const QString & path) const -> bool;
+   [[nodiscard]] auto        width() const -> int;
+
+private:
+   struct Defect
+   {
+      quint32 pixel;      // y × width + x
+      quint8  neighbours; // a bit per entry of m_offsets that is a good pixel
+   };
+
+   DefectMap(int width, int height, int channels, int step, std::vector<quint32> pixels);
+
+   template <typename Sample>
+   void                     correctSamples(Sample * samples) const;
+
+   int                      m_width;
+   int                      m_height;
+   int                      m_channels;
+   int                      m_step; // between pixels of the same colour
+   std::array<qint64, 8>    m_offsets; // to the eight neighbours of the same colour, in pixels
+   std::vector<Defect>      m_defects; // by pixel
+};
@@ -0,0 +1,178 @@
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "DefectSurvey.hpp"
+
+#include "Config.h"
+#include "DefectMap.hpp"
+#include "ParallelRows.hpp"
+#include <algorithm>
+#include <cmath>
+#include <QDebug>
+#include <QMutex>
+#include <QMutexLocker>
+
+namespace
+{
+/*!
+ * The pixels of a frame that stand out from their neighbours of the same colour, by index.
+ *
+ * @param step between pixels of the same colour.
+ * @param background the level of the sky.
+ * @param noise the standard deviation of the sky.
+ */
+template <typename Sample>
+auto standouts(const Sample * samples, int width, int height, int channels, int step, double background, double noise)
+  -> std::vector<quint32>
+{
+   const auto           threshold = DefectSurveySigma * noise;
+   QMutex               pixelsMutex;
+   std::vector<quint32> pixels;
+   parallelRows(height, [&](int firstRow, int lastRow) {
+      std::vector<quint32> found;
+      for (int y = firstRow; y < lastRow; ++y) {
+         for (int x = 0; x < width; ++x) {
+            const auto pixel = static_cast<qint64>(y) * width + x;
+            for (int channel = 0; channel < channels; ++channel) {
+               const double value = samples[pixel * channels + channel];
+               double       brightest{ 0.0 };
+               double       faintest{ 0.0 };
+               auto         neighbours{ 0 };
+               for (int ny = y - step; ny <= y + step; ny += step) {
+                  for (int nx = x - step; nx <= x + step; nx += step) {
+                     if ((nx != x || ny != y) && nx >= 0 && nx < width && ny >= 0 && ny < height) {
+                        const double neighbour = samples[(static_cast<qint64>(ny) * width + nx) * channels + channel];
+                        brightest              = neighbours == 0 ? neighbour : qMax(brightest, neighbour);
+                        faintest               = neighbours == 0 ? neighbour : qMin(faintest, neighbour);
+                        ++neighbours;
+                     }
+                  }
+               }
+               const auto hot = value - brightest > threshold
+                                && brightest - background < DefectSurveyIsolation * (value - background);
+               const auto cold = faintest - value > threshold;
+               if (neighbours > 0 && (hot || cold)) {
+                  found.push_back(static_cast<quint32>(pixel));
+                  break;
+               }
+            }
+         }
+      }
+      QMutexLocker locker(&pixelsMutex);
+      pixels.insert(pixels.end(), found.cbegin(), found.cend());
+   });
+   std::sort(pixels.begin(), pixels.end());
+   return pixels;
+}
+} // namespace
+
+/* ***************************************************************************************************************** */
+// MARK: - ctors & dtors
+/* ***************************************************************************************************************** */
+DefectSurvey::DefectSurvey(QObject * parent)
+   : QObject(parent)
+   , m_busy(false)
+   , m_frames(0)
+   , m_width(0)
+   , m_height(0)
+   , m_channels(0)
+   , m_bayerPattern(Frame::Monochrome)
+{
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Public methods
+/* ***************************************************************************************************************** */
+auto DefectSurvey::offer(const Frame & frame) -> bool
+{
+   auto idle = false;
+   if (!m_busy.compare_exchange_strong(idle, true)) {
+      return false;
+   }
+   QMetaObject::invokeMethod(
+     this, [this, frame]() { survey(frame); }, Qt::QueuedConnection);
+   return true;
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Public slots
+/* ***************************************************************************************************************** */
+void DefectSurvey::reset()
+{
+   std::vector<std::pair<quint32, int>>().swap(m_hits);
+   m_frames = 0;
+}
+
+void DefectSurvey::survey(Frame frame)
+{
+   if (frame.isNull() || frame.isFloat()) {
+      m_busy = false;
+      return;
+   }
+   const auto width    = static_cast<int>(frame.width());
+   const auto height   = static_cast<int>(frame.height());
+   const auto channels = static_cast<int>(qMax(frame.channels(), 1U));
+   if (width != m_width || height != m_height || channels != m_channels || frame.bayerPattern() != m_bayerPattern) {
+      reset();
+      m_width        = width;
+      m_height       = height;
+      m_channels     = channels;
+      m_bayerPattern = frame.bayerPattern();
+   }
+
+   auto statistics = frame.statistics();
+   if (!statistics.isValid()) {
+      statistics = FrameStatistics::measure(frame);
+   }
+   const auto step  = m_bayerPattern == Frame::Monochrome ? 1 : 2;
+   const auto noise = qMax(statistics.noise, 1.0);
+   const auto found = frame.bytesPerSample() == 2
+                        ? standouts(reinterpret_cast<const quint16 *>(frame.constData()), // NOLINT
+                                    width,
+                                    height,
+                                    channels,
+                                    step,
+                                    statistics.background,
+                                    noise)
+                        : standouts(frame.constData(), width, height, channels, step, statistics.background, noise);
+   // Let the buffer go back to the pool before the counting.
+   frame  = Frame();
+   m_busy = false;
+
+   if (static_cast<double>(found.size()) > DefectMaximumFraction * width * height) {
+      qDebug() << "A frame with" << found.size() << "pixels standing out was left out of the defect survey.";
+      return;
+   }
+   std::vector<std::pair<quint32, int>> hits;
+   hits.reserve(m_hits.size() + found.size());
+   auto hit = m_hits.cbegin();
+   for (const auto pixel : found) {
+      for (; hit != m_hits.cend() && hit->first < pixel; ++hit) {
+         hits.push_back(*hit);
+      }
+      if (hit != m_hits.cend() && hit->first == pixel) {
+         hits.emplace_back(pixel, hit->second + 1);
+         ++hit;
+      } else {
+         hits.emplace_back(pixel, 1);
+      }
+   }
+   hits.insert(hits.end(), hit, m_hits.cend());
+   m_hits.swap(hits);
+   emit progress(++m_frames, DefectSurveyFrames);
+
+   if (m_frames >= DefectSurveyFrames) {
+      const auto           needed = static_cast<int>(std::ceil(DefectSurveyHits * m_frames));
+      std::vector<quint32> pixels;
+      for (const auto & entry : m_hits) {
+         if (entry.second >= needed) {
+            pixels.push_back(entry.first);
+         }
+      }
+      reset();
+      emit surveyed(DefectMap::fromPixels(m_width, m_height, m_channels, m_bayerPattern, std::move(pixels)));
+   }
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "Frame.hpp"
+#include <atomic>
+#include <memory>
+#include <QObject>
+#include <utility>
+#include <vector>
+
+class DefectMap;
+
+/*! \brief Finds the hot and cold pixels of a sensor from the frames it streams, when no darks are at hand.
+ *
+ * A pixel stands out in a frame when it differs from all of its neighbours of the same colour by DefectSurveySigma
+ * deviations of the frame's noise, and, if bright, its brightest neighbour stays below DefectSurveyIsolation of its
+ * level; a star lights its neighbours up too.  A pixel that stands out in DefectSurveyHits of DefectSurveyFrames frames
+ * is a defect, as a star, a satellite or a cosmic ray does not stay put on one pixel frame after frame.
+ *
+ * Each frame is searched in one parallel pass, but only the pixels that stand out are kept, so the survey holds a few
+ * counts, never a frame.  A frame where more than DefectMaximumFraction of the pixels stand out is passed over.
+ *
+ * An instance lives on a thread of its own and surveys the frames it is offered, one at a time.
+ */
+class DefectSurvey : public QObject
+{
+   Q_OBJECT
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+   Q_DISABLE_COPY_MOVE(DefectSurvey)
+#endif
+
+public:
+   explicit DefectSurvey(QObject * parent = nullptr);
+   ~DefectSurvey() override = default;
+
+   /*!
+    * Queues a frame for the survey, unless one is already being searched.  Safe to call from any thread.
+    *
+    * @return False if the frame was dropped.
+    */
+   auto offer(const Frame & frame) -> bool;
+
+public slots:
+   /*!
+    * Forgets the frames surveyed so far.
+    */
+   void reset();
+   void survey(Frame frame);
+
+signals:
+   /*!
+    * Emitted as each frame is added to the survey.
+    */
+   void progress(int frames, int of);
+
+   /*!
+    * Emitted once DefectSurveyFrames frames have been surveyed, with the map they make; the survey then starts over.
+    */
+   void surveyed(std::shared_ptr<const DefectMap> map);
+
+private:
+   std::atomic_bool                     m_busy;
+
+   // Only used on the survey's thread.
+   std::vector<std::pair<quint32, int>> m_hits; // pixel and frames it stood out in, by pixel
+   int                                  m_frames;
+   int                                  m_width;
+   int                                  m_height;
+   int                                  m_channels;
+   Frame::BayerPattern                  m_bayerPattern;
+};
@@ -0,0 +1,173 @@
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "DeviceWatcher.hpp"
+
+#include "CameraCommandQueue.hpp"
+#include "Config.h"
+#include <QByteArray>
+#include <QDebug>
+#include <QMutexLocker>
+#include <qhyccd.h>
+#include <utility>
+
+namespace
+{
+/*!
+ * Held around every scan, and every open & close of a camera.
+ */
+auto driverMutex() -> QMutex &
+{
+   static QMutex mutex;
+   return mutex;
+}
+
+/*!
+ * The cameras open, across every QHYCamera; only touched under driverMutex().
+ */
+auto openCameras() -> int &
+{
+   static int count{ 0 };
+   return count;
+}
+} // namespace
+
+/* ***************************************************************************************************************** */
+// MARK: - ctors & dtors
+/* ***************************************************************************************************************** */
+DeviceWatcher::DeviceWatcher(Scanner scanner, QObject * parent)
+   : QObject(parent)
+   , m_scanner(std::move(scanner))
+   , m_commandQueue(std::make_unique<CameraCommandQueue>(QString("Device Watcher")))
+   , m_scanPending(false)
+{
+   m_timer.setInterval(DeviceScanInterval);
+   QObject::connect(&m_timer, &QTimer::timeout, this, &DeviceWatcher::rescan);
+}
+
+DeviceWatcher::~DeviceWatcher()
+{
+   m_timer.stop();
+   // Lets a queued scan finish before the scanner it calls goes away, while the queue it checks for is still there.
+   m_commandQueue->enqueue([]() {}).waitForFinished();
+   m_commandQueue.reset();
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Public methods
+/* ***************************************************************************************************************** */
+auto DeviceWatcher::cameras() const -> QStringList
+{
+   QMutexLocker locker(&m_camerasMutex);
+   return m_cameras;
+}
+
+auto DeviceWatcher::closeCamera(const std::function<bool()> & close) -> bool
+{
+   QMutexLocker locker(&driverMutex());
+   const auto   closed = close();
+   if (closed) {
+      Q_ASSERT(openCameras() > 0);
+      --openCameras();
+   }
+   return closed;
+}
+
+auto DeviceWatcher::openCamera(const std::function<qhyccd_handle *()> & open) -> qhyccd_handle *
+{
+   QMutexLocker locker(&driverMutex());
+   auto *       handle = open();
+   if (handle != nullptr) {
+      ++openCameras();
+   }
+   return handle;
+}
+
+auto DeviceWatcher::scanDriver() -> QStringList
+{
+   QStringList cameras;
+   quint32     connectedCameraCount = ScanQHYCCD();
+
+   QByteArray  nameBuffer(BufferSizeCameraName, 0);
+   for (quint32 cameraIndex = 0; cameraIndex < connectedCameraCount; cameraIndex++) {
+      auto qhyResult = GetQHYCCDId(cameraIndex, nameBuffer.data());
+      if (qhyResult == QHYCCD_SUCCESS) {
+         cameras.append(QLatin1String(nameBuffer.constData()));
+      } else {
+         qWarning() << QString(tr("GetQHYCCDId index[%1] failure")).arg(qhyResult);
+      }
+   }
+   return cameras;
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Public slots
+/* ***************************************************************************************************************** */
+void DeviceWatcher::rescan()
+{
+   if (m_scanPending.exchange(true)) {
+      return;
+   }
+   m_commandQueue->enqueue([this]() {
+      m_scanPending = false;
+      scan();
+   });
+}
+
+void DeviceWatcher::start()
+{
+   rescan();
+   m_timer.start();
+}
+
+void DeviceWatcher::stop()
+{
+   m_timer.stop();
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Private methods
+/* ***************************************************************************************************************** */
+void DeviceWatcher::scan()
+{
+   Q_ASSERT(m_commandQueue->isQueueThread());
+   QStringList scanned;
+   {
+      QMutexLocker locker(&driverMutex());
+      if (openCameras() > 0) {
+         return;
+      }
+      scanned = m_scanner();
+   }
+   QSet<QString> attached;
+   for (const auto & id : qAsConst(scanned)) {
+      attached.insert(id);
+   }
+   if (attached == m_known) {
+      return;
+   }
+
+   const auto removed = QSet<QString>(m_known).subtract(attached);
+   const auto added   = QSet<QString>(attached).subtract(m_known);
+   m_known            = attached;
+   {
+      QMutexLocker locker(&m_camerasMutex);
+      m_cameras = scanned;
+   }
+
+   for (const auto & id : removed) {
+      qDebug() << "Camera removed:" << id;
+      emit cameraRemoved(id);
+   }
+   // Reported in the order the driver lists them, so tabs & menus come out stable.
+   for (const auto & id : qAsConst(scanned)) {
+      if (added.contains(id)) {
+         qDebug() << "Camera added:" << id;
+         emit cameraAdded(id);
+      }
+   }
+   emit camerasChanged(scanned);
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <QMutex>
+#include <QObject>
+#include <QSet>
+#include <QStringList>
+#include <QTimer>
+
+class CameraCommandQueue;
+
+using qhyccd_handle = void;
+
+/*! \brief Watches for cameras being plugged in and unplugged.
+ *
+ * The driver is rescanned on a timer, and whenever rescan() is called; the scan runs on the watcher's own thread, never
+ * on the caller's.  Each scan is compared with the cameras already known, and only the differences are reported, so
+ * cameras that stay attached, and any handles open on them, are left alone.
+ *
+ * Rescans requested while one is still waiting to run are coalesced into it, so a burst of requests costs one scan.
+ *
+ * Scanning rebuilds the driver's list of devices, which is global, and which the handles of open cameras refer to.  No
+ * scan therefore runs while a camera is being opened or closed, nor at all while any camera is open, since an open
+ * camera may be exposing or streaming on a thread of its own at any moment; cameras are opened & closed through
+ * openCamera() and closeCamera() for that.  A scan due meanwhile is skipped, and the timer catches up once every camera
+ * is closed.
+ *
+ * The signals are emitted from the watcher's thread.
+ */
+class DeviceWatcher : public QObject
+{
+   Q_OBJECT
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+   Q_DISABLE_COPY_MOVE(DeviceWatcher)
+#endif
+
+public:
+   /*!
+    * Something that lists the ids of the attached cameras; called on the watcher's thread.
+    */
+   using Scanner = std::function<QStringList()>;
+
+   /*!
+    * Creates the watcher; nothing is scanned until start() is called.
+    *
+    * @param scanner lists the attached cameras; a stand-in may be given in place of the driver.
+    * @param parent the owner of the watcher.
+    */
+   explicit DeviceWatcher(Scanner scanner = scanDriver, QObject * parent = nullptr);
+   ~DeviceWatcher() override;
+
+   /*!
+    * The ids of the cameras attached as of the last scan.
+    */
+   [[nodiscard]] auto cameras() const -> QStringList;
+
+   /*!
+    * Closes a camera opened with openCamera(); no scan runs meanwhile.
+    *
+    * @param close closes the camera, and returns whether it did.
+    * @return What close returned.
+    */
+   static auto        closeCamera(const std::function<bool()> & close) -> bool;
+
+   /*!
+    * Opens a camera with no scan running; none runs from then on until it is closed with closeCamera().
+    *
+    * @param open opens the camera, and returns its handle, or nullptr if it could not.
+    * @return What open returned.
+    */
+   static auto        openCamera(const std::function<qhyccd_handle *()> & open) -> qhyccd_handle *;
+
+   /*!
+    * Lists the cameras the QHYCCD driver can see.  The driver must have been initialized.
+    *
+    * @return The ids of the attached cameras.
+    */
+   static auto        scanDriver() -> QStringList;
+
+public slots:
+   /*!
+    * Requests a scan, as soon as the watcher's thread is free.
+    */
+   void rescan();
+
+   /*!
+    * Scans now, then every DeviceScanInterval milliseconds.
+    */
+   void start();
+   void stop();
+
+signals:
+   void cameraAdded(QString id);
+   void cameraRemoved(QString id);
+
+   /*!
+    * Emitted after cameraAdded() and cameraRemoved(), once per scan that found a difference.
+    */
+   void camerasChanged(QStringList cameras);
+
+private:
+   void                                scan();
+
+   Scanner                             m_scanner;
+   std::unique_ptr<CameraCommandQueue> m_commandQueue;
+   QTimer                              m_timer;
+   std::atomic<bool>                   m_scanPending;
+
+   // Only touched on the queue's thread, except for the copy behind cameras().
+   QSet<QString>                       m_known;
+   mutable QMutex                      m_camerasMutex;
+   QStringList                         m_cameras;
+};
@@ -0,0 +1,209 @@
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "ExposureWorker.hpp"
+
+#include "Calibrator.hpp"
+#include "Config.h"
+#include "DefectMap.hpp"
+#include "FitsWriter.hpp"
+#include "FramePool.hpp"
+#include "FrameScorer.hpp"
+#include "FrameStatistics.hpp"
+#include "TransferMeter.hpp"
+#include <QDateTime>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include <QThread>
+#include <utility>
+
+#include <qhyccd.h>
+
+/* ***************************************************************************************************************** */
+// MARK: - ctors & dtors
+/* ***************************************************************************************************************** */
+ExposureWorker::ExposureWorker(std::shared_ptr<TransferMeter> transferMeter, QObject * parent)
+   : QObject(parent)
+   , m_busPriority(BusArbiter::Bulk)
+   , m_transferMeter(std::move(transferMeter))
+   , m_busy(false)
+   , m_cancelRequested(false)
+   , m_handle(nullptr)
+   , m_bayerPattern(Frame::Monochrome)
+   , m_sequence(0)
+{
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Public methods
+/* ***************************************************************************************************************** */
+void ExposureWorker::cancel()
+{
+   m_cancelRequested = true;
+   auto * cameraHandle = m_handle.load();
+   if (m_busy && cameraHandle != nullptr) {
+      CancelQHYCCDExposingAndReadout(cameraHandle);
+   }
+}
+
+auto ExposureWorker::isBusy() const -> bool
+{
+   return m_busy;
+}
+
+auto ExposureWorker::isCalibrating() const -> bool
+{
+   return std::atomic_load(&m_calibrator) != nullptr;
+}
+
+void ExposureWorker::prepare(qhyccd_handle *            cameraHandle,
+                             std::shared_ptr<FramePool> framePool,
+                             Frame::BayerPattern        bayerPattern)
+{
+   QMutexLocker locker(&m_exposureMutex);
+   m_handle       = cameraHandle;
+   m_framePool    = cameraHandle == nullptr ? nullptr : std::move(framePool);
+   m_bayerPattern = bayerPattern;
+}
+
+void ExposureWorker::setBusArbiter(std::shared_ptr<BusArbiter> busArbiter, BusArbiter::Priority priority)
+{
+   m_busPriority = priority;
+   std::atomic_store(&m_busArbiter, std::move(busArbiter));
+}
+
+void ExposureWorker::setCalibrator(std::shared_ptr<Calibrator> calibrator)
+{
+   std::atomic_store(&m_calibrator, std::move(calibrator));
+}
+
+void ExposureWorker::setDefectMap(std::shared_ptr<const DefectMap> defectMap)
+{
+   std::atomic_store(&m_defectMap, std::move(defectMap));
+}
+
+void ExposureWorker::setFitsWriter(std::shared_ptr<FitsWriter> fitsWriter)
+{
+   std::atomic_store(&m_fitsWriter, std::move(fitsWriter));
+}
+
+void ExposureWorker::setFrameScorer(std::shared_ptr<FrameScorer> frameScorer)
+{
+   std::atomic_store(&m_frameScorer, std::move(frameScorer));
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Public slots
+/* ***************************************************************************************************************** */
+void ExposureWorker::expose(double seconds)
+{
+   QMutexLocker locker(&m_exposureMutex);
+   auto *       cameraHandle = m_handle.load();
+   if (cameraHandle == nullptr || !m_framePool) {
+      emit exposureFailed(tr("The camera is not ready to expose."));
+      return;
+   }
+   auto frame = m_framePool->acquire();
+   if (frame.isNull()) {
+      emit exposureFailed(tr("No frame buffer is free; release frames, or raise the memory budget."));
+      return;
+   }
+   m_cancelRequested = false;
+   m_busy            = true;
+
+   if (SetQHYCCDParam(cameraHandle, CONTROL_EXPOSURE, seconds * MicrosecondsPerSecond) != QHYCCD_SUCCESS) {
+      m_busy = false;
+      emit exposureFailed(tr("Could not set the exposure time to %1 seconds.").arg(seconds));
+      return;
+   }
+
+   auto          startTimestamp = QDateTime::currentMSecsSinceEpoch();
+   QElapsedTimer exposureTimer;
+   exposureTimer.start();
+   auto qhyResult = ExpQHYCCDSingleFrame(cameraHandle);
+   if (qhyResult == QHYCCD_ERROR) {
+      m_busy = false;
+      emit exposureFailed(tr("ExpQHYCCDSingleFrame failed."));
+      return;
+   }
+
+   // Sleep through the exposure in short steps so progress can be reported, and a cancel honoured promptly.
+   const auto exposureMilliseconds = static_cast<qint64>(seconds * MillisecondsPerSecond);
+   while (qhyResult != QHYCCD_READ_DIRECTLY && !m_cancelRequested && exposureTimer.elapsed() < exposureMilliseconds) {
+      emit exposureProgress(static_cast<double>(exposureTimer.elapsed()) / MillisecondsPerSecond, seconds);
+      QThread::msleep(
+        static_cast<unsigned long>(qMin(ExposureProgressInterval, exposureMilliseconds - exposureTimer.elapsed())));
+   }
+   if (m_cancelRequested) {
+      CancelQHYCCDExposingAndReadout(cameraHandle);
+      m_busy = false;
+      emit exposureFailed(tr("The exposure was cancelled."));
+      return;
+   }
+   emit exposureProgress(seconds, seconds);
+   emit readoutStarted();
+
+   quint32 width{ 0 };
+   quint32 height{ 0 };
+   quint32 bitsPerPixel{ 0 };
+   quint32 channels{ 0 };
+   {
+      BusArbiter::Transfer transfer(std::atomic_load(&m_busArbiter), m_busPriority, m_transferMeter.get());
+      qhyResult = GetQHYCCDSingleFrame(cameraHandle, &width, &height, &bitsPerPixel, &channels, frame.data());
+      if (qhyResult == QHYCCD_SUCCESS) {
+         frame.setGeometry(width, height, bitsPerPixel, channels);
+         transfer.complete(frame.length());
+      }
+   }
+   m_busy = false;
+   if (qhyResult == QHYCCD_SUCCESS) {
+      const auto defectMap = std::atomic_load(&m_defectMap);
+      if (defectMap) {
+         defectMap->correct(frame);
+      }
+      frame.setBayerPattern(m_bayerPattern);
+      frame.setExposureDuration(seconds);
+      frame.setTimestamps(startTimestamp, QDateTime::currentMSecsSinceEpoch());
+      frame.setSequence(++m_sequence);
+      frame.setStatistics(FrameStatistics::measure(frame));
+      // Scored before it is published, as consumers treat a frame as read only; on a binned copy, so it is quick.
+      const auto frameScorer = std::atomic_load(&m_frameScorer);
+      if (frameScorer) {
+         frame.setQuality(frameScorer->score(frame));
+      }
+      emit frameReady(frame);
+
+      // The raw frame is out for display first; calibrating it only delays the frame to save.  The writer only queues.
+      const auto fitsWriter = std::atomic_load(&m_fitsWriter);
+      const auto calibrator = std::atomic_load(&m_calibrator);
+      if (fitsWriter && !calibrator) {
+         fitsWriter->write(frame);
+      }
+      if (calibrator) {
+         auto calibrated = calibrator->calibrate(frame);
+         if (calibrated.isNull()) {
+            qWarning() << "Frame" << frame.sequence()
+                       << "was not calibrated; the masters do not match it, or no buffer was free.";
+         } else {
+            // The masters hold the defects too, so the corrected pixels are off again once calibrated.
+            if (defectMap) {
+               defectMap->correct(calibrated);
+            }
+            calibrated.setStatistics(FrameStatistics::measure(calibrated)); // none for float frames
+            emit calibratedFrameReady(calibrated);
+            if (fitsWriter) {
+               fitsWriter->write(calibrated);
+            }
+         }
+      }
+   } else if (m_cancelRequested) {
+      emit exposureFailed(tr("The readout was cancelled."));
+   } else {
+      emit exposureFailed(tr("GetQHYCCDSingleFrame failed with code %1.").arg(qhyResult));
+   }
+}
+
@@ -0,0 +1,146 @@
+#pragma once
+
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "BusArbiter.hpp"
+#include "Frame.hpp"
+#include <atomic>
+#include <memory>
+#include <QMutex>
+#include <QObject>
+
+class Calibrator;
+class DefectMap;
+class FitsWriter;
+class FramePool;
+class FrameScorer;
+class TransferMeter;
+
+using qhyccd_handle = void;
+
+/*! \brief Runs single frame exposures for a QHYCamera.
+ *
+ * An instance of this class lives on a dedicated thread owned by the camera, so that the blocking
+ * ExpQHYCCDSingleFrame/GetQHYCCDSingleFrame calls never run on the GUI thread.  Frames are downloaded into buffers
+ * from the camera's FramePool, sized once from the maximum frame length reported by the driver, so a readout never
+ * allocates.
+ */
+class ExposureWorker : public QObject
+{
+   Q_OBJECT
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+   Q_DISABLE_COPY_MOVE(ExposureWorker)
+#endif
+
+public:
+   /*!
+    * Creates the worker.
+    *
+    * @param transferMeter where downloads are accounted for; shared with the camera's other worker.
+    * @param parent the owner of the worker.
+    */
+   explicit ExposureWorker(std::shared_ptr<TransferMeter> transferMeter, QObject * parent = nullptr);
+   ~ExposureWorker() override = default;
+
+   /*!
+    * Requests that the exposure or readout in progress, if any, be aborted.  Safe to call from any thread.
+    */
+   void               cancel();
+
+   /*!
+    * Flag to track if an exposure or readout is in progress.  Safe to call from any thread.
+    * @return If the worker is busy.
+    */
+   [[nodiscard]] auto isBusy() const -> bool;
+
+   /*!
+    * If a calibrator is set.  Safe to call from any thread.
+    */
+   [[nodiscard]] auto isCalibrating() const -> bool;
+
+   /*!
+    * Sets the camera to expose with, and where to download to.  Blocks while an exposure is in progress.
+    *
+    * @param cameraHandle the open camera, or nullptr to detach the worker from the camera.
+    * @param framePool the pool to draw frames from.
+    * @param bayerPattern the colour filter array of the sensor, for the current read mode.
+    */
+   void               prepare(qhyccd_handle *            cameraHandle,
+                              std::shared_ptr<FramePool> framePool,
+                              Frame::BayerPattern        bayerPattern);
+
+   /*!
+    * Sets the arbiter that orders downloads on the camera's USB bus.  Safe to call from any thread, even mid-download;
+    * the next download picks the change up.
+    *
+    * @param busArbiter the arbiter, or nullptr to download without waiting on other cameras.
+    * @param priority the priority of the camera's downloads.
+    */
+   void               setBusArbiter(std::shared_ptr<BusArbiter> busArbiter, BusArbiter::Priority priority);
+
+   /*!
+    * Sets the calibration applied to each frame after it is published.  Safe to call from any thread; the next frame
+    * picks the change up.
+    *
+    * @param calibrator the calibration, or nullptr to publish raw frames only.
+    */
+   void               setCalibrator(std::shared_ptr<Calibrator> calibrator);
+
+   /*!
+    * Sets the bad pixels corrected in each frame, and in its calibrated copy, before either is published.  Safe to
+    * call from any thread; the next frame picks the change up.
+    *
+    * @param defectMap the bad pixels, or nullptr to leave frames as read.
+    */
+   void               setDefectMap(std::shared_ptr<const DefectMap> defectMap);
+
+   /*!
+    * Sets the writer each frame is queued to once it is published; its calibrated copy instead, while a calibrator is
+    * set.  Safe to call from any thread; the next frame picks the change up, and a frame being queued holds its own
+    * reference to the writer.
+    *
+    * @param fitsWriter the writer, or nullptr to save nothing.
+    */
+   void               setFitsWriter(std::shared_ptr<FitsWriter> fitsWriter);
+
+   /*!
+    * Sets the scorer that judges each frame before it is published; the quality travels in the frame, and its
+    * calibrated copy.  Safe to call from any thread; the next frame picks the change up.
+    *
+    * @param frameScorer the scorer, or nullptr to publish frames unscored.
+    */
+   void               setFrameScorer(std::shared_ptr<FrameScorer> frameScorer);
+
+public slots:
+   void expose(double seconds);
+
+signals:
+   /*!
+    * A frame calibrated by the calibrator, following the frameReady() of its raw frame; this is the frame to save.
+    */
+   void calibratedFrameReady(Frame frame);
+   void exposureFailed(QString reason);
+   void exposureProgress(double elapsed, double duration);
+   void frameReady(Frame frame);
+   void readoutStarted();
+
+private:
+   QMutex                             m_exposureMutex;
+   std::shared_ptr<BusArbiter>        m_busArbiter;
+   std::atomic<BusArbiter::Priority>  m_busPriority;
+   std::shared_ptr<Calibrator>        m_calibrator;
+   std::shared_ptr<const DefectMap>   m_defectMap;
+   std::shared_ptr<FitsWriter>        m_fitsWriter;
+   std::shared_ptr<FramePool>         m_framePool;
+   std::shared_ptr<FrameScorer>       m_frameScorer;
+   std::shared_ptr<TransferMeter>     m_transferMeter;
+   std::atomic_bool                   m_busy;
+   std::atomic_bool                   m_cancelRequested;
+   std::atomic<qhyccd_handle *>       m_handle;
+   Frame::BayerPattern                m_bayerPattern;
+   quint64                            m_sequence;
+};
@@ -0,0 +1,251 @@
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "FitsImage.hpp"
+
+#include "Config.h"
+#include <cstring>
+#include <QDebug>
+#include <QtEndian>
+
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>
+#endif
+
+namespace
+{
+/*!
+ * Converts one row of one channel, from big endian samples of type T.
+ */
+template <class T, class Raw = T>
+void convertRow(const uchar * source, int width, int channels, double zero, double scale, float * samples)
+{
+   for (int x = 0; x < width; ++x) {
+      const auto raw = qFromBigEndian<Raw>(source + static_cast<size_t>(x) * sizeof(Raw));
+      T          value;
+      std::memcpy(&value, &raw, sizeof(value)); // the floats are read through integers of their size
+      samples[static_cast<size_t>(x) * static_cast<size_t>(channels)] = static_cast<float>(zero + scale * value);
+   }
+}
+
+/*!
+ * The value of a header card, without its comment; a string without its quotes.
+ */
+auto cardValue(const QByteArray & card) -> QString
+{
+   auto value = QString::fromLatin1(card.mid(FitsValueColumn)).trimmed();
+   if (value.startsWith('\'')) {
+      QString text;
+      for (int index = 1; index < value.length(); ++index) {
+         if (value.at(index) == '\'') {
+            if (index + 1 < value.length() && value.at(index + 1) == '\'') {
+               text.append('\'');
+               ++index;
+               continue;
+            }
+            break;
+         }
+         text.append(value.at(index));
+      }
+      return text.trimmed();
+   }
+   const auto comment = value.indexOf('/');
+   return (comment < 0 ? value : value.left(comment)).trimmed();
+}
+} // namespace
+
+/* ***************************************************************************************************************** */
+// MARK: - ctors & dtors
+/* ***************************************************************************************************************** */
+FitsImage::FitsImage(const QString & path)
+   : m_file(path)
+{
+}
+
+FitsImage::~FitsImage()
+{
+   if (m_map != nullptr) {
+      m_file.unmap(const_cast<uchar *>(m_map)); // NOLINT(cppcoreguidelines-pro-type-const-cast)
+   }
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Public methods
+/* ***************************************************************************************************************** */
+auto FitsImage::bitsPerPixel() const -> int
+{
+   return m_bitsPerPixel;
+}
+
+auto FitsImage::channels() const -> int
+{
+   return m_channels;
+}
+
+auto FitsImage::dataLength() const -> qint64
+{
+   return static_cast<qint64>(m_width) * m_height * m_channels * (qAbs(m_bitsPerPixel) / BitDepth8);
+}
+
+auto FitsImage::exposureDuration() const -> double
+{
+   auto seconds = keyword(QString("EXPTIME"));
+   if (seconds.isEmpty()) {
+      seconds = keyword(QString("EXPOSURE"));
+   }
+   return seconds.toDouble();
+}
+
+auto FitsImage::height() const -> int
+{
+   return m_height;
+}
+
+auto FitsImage::keyword(const QString & name) const -> QString
+{
+   return m_keywords.value(name);
+}
+
+auto FitsImage::open(const QString & path) -> std::shared_ptr<const FitsImage>
+{
+   std::shared_ptr<FitsImage> image(new FitsImage(path));
+   if (!image->m_file.open(QIODevice::ReadOnly)) {
+      qWarning() << "Cannot open the FITS file" << path;
+      return nullptr;
+   }
+   if (!image->parseHeader()) {
+      qWarning() << "The FITS file" << path << "does not hold an image this can read";
+      return nullptr;
+   }
+   const auto length = image->m_dataOffset + image->dataLength();
+   if (image->m_file.size() < length) {
+      qWarning() << "The FITS file" << path << "is truncated";
+      return nullptr;
+   }
+   image->m_map = image->m_file.map(0, length);
+   if (image->m_map == nullptr) {
+      qWarning() << "Cannot map the FITS file" << path;
+      return nullptr;
+   }
+#if defined(Q_OS_UNIX) && defined(MADV_SEQUENTIAL)
+   madvise(const_cast<uchar *>(image->m_map), static_cast<size_t>(length), MADV_SEQUENTIAL); // NOLINT
+#endif
+   return image;
+}
+
+auto FitsImage::path() const -> QString
+{
+   return m_file.fileName();
+}
+
+void FitsImage::readRows(int firstRow, int lastRow, float * samples) const
+{
+   const auto rowSamples = static_cast<size_t>(m_width) * static_cast<size_t>(m_channels);
+   for (int row = firstRow; row < lastRow; ++row) {
+      auto * rowSamplesStart = samples + static_cast<size_t>(row - firstRow) * rowSamples;
+      for (int channel = 0; channel < m_channels; ++channel) {
+         const auto * source = rowAddress(row, channel);
+         auto *       target = rowSamplesStart + channel;
+         switch (m_bitsPerPixel) {
+         case 8:
+            convertRow<quint8>(source, m_width, m_channels, m_zero, m_scale, target);
+            break;
+         case 16:
+            convertRow<qint16>(source, m_width, m_channels, m_zero, m_scale, target);
+            break;
+         case 32:
+            convertRow<qint32>(source, m_width, m_channels, m_zero, m_scale, target);
+            break;
+         case 64:
+            convertRow<qint64>(source, m_width, m_channels, m_zero, m_scale, target);
+            break;
+         case -32:
+            convertRow<float, quint32>(source, m_width, m_channels, m_zero, m_scale, target);
+            break;
+         default:
+            convertRow<double, quint64>(source, m_width, m_channels, m_zero, m_scale, target);
+            break;
+         }
+      }
+   }
+}
+
+void FitsImage::releaseRows(int firstRow, int lastRow) const
+{
+#if defined(Q_OS_UNIX) && defined(MADV_DONTNEED)
+   if (firstRow >= lastRow) {
+      return;
+   }
+   const auto rowLength = static_cast<quintptr>(m_width) * static_cast<quintptr>(qAbs(m_bitsPerPixel) / BitDepth8);
+   const auto pageMask  = static_cast<quintptr>(PageSize - 1);
+   for (int channel = 0; channel < m_channels; ++channel) {
+      // Only whole pages of these rows; a page shared with a neighbouring row may still be in use.
+      const auto start = (reinterpret_cast<quintptr>(rowAddress(firstRow, channel)) + pageMask) & ~pageMask;
+      const auto end   = (reinterpret_cast<quintptr>(rowAddress(lastRow - 1, channel)) + rowLength) & ~pageMask;
+      if (end > start) {
+         madvise(reinterpret_cast<void *>(start), end - start, MADV_DONTNEED); // NOLINT
+      }
+   }
+#else
+   Q_UNUSED(firstRow)
+   Q_UNUSED(lastRow)
+#endif
+}
+
+auto FitsImage::width() const -> int
+{
+   return m_width;
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Private methods
+/* ***************************************************************************************************************** */
+auto FitsImage::parseHeader() -> bool
+{
+   qint64 blocks{ 0 };
+   bool   ended{ false };
+   while (!ended) {
+      const auto block = m_file.read(FitsBlockLength);
+      if (block.size() != FitsBlockLength) {
+         return false;
+      }
+      ++blocks;
+      for (int offset = 0; offset < FitsBlockLength && !ended; offset += FitsCardLength) {
+         const auto card = block.mid(offset, FitsCardLength);
+         const auto name = QString::fromLatin1(card.left(FitsKeywordLength)).trimmed();
+         if (blocks == 1 && offset == 0 && name != QString("SIMPLE")) {
+            return false;
+         }
+         if (name == QString("END")) {
+            ended = true;
+         } else if (card.mid(FitsKeywordLength, 2) == "= ") {
+            m_keywords.insert(name, cardValue(card));
+         }
+      }
+   }
+   m_dataOffset = blocks * FitsBlockLength;
+
+   const auto axes = keyword(QString("NAXIS")).toInt();
+   m_bitsPerPixel  = keyword(QString("BITPIX")).toInt();
+   m_width         = keyword(QString("NAXIS1")).toInt();
+   m_height        = keyword(QString("NAXIS2")).toInt();
+   m_channels      = axes == 3 ? keyword(QString("NAXIS3")).toInt() : 1;
+   if (m_keywords.contains(QString("BZERO"))) {
+      m_zero = keyword(QString("BZERO")).toDouble();
+   }
+   if (m_keywords.contains(QString("BSCALE"))) {
+      m_scale = keyword(QString("BSCALE")).toDouble();
+   }
+   const auto knownDepth = m_bitsPerPixel == 8 || m_bitsPerPixel == 16 || m_bitsPerPixel == 32
+                           || m_bitsPerPixel == 64 || m_bitsPerPixel == -32 || m_bitsPerPixel == -64;
+   return knownDepth && (axes == 2 || axes == 3) && m_width > 0 && m_height > 0 && m_channels > 0;
+}
+
+auto FitsImage::rowAddress(int row, int channel) const -> const uchar *
+{
+   const auto rowLength = static_cast<qint64>(m_width) * (qAbs(m_bitsPerPixel) / BitDepth8);
+   return m_map + m_dataOffset + (static_cast<qint64>(channel) * m_height + row) * rowLength;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include <memory>
+#include <QFile>
+#include <QHash>
+#include <QString>
+
+/*! \brief The image in the primary HDU of a FITS file, memory mapped for reading.
+ *
+ * Opening one parses the header and maps the file; no pixel is read until rows are asked for, and each read converts
+ * just those rows from big endian, applying BZERO and BSCALE.  Any BITPIX is read; a third axis holds the channels.
+ *
+ * The pages of rows that were read may be released again, so a pass over many large files needs no more memory than
+ * the rows in use.  Rows may be read from several threads at once.
+ */
+class FitsImage
+{
+public:
+   FitsImage(const FitsImage &) = delete;
+   FitsImage(FitsImage &&)      = delete;
+   ~FitsImage();
+
+   auto                      operator=(const FitsImage &) -> FitsImage & = delete;
+   auto                      operator=(FitsImage &&) -> FitsImage & = delete;
+
+   /*!
+    * The BITPIX of the data; 8, 16, 32 or 64 for integers, -32 or -64 for floats.
+    */
+   [[nodiscard]] auto        bitsPerPixel() const -> int;
+   [[nodiscard]] auto        channels() const -> int;
+
+   /*!
+    * The length of the pixel data in the file, in bytes.
+    */
+   [[nodiscard]] auto        dataLength() const -> qint64;
+
+   /*!
+    * The EXPTIME, or EXPOSURE, of the header in seconds; 0 if it has neither.
+    */
+   [[nodiscard]] auto        exposureDuration() const -> double;
+   [[nodiscard]] auto        height() const -> int;
+
+   /*!
+    * The value of a header keyword, with the quotes of a string stripped; empty if the header does not have it.
+    */
+   [[nodiscard]] auto        keyword(const QString & name) const -> QString;
+
+   /*!
+    * Maps a FITS file.
+    *
+    * @return The image, or nullptr if the file cannot be mapped, or its primary HDU is not a 2 or 3 axis image.
+    */
+   [[nodiscard]] static auto open(const QString & path) -> std::shared_ptr<const FitsImage>;
+   [[nodiscard]] auto        path() const -> QString;
+
+   /*!
+    * Reads rows as floats.
+    *
+    * @param firstRow the first row.
+    * @param lastRow one past the last row.
+    * @param samples where the (lastRow - firstRow) × width × channels samples go, row by row, with the channels of a
+    * pixel together as in a Frame.
+    */
+   void                      readRows(int firstRow, int lastRow, float * samples) const;
+
+   /*!
+    * Lets the system drop the pages of rows from memory; they are read from the file again if needed.
+    */
+   void                      releaseRows(int firstRow, int lastRow) const;
+   [[nodiscard]] auto        width() const -> int;
+
+private:
+   explicit FitsImage(const QString & path);
+
+   auto                      parseHeader() -> bool;
+   [[nodiscard]] auto        rowAddress(int row, int channel) const -> const uchar *;
+
+   QFile                     m_file;
+   const uchar *             m_map{ nullptr };
+   QHash<QString, QString>   m_keywords;
+   qint64                    m_dataOffset{ 0 };
+   int                       m_bitsPerPixel{ 0 };
+   int                       m_width{ 0 };
+   int                       m_height{ 0 };
+   int                       m_channels{ 1 };
+   double                    m_zero{ 0.0 };
+   double                    m_scale{ 1.0 };
+};
@@ -0,0 +1,451 @@
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "FitsWriter.hpp"
+
+#include "QHYCamera.hpp"
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <utility>
+
+#include <fitsio.h>
+
+#ifdef Q_OS_UNIX
+#include <time.h>
+#endif
+
+namespace
+{
+const QLatin1String RejectedDirectory("rejected");
+
+auto bayerPatternName(Frame::BayerPattern pattern) -> QString
+{
+   switch (pattern) {
+   case Frame::GBRG:
+      return QString("GBRG");
+   case Frame::GRBG:
+      return QString("GRBG");
+   case Frame::BGGR:
+      return QString("BGGR");
+   case Frame::RGGB:
+      return QString("RGGB");
+   default:
+      return QString();
+   }
+}
+
+auto verdictName(FrameQuality::Verdict verdict) -> QString
+{
+   switch (verdict) {
+   case FrameQuality::Accepted:
+      return QString("ACCEPTED");
+   case FrameQuality::Marked:
+      return QString("MARKED");
+   case FrameQuality::Diverted:
+      return QString("DIVERTED");
+   case FrameQuality::Dropped:
+      return QString("DROPPED");
+   default:
+      return QString();
+   }
+}
+
+/*!
+ * The CPU time of the calling thread, in microseconds; 0 where unknown.
+ */
+auto threadCpuMicroseconds() -> qint64
+{
+#ifdef Q_OS_UNIX
+   timespec time{};
+   if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time) == 0) {
+      return static_cast<qint64>(time.tv_sec) * 1000000 + time.tv_nsec / 1000;
+   }
+#endif
+   return 0;
+}
+
+/*!
+ * An ISO 8601 UTC time, to the millisecond, as DATE-OBS wants it.
+ */
+auto fitsDate(qint64 milliseconds) -> QString
+{
+   return QDateTime::fromMSecsSinceEpoch(milliseconds, Qt::UTC).toString(QString("yyyy-MM-ddTHH:mm:ss.zzz"));
+}
+
+// CFITSIO takes values, and string values above all, through non-const pointers; it does not write through them.
+void writeKey(fitsfile * file, const char * name, const QString & value, const char * comment, int * status)
+{
+   auto bytes = value.toLatin1();
+   fits_write_key(file, TSTRING, name, bytes.data(), comment, status);
+}
+
+void writeKey(fitsfile * file, const char * name, double value, const char * comment, int * status)
+{
+   fits_write_key(file, TDOUBLE, name, &value, comment, status);
+}
+
+void writeKey(fitsfile * file, const char * name, int value, const char * comment, int * status)
+{
+   fits_write_key(file, TINT, name, &value, comment, status);
+}
+
+void writeKey(fitsfile * file, const char * name, qint64 value, const char * comment, int * status)
+{
+   LONGLONG longValue{ value };
+   fits_write_key(file, TLONGLONG, name, &longValue, comment, status);
+}
+
+/*!
+ * Writes the pixels; FITS keeps each channel in a plane of its own, where a Frame keeps a pixel's channels together.
+ */
+template <class Sample>
+void writePixels(fitsfile * file, int dataType, const Frame & frame, int * status)
+{
+   const auto * samples  = reinterpret_cast<const Sample *>(frame.constData()); // NOLINT
+   const auto   channels = static_cast<qint64>(qMax(frame.channels(), 1U));
+   const auto   pixels   = static_cast<qint64>(frame.width()) * frame.height();
+   if (channels == 1) {
+      fits_write_img(file, dataType, 1, pixels, const_cast<Sample *>(samples), status); // NOLINT
+      return;
+   }
+   std::vector<Sample> plane(static_cast<size_t>(pixels));
+   for (qint64 channel = 0; channel < channels && *status == 0; ++channel) {
+      for (qint64 pixel = 0; pixel < pixels; ++pixel) {
+         plane[static_cast<size_t>(pixel)] = samples[pixel * channels + channel];
+      }
+      fits_write_img(file, dataType, 1 + channel * pixels, pixels, plane.data(), status);
+   }
+}
+} // namespace
+
+/* ***************************************************************************************************************** */
+// MARK: - Instrument
+/* ***************************************************************************************************************** */
+auto FitsWriter::Instrument::describe(const QHYCamera & camera) -> Instrument
+{
+   // Frames are always read unbinned.
+   const auto capabilities = camera.capabilities();
+   Instrument instrument;
+   instrument.camera      = camera.model();
+   instrument.firmware    = capabilities.firmwareVersion;
+   instrument.readMode    = camera.readMode();
+   instrument.pixelWidth  = capabilities.pixelWidth;
+   instrument.pixelHeight = capabilities.pixelHeight;
+   instrument.gain        = camera.gain();
+   instrument.offset      = camera.offset();
+   instrument.binning     = 1;
+   return instrument;
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - ctors & dtors
+/* ***************************************************************************************************************** */
+FitsWriter::FitsWriter(QString directory, QString prefix, int queueLength, int threads, QObject * parent)
+   : QObject(parent)
+   , m_directory(std::move(directory))
+   , m_prefix(std::move(prefix))
+   , m_queueLength(qMax(queueLength, 1))
+   , m_runningThreads(0)
+   , m_bytesAtLastReport(0)
+   , m_compression(Uncompressed)
+   , m_writing(0)
+   , m_stopping(false)
+   , m_bytes(0)
+   , m_cpuMicroseconds(0)
+   , m_dropped(0)
+   , m_failed(0)
+   , m_fileBytes(0)
+   , m_written(0)
+{
+   // A CFITSIO built without --enable-reentrant must only ever be in one call at a time.
+   const auto writers = isReentrant() ? qMax(threads, 1) : 1;
+   if (writers < threads) {
+      qWarning() << "CFITSIO is not reentrant, so the FITS files of" << m_prefix
+                 << "are written and compressed on one thread rather than" << threads;
+   }
+   for (int index = 0; index < writers; ++index) {
+      m_threads.emplace_back(QThread::create([this]() { drain(); }));
+      m_threads.back()->setObjectName(QString("FITS %1 %2").arg(m_prefix).arg(index + 1));
+      QObject::connect(m_threads.back().get(), &QThread::finished, this, [this]() {
+         if (--m_runningThreads == 0) {
+            emit finished();
+         }
+      });
+      m_threads.back()->start(QThread::LowPriority);
+      ++m_runningThreads;
+   }
+   qRegisterMetaType<FitsWriter::Statistics>();
+   m_statisticsTimer.setInterval(static_cast<int>(LiveStatisticsInterval));
+   QObject::connect(&m_statisticsTimer, &QTimer::timeout, this, &FitsWriter::reportStatistics);
+   m_statisticsTimer.start();
+   m_rateTimer.start();
+}
+
+FitsWriter::~FitsWriter()
+{
+   finish();
+   for (auto & thread : m_threads) {
+      thread->wait();
+   }
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Public methods
+/* ***************************************************************************************************************** */
+auto FitsWriter::compression() const -> Compression
+{
+   QMutexLocker locker(&m_mutex);
+   return m_compression;
+}
+
+auto FitsWriter::create(QString directory, QString prefix, int queueLength, int threads) -> std::shared_ptr<FitsWriter>
+{
+   return std::shared_ptr<FitsWriter>(
+     new FitsWriter(std::move(directory), std::move(prefix), queueLength, threads), [](FitsWriter * writer) {
+        QObject::connect(writer, &FitsWriter::finished, writer, &QObject::deleteLater);
+        writer->finish();
+     });
+}
+
+auto FitsWriter::directory() const -> QString
+{
+   return m_directory;
+}
+
+void FitsWriter::finish()
+{
+   QMutexLocker locker(&m_mutex);
+   m_stopping = true;
+   m_queueChanged.wakeAll();
+}
+
+auto FitsWriter::isReentrant() -> bool
+{
+   return fits_is_reentrant() != 0;
+}
+
+void FitsWriter::setCompression(Compression compression)
+{
+   QMutexLocker locker(&m_mutex);
+   m_compression = compression;
+}
+
+void FitsWriter::setInstrument(const Instrument & instrument)
+{
+   QMutexLocker locker(&m_mutex);
+   m_instrument = instrument;
+}
+
+auto FitsWriter::statistics() const -> Statistics
+{
+   Statistics statistics;
+   {
+      QMutexLocker locker(&m_mutex);
+      statistics.queued = static_cast<int>(m_queue.size()) + m_writing;
+   }
+   statistics.queueLength = m_queueLength;
+   statistics.written     = m_written;
+   statistics.dropped     = m_dropped;
+   statistics.failed      = m_failed;
+   const auto bytes       = m_bytes.load();
+   const auto fileBytes   = m_fileBytes.load();
+   if (fileBytes > 0) {
+      statistics.compressionRatio = static_cast<double>(bytes) / static_cast<double>(fileBytes);
+   }
+   if (statistics.written > 0) {
+      statistics.cpuMilliseconds
+        = static_cast<double>(m_cpuMicroseconds) / 1000.0 / static_cast<double>(statistics.written);
+   }
+   return statistics;
+}
+
+auto FitsWriter::threadCount() const -> int
+{
+   return static_cast<int>(m_threads.size());
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Public slots
+/* ***************************************************************************************************************** */
+auto FitsWriter::write(const Frame & frame) -> bool
+{
+   if (frame.isNull() || frame.quality().verdict == FrameQuality::Dropped) {
+      return true;
+   }
+   {
+      QMutexLocker locker(&m_mutex);
+      if (!m_stopping && static_cast<int>(m_queue.size()) < m_queueLength) {
+         m_queue.push_back({ frame, m_instrument, frame.isFloat() ? Uncompressed : m_compression });
+         m_queueChanged.wakeOne();
+         return true;
+      }
+   }
+   // No logging here; this is the capture thread, and the signal says it all.
+   ++m_dropped;
+   emit frameDropped(frame.sequence());
+   return false;
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Private methods
+/* ***************************************************************************************************************** */
+void FitsWriter::drain()
+{
+   QMutexLocker locker(&m_mutex);
+   // Stopping waits for the queue to empty; nothing accepted is lost.
+   while (!m_queue.empty() || !m_stopping) {
+      if (m_queue.empty()) {
+         m_queueChanged.wait(&m_mutex);
+         continue;
+      }
+      auto job = std::move(m_queue.front());
+      m_queue.pop_front();
+      ++m_writing;
+      locker.unlock();
+
+      const auto path     = pathFor(job);
+      const auto cpuStart = threadCpuMicroseconds();
+      if (writeFile(job, path)) {
+         m_cpuMicroseconds += static_cast<quint64>(threadCpuMicroseconds() - cpuStart);
+         m_bytes += static_cast<quint64>(job.frame.length());
+         m_fileBytes += static_cast<quint64>(QFileInfo(path).size());
+         ++m_written;
+         emit frameWritten(path);
+      } else {
+         ++m_failed;
+      }
+      // The frame's buffer goes back to its pool before the next is taken.
+      job.frame = Frame();
+
+      locker.relock();
+      --m_writing;
+   }
+}
+
+auto FitsWriter::pathFor(const Job & job) const -> QString
+{
+   // The start time keeps names unique when a new session's sequence numbers start again from 1.
+   const auto & frame = job.frame;
+   const auto   start = QDateTime::fromMSecsSinceEpoch(frame.startTimestamp(), Qt::UTC);
+   const auto   name  = QString("%1_%2_%3.%4")
+                         .arg(m_prefix)
+                         .arg(start.toString(QString("yyyyMMdd-HHmmss-zzz")))
+                         .arg(frame.sequence(), 6, 10, QChar('0'))
+                         .arg(job.compression == Uncompressed ? QString("fits") : QString("fits.fz"));
+   const auto directory = frame.quality().verdict == FrameQuality::Diverted
+                            ? QDir(m_directory).filePath(RejectedDirectory)
+                            : m_directory;
+   return QDir(directory).filePath(name);
+}
+
+void FitsWriter::reportStatistics()
+{
+   auto       statistics = this->statistics();
+   const auto bytes      = m_bytes.load();
+   const auto elapsed    = static_cast<double>(m_rateTimer.restart()) / MillisecondsPerSecond;
+   if (elapsed > 0.0) {
+      statistics.megabytesPerSecond = static_cast<double>(bytes - m_bytesAtLastReport) / BytesPerMegabyte / elapsed;
+   }
+   m_bytesAtLastReport = bytes;
+   emit statisticsChanged(statistics);
+}
+
+auto FitsWriter::writeFile(const Job & job, const QString & path) -> bool
+{
+   const auto & frame = job.frame;
+   if (!QDir().mkpath(QFileInfo(path).absolutePath())) {
+      emit writeFailed(path, tr("The directory could not be created."));
+      return false;
+   }
+
+   int imageType{ BYTE_IMG };
+   int dataType{ TBYTE };
+   if (frame.isFloat()) {
+      imageType = FLOAT_IMG;
+      dataType  = TFLOAT;
+   } else if (frame.bytesPerSample() == 2) {
+      imageType = USHORT_IMG;
+      dataType  = TUSHORT;
+   }
+   const auto channels = qMax(frame.channels(), 1U);
+   long       axes[3]{ static_cast<long>(frame.width()), // NOLINT(modernize-avoid-c-arrays)
+                     static_cast<long>(frame.height()),
+                     static_cast<long>(channels) };
+
+   // An existing file is never overwritten; the create fails instead.
+   fitsfile * file{ nullptr };
+   int        status{ 0 };
+   fits_create_file(&file, QFile::encodeName(path).constData(), &status);
+   if (job.compression != Uncompressed) {
+      // The image goes into a compressed extension, a tile at a time as the pixels are written; CFITSIO's default
+      // tiles are a row for Rice, and 16 rows for HCompress, which needs them two dimensional.  Both are lossless for
+      // integer pixels.
+      fits_set_compression_type(file, job.compression == Rice ? RICE_1 : HCOMPRESS_1, &status);
+   }
+   fits_create_img(file, imageType, channels > 1 ? 3 : 2, axes, &status);
+
+   const auto & instrument = job.instrument;
+   writeKey(file, "INSTRUME", instrument.camera, "camera model", &status);
+   writeKey(file, "FIRMWARE", instrument.firmware, "camera firmware version", &status);
+   writeKey(file, "READMODE", instrument.readMode, "camera read mode", &status);
+   writeKey(file, "XPIXSZ", instrument.pixelWidth * instrument.binning, "binned pixel width in microns", &status);
+   writeKey(file, "YPIXSZ", instrument.pixelHeight * instrument.binning, "binned pixel height in microns", &status);
+   writeKey(file, "XBINNING", instrument.binning, "binning along the rows", &status);
+   writeKey(file, "YBINNING", instrument.binning, "binning along the columns", &status);
+   writeKey(file, "GAIN", instrument.gain, "camera gain setting", &status);
+   writeKey(file, "OFFSET", instrument.offset, "camera offset setting", &status);
+   const auto pattern = bayerPatternName(frame.bayerPattern());
+   if (!pattern.isEmpty()) {
+      writeKey(file, "BAYERPAT", pattern, "colour filter array, from the top left", &status);
+      writeKey(file, "XBAYROFF", 0, "column offset of the pattern", &status);
+      writeKey(file, "YBAYROFF", 0, "row offset of the pattern", &status);
+   }
+   writeKey(file, "EXPTIME", frame.exposureDuration(), "exposure in seconds", &status);
+   writeKey(file, "DATE-OBS", fitsDate(frame.startTimestamp()), "UTC start of the exposure", &status);
+   writeKey(file, "DATE-END", fitsDate(frame.readoutTimestamp()), "UTC start of the readout", &status);
+   writeKey(file, "SEQUENCE", static_cast<qint64>(frame.sequence()), "frame number within the session", &status);
+   writeKey(file, "SWCREATE", QString("QHYAstroImager %1").arg(VERSION), "software that wrote the file", &status);
+
+   const auto quality = frame.quality();
+   if (quality.isScored()) {
+      writeKey(file, "QUALITY", verdictName(quality.verdict), "verdict of the frame scorer", &status);
+      writeKey(file, "STARS", quality.stars, "stars found", &status);
+      writeKey(file, "FWHM", quality.fwhm, "median star FWHM, in pixels", &status);
+      writeKey(file, "ECCENTR", quality.eccentricity, "median star eccentricity", &status);
+      writeKey(file, "SKYLEVEL", quality.background, "background level, in ADU", &status);
+      if (quality.isRejected()) {
+         writeKey(file, "REJECTED", quality.describeReasons(), "why the scorer rejected the frame", &status);
+      }
+   }
+
+   if (frame.isFloat()) {
+      writePixels<float>(file, dataType, frame, &status);
+   } else if (frame.bytesPerSample() == 2) {
+      writePixels<quint16>(file, dataType, frame, &status);
+   } else {
+      writePixels<quint8>(file, dataType, frame, &status);
+   }
+
+   const auto written = status;
+   if (written == 0) {
+      fits_close_file(file, &status);
+   } else if (file != nullptr) {
+      status = 0;
+      fits_delete_file(file, &status); // a partial file would pass for a frame
+   }
+   if (written != 0 || status != 0) {
+      char text[FLEN_STATUS]{}; // NOLINT
+      fits_get_errstatus(written != 0 ? written : status, text);
+      qWarning() << "Could not write" << path << ":" << text;
+      emit writeFailed(path, QString::fromLatin1(text));
+      return false;
+   }
+   return true;
+}
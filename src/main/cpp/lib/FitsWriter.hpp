@@ -0,0 +1,211 @@
+#pragma once
+
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "Config.h"
+#include "Frame.hpp"
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <QElapsedTimer>
+#include <QMetaType>
+#include <QMutex>
+#include <QObject>
+#include <QString>
+#include <QThread>
+#include <QTimer>
+#include <QWaitCondition>
+#include <vector>
+
+class QHYCamera;
+
+/*! \brief Saves frames as FITS files, on threads of its own, so that capture never waits on the disk.
+ *
+ * write() only queues the frame, and returns at once; it may be called from the capture thread itself.  The queue is
+ * bounded: a frame that arrives with it full is not written, and is counted and reported through frameDropped(), rather
+ * than holding up capture.  Queued frames hold their pool buffers, so the bound also keeps capture from running out of
+ * buffers behind a slow disk.
+ *
+ * Each file's header describes the camera, from its Capabilities and settings at the time setInstrument() was last
+ * called, and the frame itself; its exposure, timestamps, Bayer pattern and, if it was scored, its FrameQuality.  A
+ * frame the scorer dropped is not written, and one it diverted goes to a "rejected" directory beside the rest.
+ *
+ * Integer frames may be written tile compressed, losslessly, which typically shrinks 16 bit frames two to three times;
+ * each writing thread compresses a frame of its own, so more threads buy more compression throughput on a slow disk.
+ * That needs a CFITSIO built with --enable-reentrant; with any other, the writer falls back to one thread, and says so.
+ * statistics() reports the ratio achieved, and the CPU time a frame costs, so that the trade can be made per machine.
+ */
+class FitsWriter : public QObject
+{
+   Q_OBJECT
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+   Q_DISABLE_COPY_MOVE(FitsWriter)
+#endif
+
+public:
+   /*! \brief How the pixels are stored.  A compressed file holds a tile compressed image extension, as fpack writes,
+    * and is named .fits.fz.
+    */
+   enum Compression
+   {
+      Uncompressed,
+      Rice,     // fast; the usual choice
+      HCompress // a little smaller, at a few times the CPU time
+   };
+
+   /*! \brief What the headers say of the camera; the same for every frame until the camera's settings change.
+    */
+   struct Instrument
+   {
+      QString camera;             // INSTRUME
+      QString firmware;           // FIRMWARE
+      QString readMode;           // READMODE
+      double  pixelWidth{ 0.0 };  // XPIXSZ, in microns, binning included
+      double  pixelHeight{ 0.0 }; // YPIXSZ, in microns, binning included
+      double  gain{ 0.0 };
+      double  offset{ 0.0 };
+      int     binning{ 1 }; // XBINNING & YBINNING
+
+      /*!
+       * The camera as it is now set up.
+       */
+      [[nodiscard]] static auto describe(const QHYCamera & camera) -> Instrument;
+   };
+
+   struct Statistics
+   {
+      int     queued{ 0 };
+      int     queueLength{ 0 };
+      quint64 written{ 0 };
+      quint64 dropped{ 0 }; // turned away with the queue full
+      quint64 failed{ 0 };
+      double  megabytesPerSecond{ 0.0 }; // written, over the last LiveStatisticsInterval
+      double  compressionRatio{ 1.0 };   // of the pixels to the files, over the frames written
+      double  cpuMilliseconds{ 0.0 };    // to write a frame, compression included, over the frames written
+   };
+
+   /*!
+    * Creates a writer, and starts its threads.
+    *
+    * @param directory where the files go; it is created if need be.
+    * @param prefix the start of every file name, such as the camera's id.
+    * @param queueLength the frames that may wait to be written.
+    * @param threads the frames written at once; more than one helps on a fast disk, or with large frames.
+    */
+   FitsWriter(QString directory, QString prefix, int queueLength, int threads, QObject * parent = nullptr);
+
+   /*!
+    * Writes the frames still queued, then stops the threads.
+    */
+   ~FitsWriter() override;
+
+   [[nodiscard]] auto compression() const -> Compression;
+
+   /*!
+    * Creates a writer to be shared between threads, such as the GUI's and the one capturing.  Releasing the last
+    * reference, from any thread, calls finish(); the writer deletes itself on its own thread once the frames queued
+    * are written, so neither thread waits on the disk.
+    *
+    * @see FitsWriter()
+    */
+   [[nodiscard]] static auto create(QString directory, QString prefix, int queueLength, int threads)
+     -> std::shared_ptr<FitsWriter>;
+   [[nodiscard]] auto directory() const -> QString;
+
+   /*!
+    * Stops taking frames, and returns at once; those queued are still written, and finished() is emitted once they
+    * are.  Destroying the writer from then on does not wait.
+    */
+   void               finish();
+
+   /*!
+    * Flag to tell if CFITSIO may be called from several threads at once.  When it may not, every writer has a single
+    * thread, so frames are written, and compressed, one at a time.
+    */
+   [[nodiscard]] static auto isReentrant() -> bool;
+
+   /*!
+    * Sets how the frames queued from now on are stored.  Float frames are always written uncompressed, as CFITSIO
+    * would quantize them; and masters are only built from uncompressed frames.  Safe to call from any thread.
+    */
+   void               setCompression(Compression compression);
+
+   /*!
+    * Sets what the headers of the frames written from now on say of the camera.  Safe to call from any thread.
+    */
+   void               setInstrument(const Instrument & instrument);
+
+   /*!
+    * Safe to call from any thread.
+    */
+   [[nodiscard]] auto statistics() const -> Statistics;
+
+   /*!
+    * The frames written at once; one, whatever was asked for, when CFITSIO is not reentrant.
+    */
+   [[nodiscard]] auto threadCount() const -> int;
+
+public slots:
+   /*!
+    * Queues a frame to be written.  Never blocks; safe to call from any thread, capture's included.
+    *
+    * @return False if the queue was full, and the frame is not written; true otherwise, even for a frame the scorer
+    * dropped, which is deliberately not written.
+    */
+   auto write(const Frame & frame) -> bool;
+
+signals:
+   void finished();
+   void frameDropped(quint64 sequence);
+   void frameWritten(QString path);
+   void writeFailed(QString path, QString reason);
+
+   /*!
+    * Emitted every LiveStatisticsInterval.
+    */
+   void statisticsChanged(FitsWriter::Statistics statistics);
+
+private:
+   struct Job
+   {
+      Frame       frame;
+      Instrument  instrument;
+      Compression compression;
+   };
+
+   void                                  drain();
+   [[nodiscard]] auto                    pathFor(const Job & job) const -> QString;
+   void                                  reportStatistics();
+   auto                                  writeFile(const Job & job, const QString & path) -> bool;
+
+   QString                               m_directory;
+   QString                               m_prefix;
+   int                                   m_queueLength;
+   std::vector<std::unique_ptr<QThread>> m_threads;
+   int                                   m_runningThreads;
+   QTimer                                m_statisticsTimer;
+   QElapsedTimer                         m_rateTimer;
+   quint64                               m_bytesAtLastReport;
+
+   // Shared with the writing threads, under the lock.
+   mutable QMutex                        m_mutex;
+   QWaitCondition                        m_queueChanged;
+   std::deque<Job>                       m_queue;
+   Instrument                            m_instrument;
+   Compression                           m_compression;
+   int                                   m_writing; // frames taken off the queue, not yet written
+   bool                                  m_stopping;
+
+   std::atomic<quint64>                  m_bytes;
+   std::atomic<quint64>                  m_cpuMicroseconds; // spent writing the frames written
+   std::atomic<quint64>                  m_dropped;
+   std::atomic<quint64>                  m_failed;
+   std::atomic<quint64>                  m_fileBytes;
+   std::atomic<quint64>                  m_written;
+};
+
+Q_DECLARE_METATYPE(FitsWriter::Statistics)
@@ -0,0 +1,218 @@
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "Frame.hpp"
+
+#include "Config.h"
+#include "DefectMap.hpp"
+#include "FrameData.hpp"
+#include <QThread>
+#include <utility>
+
+/* ***************************************************************************************************************** */
+// MARK: - ctors & dtors
+/* ***************************************************************************************************************** */
+Frame::Frame(std::shared_ptr<FrameData> frameData)
+   : d(std::move(frameData))
+{
+}
+
+FrameData::FrameData(std::shared_ptr<FramePool> framePool, FramePool::Block frameBlock)
+   : pool(std::move(framePool))
+   , block(frameBlock)
+{
+}
+
+FrameData::~FrameData()
+{
+   pool->recycle(block);
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Public methods
+/* ***************************************************************************************************************** */
+auto Frame::bayerPattern() const -> BayerPattern
+{
+   return d ? d->bayerPattern : Monochrome;
+}
+
+auto Frame::bitsPerPixel() const -> quint32
+{
+   return d ? d->bitsPerPixel : 0;
+}
+
+auto Frame::bytesPerSample() const -> int
+{
+   if (bitsPerPixel() > BitDepth16) {
+      return 4;
+   }
+   return bitsPerPixel() > BitDepth8 ? 2 : 1;
+}
+
+auto Frame::capacity() const -> qint64
+{
+   return d ? d->pool->bufferLength() : 0;
+}
+
+auto Frame::channels() const -> quint32
+{
+   return d ? d->channels : 0;
+}
+
+auto Frame::constData() const -> const quint8 *
+{
+   return d ? d->block.pixels : nullptr;
+}
+
+void Frame::correctDefects()
+{
+   if (!d) {
+      return;
+   }
+   auto pending = static_cast<int>(FrameData::CorrectionPending);
+   if (d->defectCorrection.compare_exchange_strong(pending, FrameData::Correcting, std::memory_order_acquire)) {
+      auto defectMap = std::move(d->defects);
+      defectMap->correct(*this);
+      d->defectCorrection.store(FrameData::Corrected, std::memory_order_release);
+   } else {
+      // Another consumer got here first; the index is walked, never the frame, so the wait is short.
+      while (d->defectCorrection.load(std::memory_order_acquire) == FrameData::Correcting) {
+         QThread::yieldCurrentThread();
+      }
+   }
+}
+
+auto Frame::data() -> quint8 *
+{
+   return d ? d->block.pixels : nullptr;
+}
+
+auto Frame::exposureDuration() const -> double
+{
+   return d ? d->exposureDuration : 0.0;
+}
+
+auto Frame::height() const -> quint32
+{
+   return d ? d->height : 0;
+}
+
+auto Frame::isFloat() const -> bool
+{
+   return bitsPerPixel() == BitDepthFloat;
+}
+
+auto Frame::isNull() const -> bool
+{
+   return !d;
+}
+
+auto Frame::length() const -> qint64
+{
+   return static_cast<qint64>(width()) * height() * qMax(channels(), 1U) * bytesPerSample();
+}
+
+auto Frame::poolGeneration() const -> quint64
+{
+   return d ? d->pool->generation() : 0;
+}
+
+auto Frame::quality() const -> FrameQuality
+{
+   return d ? d->quality : FrameQuality();
+}
+
+auto Frame::readoutTimestamp() const -> qint64
+{
+   return d ? d->readoutTimestamp : 0;
+}
+
+auto Frame::sequence() const -> quint64
+{
+   return d ? d->sequence : 0;
+}
+
+auto Frame::startTimestamp() const -> qint64
+{
+   return d ? d->startTimestamp : 0;
+}
+
+auto Frame::statistics() const -> FrameStatistics
+{
+   return d ? d->statistics : FrameStatistics();
+}
+
+auto Frame::width() const -> quint32
+{
+   return d ? d->width : 0;
+}
+
+void Frame::setBayerPattern(BayerPattern pattern)
+{
+   if (d) {
+      d->bayerPattern = pattern;
+   }
+}
+
+void Frame::setDefectMap(std::shared_ptr<const DefectMap> defectMap)
+{
+   if (d) {
+      const auto correction = defectMap ? FrameData::CorrectionPending : FrameData::Corrected;
+      d->defects            = std::move(defectMap);
+      d->defectCorrection.store(correction, std::memory_order_relaxed);
+   }
+}
+
+void Frame::setExposureDuration(double seconds)
+{
+   if (d) {
+      d->exposureDuration = seconds;
+   }
+}
+
+void Frame::setGeometry(quint32 width, quint32 height, quint32 bitsPerPixel, quint32 channels)
+{
+   if (d) {
+      d->width        = width;
+      d->height       = height;
+      d->bitsPerPixel = bitsPerPixel;
+      d->channels     = channels;
+   }
+}
+
+void Frame::setQuality(const FrameQuality & quality)
+{
+   if (d) {
+      d->quality = quality;
+   }
+}
+
+void Frame::setSequence(quint64 sequence)
+{
+   if (d) {
+      d->sequence = sequence;
+   }
+}
+
+void Frame::setStatistics(const FrameStatistics & statistics)
+{
+   if (d) {
+      d->statistics = statistics;
+   }
+}
+
+void Frame::setTimestamps(qint64 start, qint64 readout)
+{
+   if (d) {
+      d->startTimestamp   = start;
+      d->readoutTimestamp = readout;
+   }
+}
+
+auto Frame::useCount() const -> long
+{
+   return d.use_count();
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "FrameQuality.hpp"
+#include "FrameStatistics.hpp"
+#include <memory>
+#include <QMetaType>
+
+class DefectMap;
+class FramePool;
+struct FrameData;
+
+/*! \brief A downloaded image, shared by reference count.
+ *
+ * Copying a Frame copies the handle, never the pixels; the display, writers and statistics all read the same buffer.
+ * The pixel buffer comes from a FramePool, and goes back to it when the last handle is released.  The producer fills
+ * the pixels and metadata before handing the frame out; consumers treat it as read only, save for correctDefects().
+ */
+class Frame
+{
+public:
+   enum BayerPattern
+   {
+      Monochrome = 0x00,
+      GBRG       = 0x01, // the values match the driver's BAYER_ID
+      GRBG       = 0x02,
+      BGGR       = 0x03,
+      RGGB       = 0x04
+   };
+
+   Frame() = default;
+
+   [[nodiscard]] auto bayerPattern() const -> BayerPattern;
+   [[nodiscard]] auto bitsPerPixel() const -> quint32;
+
+   /*!
+    * The number of bytes per sample; 1 or 2, or 4 for float samples.
+    */
+   [[nodiscard]] auto bytesPerSample() const -> int;
+
+   /*!
+    * The size of the pixel buffer, which is at least length().
+    */
+   [[nodiscard]] auto capacity() const -> qint64;
+   [[nodiscard]] auto channels() const -> quint32;
+   [[nodiscard]] auto constData() const -> const quint8 *;
+
+   /*!
+    * Corrects the bad pixels left by setDefectMap(), on the first call; a call made while another thread corrects waits
+    * for it, and later calls do nothing.  FrameRing calls it as each frame is leased, so no consumer sees them.
+    */
+   void               correctDefects();
+
+   /*!
+    * Writable access to the pixels, for the producer only.
+    */
+   [[nodiscard]] auto data() -> quint8 *;
+
+   /*!
+    * The exposure time, in seconds; 0 for live view frames.
+    */
+   [[nodiscard]] auto exposureDuration() const -> double;
+   [[nodiscard]] auto height() const -> quint32;
+
+   /*!
+    * If the samples are floats, as calibration makes; the display, statistics and star detection skip such frames.
+    */
+   [[nodiscard]] auto isFloat() const -> bool;
+   [[nodiscard]] auto isNull() const -> bool;
+
+   /*!
+    * The number of bytes of pixel data; width × height × channels × bytesPerSample().
+    */
+   [[nodiscard]] auto length() const -> qint64;
+
+   /*!
+    * The generation of the pool the buffer came from; see FramePool::generation().  0 for a null frame.
+    */
+   [[nodiscard]] auto poolGeneration() const -> quint64;
+
+   /*!
+    * The quality the producer scored, or an unscored one if it did not.
+    */
+   [[nodiscard]] auto quality() const -> FrameQuality;
+
+   /*!
+    * Milliseconds since the epoch, UTC, when the readout finished.
+    */
+   [[nodiscard]] auto readoutTimestamp() const -> qint64;
+   [[nodiscard]] auto sequence() const -> quint64;
+
+   /*!
+    * Milliseconds since the epoch, UTC, when the exposure started.
+    */
+   [[nodiscard]] auto startTimestamp() const -> qint64;
+
+   /*!
+    * The statistics the producer measured, or invalid ones if it did not.  Exposures carry them; live view frames do
+    * not, as measuring every frame would hold up the stream.
+    */
+   [[nodiscard]] auto statistics() const -> FrameStatistics;
+   [[nodiscard]] auto width() const -> quint32;
+
+   void               setBayerPattern(BayerPattern pattern);
+
+   /*!
+    * Leaves the bad pixels of a map to be corrected by the first consumer, through correctDefects(), so the producer
+    * does not spend the time.  For the producer only, before it hands the frame out.
+    *
+    * @param defectMap the bad pixels, or nullptr if there are none.
+    */
+   void               setDefectMap(std::shared_ptr<const DefectMap> defectMap);
+   void               setExposureDuration(double seconds);
+   void               setGeometry(quint32 width, quint32 height, quint32 bitsPerPixel, quint32 channels);
+   void               setQuality(const FrameQuality & quality);
+   void               setSequence(quint64 sequence);
+   void               setStatistics(const FrameStatistics & statistics);
+   void               setTimestamps(qint64 start, qint64 readout);
+
+   /*!
+    * The number of handles to this frame.  A producer may only re-use a frame whose count is 1.
+    */
+   [[nodiscard]] auto useCount() const -> long;
+
+private:
+   friend class FramePool;
+   explicit Frame(std::shared_ptr<FrameData> frameData);
+
+   std::shared_ptr<FrameData> d;
+};
+
+Q_DECLARE_METATYPE(Frame)
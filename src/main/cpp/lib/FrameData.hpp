@@ -0,0 +1,54 @@
+#pragma once
+
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "Frame.hpp"
+#include "FramePool.hpp"
+#include "FrameQuality.hpp"
+#include "FrameStatistics.hpp"
+#include <atomic>
+#include <memory>
+
+class DefectMap;
+
+/*! \brief The shared state behind a Frame; private to the library.
+ *
+ * Destroying the last reference returns the pixel buffer to the pool it came from.
+ */
+struct FrameData
+{
+   enum DefectCorrection
+   {
+      Corrected, // or nothing to correct
+      CorrectionPending,
+      Correcting
+   };
+
+   FrameData(std::shared_ptr<FramePool> framePool, FramePool::Block frameBlock);
+   FrameData(const FrameData &) = delete;
+   FrameData(FrameData &&)      = delete;
+   ~FrameData();
+
+   auto                             operator=(const FrameData &) -> FrameData & = delete;
+   auto                             operator=(FrameData &&) -> FrameData & = delete;
+
+   std::shared_ptr<FramePool>       pool;
+   FramePool::Block                 block;
+   std::shared_ptr<const DefectMap> defects; // still to be applied, while CorrectionPending
+   std::atomic<int>                 defectCorrection{ Corrected };
+   double                           exposureDuration{ 0.0 };
+   qint64                           readoutTimestamp{ 0 };
+   qint64                           startTimestamp{ 0 };
+   quint64                          sequence{ 0 };
+   FrameStatistics                  statistics;
+   FrameQuality                     quality;
+   Frame::BayerPattern              bayerPattern{ Frame::Monochrome };
+   quint32                          bitsPerPixel{ 0 };
+   quint32                          channels{ 0 };
+   quint32                          height{ 0 };
+   quint32                          width{ 0 };
+};
@@ -0,0 +1,203 @@
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "FramePool.hpp"
+
+#include "Config.h"
+#include "FrameData.hpp"
+#include <atomic>
+#include <QDebug>
+#include <QMutexLocker>
+#include <QtGlobal>
+
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>
+#endif
+
+namespace
+{
+std::atomic<qint64>  memoryBudgetBytes{ DefaultFrameMemoryBudget };
+std::atomic<qint64>  memoryInUseBytes{ 0 };
+std::atomic_bool     hugePagesEnabled{ true };
+std::atomic<quint64> poolGenerations{ 0 };
+
+auto roundUp(qint64 value, qint64 multiple) -> qint64
+{
+   return (value + multiple - 1) / multiple * multiple;
+}
+
+auto reserveMemory(qint64 bytes) -> bool
+{
+   auto inUse = memoryInUseBytes.load();
+   do {
+      if (inUse + bytes > memoryBudgetBytes.load()) {
+         return false;
+      }
+   } while (!memoryInUseBytes.compare_exchange_weak(inUse, inUse + bytes));
+   return true;
+}
+} // namespace
+
+/* ***************************************************************************************************************** */
+// MARK: - ctors & dtors
+/* ***************************************************************************************************************** */
+FramePool::FramePool(qint64 bufferLength, int maximumBuffers)
+   : m_bufferLength(bufferLength)
+   , m_generation(++poolGenerations)
+   , m_allocatedBuffers(0)
+   , m_maximumBuffers(maximumBuffers)
+{
+   m_freeBlocks.reserve(maximumBuffers);
+}
+
+FramePool::~FramePool()
+{
+   // Every frame holds a reference to the pool, so by now all buffers are back on the free list.
+   for (const auto & block : qAsConst(m_freeBlocks)) {
+      freeBlock(block);
+   }
+}
+
+auto FramePool::create(qint64 bufferLength, int maximumBuffers) -> std::shared_ptr<FramePool>
+{
+   return std::shared_ptr<FramePool>(new FramePool(bufferLength, maximumBuffers));
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Public methods
+/* ***************************************************************************************************************** */
+auto FramePool::acquire() -> Frame
+{
+   Block block;
+   {
+      QMutexLocker locker(&m_mutex);
+      if (!m_freeBlocks.isEmpty()) {
+         block = m_freeBlocks.takeLast(); // the most recently used buffer is the most likely to be cache resident
+      } else if (m_allocatedBuffers < m_maximumBuffers) {
+         block = allocateBlock();
+         if (block.pixels != nullptr) {
+            ++m_allocatedBuffers;
+         }
+      }
+   }
+   if (block.pixels == nullptr) {
+      return Frame();
+   }
+   return Frame(std::make_shared<FrameData>(shared_from_this(), block));
+}
+
+auto FramePool::allocatedBuffers() const -> int
+{
+   QMutexLocker locker(&m_mutex);
+   return m_allocatedBuffers;
+}
+
+auto FramePool::bufferLength() const -> qint64
+{
+   return m_bufferLength;
+}
+
+auto FramePool::generation() const -> quint64
+{
+   return m_generation;
+}
+
+void FramePool::reserve(int count)
+{
+   QMutexLocker locker(&m_mutex);
+   while (m_allocatedBuffers < qMin(count, m_maximumBuffers)) {
+      auto block = allocateBlock();
+      if (block.pixels == nullptr) {
+         break;
+      }
+      m_freeBlocks.append(block);
+      ++m_allocatedBuffers;
+   }
+}
+
+auto FramePool::memoryBudget() -> qint64
+{
+   return memoryBudgetBytes;
+}
+
+auto FramePool::memoryInUse() -> qint64
+{
+   return memoryInUseBytes;
+}
+
+void FramePool::setMemoryBudget(qint64 bytes)
+{
+   memoryBudgetBytes = bytes;
+}
+
+void FramePool::setUseHugePages(bool useHugePages)
+{
+   hugePagesEnabled = useHugePages;
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Private methods
+/* ***************************************************************************************************************** */
+auto FramePool::allocateBlock() -> Block
+{
+   Block block;
+   auto  mappedLength = roundUp(m_bufferLength, hugePagesEnabled ? HugePageSize : PageSize);
+   if (!reserveMemory(mappedLength)) {
+      qWarning() << "Frame memory budget of" << memoryBudgetBytes.load() << "bytes exhausted";
+      return block;
+   }
+   block.mappedLength = mappedLength;
+
+#ifdef Q_OS_UNIX
+   void * pixels = MAP_FAILED;
+#ifdef MAP_HUGETLB
+   if (hugePagesEnabled) {
+      // Only succeeds if huge pages have been reserved (vm.nr_hugepages).
+      pixels          = mmap(nullptr,
+                    static_cast<size_t>(mappedLength),
+                    PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+                    -1,
+                    0);
+      block.hugePages = pixels != MAP_FAILED;
+   }
+#endif
+   if (pixels == MAP_FAILED) {
+      pixels =
+        mmap(nullptr, static_cast<size_t>(mappedLength), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#ifdef MADV_HUGEPAGE
+      if (pixels != MAP_FAILED && hugePagesEnabled) {
+         madvise(pixels, static_cast<size_t>(mappedLength), MADV_HUGEPAGE);
+      }
+#endif
+   }
+   block.pixels = pixels == MAP_FAILED ? nullptr : static_cast<quint8 *>(pixels);
+#else
+   block.pixels = static_cast<quint8 *>(qMallocAligned(static_cast<size_t>(mappedLength), PageSize));
+#endif
+
+   if (block.pixels == nullptr) {
+      qWarning() << "Could not allocate a frame buffer of" << mappedLength << "bytes";
+      memoryInUseBytes -= mappedLength;
+   }
+   return block;
+}
+
+void FramePool::freeBlock(const Block & block)
+{
+#ifdef Q_OS_UNIX
+   munmap(block.pixels, static_cast<size_t>(block.mappedLength));
+#else
+   qFreeAligned(block.pixels);
+#endif
+   memoryInUseBytes -= block.mappedLength;
+}
+
+void FramePool::recycle(const Block & block)
+{
+   QMutexLocker locker(&m_mutex);
+   m_freeBlocks.append(block);
+}
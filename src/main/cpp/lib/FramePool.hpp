@@ -0,0 +1,100 @@
+#pragma once
+
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "Frame.hpp"
+#include <memory>
+#include <QMutex>
+#include <QVector>
+
+/*! \brief A per-camera pool of equally sized, page aligned pixel buffers.
+ *
+ * Buffers are allocated once and recycled when the last Frame using them is released, so steady state capture never
+ * maps or faults in pixel memory.  Each frame handed out still costs one small heap allocation, for the shared handle
+ * that counts its users.  On Linux, buffers are backed by 2 MB huge pages when any are reserved, and by transparent
+ * huge pages otherwise.  Every pool draws on one memory budget shared by all open cameras; a pool that would exceed it
+ * hands out null frames rather than allocating.
+ *
+ * Frames keep their pool alive, so a pool may be dropped while frames from it are still in use.
+ */
+class FramePool : public std::enable_shared_from_this<FramePool>
+{
+public:
+   /*!
+    * Creates a pool.
+    *
+    * @param bufferLength the size of each buffer, in bytes; usually Capabilities::maxFrameLength.
+    * @param maximumBuffers the most buffers the pool will allocate.
+    * @return The pool.
+    */
+   [[nodiscard]] static auto create(qint64 bufferLength, int maximumBuffers) -> std::shared_ptr<FramePool>;
+
+   FramePool(const FramePool &) = delete;
+   FramePool(FramePool &&)      = delete;
+   ~FramePool();
+
+   auto               operator=(const FramePool &) -> FramePool & = delete;
+   auto               operator=(FramePool &&) -> FramePool & = delete;
+
+   /*!
+    * Hands out a buffer, allocating one if none is free and both the pool size and memory budget allow it.
+    * @return The frame, which is null if the pool is exhausted.
+    */
+   [[nodiscard]] auto acquire() -> Frame;
+   [[nodiscard]] auto allocatedBuffers() const -> int;
+   [[nodiscard]] auto bufferLength() const -> qint64;
+
+   /*!
+    * Tells pools apart; unlike the addresses of their buffers, which a later pool may be given, it is never reused.
+    */
+   [[nodiscard]] auto generation() const -> quint64;
+
+   /*!
+    * Allocates buffers up front, so the first frames do not pay for the allocation and page faults.
+    * @param count the number of buffers the pool should hold.
+    */
+   void               reserve(int count);
+
+   /*!
+    * The limit on memory held by all pools together, in bytes.
+    */
+   [[nodiscard]] static auto memoryBudget() -> qint64;
+
+   /*!
+    * The memory held by all pools together, in bytes.
+    */
+   [[nodiscard]] static auto memoryInUse() -> qint64;
+   static void               setMemoryBudget(qint64 bytes);
+
+   /*!
+    * Sets if new buffers should be backed by huge pages, where the platform supports it.
+    */
+   static void               setUseHugePages(bool useHugePages);
+
+private:
+   friend struct FrameData;
+
+   struct Block
+   {
+      quint8 * pixels{ nullptr };
+      qint64   mappedLength{ 0 };
+      bool     hugePages{ false };
+   };
+
+   FramePool(qint64 bufferLength, int maximumBuffers);
+
+   [[nodiscard]] auto        allocateBlock() -> Block;
+   static void               freeBlock(const Block & block);
+   void                      recycle(const Block & block);
+
+   mutable QMutex m_mutex;
+   QVector<Block> m_freeBlocks;
+   qint64         m_bufferLength;
+   quint64        m_generation;
+   int            m_allocatedBuffers;
+   int            m_maximumBuffers;
+};
@@ -0,0 +1,41 @@
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "FrameQuality.hpp"
+
+#include <QCoreApplication>
+#include <QStringList>
+
+/* ***************************************************************************************************************** */
+// MARK: - Public methods
+/* ***************************************************************************************************************** */
+auto FrameQuality::describeReasons() const -> QString
+{
+   QStringList phrases;
+   if ((reasons & FewStars) != 0) {
+      phrases.append(QCoreApplication::translate("FrameQuality", "too few stars"));
+   }
+   if ((reasons & Blurred) != 0) {
+      phrases.append(QCoreApplication::translate("FrameQuality", "blurred stars"));
+   }
+   if ((reasons & Elongated) != 0) {
+      phrases.append(QCoreApplication::translate("FrameQuality", "elongated stars"));
+   }
+   if ((reasons & BrightSky) != 0) {
+      phrases.append(QCoreApplication::translate("FrameQuality", "a bright sky"));
+   }
+   return phrases.join(QString(", "));
+}
+
+auto FrameQuality::isRejected() const -> bool
+{
+   return verdict == Marked || verdict == Diverted || verdict == Dropped;
+}
+
+auto FrameQuality::isScored() const -> bool
+{
+   return verdict != Unscored;
+}
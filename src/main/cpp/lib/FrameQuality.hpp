@@ -0,0 +1,55 @@
+#pragma once
+
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include <QMetaType>
+#include <QString>
+
+/*! \brief How good one exposure is, and what the FrameScorer made of it; carried with the frame to whoever saves it.
+ *
+ * The figures are in frame pixels and sample units, so a writer can record them as they are and later tools need not
+ * measure the frame again.
+ */
+struct FrameQuality
+{
+   enum Verdict
+   {
+      Unscored,
+      Accepted,
+      Marked,   // outside the thresholds; kept with the rest, and flagged
+      Diverted, // outside the thresholds; kept apart from the rest
+      Dropped   // outside the thresholds; not kept
+   };
+
+   enum Reason
+   {
+      FewStars   = 0x01, // clouds, or dew
+      Blurred    = 0x02, // seeing, focus, or wind
+      Elongated  = 0x04, // guiding, or wind
+      BrightSky  = 0x08  // clouds lit from below, twilight, or the moon
+   };
+
+   int     stars{ 0 };
+   double  fwhm{ 0.0 };         // the median of the stars, in pixels
+   double  eccentricity{ 0.0 }; // the median of the stars
+   double  background{ 0.0 };
+   Verdict verdict{ Unscored };
+   int     reasons{ 0 }; // Reasons the frame is outside the thresholds, or'ed
+
+   /*!
+    * The reasons, as a phrase for the user; empty if there are none.
+    */
+   [[nodiscard]] auto describeReasons() const -> QString;
+
+   /*!
+    * If the frame was scored, and found outside the thresholds.
+    */
+   [[nodiscard]] auto isRejected() const -> bool;
+   [[nodiscard]] auto isScored() const -> bool;
+};
+
+Q_DECLARE_METATYPE(FrameQuality)
@@ -0,0 +1,216 @@
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "FrameRing.hpp"
+
+#include "FramePool.hpp"
+#include <limits>
+#include <utility>
+
+/* ***************************************************************************************************************** */
+// MARK: - ctors & dtors
+/* ***************************************************************************************************************** */
+FrameRing::FrameRing(int capacity, std::shared_ptr<FramePool> framePool)
+   : m_slots(new Slot[static_cast<size_t>(capacity)])
+   , m_framePool(std::move(framePool))
+   , m_capacity(capacity)
+   , m_writeSlot(nullptr)
+   , m_lastSequence(0)
+   , m_latestSlot(-1)
+   , m_overwritten(0)
+   , m_published(0)
+{
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Public methods
+/* ***************************************************************************************************************** */
+auto FrameRing::capacity() const -> int
+{
+   return m_capacity;
+}
+
+auto FrameRing::beginWrite() -> Frame *
+{
+   // A slot stays claimed until it is committed, so polling for a frame that is not ready yet costs nothing.
+   // Otherwise claim the oldest unpinned slot; empty slots have sequence 0, so are always tried first.
+   while (m_writeSlot == nullptr) {
+      Slot *  oldest         = nullptr;
+      quint64 oldestSequence = std::numeric_limits<quint64>::max();
+      for (int slotIndex = 0; slotIndex < m_capacity; ++slotIndex) {
+         auto & slot     = m_slots[slotIndex];
+         auto   sequence = slot.sequence.load(std::memory_order_relaxed);
+         if (slot.readers.load(std::memory_order_relaxed) == 0 && sequence < oldestSequence) {
+            oldest         = &slot;
+            oldestSequence = sequence;
+         }
+      }
+      if (oldest == nullptr) {
+         return nullptr;
+      }
+      int unpinned = 0;
+      if (oldest->readers.compare_exchange_strong(unpinned, -1, std::memory_order_acquire)) {
+         // No consumer can copy the handle while the slot is claimed, so the count can only go down.
+         if (oldest->frame.isNull() || oldest->frame.useCount() > 1) {
+            auto freshFrame = m_framePool->acquire();
+            if (freshFrame.isNull()) {
+               oldest->readers.store(0, std::memory_order_release);
+               return nullptr;
+            }
+            oldest->frame = freshFrame;
+         }
+         if (oldestSequence != 0 && !oldest->consumed.load(std::memory_order_relaxed)) {
+            m_overwritten.fetch_add(1, std::memory_order_relaxed);
+         }
+         oldest->sequence.store(0, std::memory_order_relaxed);
+         m_writeSlot = oldest;
+      }
+   }
+   return &m_writeSlot->frame;
+}
+
+auto FrameRing::commitWrite() -> quint64
+{
+   if (m_writeSlot == nullptr) {
+      return 0;
+   }
+   auto sequence = ++m_lastSequence;
+   m_writeSlot->frame.setSequence(sequence);
+   m_writeSlot->consumed.store(false, std::memory_order_relaxed);
+   m_writeSlot->sequence.store(sequence, std::memory_order_release);
+   m_writeSlot->readers.store(0, std::memory_order_release);
+   m_latestSlot.store(static_cast<int>(m_writeSlot - m_slots.get()), std::memory_order_release);
+   m_published.fetch_add(1, std::memory_order_relaxed);
+   m_writeSlot = nullptr;
+   return sequence;
+}
+
+void FrameRing::abortWrite()
+{
+   if (m_writeSlot != nullptr) {
+      m_writeSlot->readers.store(0, std::memory_order_release);
+      m_writeSlot = nullptr;
+   }
+}
+
+auto FrameRing::latest() -> Lease
+{
+   for (int attempt = 0; attempt < m_capacity; ++attempt) {
+      auto slotIndex = m_latestSlot.load(std::memory_order_acquire);
+      if (slotIndex < 0) {
+         break;
+      }
+      auto & slot = m_slots[slotIndex];
+      if (tryPin(slot, 0)) {
+         return Lease(&slot);
+      }
+   }
+   return Lease();
+}
+
+auto FrameRing::next(quint64 afterSequence) -> Lease
+{
+   for (int attempt = 0; attempt < m_capacity; ++attempt) {
+      Slot *  candidate         = nullptr;
+      quint64 candidateSequence = std::numeric_limits<quint64>::max();
+      for (int slotIndex = 0; slotIndex < m_capacity; ++slotIndex) {
+         auto & slot     = m_slots[slotIndex];
+         auto   sequence = slot.sequence.load(std::memory_order_acquire);
+         if (sequence > afterSequence && sequence < candidateSequence) {
+            candidate         = &slot;
+            candidateSequence = sequence;
+         }
+      }
+      if (candidate == nullptr) {
+         break;
+      }
+      if (tryPin(*candidate, candidateSequence)) {
+         return Lease(candidate);
+      }
+   }
+   return Lease();
+}
+
+auto FrameRing::overwrittenFrames() const -> quint64
+{
+   return m_overwritten.load(std::memory_order_relaxed);
+}
+
+auto FrameRing::publishedFrames() const -> quint64
+{
+   return m_published.load(std::memory_order_relaxed);
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Private methods
+/* ***************************************************************************************************************** */
+auto FrameRing::tryPin(Slot & slot, quint64 expectedSequence) -> bool
+{
+   auto readers = slot.readers.load(std::memory_order_relaxed);
+   do {
+      if (readers < 0) {
+         return false;
+      }
+   } while (!slot.readers.compare_exchange_weak(readers, readers + 1, std::memory_order_acquire));
+
+   // The slot may have been re-written between choosing it and pinning it.
+   auto sequence = slot.sequence.load(std::memory_order_acquire);
+   if (sequence == 0 || (expectedSequence != 0 && sequence != expectedSequence)) {
+      slot.readers.fetch_sub(1, std::memory_order_release);
+      return false;
+   }
+   slot.consumed.store(true, std::memory_order_relaxed);
+   slot.frame.correctDefects();
+   return true;
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Lease
+/* ***************************************************************************************************************** */
+FrameRing::Lease::Lease(Slot * slot)
+   : m_slot(slot)
+{
+}
+
+FrameRing::Lease::Lease(Lease && other) noexcept
+   : m_slot(other.m_slot)
+{
+   other.m_slot = nullptr;
+}
+
+FrameRing::Lease::~Lease()
+{
+   release();
+}
+
+auto FrameRing::Lease::operator=(Lease && other) noexcept -> Lease &
+{
+   if (this != &other) {
+      release();
+      m_slot       = other.m_slot;
+      other.m_slot = nullptr;
+   }
+   return *this;
+}
+
+auto FrameRing::Lease::frame() const -> const Frame &
+{
+   static const Frame invalid;
+   return m_slot == nullptr ? invalid : m_slot->frame;
+}
+
+auto FrameRing::Lease::isValid() const -> bool
+{
+   return m_slot != nullptr;
+}
+
+void FrameRing::Lease::release()
+{
+   if (m_slot != nullptr) {
+      m_slot->readers.fetch_sub(1, std::memory_order_release);
+      m_slot = nullptr;
+   }
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "Frame.hpp"
+#include <atomic>
+#include <memory>
+
+class FramePool;
+
+/*! \brief A fixed capacity ring of frame slots, written by one producer and read by any number of consumers.
+ *
+ * Neither side ever takes a lock.  The producer claims the oldest slot that no consumer is reading, downloads into its
+ * frame in place, and publishes it.  Consumers pin a slot through a Lease for as long as they read the frame; a pinned
+ * slot is skipped by the producer rather than waited on.  When consumers fall behind, the oldest frames are
+ * overwritten, so memory use is bounded by the capacity given at construction.
+ *
+ * The first lease of a frame applies the defect map the producer left on it; see Frame::correctDefects().
+ */
+class FrameRing
+{
+private:
+   struct Slot
+   {
+      std::atomic<quint64> sequence{ 0 }; // 0 when the slot holds no frame
+      std::atomic<int>     readers{ 0 };  // -1 while the producer is writing
+      std::atomic_bool     consumed{ false };
+      Frame                frame;
+   };
+
+public:
+   /*! \brief A consumer's pin on one published frame.
+    *
+    * The slot cannot be re-used while the lease is held.  To keep the frame longer, copy the Frame handle and release
+    * the lease; the producer then moves on to a fresh buffer from the pool, and the pixels are never copied.
+    */
+   class Lease
+   {
+   public:
+      Lease() = default;
+      Lease(const Lease &) = delete;
+      Lease(Lease && other) noexcept;
+      ~Lease();
+
+      auto               operator=(const Lease &) -> Lease & = delete;
+      auto               operator=(Lease && other) noexcept -> Lease &;
+
+      [[nodiscard]] auto frame() const -> const Frame &;
+      [[nodiscard]] auto isValid() const -> bool;
+
+      /*!
+       * Unpins the frame; the lease is invalid afterwards.
+       */
+      void               release();
+
+   private:
+      friend class FrameRing;
+      explicit Lease(Slot * slot);
+
+      Slot * m_slot{ nullptr };
+   };
+
+   /*!
+    * Creates a ring.
+    *
+    * @param capacity the number of slots; at least two more than the number of consumers.
+    * @param framePool the pool frames are drawn from; it should hold more buffers than the ring has slots.
+    */
+   FrameRing(int capacity, std::shared_ptr<FramePool> framePool);
+   FrameRing(const FrameRing &) = delete;
+   FrameRing(FrameRing &&)      = delete;
+   ~FrameRing()                 = default;
+
+   auto               operator=(const FrameRing &) -> FrameRing & = delete;
+   auto               operator=(FrameRing &&) -> FrameRing & = delete;
+
+   [[nodiscard]] auto capacity() const -> int;
+
+   // MARK: Producer interface; these must only be called from the single producer thread.
+
+   /*!
+    * Claims the oldest slot not pinned by a consumer, discarding the frame it held.  If a consumer still holds a handle
+    * to that frame, the slot takes a fresh one from the pool.  Calling this again before commitWrite() returns the slot
+    * already claimed.
+    * @return The frame to download into and describe, or nullptr if every slot is pinned or the pool is exhausted.
+    */
+   [[nodiscard]] auto beginWrite() -> Frame *;
+
+   /*!
+    * Publishes the slot claimed by beginWrite(), assigning the frame its sequence number.
+    * @return The sequence number of the published frame.
+    */
+   auto               commitWrite() -> quint64;
+
+   /*!
+    * Returns the slot claimed by beginWrite() to the ring without publishing it.
+    */
+   void               abortWrite();
+
+   // MARK: Consumer interface; safe to call from any thread.
+
+   /*!
+    * Pins the most recently published frame.
+    * @return The lease, which is invalid if nothing has been published.
+    */
+   [[nodiscard]] auto latest() -> Lease;
+
+   /*!
+    * Pins the oldest frame still in the ring that is newer than the given sequence number.
+    * @param afterSequence the sequence number of the last frame the consumer saw, or 0.
+    * @return The lease, which is invalid if no newer frame is available.
+    */
+   [[nodiscard]] auto next(quint64 afterSequence) -> Lease;
+
+   /*!
+    * The count of frames that were overwritten before any consumer leased them.
+    */
+   [[nodiscard]] auto overwrittenFrames() const -> quint64;
+   [[nodiscard]] auto publishedFrames() const -> quint64;
+
+private:
+   [[nodiscard]] static auto tryPin(Slot & slot, quint64 expectedSequence) -> bool;
+
+   std::unique_ptr<Slot[]>    m_slots; // NOLINT(modernize-avoid-c-arrays): atomics are not movable, so no QVector
+   std::shared_ptr<FramePool> m_framePool;
+   int                        m_capacity;
+   Slot *                     m_writeSlot;
+   quint64                    m_lastSequence;
+   std::atomic<int>           m_latestSlot;
+   std::atomic<quint64>       m_overwritten;
+   std::atomic<quint64>       m_published;
+};
@@ -0,0 +1,190 @@
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "FrameScorer.hpp"
+
+#include "FramePool.hpp"
+#include "ParallelRows.hpp"
+#include "StarDetector.hpp"
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+namespace
+{
+template <typename Value>
+auto median(std::vector<Value> values) -> Value
+{
+   if (values.empty()) {
+      return Value();
+   }
+   const auto middle = values.begin() + static_cast<std::ptrdiff_t>(values.size() / 2);
+   std::nth_element(values.begin(), middle, values.end());
+   return *middle;
+}
+
+/*!
+ * Averages factor × factor blocks of every channel into one 16 bit sample.
+ */
+template <typename Sample>
+void bin(const Sample * samples, int width, int channels, int factor, int binnedWidth, int binnedHeight, quint16 * out)
+{
+   const auto blockSamples = factor * factor * channels;
+   const auto scale        = sizeof(Sample) == 1 ? 257 : 1;
+   parallelRows(binnedHeight, [&](int firstRow, int lastRow) {
+      for (int y = firstRow; y < lastRow; ++y) {
+         for (int x = 0; x < binnedWidth; ++x) {
+            quint64 sum{ 0 };
+            for (int row = 0; row < factor; ++row) {
+               const auto * block = samples
+                                    + (static_cast<qint64>(y * factor + row) * width + static_cast<qint64>(x) * factor)
+                                        * channels;
+               for (int sample = 0; sample < factor * channels; ++sample) {
+                  sum += block[sample];
+               }
+            }
+            out[static_cast<qint64>(y) * binnedWidth + x] = static_cast<quint16>(sum * scale / blockSamples);
+         }
+      }
+   });
+}
+} // namespace
+
+/* ***************************************************************************************************************** */
+// MARK: - ctors & dtors
+/* ***************************************************************************************************************** */
+FrameScorer::FrameScorer(Thresholds thresholds)
+   : m_thresholds(thresholds)
+{
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Public methods
+/* ***************************************************************************************************************** */
+auto FrameScorer::measure(const Frame & frame) -> FrameQuality
+{
+   FrameQuality quality;
+   if (frame.isNull() || frame.isFloat()) {
+      return quality;
+   }
+   const auto copy   = binned(frame);
+   const auto factor = copy.isNull() ? 1.0 : static_cast<double>(frame.width()) / copy.width();
+   const auto field  = StarDetector::detect(copy.isNull() ? frame : copy);
+
+   std::vector<double> eccentricities(static_cast<size_t>(field.stars.count()));
+   std::transform(field.stars.cbegin(), field.stars.cend(), eccentricities.begin(), [](const Star & star) {
+      return star.eccentricity;
+   });
+   quality.stars        = field.stars.count();
+   quality.fwhm         = field.fwhm * factor;
+   quality.eccentricity = median(std::move(eccentricities));
+   quality.background   = frame.statistics().background;
+   return quality;
+}
+
+void FrameScorer::reset()
+{
+   m_baseline.clear();
+}
+
+auto FrameScorer::score(const Frame & frame) -> FrameQuality
+{
+   auto quality = measure(frame);
+   if (frame.isNull() || frame.isFloat()) {
+      return quality;
+   }
+
+   quality.verdict = FrameQuality::Accepted;
+   if (static_cast<int>(m_baseline.size()) >= QualityBaselineMinimum) {
+      std::vector<int>    stars;
+      std::vector<double> fwhms;
+      std::vector<double> backgrounds;
+      std::vector<double> noises;
+      for (const auto & sample : m_baseline) {
+         stars.push_back(sample.quality.stars);
+         fwhms.push_back(sample.quality.fwhm);
+         backgrounds.push_back(sample.quality.background);
+         noises.push_back(sample.noise);
+      }
+      const auto baselineFwhm = median(fwhms);
+      if (quality.stars < m_thresholds.minimumStars * median(stars)) {
+         quality.reasons |= FrameQuality::FewStars;
+      }
+      if (quality.stars > 0 && baselineFwhm > 0.0 && quality.fwhm > m_thresholds.maximumFwhm * baselineFwhm) {
+         quality.reasons |= FrameQuality::Blurred;
+      }
+      if (quality.background - median(backgrounds) > m_thresholds.maximumBackground * median(noises)) {
+         quality.reasons |= FrameQuality::BrightSky;
+      }
+   }
+   if (quality.stars > 0 && quality.eccentricity > m_thresholds.maximumEccentricity) {
+      quality.reasons |= FrameQuality::Elongated;
+   }
+
+   if (quality.reasons == 0) {
+      m_baseline.push_back({ quality, frame.statistics().noise });
+      if (static_cast<int>(m_baseline.size()) > QualityBaselineFrames) {
+         m_baseline.pop_front();
+      }
+   } else {
+      switch (m_thresholds.action) {
+      case Mark:
+         quality.verdict = FrameQuality::Marked;
+         break;
+      case Divert:
+         quality.verdict = FrameQuality::Diverted;
+         break;
+      case Drop:
+         quality.verdict = FrameQuality::Dropped;
+         break;
+      }
+   }
+   return quality;
+}
+
+auto FrameScorer::thresholds() const -> Thresholds
+{
+   return m_thresholds;
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Private methods
+/* ***************************************************************************************************************** */
+auto FrameScorer::binned(const Frame & frame) -> Frame
+{
+   // A copy too small to search is no help; the frame is searched as it is.
+   const auto width        = static_cast<int>(frame.width());
+   const auto channels     = static_cast<int>(qMax(frame.channels(), 1U));
+   const auto binnedWidth  = width / QualityBinning;
+   const auto binnedHeight = static_cast<int>(frame.height()) / QualityBinning;
+   if (binnedWidth < StarTileSize || binnedHeight < StarTileSize) {
+      return Frame();
+   }
+   const auto length = static_cast<qint64>(binnedWidth) * binnedHeight * static_cast<qint64>(sizeof(quint16));
+   if (!m_framePool || m_framePool->bufferLength() < length) {
+      m_framePool = FramePool::create(length, 1);
+   }
+   auto copy = m_framePool->acquire();
+   if (copy.isNull()) {
+      return copy;
+   }
+   auto * out = reinterpret_cast<quint16 *>(copy.data()); // NOLINT
+   if (frame.bytesPerSample() == 2) {
+      bin(reinterpret_cast<const quint16 *>(frame.constData()), // NOLINT
+          width,
+          channels,
+          QualityBinning,
+          binnedWidth,
+          binnedHeight,
+          out);
+   } else {
+      bin(frame.constData(), width, channels, QualityBinning, binnedWidth, binnedHeight, out);
+   }
+   copy.setGeometry(static_cast<quint32>(binnedWidth), static_cast<quint32>(binnedHeight), BitDepth16, 1);
+   copy.setBayerPattern(Frame::Monochrome);
+   copy.setSequence(frame.sequence());
+   return copy;
+}
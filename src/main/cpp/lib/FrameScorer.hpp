@@ -0,0 +1,90 @@
+#pragma once
+
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "Config.h"
+#include "Frame.hpp"
+#include "FrameQuality.hpp"
+#include <deque>
+#include <memory>
+
+class FramePool;
+
+/*! \brief Scores exposures as they are captured, and rejects those ruined by clouds, wind or guiding errors.
+ *
+ * The stars are found on a copy of the frame binned QualityBinning × QualityBinning, which is a fraction of the work
+ * of the full frame; a colour mosaic's cells bin to its luminance, so no debayering is needed.  Each frame gets its
+ * star count, the median FWHM and eccentricity of its stars, and its background.
+ *
+ * A frame is judged against a rolling baseline, the medians of the last QualityBaselineFrames frames that passed; so a
+ * slow change through the night, such as the target sinking into worse seeing, moves the baseline with it, while a
+ * passing cloud does not.  Until QualityBaselineMinimum frames have passed, every frame does.
+ *
+ * Not thread safe; a scorer keeps its baseline for one camera, whose exposure thread alone scores with it.
+ */
+class FrameScorer
+{
+public:
+   /*!
+    * What is done with a frame outside the thresholds.
+    */
+   enum Action
+   {
+      Mark,
+      Divert,
+      Drop
+   };
+
+   struct Thresholds
+   {
+      Action action{ Divert };
+      double minimumStars{ QualityMinimumStars };             // a fraction of the baseline's star count
+      double maximumFwhm{ QualityMaximumFwhm };               // a multiple of the baseline's FWHM
+      double maximumEccentricity{ QualityEccentricityLimit }; // of the median star; not relative to the baseline
+      double maximumBackground{ QualityMaximumBackground };   // above the baseline, in its noise
+   };
+
+   explicit FrameScorer(Thresholds thresholds);
+   FrameScorer(const FrameScorer &) = delete;
+   FrameScorer(FrameScorer &&)      = delete;
+   ~FrameScorer()                   = default;
+
+   auto                      operator=(const FrameScorer &) -> FrameScorer & = delete;
+   auto                      operator=(FrameScorer &&) -> FrameScorer & = delete;
+
+   /*!
+    * Measures a frame's quality, without judging it.
+    *
+    * @param frame the frame, with its statistics measured.
+    * @return The figures, with the verdict Unscored; all 0 for a float frame.
+    */
+   [[nodiscard]] auto        measure(const Frame & frame) -> FrameQuality;
+
+   /*!
+    * Forgets the baseline, as for a new target or a new night.
+    */
+   void                      reset();
+
+   /*!
+    * Measures and judges a frame, and adds it to the baseline if it passes.
+    */
+   [[nodiscard]] auto        score(const Frame & frame) -> FrameQuality;
+   [[nodiscard]] auto        thresholds() const -> Thresholds;
+
+private:
+   struct Sample
+   {
+      FrameQuality quality;
+      double       noise{ 0.0 };
+   };
+
+   [[nodiscard]] auto         binned(const Frame & frame) -> Frame;
+
+   Thresholds                 m_thresholds;
+   std::deque<Sample>         m_baseline;  // the frames that passed, oldest first
+   std::shared_ptr<FramePool> m_framePool; // sized for the last frame binned
+};
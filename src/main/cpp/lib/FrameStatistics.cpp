@@ -0,0 +1,119 @@
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "FrameStatistics.hpp"
+
+#include "Config.h"
+#include "Frame.hpp"
+#include "Histogram.hpp"
+#include <cmath>
+
+namespace
+{
+/*! \brief The count, mean, median and standard deviation of the bins from low to high, inclusive.
+ */
+struct Moments
+{
+   quint64 count{ 0 };
+   double  mean{ 0.0 };
+   int     median{ 0 };
+   double  standardDeviation{ 0.0 };
+};
+
+auto moments(const QVector<quint32> & bins, int low, int high) -> Moments
+{
+   Moments result;
+   double  sum{ 0.0 };
+   for (int bin = low; bin <= high; ++bin) {
+      result.count += bins[bin];
+      sum += static_cast<double>(bin) * bins[bin];
+   }
+   if (result.count == 0) {
+      return result;
+   }
+   result.mean = sum / static_cast<double>(result.count);
+
+   double     squares{ 0.0 };
+   quint64    seen{ 0 };
+   const auto half = (result.count + 1) / 2;
+   result.median   = -1;
+   for (int bin = low; bin <= high; ++bin) {
+      const auto deviation = static_cast<double>(bin) - result.mean;
+      squares += deviation * deviation * bins[bin];
+      seen += bins[bin];
+      if (result.median < 0 && seen >= half) {
+         result.median = bin;
+      }
+   }
+   result.standardDeviation = std::sqrt(squares / static_cast<double>(result.count));
+   return result;
+}
+} // namespace
+
+/* ***************************************************************************************************************** */
+// MARK: - Public methods
+/* ***************************************************************************************************************** */
+auto FrameStatistics::isValid() const -> bool
+{
+   return count != 0;
+}
+
+auto FrameStatistics::measure(const Frame & frame) -> FrameStatistics
+{
+   if (frame.isFloat()) {
+      return FrameStatistics();
+   }
+   return measure(Histogram(frame), (1 << (BitDepth8 * frame.bytesPerSample())) - 1);
+}
+
+auto FrameStatistics::measure(const Histogram & histogram, int saturationLevel) -> FrameStatistics
+{
+   FrameStatistics statistics;
+   if (histogram.isEmpty()) {
+      return statistics;
+   }
+   const auto & bins = histogram.bins();
+   const auto   all  = moments(bins, histogram.minimum(), histogram.maximum());
+   statistics.count             = all.count;
+   statistics.minimum           = histogram.minimum();
+   statistics.maximum           = histogram.maximum();
+   statistics.mean              = all.mean;
+   statistics.median            = all.median;
+   statistics.standardDeviation = all.standardDeviation;
+
+   if (saturationLevel < 0 || saturationLevel >= bins.count()) {
+      saturationLevel = bins.count() - 1;
+   }
+   for (int bin = qMax(saturationLevel, statistics.minimum); bin <= statistics.maximum; ++bin) {
+      statistics.saturated += bins[bin];
+   }
+
+   // Clip around the median, starting from the MAD rather than the standard deviation, which the stars inflate.
+   auto centre = static_cast<double>(all.median);
+   auto sigma  = histogram.medianAbsoluteDeviation() * MADToSigma;
+   auto low    = statistics.minimum;
+   auto high   = statistics.maximum;
+   auto kept   = all;
+   for (int iteration = 0; iteration < SigmaClipIterations; ++iteration) {
+      const auto clippedLow  = qMax(statistics.minimum, static_cast<int>(std::ceil(centre - SigmaClipLimit * sigma)));
+      const auto clippedHigh = qMin(statistics.maximum, static_cast<int>(std::floor(centre + SigmaClipLimit * sigma)));
+      if ((clippedLow == low && clippedHigh == high) || clippedLow > clippedHigh) {
+         break;
+      }
+      const auto clipped = moments(bins, clippedLow, clippedHigh);
+      if (clipped.count == 0) {
+         break;
+      }
+      low    = clippedLow;
+      high   = clippedHigh;
+      kept   = clipped;
+      centre = kept.median;
+      sigma  = kept.standardDeviation;
+   }
+   statistics.background = kept.median;
+   statistics.noise      = kept.standardDeviation;
+   return statistics;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include <QMetaType>
+
+class Frame;
+class Histogram;
+
+/*! \brief The quality control figures of one frame, all channels together, in sample units.
+ *
+ * Everything is read from the frame's Histogram, so measuring a frame costs one parallel pass over its samples and a
+ * few walks over the bins.  The median comes from the bins, never from sorting the samples.
+ *
+ * The background and noise are the median and standard deviation of the samples left after sigma clipping, so stars,
+ * hot pixels and satellite trails do not pull them up.
+ */
+struct FrameStatistics
+{
+   quint64 count{ 0 };
+   int     minimum{ 0 };
+   int     maximum{ 0 };
+   double  mean{ 0.0 };
+   int     median{ 0 };
+   double  standardDeviation{ 0.0 };
+   quint64 saturated{ 0 }; // samples at the saturation level or above
+   double  background{ 0.0 };
+   double  noise{ 0.0 };
+
+   /*!
+    * False for statistics that were never measured.
+    */
+   [[nodiscard]] auto        isValid() const -> bool;
+
+   /*!
+    * Measures every sample of a frame.  A sample is saturated at the largest value its sample size can hold.
+    */
+   [[nodiscard]] static auto measure(const Frame & frame) -> FrameStatistics;
+
+   /*!
+    * Reads the statistics from a histogram that is already built.
+    *
+    * @param histogram the histogram of the samples.
+    * @param saturationLevel the smallest saturated value; -1 for the last bin.
+    */
+   [[nodiscard]] static auto measure(const Histogram & histogram, int saturationLevel = -1) -> FrameStatistics;
+};
+
+Q_DECLARE_METATYPE(FrameStatistics)
@@ -0,0 +1,185 @@
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "Histogram.hpp"
+
+#include "Config.h"
+#include "ParallelRows.hpp"
+#include <cmath>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThreadPool>
+#include <vector>
+
+/* ***************************************************************************************************************** */
+// MARK: - ctors & dtors
+/* ***************************************************************************************************************** */
+Histogram::Histogram(const Frame & frame)
+{
+   const auto samples = static_cast<qint64>(frame.width()) * frame.height() * qMax(frame.channels(), 1U);
+   if (frame.isNull() || frame.isFloat() || samples == 0) {
+      return;
+   }
+   if (frame.bytesPerSample() == 1) {
+      compute(frame.constData(), samples);
+   } else {
+      compute(reinterpret_cast<const quint16 *>(frame.constData()), samples);
+   }
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Public methods
+/* ***************************************************************************************************************** */
+auto Histogram::binCount() const -> int
+{
+   return m_bins.count();
+}
+
+auto Histogram::bins() const -> const QVector<quint32> &
+{
+   return m_bins;
+}
+
+auto Histogram::coarse(int binCount) const -> QVector<quint32>
+{
+   if (binCount <= 0 || binCount >= m_bins.count()) {
+      return m_bins;
+   }
+   QVector<quint32> folded(binCount, 0);
+   const auto       width = m_bins.count() / binCount;
+   for (int bin = 0; bin < m_bins.count(); ++bin) {
+      folded[qMin(bin / width, binCount - 1)] += m_bins[bin];
+   }
+   return folded;
+}
+
+void Histogram::compute(const quint8 * samples, qint64 count)
+{
+   build(samples, count, 1 << BitDepth8);
+}
+
+void Histogram::compute(const quint16 * samples, qint64 count)
+{
+   build(samples, count, 1 << BitDepth16);
+}
+
+auto Histogram::count() const -> quint64
+{
+   return m_count;
+}
+
+auto Histogram::isEmpty() const -> bool
+{
+   return m_count == 0;
+}
+
+auto Histogram::maximum() const -> int
+{
+   return m_maximum;
+}
+
+auto Histogram::mean() const -> double
+{
+   return m_mean;
+}
+
+auto Histogram::median() const -> int
+{
+   return percentile(0.5);
+}
+
+auto Histogram::medianAbsoluteDeviation() const -> double
+{
+   if (m_count == 0) {
+      return 0.0;
+   }
+   // Grow a window around the median, taking the nearer bin each step, until it holds half the samples.
+   const auto centre = median();
+   const auto half   = (m_count + 1) / 2;
+   auto       low    = centre;
+   auto       high   = centre;
+   quint64    inside = m_bins[centre];
+   while (inside < half) {
+      const auto below = low > 0 ? centre - (low - 1) : m_bins.count();
+      const auto above = high < m_bins.count() - 1 ? (high + 1) - centre : m_bins.count();
+      if (below <= above) {
+         inside += m_bins[--low];
+      } else {
+         inside += m_bins[++high];
+      }
+   }
+   return static_cast<double>(qMax(centre - low, high - centre));
+}
+
+auto Histogram::minimum() const -> int
+{
+   return m_minimum;
+}
+
+auto Histogram::percentile(double fraction) const -> int
+{
+   if (m_count == 0) {
+      return 0;
+   }
+   const auto wanted = qMax<quint64>(1, static_cast<quint64>(std::ceil(qBound(0.0, fraction, 1.0) * m_count)));
+   quint64    seen{ 0 };
+   for (int bin = m_minimum; bin <= m_maximum; ++bin) {
+      seen += m_bins[bin];
+      if (seen >= wanted) {
+         return bin;
+      }
+   }
+   return m_maximum;
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Private methods
+/* ***************************************************************************************************************** */
+template <class T>
+void Histogram::build(const T * samples, qint64 count, int binCount)
+{
+   m_bins.fill(0, binCount);
+   m_count   = 0;
+   m_minimum = 0;
+   m_maximum = 0;
+   m_mean    = 0.0;
+   if (samples == nullptr || count <= 0) {
+      return;
+   }
+
+   // One chunk per pool thread, so the private bins cost one merge per thread rather than one per small chunk.
+   const auto blocks  = static_cast<int>((count + SampleBlockLength - 1) / SampleBlockLength);
+   const auto threads = qMax(1, QThreadPool::globalInstance()->maxThreadCount());
+   QMutex     mergeMutex;
+   parallelRows(
+     blocks,
+     [&](int firstBlock, int lastBlock) {
+        std::vector<quint32> privateBins(static_cast<size_t>(binCount), 0);
+        const auto *         sample = samples + static_cast<qint64>(firstBlock) * SampleBlockLength;
+        const auto *         end    = samples + qMin(count, static_cast<qint64>(lastBlock) * SampleBlockLength);
+        for (; sample < end; ++sample) {
+           ++privateBins[*sample];
+        }
+        QMutexLocker locker(&mergeMutex);
+        auto *       bins = m_bins.data();
+        for (int bin = 0; bin < binCount; ++bin) {
+           bins[bin] += privateBins[static_cast<size_t>(bin)];
+        }
+     },
+     (blocks + threads - 1) / threads);
+
+   m_count = static_cast<quint64>(count);
+   double sum{ 0.0 };
+   m_minimum = binCount - 1;
+   for (int bin = 0; bin < binCount; ++bin) {
+      if (m_bins[bin] != 0) {
+         m_minimum = qMin(m_minimum, bin);
+         m_maximum = bin;
+         sum += static_cast<double>(bin) * m_bins[bin];
+      }
+   }
+   m_mean = sum / static_cast<double>(m_count);
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "Frame.hpp"
+#include <QVector>
+
+/*! \brief The distribution of the sample values of one frame, with one bin per possible value.
+ *
+ * A 16 bit frame gets 65536 bins, an 8 bit frame 256.  The samples are split across the global thread pool; each chunk
+ * counts into its own bins, which are summed once at the end, so no two threads ever write the same counter.
+ *
+ * Every statistic is read from the bins rather than from the samples, so once the histogram is built, the minimum,
+ * maximum, mean, median, percentiles and MAD cost a walk over the bins, whatever the size of the frame.
+ */
+class Histogram
+{
+public:
+   Histogram() = default;
+
+   /*!
+    * Builds the histogram of every sample of a frame, all channels together.
+    */
+   explicit Histogram(const Frame & frame);
+
+   /*!
+    * Builds the histogram of 8 bit samples, replacing any earlier one.
+    */
+   void               compute(const quint8 * samples, qint64 count);
+
+   /*!
+    * Builds the histogram of 16 bit samples, replacing any earlier one.
+    */
+   void               compute(const quint16 * samples, qint64 count);
+
+   [[nodiscard]] auto binCount() const -> int;
+   [[nodiscard]] auto bins() const -> const QVector<quint32> &;
+
+   /*!
+    * The histogram folded into fewer, wider bins, for drawing.
+    *
+    * @param binCount the number of bins wanted; a power of 2 no larger than binCount().
+    */
+   [[nodiscard]] auto coarse(int binCount) const -> QVector<quint32>;
+
+   /*!
+    * The number of samples counted.
+    */
+   [[nodiscard]] auto count() const -> quint64;
+   [[nodiscard]] auto isEmpty() const -> bool;
+   [[nodiscard]] auto maximum() const -> int;
+   [[nodiscard]] auto mean() const -> double;
+   [[nodiscard]] auto median() const -> int;
+
+   /*!
+    * The median of the absolute deviations from the median, in sample units.
+    */
+   [[nodiscard]] auto medianAbsoluteDeviation() const -> double;
+   [[nodiscard]] auto minimum() const -> int;
+
+   /*!
+    * The smallest value at or below which the given fraction of the samples lie.
+    *
+    * @param fraction between 0 and 1.
+    */
+   [[nodiscard]] auto percentile(double fraction) const -> int;
+
+private:
+   template <class T>
+   void               build(const T * samples, qint64 count, int binCount);
+
+   QVector<quint32>   m_bins;
+   quint64            m_count{ 0 };
+   int                m_minimum{ 0 };
+   int                m_maximum{ 0 };
+   double             m_mean{ 0.0 };
+};
@@ -0,0 +1,454 @@
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "LiveStacker.hpp"
+
+#include "Config.h"
+#include "Debayer.hpp"
+#include "FramePool.hpp"
+#include "FrameStatistics.hpp"
+#include "ParallelRows.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+namespace
+{
+/*! \brief The running mean, and variance, of every sample of the stack.
+ */
+struct Accumulator
+{
+   float *   mean;
+   float *   squares; // nullptr for a plain mean
+   quint32 * counts;
+   int       width;
+   int       height;
+   int       channels;
+};
+
+/*! \brief Where a pixel of the stack is in the frame; the inverse of the registration.
+ */
+struct SourceMap
+{
+   double xPerX; // so x = xPerX × X + xPerY × Y + x0, y = -xPerY × X + xPerX × Y + y0
+   double xPerY;
+   double x0;
+   double y0;
+};
+
+inline void add(const Accumulator & stack, qint64 index, float value)
+{
+   auto count = stack.counts[index];
+   auto mean  = stack.mean[index];
+   if (stack.squares != nullptr && count >= static_cast<quint32>(LiveStackMinimumFrames)) {
+      const auto deviation = std::sqrt(stack.squares[index] / static_cast<float>(count - 1));
+      if (deviation > 0.0F && std::abs(value - mean) > static_cast<float>(LiveStackKappa) * deviation) {
+         return;
+      }
+   }
+   if (count == std::numeric_limits<quint32>::max()) {
+      return;
+   }
+   ++count;
+   const auto delta = value - mean;
+   mean += delta / static_cast<float>(count);
+   stack.counts[index] = count;
+   stack.mean[index]   = mean;
+   if (stack.squares != nullptr) {
+      stack.squares[index] += delta * (value - mean);
+   }
+}
+
+/*!
+ * Resamples rows of the stack from a frame, bilinearly, and adds them.
+ */
+template <class T>
+void accumulateRows(const T * samples, const Accumulator & stack, const SourceMap & map, int firstRow, int lastRow)
+{
+   const auto maximumX = static_cast<double>(stack.width - 1);
+   const auto maximumY = static_cast<double>(stack.height - 1);
+   for (int row = firstRow; row < lastRow; ++row) {
+      for (int column = 0; column < stack.width; ++column) {
+         const auto x = map.xPerX * column + map.xPerY * row + map.x0;
+         const auto y = -map.xPerY * column + map.xPerX * row + map.y0;
+         if (x < 0.0 || y < 0.0 || x > maximumX || y > maximumY) {
+            continue;
+         }
+         const auto left  = std::min(static_cast<int>(x), stack.width - 2);
+         const auto top   = std::min(static_cast<int>(y), stack.height - 2);
+         const auto right = static_cast<float>(x - left);
+         const auto down  = static_cast<float>(y - top);
+         const auto * topLeft =
+           samples + (static_cast<qint64>(top) * stack.width + left) * static_cast<qint64>(stack.channels);
+         const auto * bottomLeft = topLeft + static_cast<qint64>(stack.width) * stack.channels;
+         const auto   target     = (static_cast<qint64>(row) * stack.width + column) * stack.channels;
+         for (int channel = 0; channel < stack.channels; ++channel) {
+            const auto upper = topLeft[channel] + right * (topLeft[channel + stack.channels] - topLeft[channel]);
+            const auto lower =
+              bottomLeft[channel] + right * (bottomLeft[channel + stack.channels] - bottomLeft[channel]);
+            add(stack, target + channel, upper + down * (lower - upper));
+         }
+      }
+   }
+}
+} // namespace
+
+/* ***************************************************************************************************************** */
+// MARK: - ctors & dtors
+/* ***************************************************************************************************************** */
+LiveStacker::LiveStacker(QObject * parent)
+   : QObject(parent)
+   , m_method(KappaSigma)
+   , m_queued(0)
+   , m_skipped(0)
+   , m_stackMethod(KappaSigma)
+   , m_width(0)
+   , m_height(0)
+   , m_channels(1)
+   , m_bytesPerSample(1)
+   , m_frames(0)
+   , m_integration(0.0)
+   , m_startTimestamp(0)
+   , m_readoutTimestamp(0)
+   , m_renderTimer(new QTimer(this))
+{
+   m_renderTimer->setSingleShot(true);
+   QObject::connect(m_renderTimer, &QTimer::timeout, this, &LiveStacker::render);
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Public methods
+/* ***************************************************************************************************************** */
+auto LiveStacker::method() const -> Method
+{
+   return m_method;
+}
+
+auto LiveStacker::offer(const Frame & frame) -> bool
+{
+   if (m_queued++ >= LiveStackQueueLength) {
+      --m_queued;
+      ++m_skipped;
+      return false;
+   }
+   QMetaObject::invokeMethod(
+     this,
+     [this, frame]() mutable {
+        stack(std::move(frame));
+        --m_queued;
+     },
+     Qt::QueuedConnection);
+   return true;
+}
+
+void LiveStacker::setMethod(Method method)
+{
+   m_method = method;
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Public slots
+/* ***************************************************************************************************************** */
+void LiveStacker::reset()
+{
+   m_frames = 0;
+   m_skipped = 0;
+   m_referenceStars.clear();
+   m_referenceTriangles.clear();
+   std::vector<float>().swap(m_mean);
+   std::vector<float>().swap(m_squares);
+   std::vector<quint32>().swap(m_counts);
+   std::vector<quint8>().swap(m_rgb);
+   m_framePool.reset();
+   m_renderTimer->stop();
+   m_sinceRender.invalidate();
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Private methods
+/* ***************************************************************************************************************** */
+void LiveStacker::accumulate(const quint8 * samples, int bytesPerSample, int channels, const Transform & transform)
+{
+   Accumulator stack{ m_mean.data(),
+                      m_squares.empty() ? nullptr : m_squares.data(),
+                      m_counts.data(),
+                      m_width,
+                      m_height,
+                      channels };
+
+   // The transform maps frame pixels onto the stack; resampling needs the other way.
+   const auto scale = transform.a * transform.a + transform.b * transform.b;
+   SourceMap  map{ transform.a / scale,
+                  transform.b / scale,
+                  -(transform.a * transform.x + transform.b * transform.y) / scale,
+                  (transform.b * transform.x - transform.a * transform.y) / scale };
+   parallelRows(m_height, [&](int firstRow, int lastRow) {
+      if (bytesPerSample == 1) {
+         accumulateRows(samples, stack, map, firstRow, lastRow);
+      } else {
+         accumulateRows(reinterpret_cast<const quint16 *>(samples), stack, map, firstRow, lastRow); // NOLINT
+      }
+   });
+}
+
+auto LiveStacker::match(const StarField & field, Transform & transform) const -> bool
+{
+   const auto stars = field.stars.mid(0, LiveStackMatchStars);
+   const auto count = stars.count();
+   if (count < 3) {
+      return false;
+   }
+
+   // Each pair of triangles of the same shape votes for its corners being the same stars.
+   const auto       referenceCount = m_referenceStars.count();
+   const auto       tolerance      = static_cast<float>(LiveStackShapeTolerance);
+   std::vector<int> votes(static_cast<size_t>(count) * static_cast<size_t>(referenceCount), 0);
+   for (const auto & triangle : triangles(stars)) {
+      auto candidate = std::lower_bound(
+        m_referenceTriangles.cbegin(),
+        m_referenceTriangles.cend(),
+        triangle.longRatio - tolerance,
+        [](const Triangle & reference, float ratio) { return reference.longRatio < ratio; });
+      for (; candidate != m_referenceTriangles.cend() && candidate->longRatio <= triangle.longRatio + tolerance;
+           ++candidate) {
+         if (std::abs(candidate->shortRatio - triangle.shortRatio) <= tolerance) {
+            for (int corner = 0; corner < 3; ++corner) {
+               votes[static_cast<size_t>(triangle.stars[corner] * referenceCount + candidate->stars[corner])]++;
+            }
+         }
+      }
+   }
+
+   // A star is paired with the reference star it got the most votes for, if that star voted most for it too.
+   struct Pair
+   {
+      int star;
+      int reference;
+   };
+   std::vector<Pair> pairs;
+   for (int star = 0; star < count; ++star) {
+      const auto * row  = votes.data() + static_cast<size_t>(star) * static_cast<size_t>(referenceCount);
+      const auto   best = static_cast<int>(std::max_element(row, row + referenceCount) - row);
+      if (row[best] < LiveStackMinimumVotes) {
+         continue;
+      }
+      auto mutual = true;
+      for (int other = 0; other < count && mutual; ++other) {
+         mutual = other == star || votes[static_cast<size_t>(other * referenceCount + best)] < row[best];
+      }
+      if (mutual) {
+         pairs.push_back({ star, best });
+      }
+   }
+
+   // A least squares fit of the pairs; the worst is dropped until all fit.
+   while (static_cast<int>(pairs.size()) >= LiveStackMinimumMatches) {
+      double x{ 0.0 };
+      double y{ 0.0 };
+      double referenceX{ 0.0 };
+      double referenceY{ 0.0 };
+      for (const auto & pair : pairs) {
+         x += stars[pair.star].x;
+         y += stars[pair.star].y;
+         referenceX += m_referenceStars[pair.reference].x;
+         referenceY += m_referenceStars[pair.reference].y;
+      }
+      const auto pairCount = static_cast<double>(pairs.size());
+      x /= pairCount;
+      y /= pairCount;
+      referenceX /= pairCount;
+      referenceY /= pairCount;
+
+      double spread{ 0.0 };
+      double cosine{ 0.0 };
+      double sine{ 0.0 };
+      for (const auto & pair : pairs) {
+         const auto dx          = stars[pair.star].x - x;
+         const auto dy          = stars[pair.star].y - y;
+         const auto referenceDx = m_referenceStars[pair.reference].x - referenceX;
+         const auto referenceDy = m_referenceStars[pair.reference].y - referenceY;
+         spread += dx * dx + dy * dy;
+         cosine += dx * referenceDx + dy * referenceDy;
+         sine += dx * referenceDy - dy * referenceDx;
+      }
+      if (spread <= 0.0) {
+         return false;
+      }
+      transform.a = cosine / spread;
+      transform.b = sine / spread;
+      transform.x = referenceX - transform.a * x + transform.b * y;
+      transform.y = referenceY - transform.b * x - transform.a * y;
+
+      auto   worst = pairs.begin();
+      double worstResidual{ -1.0 };
+      for (auto pair = pairs.begin(); pair != pairs.end(); ++pair) {
+         const auto & star     = stars[pair->star];
+         const auto & target   = m_referenceStars[pair->reference];
+         const auto   residual = std::hypot(transform.a * star.x - transform.b * star.y + transform.x - target.x,
+                                          transform.b * star.x + transform.a * star.y + transform.y - target.y);
+         if (residual > worstResidual) {
+            worstResidual = residual;
+            worst         = pair;
+         }
+      }
+      if (worstResidual <= LiveStackMatchTolerance) {
+         // The optics do not change during a stack, so a fit that scales the frame is a false match.
+         return std::abs(std::hypot(transform.a, transform.b) - 1.0) <= LiveStackScaleTolerance;
+      }
+      pairs.erase(worst);
+   }
+   return false;
+}
+
+void LiveStacker::render()
+{
+   if (m_frames == 0 || !m_framePool) {
+      return;
+   }
+   auto stack = m_framePool->acquire();
+   if (stack.isNull()) {
+      // Every render handed out is still held; try again later rather than block the stacking.
+      m_renderTimer->start(LiveStackRenderInterval);
+      return;
+   }
+
+   const auto   scale     = m_bytesPerSample == 1 ? static_cast<float>((1 << BitDepth8) + 1) : 1.0F;
+   const auto   rowLength = static_cast<qint64>(m_width) * m_channels;
+   auto *       samples   = reinterpret_cast<quint16 *>(stack.data()); // NOLINT
+   const auto * mean      = m_mean.data();
+   parallelRows(m_height, [=](int firstRow, int lastRow) {
+      for (auto index = firstRow * rowLength; index < lastRow * rowLength; ++index) {
+         const auto value = std::min(std::max(mean[index] * scale, 0.0F), static_cast<float>((1 << BitDepth16) - 1));
+         samples[index]   = static_cast<quint16>(std::lrint(value));
+      }
+   });
+   stack.setGeometry(static_cast<quint32>(m_width),
+                     static_cast<quint32>(m_height),
+                     static_cast<quint32>(BitDepth16),
+                     static_cast<quint32>(m_channels));
+   stack.setBayerPattern(Frame::Monochrome);
+   stack.setExposureDuration(m_integration);
+   stack.setSequence(static_cast<quint64>(m_frames));
+   stack.setTimestamps(m_startTimestamp, m_readoutTimestamp);
+   stack.setStatistics(FrameStatistics::measure(stack));
+   m_sinceRender.start();
+   emit stackUpdated(stack, m_frames, m_skipped);
+}
+
+void LiveStacker::stack(Frame frame)
+{
+   if (frame.isNull() || frame.isFloat()) {
+      ++m_skipped;
+      return;
+   }
+   const auto mosaic   = frame.channels() <= 1 && frame.bayerPattern() != Frame::Monochrome;
+   const auto channels = mosaic || frame.channels() == 3 ? 3 : 1;
+   if (m_frames > 0
+       && (static_cast<int>(frame.width()) != m_width || static_cast<int>(frame.height()) != m_height
+           || channels != m_channels || frame.bytesPerSample() != m_bytesPerSample)) {
+      reset();
+   }
+
+   const auto field   = StarDetector::detect(frame);
+   Transform  transform;
+   if (m_frames == 0) {
+      if (field.stars.count() < LiveStackMinimumStars) {
+         ++m_skipped;
+         return;
+      }
+      start(frame, field, channels);
+   } else if (!match(field, transform)) {
+      ++m_skipped;
+      return;
+   }
+
+   const auto * samples = frame.constData();
+   if (mosaic) {
+      m_rgb.resize(static_cast<size_t>(frame.length()) * 3);
+      Debayer::debayer(frame, Debayer::Bilinear, m_rgb.data());
+      samples = m_rgb.data();
+   }
+   accumulate(samples, frame.bytesPerSample(), channels, transform);
+   m_frames++;
+   m_integration += frame.exposureDuration();
+   m_readoutTimestamp = frame.readoutTimestamp();
+   // Let the buffer go back to the pool before the render.
+   frame = Frame();
+
+   if (!m_sinceRender.isValid() || m_sinceRender.elapsed() >= LiveStackRenderInterval) {
+      m_renderTimer->stop();
+      render();
+   } else if (!m_renderTimer->isActive()) {
+      m_renderTimer->start(static_cast<int>(LiveStackRenderInterval - m_sinceRender.elapsed()));
+   }
+}
+
+void LiveStacker::start(const Frame & frame, const StarField & field, int channels)
+{
+   m_stackMethod        = m_method;
+   m_referenceStars     = field.stars.mid(0, LiveStackMatchStars);
+   m_referenceTriangles = triangles(m_referenceStars);
+   m_width              = static_cast<int>(frame.width());
+   m_height             = static_cast<int>(frame.height());
+   m_channels           = channels;
+   m_bytesPerSample     = frame.bytesPerSample();
+   m_integration        = 0.0;
+   m_startTimestamp     = frame.startTimestamp();
+
+   const auto samples = static_cast<size_t>(m_width) * static_cast<size_t>(m_height) * static_cast<size_t>(channels);
+   m_mean.assign(samples, 0.0F);
+   m_counts.assign(samples, 0);
+   if (m_stackMethod == KappaSigma) {
+      m_squares.assign(samples, 0.0F);
+   } else {
+      std::vector<float>().swap(m_squares);
+   }
+   m_framePool =
+     FramePool::create(static_cast<qint64>(samples) * static_cast<qint64>(sizeof(quint16)), LiveStackBuffers);
+}
+
+auto LiveStacker::triangles(const QVector<Star> & stars) -> std::vector<Triangle>
+{
+   struct Side
+   {
+      double length;
+      int    opposite;
+   };
+
+   std::vector<Triangle> found;
+   const auto            count = stars.count();
+   for (int first = 0; first < count; ++first) {
+      for (int second = first + 1; second < count; ++second) {
+         for (int third = second + 1; third < count; ++third) {
+            std::array<Side, 3> sides{ {
+              { std::hypot(stars[second].x - stars[third].x, stars[second].y - stars[third].y), first },
+              { std::hypot(stars[first].x - stars[third].x, stars[first].y - stars[third].y), second },
+              { std::hypot(stars[first].x - stars[second].x, stars[first].y - stars[second].y), third },
+            } };
+            std::sort(sides.begin(), sides.end(), [](const Side & one, const Side & other) {
+               return one.length > other.length;
+            });
+            // Small triangles are mostly centroid error.
+            if (sides[2].length < LiveStackMinimumSide) {
+               continue;
+            }
+            Triangle triangle;
+            triangle.longRatio  = static_cast<float>(sides[1].length / sides[0].length);
+            triangle.shortRatio = static_cast<float>(sides[2].length / sides[0].length);
+            for (int corner = 0; corner < 3; ++corner) {
+               triangle.stars[corner] = sides[static_cast<size_t>(corner)].opposite;
+            }
+            found.push_back(triangle);
+         }
+      }
+   }
+   std::sort(found.begin(), found.end(), [](const Triangle & one, const Triangle & other) {
+      return one.longRatio < other.longRatio;
+   });
+   return found;
+}
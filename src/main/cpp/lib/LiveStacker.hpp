@@ -0,0 +1,130 @@
+#pragma once
+
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "Frame.hpp"
+#include "StarDetector.hpp"
+#include <atomic>
+#include <memory>
+#include <QElapsedTimer>
+#include <QObject>
+#include <QTimer>
+#include <vector>
+
+class FramePool;
+
+/*! \brief Stacks frames as they arrive, for viewing faint objects live.
+ *
+ * Each frame's stars are found, and the frame registered to the first frame of the stack by matching triangles of
+ * its brightest stars, which holds through drift and field rotation.  The frame is then resampled onto the first and
+ * added to a running mean; for KappaSigma the running variance is kept too, and samples too far from the mean are left
+ * out, so satellites and planes do not stay in the stack.  A colour mosaic is debayered before it is added.
+ *
+ * The stack is held as floats the size of the first frame, so the memory used does not grow with the number of frames.
+ * It is rendered as a 16 bit frame at most every LiveStackRenderInterval.
+ *
+ * An instance lives on a thread of its own, so a frame is registered and added while the next one is exposed; the
+ * search and the resampling are spread across the global thread pool.
+ */
+class LiveStacker : public QObject
+{
+   Q_OBJECT
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+   Q_DISABLE_COPY_MOVE(LiveStacker)
+#endif
+
+public:
+   enum Method
+   {
+      Mean,
+      KappaSigma // the running mean of the samples within LiveStackKappa standard deviations of it
+   };
+   Q_ENUM(Method)
+
+   explicit LiveStacker(QObject * parent = nullptr);
+   ~LiveStacker() override = default;
+
+   [[nodiscard]] auto method() const -> Method;
+
+   /*!
+    * Queues a frame for stacking, unless LiveStackQueueLength frames are already waiting.  Safe to call from any
+    * thread.
+    *
+    * @return False if the frame was dropped.
+    */
+   auto               offer(const Frame & frame) -> bool;
+
+   /*!
+    * Sets how samples are combined; the stack started next uses it.  Safe to call from any thread.
+    */
+   void               setMethod(Method method);
+
+public slots:
+   /*!
+    * Empties the stack; the next frame registered starts a new one.
+    */
+   void reset();
+
+signals:
+   /*!
+    * Emitted with the rendered stack, no more often than every LiveStackRenderInterval.
+    *
+    * @param stack the 16 bit stack.
+    * @param frames the frames in the stack.
+    * @param skipped the frames offered since the stack started that are not in it; dropped, or not registered.
+    */
+   void stackUpdated(Frame stack, int frames, int skipped);
+
+private:
+   /*! \brief Maps frame pixels onto the first frame; a rotation, scale & shift.
+    */
+   struct Transform
+   {
+      double a{ 1.0 }; // scale × cos(rotation)
+      double b{ 0.0 }; // scale × sin(rotation)
+      double x{ 0.0 };
+      double y{ 0.0 };
+   };
+
+   struct Triangle
+   {
+      float longRatio{ 0.0F };  // the middle side over the longest
+      float shortRatio{ 0.0F }; // the shortest side over the longest
+      int   stars[3]{ 0, 0, 0 }; // opposite the longest, middle & shortest sides
+   };
+
+   void               accumulate(const quint8 * samples, int bytesPerSample, int channels, const Transform & transform);
+   [[nodiscard]] auto match(const StarField & field, Transform & transform) const -> bool;
+   void               render();
+   void               stack(Frame frame);
+   void               start(const Frame & frame, const StarField & field, int channels);
+   [[nodiscard]] static auto triangles(const QVector<Star> & stars) -> std::vector<Triangle>;
+
+   std::atomic<Method>        m_method;
+   std::atomic<int>           m_queued;
+   std::atomic<int>           m_skipped;
+
+   // Only used on the stacker's thread.
+   Method                     m_stackMethod;
+   QVector<Star>              m_referenceStars;
+   std::vector<Triangle>      m_referenceTriangles;
+   int                        m_width;
+   int                        m_height;
+   int                        m_channels;
+   int                        m_bytesPerSample;
+   int                        m_frames;
+   double                     m_integration; // in seconds
+   std::vector<float>         m_mean;
+   std::vector<float>         m_squares; // the running sum of squared deviations, for KappaSigma
+   std::vector<quint32>       m_counts;  // of the samples in the mean
+   std::vector<quint8>        m_rgb;     // a debayered frame
+   std::shared_ptr<FramePool> m_framePool;
+   qint64                     m_startTimestamp;   // of the first frame
+   qint64                     m_readoutTimestamp; // of the last frame
+   QElapsedTimer              m_sinceRender;
+   QTimer *                   m_renderTimer;
+};
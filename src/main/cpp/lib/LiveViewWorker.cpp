@@ -0,0 +1,172 @@
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "LiveViewWorker.hpp"
+
+#include "Config.h"
+#include "FramePool.hpp"
+#include "TransferMeter.hpp"
+#include <QDateTime>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include <QThread>
+#include <utility>
+
+#include <qhyccd.h>
+
+/* ***************************************************************************************************************** */
+// MARK: - ctors & dtors
+/* ***************************************************************************************************************** */
+LiveViewWorker::LiveViewWorker(std::shared_ptr<TransferMeter> transferMeter, QObject * parent)
+   : QObject(parent)
+   , m_busPriority(BusArbiter::Bulk)
+   , m_transferMeter(std::move(transferMeter))
+   , m_frameRate(0.0)
+   , m_overwrittenAtStart(0)
+   , m_starvedFrames(0)
+   , m_stopRequested(false)
+   , m_streaming(false)
+   , m_bayerPattern(Frame::Monochrome)
+   , m_handle(nullptr)
+{
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Public methods
+/* ***************************************************************************************************************** */
+auto LiveViewWorker::achievedFrameRate() const -> double
+{
+   return m_frameRate;
+}
+
+auto LiveViewWorker::droppedFrames() const -> quint64
+{
+   auto frames = std::atomic_load(&m_frames);
+   return m_starvedFrames + (frames ? frames->overwrittenFrames() - m_overwrittenAtStart : 0);
+}
+
+auto LiveViewWorker::frames() const -> std::shared_ptr<FrameRing>
+{
+   return std::atomic_load(&m_frames);
+}
+
+auto LiveViewWorker::isStreaming() const -> bool
+{
+   return m_streaming;
+}
+
+void LiveViewWorker::prepare(qhyccd_handle *            cameraHandle,
+                             std::shared_ptr<FramePool> framePool,
+                             Frame::BayerPattern        bayerPattern)
+{
+   QMutexLocker locker(&m_streamMutex);
+   m_handle       = cameraHandle;
+   m_bayerPattern = bayerPattern;
+   m_discardBuffer.clear();
+   if (cameraHandle == nullptr || !framePool) {
+      m_framePool.reset();
+      std::atomic_store(&m_frames, std::shared_ptr<FrameRing>());
+   } else if (framePool != m_framePool) {
+      m_framePool = framePool;
+      std::atomic_store(&m_frames, std::make_shared<FrameRing>(LiveFrameRingCapacity, framePool));
+   }
+}
+
+void LiveViewWorker::setBusArbiter(std::shared_ptr<BusArbiter> busArbiter, BusArbiter::Priority priority)
+{
+   m_busPriority = priority;
+   std::atomic_store(&m_busArbiter, std::move(busArbiter));
+}
+
+void LiveViewWorker::setDefectMap(std::shared_ptr<const DefectMap> defectMap)
+{
+   std::atomic_store(&m_defectMap, std::move(defectMap));
+}
+
+void LiveViewWorker::stop()
+{
+   m_stopRequested = true;
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Public slots
+/* ***************************************************************************************************************** */
+void LiveViewWorker::stream()
+{
+   QMutexLocker locker(&m_streamMutex);
+   if (m_handle == nullptr || !m_frames || !m_framePool) {
+      emit streamFailed(tr("The camera is not ready to stream."));
+      return;
+   }
+   if (BeginQHYCCDLive(m_handle) != QHYCCD_SUCCESS) {
+      emit streamFailed(tr("BeginQHYCCDLive failed."));
+      return;
+   }
+   auto & frames           = *m_frames;
+   m_overwrittenAtStart    = frames.overwrittenFrames();
+   m_starvedFrames         = 0;
+   m_frameRate             = 0.0;
+   m_stopRequested         = false;
+   m_streaming             = true;
+   emit streamingChanged(true);
+
+   auto          publishedAtLastReport = frames.publishedFrames();
+   QElapsedTimer statisticsTimer;
+   statisticsTimer.start();
+   while (!m_stopRequested) {
+      quint32 width{ 0 };
+      quint32 height{ 0 };
+      quint32 bitsPerPixel{ 0 };
+      quint32 channels{ 0 };
+      auto *  frame = frames.beginWrite();
+      if (frame == nullptr && m_discardBuffer.isEmpty()) {
+         // Consumers are holding every buffer; keep draining the camera so the stream does not stall.
+         m_discardBuffer = QByteArray(static_cast<int>(m_framePool->bufferLength()), Qt::Uninitialized);
+      }
+      auto * pixels = frame != nullptr ? frame->data() : reinterpret_cast<quint8 *>(m_discardBuffer.data()); // NOLINT
+      quint32 qhyResult{ QHYCCD_ERROR };
+      {
+         // Scoped to the download alone; a guide camera must not hold the bus while it sleeps between polls.
+         BusArbiter::Transfer transfer(std::atomic_load(&m_busArbiter), m_busPriority, m_transferMeter.get());
+         qhyResult = GetQHYCCDLiveFrame(m_handle, &width, &height, &bitsPerPixel, &channels, pixels);
+         if (qhyResult == QHYCCD_SUCCESS) {
+            auto bytesPerSample = bitsPerPixel > BitDepth8 ? 2 : 1;
+            transfer.complete(static_cast<qint64>(width) * height * qMax(channels, 1U) * bytesPerSample);
+         }
+      }
+      if (qhyResult == QHYCCD_SUCCESS) {
+         if (frame != nullptr) {
+            auto now = QDateTime::currentMSecsSinceEpoch();
+            // Only the metadata is set here.  Defects are left to the first consumer (see Frame::correctDefects()),
+            // and statistics to the consumers that want them, so nothing but the driver holds up the next download.
+            frame->setGeometry(width, height, bitsPerPixel, channels);
+            frame->setBayerPattern(m_bayerPattern);
+            frame->setDefectMap(std::atomic_load(&m_defectMap));
+            frame->setExposureDuration(0.0);
+            frame->setTimestamps(now, now);
+            frames.commitWrite();
+         } else {
+            ++m_starvedFrames;
+         }
+      } else {
+         QThread::usleep(LiveFramePollInterval);
+      }
+
+      if (statisticsTimer.elapsed() >= LiveStatisticsInterval) {
+         auto published = frames.publishedFrames() + m_starvedFrames;
+         m_frameRate    = static_cast<double>(published - publishedAtLastReport) * MillisecondsPerSecond
+                       / static_cast<double>(statisticsTimer.restart());
+         publishedAtLastReport = published;
+         emit statisticsChanged(m_frameRate, droppedFrames());
+      }
+   }
+
+   frames.abortWrite();
+   StopQHYCCDLive(m_handle);
+   m_streaming = false;
+   emit streamingChanged(false);
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "BusArbiter.hpp"
+#include "Frame.hpp"
+#include "FrameRing.hpp"
+#include <atomic>
+#include <memory>
+#include <QByteArray>
+#include <QMutex>
+#include <QObject>
+
+class DefectMap;
+class FramePool;
+class TransferMeter;
+
+using qhyccd_handle = void;
+
+/*! \brief Streams live view frames from a QHYCamera into a FrameRing.
+ *
+ * An instance of this class lives on a dedicated thread owned by the camera, and polls GetQHYCCDLiveFrame for as long
+ * as the stream runs.  Frames are downloaded straight into pooled buffers in the ring; the producer never waits on a
+ * consumer, and never posts per-frame events to the GUI thread.  When no slot or buffer is free the frame is still
+ * drained from the camera, and counted as dropped.
+ *
+ * The producer only fills and publishes frames.  Bad pixels are corrected by the first consumer to lease a frame, and
+ * live frames carry no statistics; a consumer that needs them measures the frames it takes, as DefectSurvey does.
+ */
+class LiveViewWorker : public QObject
+{
+   Q_OBJECT
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+   Q_DISABLE_COPY_MOVE(LiveViewWorker)
+#endif
+
+public:
+   /*!
+    * Creates the worker.
+    *
+    * @param transferMeter where downloads are accounted for; shared with the camera's other worker.
+    * @param parent the owner of the worker.
+    */
+   explicit LiveViewWorker(std::shared_ptr<TransferMeter> transferMeter, QObject * parent = nullptr);
+   ~LiveViewWorker() override = default;
+
+   /*!
+    * The frame rate achieved over the last statistics interval.  Safe to call from any thread.
+    */
+   [[nodiscard]] auto achievedFrameRate() const -> double;
+
+   /*!
+    * The count of frames lost since the stream started; either never read before being overwritten, or discarded
+    * because no slot or buffer was free.  Safe to call from any thread.
+    */
+   [[nodiscard]] auto droppedFrames() const -> quint64;
+   [[nodiscard]] auto frames() const -> std::shared_ptr<FrameRing>;
+   [[nodiscard]] auto isStreaming() const -> bool;
+
+   /*!
+    * Sets the camera to stream from, and re-creates the frame ring.  Blocks while a stream is running.
+    *
+    * @param cameraHandle the open camera, or nullptr to detach the worker from the camera.
+    * @param framePool the pool to draw frames from.
+    * @param bayerPattern the colour filter array of the sensor, for the current read mode.
+    */
+   void               prepare(qhyccd_handle *            cameraHandle,
+                              std::shared_ptr<FramePool> framePool,
+                              Frame::BayerPattern        bayerPattern);
+
+   /*!
+    * Sets the arbiter that orders downloads on the camera's USB bus.  Safe to call from any thread, even mid-download;
+    * the next download picks the change up.
+    *
+    * @param busArbiter the arbiter, or nullptr to download without waiting on other cameras.
+    * @param priority the priority of the camera's downloads.
+    */
+   void               setBusArbiter(std::shared_ptr<BusArbiter> busArbiter, BusArbiter::Priority priority);
+
+   /*!
+    * Sets the bad pixels corrected in each frame; see Frame::setDefectMap().  Safe to call from any thread; the next
+    * frame picks the change up.
+    *
+    * @param defectMap the bad pixels, or nullptr to leave frames as read.
+    */
+   void               setDefectMap(std::shared_ptr<const DefectMap> defectMap);
+
+   /*!
+    * Requests that the stream stop.  Safe to call from any thread.
+    */
+   void               stop();
+
+public slots:
+   void stream();
+
+signals:
+   void statisticsChanged(double framesPerSecond, quint64 droppedFrames);
+   void streamFailed(QString reason);
+   void streamingChanged(bool streaming);
+
+private:
+   QMutex                            m_streamMutex;
+   QByteArray                        m_discardBuffer;
+   std::shared_ptr<BusArbiter>       m_busArbiter;
+   std::shared_ptr<const DefectMap>  m_defectMap;
+   std::atomic<BusArbiter::Priority> m_busPriority;
+   std::shared_ptr<FramePool>        m_framePool;
+   std::shared_ptr<FrameRing>        m_frames;
+   std::shared_ptr<TransferMeter>    m_transferMeter;
+   std::atomic<double>               m_frameRate;
+   std::atomic<quint64>              m_overwrittenAtStart;
+   std::atomic<quint64>              m_starvedFrames;
+   std::atomic_bool                  m_stopRequested;
+   std::atomic_bool                  m_streaming;
+   Frame::BayerPattern               m_bayerPattern;
+   qhyccd_handle *                   m_handle;
+};
@@ -0,0 +1,357 @@
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "LuckyImager.hpp"
+
+#include "Calibrator.hpp"
+#include "FramePool.hpp"
+#include "FrameRing.hpp"
+#include "ParallelRows.hpp"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QThread>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define LUCKYIMAGER_X86 1
+#include <immintrin.h>
+#endif
+
+namespace
+{
+/*! \brief The sums over one row; each row's are added in double, so a large frame loses no precision.
+ */
+struct Energy
+{
+   double gradient{ 0.0 };
+   double level{ 0.0 };
+};
+
+/* ***************************************************************************************************************** */
+// MARK: - Scalar
+/* ***************************************************************************************************************** */
+template <class Sample>
+auto gradientScalar(const Sample * row, qint64 first, qint64 last, qint64 right, qint64 down) -> Energy
+{
+   Energy energy;
+   for (auto index = first; index < last; ++index) {
+      const auto here       = static_cast<float>(row[index]);
+      const auto horizontal = static_cast<float>(row[index + right]) - here;
+      const auto vertical   = static_cast<float>(row[index + down]) - here;
+      energy.gradient += static_cast<double>(horizontal * horizontal + vertical * vertical);
+      energy.level += static_cast<double>(here);
+   }
+   return energy;
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - SIMD
+/* ***************************************************************************************************************** */
+#ifdef LUCKYIMAGER_X86
+constexpr qint64 Lanes128 = 4; // 32 bit lanes
+constexpr qint64 Lanes256 = 8;
+
+__attribute__((target("sse4.1"), always_inline)) inline auto load128(const quint8 * raw) -> __m128
+{
+   qint32 packed{ 0 };
+   std::memcpy(&packed, raw, sizeof(packed));
+   return _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(packed)));
+}
+
+__attribute__((target("sse4.1"), always_inline)) inline auto load128(const quint16 * raw) -> __m128
+{
+   return _mm_cvtepi32_ps(_mm_cvtepu16_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(raw)))); // NOLINT
+}
+
+template <class Sample>
+__attribute__((target("sse4.1"))) auto gradientSSE41(const Sample * row, qint64 first, qint64 last, qint64 right,
+                                                     qint64 down) -> Energy
+{
+   auto gradient = _mm_setzero_ps();
+   auto level    = _mm_setzero_ps();
+   auto index    = first;
+   for (; index + Lanes128 <= last; index += Lanes128) {
+      const auto here       = load128(row + index);
+      const auto horizontal = _mm_sub_ps(load128(row + index + right), here);
+      const auto vertical   = _mm_sub_ps(load128(row + index + down), here);
+      gradient = _mm_add_ps(gradient, _mm_add_ps(_mm_mul_ps(horizontal, horizontal), _mm_mul_ps(vertical, vertical)));
+      level    = _mm_add_ps(level, here);
+   }
+   std::array<float, Lanes128> gradients{};
+   std::array<float, Lanes128> levels{};
+   _mm_storeu_ps(gradients.data(), gradient);
+   _mm_storeu_ps(levels.data(), level);
+   auto energy = gradientScalar(row, index, last, right, down);
+   for (qint64 lane = 0; lane < Lanes128; ++lane) {
+      energy.gradient += static_cast<double>(gradients.at(static_cast<size_t>(lane)));
+      energy.level += static_cast<double>(levels.at(static_cast<size_t>(lane)));
+   }
+   return energy;
+}
+
+__attribute__((target("avx2"), always_inline)) inline auto load256(const quint8 * raw) -> __m256
+{
+   return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(raw)))); // NOLINT
+}
+
+__attribute__((target("avx2"), always_inline)) inline auto load256(const quint16 * raw) -> __m256
+{
+   return _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(raw)))); // NOLINT
+}
+
+template <class Sample>
+__attribute__((target("avx2"))) auto gradientAVX2(const Sample * row, qint64 first, qint64 last, qint64 right,
+                                                  qint64 down) -> Energy
+{
+   auto gradient = _mm256_setzero_ps();
+   auto level    = _mm256_setzero_ps();
+   auto index    = first;
+   for (; index + Lanes256 <= last; index += Lanes256) {
+      const auto here       = load256(row + index);
+      const auto horizontal = _mm256_sub_ps(load256(row + index + right), here);
+      const auto vertical   = _mm256_sub_ps(load256(row + index + down), here);
+      gradient              = _mm256_add_ps(gradient,
+                               _mm256_add_ps(_mm256_mul_ps(horizontal, horizontal), _mm256_mul_ps(vertical, vertical)));
+      level                 = _mm256_add_ps(level, here);
+   }
+   std::array<float, Lanes256> gradients{};
+   std::array<float, Lanes256> levels{};
+   _mm256_storeu_ps(gradients.data(), gradient);
+   _mm256_storeu_ps(levels.data(), level);
+   auto energy = gradientScalar(row, index, last, right, down);
+   for (qint64 lane = 0; lane < Lanes256; ++lane) {
+      energy.gradient += static_cast<double>(gradients.at(static_cast<size_t>(lane)));
+      energy.level += static_cast<double>(levels.at(static_cast<size_t>(lane)));
+   }
+   return energy;
+}
+#endif
+
+template <class Sample>
+using GradientSpan = Energy (*)(const Sample *, qint64, qint64, qint64, qint64);
+
+template <class Sample>
+auto gradientSpan() -> GradientSpan<Sample>
+{
+   switch (Calibrator::kernel()) {
+#ifdef LUCKYIMAGER_X86
+   case Calibrator::AVX2:
+      return &gradientAVX2<Sample>;
+   case Calibrator::SSE41:
+      return &gradientSSE41<Sample>;
+#endif
+   default:
+      return &gradientScalar<Sample>;
+   }
+}
+
+/*!
+ * The gradient energy of a frame, over its squared mean level.
+ *
+ * @param step the distance to the next sample of the same colour; 2 in a mosaic, so the pattern is not seen as detail.
+ */
+template <class Sample>
+auto gradientEnergy(const Sample * samples, int width, int height, int channels, int step) -> double
+{
+   const auto rows = height - step;
+   if (rows <= 0 || width <= step) {
+      return 0.0;
+   }
+   const auto rowLength = static_cast<qint64>(width) * channels;
+   const auto count     = static_cast<qint64>(width - step) * channels;
+   const auto right     = static_cast<qint64>(step) * channels;
+   const auto down      = step * rowLength;
+   const auto span      = gradientSpan<Sample>();
+
+   std::vector<Energy> energies(static_cast<size_t>(rows));
+   parallelRows(rows, [&](int firstRow, int lastRow) {
+      for (int y = firstRow; y < lastRow; ++y) {
+         energies[static_cast<size_t>(y)] = span(samples + y * rowLength, 0, count, right, down);
+      }
+   });
+
+   Energy total;
+   for (const auto & energy : energies) {
+      total.gradient += energy.gradient;
+      total.level += energy.level;
+   }
+   const auto n    = static_cast<double>(count) * rows;
+   const auto mean = total.level / n;
+   return total.gradient / n / std::max(mean * mean, 1.0);
+}
+
+/*!
+ * Orders a heap with the least sharp candidate on top.
+ */
+template <class Candidate>
+auto sharper(const Candidate & left, const Candidate & right) -> bool
+{
+   return left.sharpness > right.sharpness;
+}
+} // namespace
+
+/* ***************************************************************************************************************** */
+// MARK: - ctors & dtors
+/* ***************************************************************************************************************** */
+LuckyImager::LuckyImager(QObject * parent)
+   : QObject(parent)
+   , m_running(false)
+   , m_stopRequested(false)
+{
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Public methods
+/* ***************************************************************************************************************** */
+auto LuckyImager::isRunning() const -> bool
+{
+   return m_running;
+}
+
+auto LuckyImager::sharpness(const Frame & frame) -> double
+{
+   if (frame.isNull() || frame.isFloat()) {
+      return 0.0;
+   }
+   const auto width    = static_cast<int>(frame.width());
+   const auto height   = static_cast<int>(frame.height());
+   const auto channels = static_cast<int>(qMax(frame.channels(), 1U));
+   const auto step     = frame.bayerPattern() == Frame::Monochrome ? 1 : 2;
+   if (frame.bytesPerSample() == 2) {
+      return gradientEnergy(reinterpret_cast<const quint16 *>(frame.constData()), // NOLINT
+                            width,
+                            height,
+                            channels,
+                            step);
+   }
+   return gradientEnergy(frame.constData(), width, height, channels, step);
+}
+
+void LuckyImager::stop()
+{
+   m_stopRequested = true;
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Public slots
+/* ***************************************************************************************************************** */
+void LuckyImager::run(std::shared_ptr<FrameRing> frames, LuckyImager::Options options)
+{
+   if (!frames || m_running) {
+      return;
+   }
+   const auto windowFrames = qMax(options.windowFrames, 1);
+   const auto keepFraction = qBound(0.0, options.keepFraction, 1.0);
+   const auto capacity     = qMax(1, qRound(windowFrames * keepFraction));
+   // Sized on the first frame; a frame may be copied in while the last window's are still being written.
+   m_framePool.reset();
+   m_kept.clear();
+   m_kept.reserve(static_cast<size_t>(capacity));
+   m_stopRequested = false;
+   m_running       = true;
+   emit runningChanged(true);
+
+   // Only frames from now on; the ring may hold frames of another target.
+   quint64 lastSequence{ 0 };
+   {
+      auto lease   = frames->latest();
+      lastSequence = lease.isValid() ? lease.frame().sequence() : 0;
+   }
+   quint64       scored{ 0 };
+   quint64       missed{ 0 };
+   int           windowScored{ 0 };
+   QElapsedTimer statisticsTimer;
+   statisticsTimer.start();
+   while (!m_stopRequested) {
+      auto lease = frames->next(lastSequence);
+      if (lease.isValid()) {
+         const auto & frame = lease.frame();
+         if (lastSequence != 0 && frame.sequence() > lastSequence + 1) {
+            missed += frame.sequence() - lastSequence - 1;
+         }
+         lastSequence         = frame.sequence();
+         const auto score     = sharpness(frame);
+         if (static_cast<int>(m_kept.size()) < capacity || score > m_kept.front().sharpness) {
+            keep(frame, score, capacity);
+         }
+         lease.release();
+         ++scored;
+         if (++windowScored >= windowFrames) {
+            flush(windowScored, keepFraction);
+            windowScored = 0;
+         }
+      } else {
+         QThread::usleep(LiveFramePollInterval);
+      }
+
+      if (statisticsTimer.elapsed() >= LiveStatisticsInterval) {
+         statisticsTimer.restart();
+         emit statisticsChanged(scored, missed);
+      }
+   }
+
+   flush(windowScored, keepFraction);
+   m_framePool.reset();
+   m_running = false;
+   emit statisticsChanged(scored, missed);
+   emit runningChanged(false);
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Private methods
+/* ***************************************************************************************************************** */
+void LuckyImager::flush(int scored, double keepFraction)
+{
+   // A short last window keeps its share, not a full window's.
+   const auto share = static_cast<size_t>(qMax(1, qRound(scored * keepFraction)));
+   while (m_kept.size() > share) {
+      std::pop_heap(m_kept.begin(), m_kept.end(), sharper<Candidate>);
+      m_kept.pop_back();
+   }
+   if (m_kept.empty()) {
+      return;
+   }
+   std::sort(m_kept.begin(), m_kept.end(), [](const Candidate & left, const Candidate & right) {
+      return left.frame.sequence() < right.frame.sequence();
+   });
+   QVector<Frame> selected;
+   selected.reserve(static_cast<int>(m_kept.size()));
+   for (auto & candidate : m_kept) {
+      selected.append(std::move(candidate.frame));
+   }
+   m_kept.clear();
+   emit framesSelected(selected, scored);
+}
+
+void LuckyImager::keep(const Frame & frame, double sharpness, int capacity)
+{
+   // The evicted frame's buffer goes back to the pool first, so a full heap never needs one more.
+   if (static_cast<int>(m_kept.size()) >= capacity) {
+      std::pop_heap(m_kept.begin(), m_kept.end(), sharper<Candidate>);
+      m_kept.pop_back();
+   }
+   if (!m_framePool || m_framePool->bufferLength() < frame.length()) {
+      m_framePool = FramePool::create(frame.length(), 2 * capacity + 1);
+   }
+   auto copy = m_framePool->acquire();
+   if (copy.isNull()) {
+      qWarning() << "The lucky imaging pool is exhausted; a frame was not kept.";
+      return;
+   }
+   std::memcpy(copy.data(), frame.constData(), static_cast<size_t>(frame.length()));
+   copy.setGeometry(frame.width(), frame.height(), frame.bitsPerPixel(), frame.channels());
+   copy.setBayerPattern(frame.bayerPattern());
+   copy.setExposureDuration(frame.exposureDuration());
+   copy.setSequence(frame.sequence());
+   copy.setQuality(frame.quality());
+   copy.setStatistics(frame.statistics());
+   copy.setTimestamps(frame.startTimestamp(), frame.readoutTimestamp());
+   m_kept.push_back({ sharpness, std::move(copy) });
+   std::push_heap(m_kept.begin(), m_kept.end(), sharper<Candidate>);
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "Config.h"
+#include "Frame.hpp"
+#include <atomic>
+#include <memory>
+#include <QMetaType>
+#include <QObject>
+#include <QVector>
+#include <vector>
+
+class FramePool;
+class FrameRing;
+
+/*! \brief Keeps the sharpest live view frames, for planetary and lunar imaging.
+ *
+ * Every frame published to the ring is scored as it arrives by its gradient energy: the mean squared difference between
+ * each sample and its right and lower neighbours of the same colour, over the squared mean level, so a frame is not
+ * favoured for being brighter.  The kernels are SSE4.1 and AVX2, picked once for the CPU, with a scalar fallback.
+ *
+ * The best Options::keepFraction of each window of Options::windowFrames frames are held in a min-heap, so a new frame
+ * only has to beat the worst kept one, and only a frame that does is copied out of the ring; into a buffer of the
+ * imager's own pool, so the ring never runs short.  At the end of each window, and when stopped, the kept frames are
+ * handed on in capture order, and only those need writing.  The pool holds two windows' worth, so one window can be
+ * written while the next is ranked.
+ *
+ * An instance lives on a thread of its own; run() polls the ring until stop() is called.
+ */
+class LuckyImager : public QObject
+{
+   Q_OBJECT
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+   Q_DISABLE_COPY_MOVE(LuckyImager)
+#endif
+
+public:
+   struct Options
+   {
+      double keepFraction{ LuckyKeepFraction }; // of the frames of each window
+      int    windowFrames{ LuckyWindowFrames };
+   };
+
+   explicit LuckyImager(QObject * parent = nullptr);
+   ~LuckyImager() override = default;
+
+   /*!
+    * Safe to call from any thread.
+    */
+   [[nodiscard]] auto        isRunning() const -> bool;
+
+   /*!
+    * The gradient energy of a frame; larger is sharper.  Only comparable between frames of one target and geometry.
+    *
+    * @return The sharpness, or 0 for a float frame.
+    */
+   [[nodiscard]] static auto sharpness(const Frame & frame) -> double;
+
+   /*!
+    * Requests that run() hand on what it has kept, and return.  Safe to call from any thread.
+    */
+   void                      stop();
+
+public slots:
+   /*!
+    * Scores the frames of a ring as they are published, until stop() is called.
+    */
+   void run(std::shared_ptr<FrameRing> frames, LuckyImager::Options options);
+
+signals:
+   /*!
+    * Emitted at the end of each window, and on stopping, with the frames kept; in capture order.  The frames belong to
+    * the imager's pool; release them once written.
+    *
+    * @param frames the frames kept.
+    * @param scored the frames of the window they were picked from.
+    */
+   void framesSelected(QVector<Frame> frames, int scored);
+   void runningChanged(bool running);
+
+   /*!
+    * Emitted every LiveStatisticsInterval while running.
+    *
+    * @param scored the frames scored since the run started.
+    * @param missed the frames overwritten in the ring before they were scored.
+    */
+   void statisticsChanged(quint64 scored, quint64 missed);
+
+private:
+   struct Candidate
+   {
+      double sharpness{ 0.0 };
+      Frame  frame;
+   };
+
+   void                       flush(int scored, double keepFraction);
+   void                       keep(const Frame & frame, double sharpness, int capacity);
+
+   std::atomic_bool           m_running;
+   std::atomic_bool           m_stopRequested;
+   std::vector<Candidate>     m_kept; // a min-heap on sharpness
+   std::shared_ptr<FramePool> m_framePool;
+};
+
+Q_DECLARE_METATYPE(LuckyImager::Options)
@@ -0,0 +1,311 @@
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "MasterBuilder.hpp"
+
+#include "FitsImage.hpp"
+#include "ParallelRows.hpp"
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QThreadPool>
+#include <vector>
+
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif
+
+namespace
+{
+using Images = std::vector<std::shared_ptr<const FitsImage>>;
+
+auto mean(const float * values, int count) -> double
+{
+   double sum{ 0.0 };
+   for (int index = 0; index < count; ++index) {
+      sum += values[index];
+   }
+   return sum / count;
+}
+
+auto standardDeviation(const float * values, int count) -> double
+{
+   const auto average = mean(values, count);
+   double     sum{ 0.0 };
+   for (int index = 0; index < count; ++index) {
+      sum += (values[index] - average) * (values[index] - average);
+   }
+   return std::sqrt(sum / count);
+}
+
+/*!
+ * The median; reorders the values.
+ */
+auto median(float * values, int count) -> double
+{
+   const auto middle = values + count / 2;
+   std::nth_element(values, middle, values + count);
+   if (count % 2 == 1) {
+      return *middle;
+   }
+   return (static_cast<double>(*middle) + *std::max_element(values, middle)) / 2.0;
+}
+
+/*!
+ * The deviation of the values with those beyond WinsorizedClipLimit deviations clamped to it, repeated until it
+ * settles; scaled so it matches the standard deviation of normal data.
+ */
+auto winsorizedDeviation(const float * values, int count, double center, float * scratch) -> double
+{
+   std::copy(values, values + count, scratch);
+   auto deviation = standardDeviation(scratch, count);
+   for (int iteration = 0; iteration < SigmaClipIterations && deviation > 0.0; ++iteration) {
+      const auto low  = static_cast<float>(center - WinsorizedClipLimit * deviation);
+      const auto high = static_cast<float>(center + WinsorizedClipLimit * deviation);
+      for (int index = 0; index < count; ++index) {
+         scratch[index] = std::min(std::max(scratch[index], low), high);
+      }
+      const auto previous = deviation;
+      deviation           = WinsorizedCorrection * standardDeviation(scratch, count);
+      if (std::abs(deviation - previous) <= WinsorizedTolerance * previous) {
+         break;
+      }
+   }
+   return deviation;
+}
+
+/*!
+ * Combines the values of one pixel; reorders them.
+ *
+ * @param values one per frame.
+ * @param scratch room for as many values.
+ * @param rejected incremented by the values left out.
+ */
+auto combine(float * values, int count, float * scratch, const MasterBuilder::Options & options, qint64 & rejected)
+  -> float
+{
+   switch (options.method) {
+   case MasterBuilder::Average:
+      return static_cast<float>(mean(values, count));
+   case MasterBuilder::Median:
+      return static_cast<float>(median(values, count));
+   case MasterBuilder::SigmaClip:
+   case MasterBuilder::WinsorizedSigmaClip:
+      break;
+   }
+
+   auto kept = count;
+   for (int iteration = 0; iteration < SigmaClipIterations && kept > 2; ++iteration) {
+      std::copy(values, values + kept, scratch);
+      const auto center    = median(scratch, kept);
+      const auto deviation = options.method == MasterBuilder::SigmaClip
+                               ? standardDeviation(values, kept)
+                               : winsorizedDeviation(values, kept, center, scratch);
+      if (deviation <= 0.0) {
+         break;
+      }
+      const auto low  = static_cast<float>(center - options.lowSigma * deviation);
+      const auto high = static_cast<float>(center + options.highSigma * deviation);
+      const auto end  = std::partition(
+        values, values + kept, [=](float value) { return value >= low && value <= high; });
+      const auto left = static_cast<int>(end - values);
+      if (left == kept || left == 0) {
+         break;
+      }
+      kept = left;
+   }
+   rejected += count - kept;
+   return static_cast<float>(mean(values, kept));
+}
+
+/*!
+ * The mean of every FlatNormalizationStride-th row of an image, as the scale of a flat.
+ */
+auto sampledMean(const FitsImage & image) -> double
+{
+   std::vector<float> row(static_cast<size_t>(image.width()) * static_cast<size_t>(image.channels()));
+   double             sum{ 0.0 };
+   qint64             count{ 0 };
+   for (int y = image.height() / (2 * FlatNormalizationStride); y < image.height(); y += FlatNormalizationStride) {
+      image.readRows(y, y + 1, row.data());
+      image.releaseRows(y, y + 1);
+      sum += mean(row.data(), static_cast<int>(row.size())) * static_cast<double>(row.size());
+      count += static_cast<qint64>(row.size());
+   }
+   return count > 0 ? sum / static_cast<double>(count) : 0.0;
+}
+
+auto peakResidentBytes() -> qint64
+{
+#ifdef Q_OS_UNIX
+   rusage usage{};
+   if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef Q_OS_MACOS
+      return static_cast<qint64>(usage.ru_maxrss); // in bytes
+#else
+      return static_cast<qint64>(usage.ru_maxrss) * BytesPerKilobyte; // in kilobytes
+#endif
+   }
+#endif
+   return 0;
+}
+} // namespace
+
+/* ***************************************************************************************************************** */
+// MARK: - ctors & dtors
+/* ***************************************************************************************************************** */
+MasterBuilder::MasterBuilder(QObject * parent)
+   : QObject(parent)
+   , m_cancelRequested(false)
+{
+   qRegisterMetaType<MasterBuilder::Options>();
+   qRegisterMetaType<MasterBuilder::Report>();
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Public methods
+/* ***************************************************************************************************************** */
+auto MasterBuilder::Report::succeeded() const -> bool
+{
+   return error.isEmpty();
+}
+
+auto MasterBuilder::Report::throughput() const -> double
+{
+   return elapsed > 0
+            ? static_cast<double>(bytesRead) / BytesPerMegabyte / (static_cast<double>(elapsed) / MillisecondsPerSecond)
+            : 0.0;
+}
+
+auto MasterBuilder::build(const QStringList & inputs, const QString & output, const Options & options) -> Report
+{
+   QElapsedTimer timer;
+   timer.start();
+   m_cancelRequested = false;
+
+   Report report;
+   Images images;
+   for (const auto & input : inputs) {
+      auto image = FitsImage::open(input);
+      if (!image) {
+         report.error = tr("%1 cannot be read as a FITS image.").arg(input);
+         return report;
+      }
+      if (!images.empty()
+          && (image->width() != images.front()->width() || image->height() != images.front()->height()
+              || image->channels() != images.front()->channels())) {
+         report.error = tr("%1 is not the size of %2.").arg(input, images.front()->path());
+         return report;
+      }
+      report.bytesRead += image->dataLength();
+      images.push_back(std::move(image));
+   }
+   if (images.empty()) {
+      report.error = tr("There are no frames to combine.");
+      return report;
+   }
+   report.frames   = static_cast<int>(images.size());
+   report.width    = images.front()->width();
+   report.height   = images.front()->height();
+   report.channels = images.front()->channels();
+
+   std::vector<double> scales(images.size(), 1.0);
+   if (options.kind == MasterFrame::Flat) {
+      std::vector<double> means(images.size());
+      std::transform(images.cbegin(), images.cend(), means.begin(), [](const auto & image) {
+         return sampledMean(*image);
+      });
+      for (size_t index = 0; index < images.size(); ++index) {
+         scales[index] = means[index] > 0.0 ? means.front() / means[index] : 1.0;
+      }
+   }
+
+   // Every thread that may work at once holds a band of every input.
+   const auto frames     = report.frames;
+   const auto rowSamples = static_cast<qint64>(report.width) * report.channels;
+   const auto threads    = QThreadPool::globalInstance()->maxThreadCount() + 1;
+   const auto rowsPerBudget =
+     options.memoryBudget / (static_cast<qint64>(threads) * frames * rowSamples * static_cast<qint64>(sizeof(float)));
+   report.bandRows =
+     static_cast<int>(qBound(static_cast<qint64>(1), rowsPerBudget, static_cast<qint64>(report.height)));
+   const auto bands = (report.height + report.bandRows - 1) / report.bandRows;
+
+   std::vector<float>  master(static_cast<size_t>(rowSamples) * static_cast<size_t>(report.height));
+   std::atomic<qint64> rejected{ 0 };
+   std::atomic<int>    rowsDone{ 0 };
+   parallelRows(
+     bands,
+     [&](int firstBand, int lastBand) {
+        std::vector<float> band(static_cast<size_t>(frames) * static_cast<size_t>(report.bandRows * rowSamples));
+        std::vector<float> values(static_cast<size_t>(frames));
+        std::vector<float> scratch(static_cast<size_t>(frames));
+        qint64             bandRejected{ 0 };
+        for (int bandIndex = firstBand; bandIndex < lastBand && !m_cancelRequested; ++bandIndex) {
+           const auto firstRow = bandIndex * report.bandRows;
+           const auto lastRow  = qMin(report.height, firstRow + report.bandRows);
+           const auto samples  = static_cast<size_t>((lastRow - firstRow) * rowSamples);
+           for (size_t frame = 0; frame < images.size(); ++frame) {
+              images[frame]->readRows(firstRow, lastRow, band.data() + frame * samples);
+              images[frame]->releaseRows(firstRow, lastRow);
+           }
+           auto * target = master.data() + static_cast<size_t>(firstRow * rowSamples);
+           for (size_t sample = 0; sample < samples; ++sample) {
+              for (size_t frame = 0; frame < images.size(); ++frame) {
+                 values[frame] = static_cast<float>(band[frame * samples + sample] * scales[frame]);
+              }
+              target[sample] = combine(values.data(), frames, scratch.data(), options, bandRejected);
+           }
+           emit progress(rowsDone += lastRow - firstRow, report.height);
+        }
+        rejected += bandRejected;
+     },
+     1);
+
+   if (m_cancelRequested) {
+      report.error = tr("The build was cancelled.");
+      return report;
+   }
+   if (!MasterFrame::save(output,
+                          options.kind,
+                          report.width,
+                          report.height,
+                          report.channels,
+                          images.front()->exposureDuration(),
+                          master.data())) {
+      report.error = tr("The master cannot be written to %1.").arg(output);
+      return report;
+   }
+   report.rejectedSamples   = rejected;
+   report.elapsed           = timer.elapsed();
+   report.peakResidentBytes = peakResidentBytes();
+   return report;
+}
+
+void MasterBuilder::cancel()
+{
+   m_cancelRequested = true;
+}
+
+auto MasterBuilder::inputsIn(const QString & directory) -> QStringList
+{
+   QStringList inputs;
+   const auto  entries = QDir(directory).entryInfoList(
+     { QString("*.fits"), QString("*.fit"), QString("*.fts") }, QDir::Files | QDir::Readable, QDir::Name);
+   for (const auto & entry : entries) {
+      inputs.append(entry.absoluteFilePath());
+   }
+   return inputs;
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Public slots
+/* ***************************************************************************************************************** */
+void MasterBuilder::start(QStringList inputs, QString output, MasterBuilder::Options options)
+{
+   emit finished(build(inputs, output, options));
+}
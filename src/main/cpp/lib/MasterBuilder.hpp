@@ -0,0 +1,120 @@
+#pragma once
+
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "Config.h"
+#include "MasterFrame.hpp"
+#include <atomic>
+#include <QMetaType>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+
+/*! \brief Combines a set of bias, dark or flat frames into a master.
+ *
+ * The inputs are FITS files, memory mapped; they are never loaded whole.  The frames are cut into bands of rows, and
+ * each band of every input is read, combined and released by one pool thread, so the memory used is the bands in
+ * flight, bounded by Options::memoryBudget, plus the master itself.  A hundred 60 megapixel frames take no more memory
+ * than a few.
+ *
+ * The frames of a flat are scaled to the same mean before they are combined.
+ *
+ * An instance may live on a thread of its own and build what it is asked to, reporting progress; or build() may be
+ * called directly, as by the command line.
+ */
+class MasterBuilder : public QObject
+{
+   Q_OBJECT
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+   Q_DISABLE_COPY_MOVE(MasterBuilder)
+#endif
+
+public:
+   enum Method
+   {
+      Average,
+      Median,
+      SigmaClip,          // the mean of the samples within the limits of the median, repeated until none are dropped
+      WinsorizedSigmaClip // as SigmaClip, with the deviation measured on winsorized samples, so outliers skew it less
+   };
+   Q_ENUM(Method)
+
+   struct Options
+   {
+      MasterFrame::Kind kind{ MasterFrame::Dark };
+      Method            method{ WinsorizedSigmaClip };
+      double            lowSigma{ SigmaClipLimit };  // in standard deviations below the median
+      double            highSigma{ SigmaClipLimit }; // in standard deviations above the median
+      qint64            memoryBudget{ MasterBuildMemoryBudget }; // in bytes, for the bands of input read at once
+   };
+
+   /*! \brief What a build did, and what it took.
+    */
+   struct Report
+   {
+      QString error; // empty if the master was written
+      int     frames{ 0 };
+      int     width{ 0 };
+      int     height{ 0 };
+      int     channels{ 0 };
+      int     bandRows{ 0 };
+      qint64  bytesRead{ 0 };         // of input pixel data
+      qint64  elapsed{ 0 };           // in milliseconds
+      qint64  peakResidentBytes{ 0 }; // of the process, so far; 0 where unknown
+      qint64  rejectedSamples{ 0 };
+
+      [[nodiscard]] auto succeeded() const -> bool;
+
+      /*!
+       * The input read per second, in MB.
+       */
+      [[nodiscard]] auto throughput() const -> double;
+   };
+
+   explicit MasterBuilder(QObject * parent = nullptr);
+   ~MasterBuilder() override = default;
+
+   /*!
+    * Builds a master on the calling thread and the global thread pool, emitting progress() on the way.
+    *
+    * @param inputs the FITS files, all of one size.
+    * @param output where the master goes; see MasterFrame.
+    * @param options how to combine the inputs.
+    */
+   auto                      build(const QStringList & inputs, const QString & output, const Options & options)
+     -> Report;
+
+   /*!
+    * Requests that the build in progress, if any, stop.  Safe to call from any thread.
+    */
+   void                      cancel();
+
+   /*!
+    * The FITS files in a directory, by name.
+    */
+   [[nodiscard]] static auto inputsIn(const QString & directory) -> QStringList;
+
+public slots:
+   /*!
+    * Builds a master, and emits finished().
+    */
+   void start(QStringList inputs, QString output, MasterBuilder::Options options);
+
+signals:
+   void finished(MasterBuilder::Report report);
+
+   /*!
+    * Emitted as bands are finished, with the rows done; from the threads doing the work.
+    */
+   void progress(int rowsDone, int rows);
+
+private:
+   std::atomic_bool m_cancelRequested;
+};
+
+Q_DECLARE_METATYPE(MasterBuilder::Options)
+Q_DECLARE_METATYPE(MasterBuilder::Report)
@@ -0,0 +1,176 @@
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "MasterFrame.hpp"
+
+#include "Config.h"
+#include <array>
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+
+namespace
+{
+/*! \brief The start of a master's cache file; padded so the samples that follow are aligned for SIMD loads.
+ */
+struct Header
+{
+   std::array<char, 8>  magic;
+   quint32              format;
+   quint32              kind;
+   quint32              width;
+   quint32              height;
+   quint32              channels;
+   quint32              reserved;
+   double               exposureDuration;
+   double               mean;
+   std::array<char, 16> padding;
+};
+static_assert(sizeof(Header) == static_cast<size_t>(MasterFrameHeaderLength),
+              "The samples of a master must start aligned.");
+
+const std::array<char, 8> Magic{ { 'Q', 'A', 'I', 'M', 'S', 'T', 'R', '\0' } };
+} // namespace
+
+/* ***************************************************************************************************************** */
+// MARK: - ctors & dtors
+/* ***************************************************************************************************************** */
+MasterFrame::MasterFrame(const QString & path)
+   : m_file(path)
+{
+}
+
+MasterFrame::~MasterFrame()
+{
+   if (m_map != nullptr) {
+      m_file.unmap(const_cast<uchar *>(m_map)); // NOLINT(cppcoreguidelines-pro-type-const-cast)
+   }
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Public methods
+/* ***************************************************************************************************************** */
+auto MasterFrame::channels() const -> int
+{
+   return m_channels;
+}
+
+auto MasterFrame::exposureDuration() const -> double
+{
+   return m_exposureDuration;
+}
+
+auto MasterFrame::height() const -> int
+{
+   return m_height;
+}
+
+auto MasterFrame::kind() const -> Kind
+{
+   return m_kind;
+}
+
+auto MasterFrame::mean() const -> double
+{
+   return m_mean;
+}
+
+auto MasterFrame::open(const QString & path) -> std::shared_ptr<const MasterFrame>
+{
+   std::shared_ptr<MasterFrame> master(new MasterFrame(path));
+   if (!master->m_file.open(QIODevice::ReadOnly)) {
+      qWarning() << "Cannot open the master frame" << path;
+      return nullptr;
+   }
+   Header header{};
+   if (master->m_file.read(reinterpret_cast<char *>(&header), sizeof(header)) != sizeof(header) // NOLINT
+       || header.magic != Magic || header.format != MasterFrameFormat || header.kind < Bias || header.kind > Flat) {
+      qWarning() << "The master frame" << path << "is not of this version's format";
+      return nullptr;
+   }
+   master->m_kind             = static_cast<Kind>(header.kind);
+   master->m_width            = static_cast<int>(header.width);
+   master->m_height           = static_cast<int>(header.height);
+   master->m_channels         = static_cast<int>(qMax(header.channels, 1U));
+   master->m_exposureDuration = header.exposureDuration;
+   master->m_mean             = header.mean;
+
+   const auto length = MasterFrameHeaderLength + master->sampleCount() * static_cast<qint64>(sizeof(float));
+   if (master->m_file.size() < length) {
+      qWarning() << "The master frame" << path << "is truncated";
+      return nullptr;
+   }
+   master->m_map = master->m_file.map(0, length);
+   if (master->m_map == nullptr) {
+      qWarning() << "Cannot map the master frame" << path;
+      return nullptr;
+   }
+   return master;
+}
+
+auto MasterFrame::path() const -> QString
+{
+   return m_file.fileName();
+}
+
+auto MasterFrame::save(const QString & path,
+                       Kind            kind,
+                       int             width,
+                       int             height,
+                       int             channels,
+                       double          exposureDuration,
+                       const float *   samples) -> bool
+{
+   const auto count = static_cast<qint64>(width) * height * qMax(channels, 1);
+   double     sum{ 0.0 };
+   for (qint64 index = 0; index < count; ++index) {
+      sum += samples[index];
+   }
+
+   Header header{};
+   header.magic            = Magic;
+   header.format           = MasterFrameFormat;
+   header.kind             = kind;
+   header.width            = static_cast<quint32>(width);
+   header.height           = static_cast<quint32>(height);
+   header.channels         = static_cast<quint32>(qMax(channels, 1));
+   header.exposureDuration = exposureDuration;
+   header.mean             = count > 0 ? sum / static_cast<double>(count) : 0.0;
+
+   if (!QDir().mkpath(QFileInfo(path).absolutePath())) {
+      qWarning() << "Cannot create the directory for the master frame" << path;
+      return false;
+   }
+   // A mapped master keeps reading the file it opened; the new one is renamed over it.
+   QSaveFile file(path);
+   if (!file.open(QIODevice::WriteOnly)) {
+      qWarning() << "Cannot write the master frame" << path;
+      return false;
+   }
+   file.write(reinterpret_cast<const char *>(&header), sizeof(header));                              // NOLINT
+   file.write(reinterpret_cast<const char *>(samples), count * static_cast<qint64>(sizeof(float))); // NOLINT
+   if (!file.commit()) {
+      qWarning() << "Cannot write the master frame" << path;
+      return false;
+   }
+   return true;
+}
+
+auto MasterFrame::samples() const -> const float *
+{
+   return reinterpret_cast<const float *>(m_map + MasterFrameHeaderLength); // NOLINT
+}
+
+auto MasterFrame::sampleCount() const -> qint64
+{
+   return static_cast<qint64>(m_width) * m_height * m_channels;
+}
+
+auto MasterFrame::width() const -> int
+{
+   return m_width;
+}
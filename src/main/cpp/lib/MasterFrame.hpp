@@ -0,0 +1,95 @@
+#pragma once
+
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include <memory>
+#include <QFile>
+#include <QString>
+
+/*! \brief A master bias, dark or flat, memory mapped from its cache file.
+ *
+ * The cache holds the samples as native 32 bit floats behind a short header, so opening one maps the file and reads
+ * nothing; the pages are read on the first pass over them, and shared by every calibrator that opens the same file.
+ * The file must not be changed while mapped; save() replaces it atomically instead.
+ *
+ * A flat records the mean of its samples, so it can be normalized on the fly.
+ */
+class MasterFrame
+{
+public:
+   enum Kind
+   {
+      Bias = 1,
+      Dark = 2,
+      Flat = 3
+   };
+
+   MasterFrame(const MasterFrame &) = delete;
+   MasterFrame(MasterFrame &&)      = delete;
+   ~MasterFrame();
+
+   auto                      operator=(const MasterFrame &) -> MasterFrame & = delete;
+   auto                      operator=(MasterFrame &&) -> MasterFrame & = delete;
+
+   /*!
+    * The number of channels per pixel; 1 for a mosaic or monochrome frame.
+    */
+   [[nodiscard]] auto        channels() const -> int;
+
+   /*!
+    * The exposure of the frames the master was made from, in seconds.
+    */
+   [[nodiscard]] auto        exposureDuration() const -> double;
+   [[nodiscard]] auto        height() const -> int;
+   [[nodiscard]] auto        kind() const -> Kind;
+   [[nodiscard]] auto        mean() const -> double;
+
+   /*!
+    * Maps a master's cache file.
+    *
+    * @return The master, or nullptr if the file is missing, of another format, or cannot be mapped.
+    */
+   [[nodiscard]] static auto open(const QString & path) -> std::shared_ptr<const MasterFrame>;
+   [[nodiscard]] auto        path() const -> QString;
+
+   /*!
+    * Writes a master's cache file, replacing any earlier one.
+    *
+    * @param samples width × height × channels samples, row by row.
+    * @return The success of writing the file.
+    */
+   static auto               save(const QString & path,
+                                  Kind            kind,
+                                  int             width,
+                                  int             height,
+                                  int             channels,
+                                  double          exposureDuration,
+                                  const float *   samples) -> bool;
+
+   /*!
+    * The samples; width × height × channels of them, row by row.
+    */
+   [[nodiscard]] auto        samples() const -> const float *;
+
+   /*!
+    * The number of samples.
+    */
+   [[nodiscard]] auto        sampleCount() const -> qint64;
+   [[nodiscard]] auto        width() const -> int;
+
+private:
+   explicit MasterFrame(const QString & path);
+
+   QFile          m_file;
+   const uchar *  m_map{ nullptr };
+   Kind           m_kind{ Bias };
+   int            m_width{ 0 };
+   int            m_height{ 0 };
+   int            m_channels{ 1 };
+   double         m_exposureDuration{ 0.0 };
+   double         m_mean{ 0.0 };
+};
@@ -0,0 +1,79 @@
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "ParallelRows.hpp"
+
+#include <atomic>
+#include <QRunnable>
+#include <QSemaphore>
+#include <QThreadPool>
+
+namespace
+{
+struct RowJob
+{
+   const std::function<void(int, int)> & work;
+   int                                   rows;
+   int                                   chunkRows;
+   int                                   chunks;
+   std::atomic<int>                      nextChunk{ 0 };
+   QSemaphore                            helpersDone{ 0 };
+
+   void runChunks()
+   {
+      for (auto chunk = nextChunk++; chunk < chunks; chunk = nextChunk++) {
+         work(chunk * chunkRows, qMin(rows, (chunk + 1) * chunkRows));
+      }
+   }
+};
+
+class RowHelper : public QRunnable
+{
+public:
+   explicit RowHelper(RowJob * job)
+      : m_job(job)
+   {
+   }
+
+   void run() override
+   {
+      m_job->runChunks();
+      m_job->helpersDone.release();
+   }
+
+private:
+   RowJob * m_job;
+};
+} // namespace
+
+void parallelRows(int rows, const std::function<void(int firstRow, int lastRow)> & work, int minimumRows)
+{
+   if (rows <= 0) {
+      return;
+   }
+   auto * pool      = QThreadPool::globalInstance();
+   auto   maxChunks = qMax(1, pool->maxThreadCount() * ParallelChunksPerThread);
+   auto   chunks    = qBound(1, rows / qMax(1, minimumRows), maxChunks);
+   if (chunks == 1) {
+      work(0, rows);
+      return;
+   }
+   auto   chunkRows = (rows + chunks - 1) / chunks;
+   RowJob job{ work, rows, chunkRows, (rows + chunkRows - 1) / chunkRows };
+
+   // Only idle threads are asked to help, so a caller that is itself on the pool can never wait on a queued helper.
+   int helpers{ 0 };
+   while (helpers < job.chunks - 1) {
+      auto * helper = new RowHelper(&job); // NOLINT(cppcoreguidelines-owning-memory)
+      if (!pool->tryStart(helper)) {
+         delete helper; // NOLINT(cppcoreguidelines-owning-memory)
+         break;
+      }
+      ++helpers;
+   }
+   job.runChunks();
+   job.helpersDone.acquire(helpers);
+}
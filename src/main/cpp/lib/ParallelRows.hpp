@@ -0,0 +1,24 @@
+#pragma once
+
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "Config.h"
+#include <functional>
+
+/*!
+ * Splits the rows of an image into chunks, and runs them on the global thread pool and the calling thread.  Returns
+ * once every row has been processed.
+ *
+ * The calling thread works through chunks too, and helpers are only started on idle pool threads, so this is safe to
+ * call from a pool thread; with no thread free, every chunk runs on the caller.
+ *
+ * @param rows the number of rows.
+ * @param work called with a half open range of rows, [firstRow, lastRow); it may run on several threads at once.
+ * @param minimumRows the fewest rows worth handing to another thread.
+ */
+void parallelRows(int rows, const std::function<void(int firstRow, int lastRow)> & work,
+                  int minimumRows = ParallelRowsMinimum);
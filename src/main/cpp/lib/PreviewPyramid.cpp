@@ -0,0 +1,357 @@
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "PreviewPyramid.hpp"
+
+#include "Debayer.hpp"
+#include "ParallelRows.hpp"
+#include <cmath>
+#include <cstddef>
+#include <QMutexLocker>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define PYRAMID_X86 1
+#include <immintrin.h>
+#endif
+
+namespace
+{
+using Level = PreviewPyramid::Level;
+
+constexpr quint16 Widen8Bit = 257; // takes 255 to 65535
+
+// Rounds half up, as pavgw does, so the SIMD and scalar binning agree.
+inline auto average(unsigned a, unsigned b) -> unsigned
+{
+   return (a + b + 1U) >> 1U;
+}
+
+inline auto widened(quint8 sample) -> quint16
+{
+   return static_cast<quint16>(sample * Widen8Bit);
+}
+
+inline auto widened(quint16 sample) -> quint16
+{
+   return sample;
+}
+
+auto emptyLevel(int width, int height, int channels) -> Level
+{
+   Level level;
+   level.width    = qMax(width, 0);
+   level.height   = qMax(height, 0);
+   level.channels = channels;
+   level.samples.resize(level.width * level.height * channels);
+   return level;
+}
+
+auto planeOf(Level & level, int channel) -> quint16 *
+{
+   return level.samples.data() + static_cast<std::ptrdiff_t>(channel) * level.width * level.height;
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - 2 × 2 binning
+/* ***************************************************************************************************************** */
+template <class T>
+void binRowScalar(const T * top, const T * bottom, int first, int width, quint16 * binned)
+{
+   for (int x = first; x < width; ++x) {
+      const auto left  = average(top[2 * x], bottom[2 * x]);
+      const auto right = average(top[2 * x + 1], bottom[2 * x + 1]);
+      binned[x]        = widened(static_cast<T>(average(left, right)));
+   }
+}
+
+#ifdef PYRAMID_X86
+__attribute__((target("sse4.1"))) void binRowSSE41(const quint16 * top, const quint16 * bottom, int width,
+                                                   quint16 * binned)
+{
+   constexpr int Lanes     = 8;
+   const auto    lowHalves = _mm_set1_epi32(0xFFFF);
+   const auto    one       = _mm_set1_epi32(1);
+   // Average vertically in 16 bits, then add each horizontal pair in 32 bits and pack back down.
+   auto          pairAverage = [&](const quint16 * topPair, const quint16 * bottomPair) {
+      const auto vertical = _mm_avg_epu16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(topPair)),
+                                          _mm_loadu_si128(reinterpret_cast<const __m128i *>(bottomPair)));
+      const auto sum      = _mm_add_epi32(_mm_and_si128(vertical, lowHalves), _mm_srli_epi32(vertical, 16));
+      return _mm_srli_epi32(_mm_add_epi32(sum, one), 1);
+   };
+   int x = 0;
+   for (; x + Lanes <= width; x += Lanes) {
+      const auto * topPair    = top + 2 * x;
+      const auto * bottomPair = bottom + 2 * x;
+      const auto   low        = pairAverage(topPair, bottomPair);
+      const auto   high       = pairAverage(topPair + Lanes, bottomPair + Lanes);
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(binned + x), _mm_packus_epi32(low, high));
+   }
+   binRowScalar(top, bottom, x, width, binned);
+}
+#endif
+
+void binRow(const quint16 * top, const quint16 * bottom, int width, quint16 * binned)
+{
+#ifdef PYRAMID_X86
+   static const bool hasSSE41 = [] {
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("sse4.1") != 0;
+   }();
+   if (hasSSE41) {
+      binRowSSE41(top, bottom, width, binned);
+      return;
+   }
+#endif
+   binRowScalar(top, bottom, 0, width, binned);
+}
+
+void binRow(const quint8 * top, const quint8 * bottom, int width, quint16 * binned)
+{
+   binRowScalar(top, bottom, 0, width, binned);
+}
+
+/*!
+ * Bins one plane of width × height samples, with rows of stride samples.
+ */
+template <class T>
+void binPlane(const T * source, int stride, quint16 * binned, int width, int height)
+{
+   parallelRows(height, [=](int firstRow, int lastRow) {
+      for (int y = firstRow; y < lastRow; ++y) {
+         const auto * top = source + static_cast<std::ptrdiff_t>(2 * y) * stride;
+         binRow(top, top + stride, width, binned + static_cast<std::ptrdiff_t>(y) * width);
+      }
+   });
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - First level
+/* ***************************************************************************************************************** */
+/*!
+ * Takes each 2 × 2 cell of a mosaic as one RGB pixel: its red, the average of its greens, and its blue.
+ */
+template <class T>
+void superPixels(const T * mosaic, int stride, Frame::BayerPattern pattern, Level & level)
+{
+   // Where red sits in the cell; blue is opposite, and the greens fill the other corners.
+   const int redX  = pattern == Frame::GRBG || pattern == Frame::BGGR ? 1 : 0;
+   const int redY  = pattern == Frame::GBRG || pattern == Frame::BGGR ? 1 : 0;
+   auto *    red   = planeOf(level, 0);
+   auto *    green = planeOf(level, 1);
+   auto *    blue  = planeOf(level, 2);
+   parallelRows(level.height, [=, &level](int firstRow, int lastRow) {
+      for (int y = firstRow; y < lastRow; ++y) {
+         const std::array<const T *, 2> rows{ mosaic + static_cast<std::ptrdiff_t>(2 * y) * stride,
+                                              mosaic + static_cast<std::ptrdiff_t>(2 * y + 1) * stride };
+         const auto                     offset = static_cast<std::ptrdiff_t>(y) * level.width;
+         for (int x = 0; x < level.width; ++x) {
+            red[offset + x]   = widened(rows[redY][2 * x + redX]);
+            blue[offset + x]  = widened(rows[1 - redY][2 * x + 1 - redX]);
+            green[offset + x] = widened(static_cast<T>(
+              average(rows[redY][2 * x + 1 - redX], rows[1 - redY][2 * x + redX])));
+         }
+      }
+   });
+}
+
+/*!
+ * Bins each channel of an interleaved frame, which the driver gives in B, G, R order.
+ */
+template <class T>
+void binInterleaved(const T * pixels, int frameWidth, Level & level)
+{
+   const auto stride = 3 * static_cast<std::ptrdiff_t>(frameWidth);
+   parallelRows(level.height, [=, &level](int firstRow, int lastRow) {
+      for (int channel = 0; channel < 3; ++channel) {
+         auto *     plane  = planeOf(level, channel);
+         const auto source = 2 - channel;
+         for (int y = firstRow; y < lastRow; ++y) {
+            const auto * top    = pixels + 2 * y * stride;
+            const auto * bottom = top + stride;
+            for (int x = 0; x < level.width; ++x) {
+               const auto left  = average(top[6 * x + source], bottom[6 * x + source]);
+               const auto right = average(top[6 * x + 3 + source], bottom[6 * x + 3 + source]);
+               plane[static_cast<std::ptrdiff_t>(y) * level.width + x] = widened(static_cast<T>(average(left, right)));
+            }
+         }
+      }
+   });
+}
+
+template <class T>
+void buildFirstLevel(const Frame & frame, const T * samples, int channels, Level & level)
+{
+   const auto width = static_cast<int>(frame.width());
+   if (frame.channels() == 3) {
+      binInterleaved(samples, width, level);
+   } else if (channels == 3) {
+      superPixels(samples, width, frame.bayerPattern(), level);
+   } else {
+      binPlane(samples, width, planeOf(level, 0), level.width, level.height);
+   }
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Regions
+/* ***************************************************************************************************************** */
+template <class T>
+void copyRegion(const Frame & frame, const T * samples, const QRect & area, Level & region)
+{
+   const auto width    = static_cast<std::ptrdiff_t>(frame.width());
+   const auto channels = static_cast<int>(qMax(frame.channels(), 1U));
+   for (int y = 0; y < region.height; ++y) {
+      const auto * row = samples + ((area.top() + y) * width + area.left()) * channels;
+      for (int channel = 0; channel < region.channels; ++channel) {
+         auto *     plane  = planeOf(region, channel) + static_cast<std::ptrdiff_t>(y) * region.width;
+         const auto source = channels == 3 ? 2 - channel : channel; // B, G, R order
+         for (int x = 0; x < region.width; ++x) {
+            plane[x] = widened(row[x * channels + source]);
+         }
+      }
+   }
+}
+
+template <class T>
+void debayerRegion(const Frame & frame, const T * mosaic, const QRect & area, Level & region)
+{
+   // Debayer a margin around the area too, so its edges interpolate from real neighbours.  The margin starts on an
+   // even pixel to keep the colour filter phase.
+   auto margin = area.adjusted(-2, -2, 2, 2).intersected(QRect(0, 0, static_cast<int>(frame.width()),
+                                                               static_cast<int>(frame.height())));
+   margin.setLeft(margin.left() & ~1);
+   margin.setTop(margin.top() & ~1);
+   if (margin.width() < 2 || margin.height() < 2) {
+      copyRegion(frame, mosaic, area, region);
+      return;
+   }
+   const auto     frameWidth = static_cast<std::ptrdiff_t>(frame.width());
+   std::vector<T> cropped(static_cast<size_t>(margin.width()) * static_cast<size_t>(margin.height()));
+   for (int y = 0; y < margin.height(); ++y) {
+      const auto * row = mosaic + (margin.top() + y) * frameWidth + margin.left();
+      std::copy(row, row + margin.width(), cropped.begin() + static_cast<std::ptrdiff_t>(y) * margin.width());
+   }
+   std::vector<T> rgb(cropped.size() * 3);
+   Debayer::debayer(cropped.data(), margin.width(), margin.height(), frame.bayerPattern(), Debayer::Bilinear,
+                    rgb.data());
+   const auto originX = area.left() - margin.left();
+   const auto originY = area.top() - margin.top();
+   for (int y = 0; y < region.height; ++y) {
+      const auto * row = rgb.data() + ((originY + y) * static_cast<std::ptrdiff_t>(margin.width()) + originX) * 3;
+      for (int channel = 0; channel < 3; ++channel) {
+         auto * plane = planeOf(region, channel) + static_cast<std::ptrdiff_t>(y) * region.width;
+         for (int x = 0; x < region.width; ++x) {
+            plane[x] = widened(row[3 * x + channel]);
+         }
+      }
+   }
+}
+
+template <class T>
+void buildRegion(const Frame & frame, const T * samples, const QRect & area, Level & region)
+{
+   if (frame.channels() <= 1 && region.channels == 3) {
+      debayerRegion(frame, samples, area, region);
+   } else {
+      copyRegion(frame, samples, area, region);
+   }
+}
+} // namespace
+
+/* ***************************************************************************************************************** */
+// MARK: - Level
+/* ***************************************************************************************************************** */
+auto PreviewPyramid::Level::isEmpty() const -> bool
+{
+   return width == 0 || height == 0;
+}
+
+auto PreviewPyramid::Level::plane(int channel) const -> const quint16 *
+{
+   return samples.constData() + static_cast<std::ptrdiff_t>(channel) * width * height;
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - ctors & dtors
+/* ***************************************************************************************************************** */
+PreviewPyramid::PreviewPyramid(Frame frame)
+   : m_frame(frame.isFloat() ? Frame() : std::move(frame))
+   , m_channels(m_frame.channels() == 3 || m_frame.bayerPattern() != Frame::Monochrome ? 3 : 1)
+{
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Public methods
+/* ***************************************************************************************************************** */
+auto PreviewPyramid::channels() const -> int
+{
+   return m_channels;
+}
+
+auto PreviewPyramid::frame() const -> const Frame &
+{
+   return m_frame;
+}
+
+auto PreviewPyramid::level(int level) -> const Level &
+{
+   static const Level none;
+   if (level < 1 || level > PreviewPyramidLevels || m_frame.isNull()) {
+      return none;
+   }
+   // Held while building, so a level is only ever built once, and never moved once handed out.
+   QMutexLocker locker(&m_levelsMutex);
+   for (int reduction = 1; reduction <= level; ++reduction) {
+      auto & current = m_levels[static_cast<size_t>(reduction - 1)];
+      if (!current.isEmpty()) {
+         continue;
+      }
+      const auto levelSize = size(reduction);
+      auto       built     = emptyLevel(levelSize.width(), levelSize.height(), m_channels);
+      if (reduction > 1) {
+         const auto & below = m_levels[static_cast<size_t>(reduction - 2)];
+         for (int channel = 0; channel < m_channels; ++channel) {
+            binPlane(below.plane(channel), below.width, planeOf(built, channel), built.width, built.height);
+         }
+      } else if (m_frame.bytesPerSample() == 1) {
+         buildFirstLevel(m_frame, m_frame.constData(), m_channels, built);
+      } else {
+         buildFirstLevel(m_frame, reinterpret_cast<const quint16 *>(m_frame.constData()), m_channels, built);
+      }
+      current = std::move(built);
+   }
+   return m_levels[static_cast<size_t>(level - 1)];
+}
+
+auto PreviewPyramid::levelFor(double zoom) -> int
+{
+   if (zoom <= 0.0 || zoom >= 1.0) {
+      return 0;
+   }
+   return qMin(static_cast<int>(std::floor(std::log2(1.0 / zoom))), PreviewPyramidLevels);
+}
+
+auto PreviewPyramid::region(const QRect & area) const -> Level
+{
+   const auto clipped = area.intersected(QRect(QPoint(0, 0), size()));
+   if (m_frame.isNull() || clipped.isEmpty()) {
+      return Level();
+   }
+   auto region = emptyLevel(clipped.width(), clipped.height(), m_channels);
+   if (m_frame.bytesPerSample() == 1) {
+      buildRegion(m_frame, m_frame.constData(), clipped, region);
+   } else {
+      buildRegion(m_frame, reinterpret_cast<const quint16 *>(m_frame.constData()), clipped, region);
+   }
+   return region;
+}
+
+auto PreviewPyramid::size(int level) const -> QSize
+{
+   const auto shift = qBound(0, level, PreviewPyramidLevels);
+   return QSize(static_cast<int>(m_frame.width() >> shift), static_cast<int>(m_frame.height() >> shift));
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "Config.h"
+#include "Frame.hpp"
+#include <array>
+#include <QMutex>
+#include <QRect>
+#include <QVector>
+
+/*! \brief Reduced copies of one frame, for display.
+ *
+ * Level n averages 2ⁿ × 2ⁿ blocks of the frame, up to PreviewPyramidLevels; each level is binned in software from the
+ * one below it the first time it is asked for.  A viewer reads the level that matches its zoom, so a large frame shown
+ * small never has its full resolution scaled.  At full resolution only the region on screen is converted, by region().
+ *
+ * For a colour frame, level 1 takes one RGB pixel from each 2 × 2 cell of the mosaic, so no level needs debayering;
+ * only region() does.
+ *
+ * This is for display only; it never changes the frame, nor the camera's binning.  Levels are safe to request from any
+ * thread.
+ */
+class PreviewPyramid
+{
+public:
+   /*! \brief The pixels of one level, or of one region.
+    */
+   struct Level
+   {
+      int                width{ 0 };
+      int                height{ 0 };
+      int                channels{ 1 }; // 3 for colour, in R, G, B order
+      QVector<quint16>   samples;       // one plane per channel, each width × height; 8 bit frames are scaled to 16
+
+      [[nodiscard]] auto isEmpty() const -> bool;
+      [[nodiscard]] auto plane(int channel) const -> const quint16 *;
+   };
+
+   explicit PreviewPyramid(Frame frame);
+   PreviewPyramid(const PreviewPyramid &) = delete;
+   PreviewPyramid(PreviewPyramid &&)      = delete;
+   ~PreviewPyramid()                      = default;
+
+   auto                      operator=(const PreviewPyramid &) -> PreviewPyramid & = delete;
+   auto                      operator=(PreviewPyramid &&) -> PreviewPyramid & = delete;
+
+   /*!
+    * 3 for a frame with a colour filter array, or with three channels; 1 otherwise.
+    */
+   [[nodiscard]] auto        channels() const -> int;
+   [[nodiscard]] auto        frame() const -> const Frame &;
+
+   /*!
+    * A reduced level, built on first use.  The reference stays valid for the life of the pyramid.
+    *
+    * @param level from 1 to PreviewPyramidLevels.
+    */
+   [[nodiscard]] auto        level(int level) -> const Level &;
+
+   /*!
+    * The level to display at a zoom; the most reduced one that still has a pixel for every pixel on screen.
+    *
+    * @param zoom screen pixels per frame pixel.
+    * @return 0 for full resolution, otherwise a level for level().
+    */
+   [[nodiscard]] static auto levelFor(double zoom) -> int;
+
+   /*!
+    * The full resolution pixels of part of the frame, debayered if need be.
+    *
+    * @param area the part wanted, in frame pixels; clipped to the frame.
+    */
+   [[nodiscard]] auto        region(const QRect & area) const -> Level;
+
+   /*!
+    * The size of a level, or of the frame for level 0.
+    */
+   [[nodiscard]] auto        size(int level = 0) const -> QSize;
+
+private:
+   Frame                                   m_frame;
+   int                                     m_channels;
+   QMutex                                  m_levelsMutex;
+   std::array<Level, PreviewPyramidLevels> m_levels; // m_levels[0] is level 1
+};
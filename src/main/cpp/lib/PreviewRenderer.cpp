@@ -0,0 +1,204 @@
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "PreviewRenderer.hpp"
+
+#include "Config.h"
+#include "Histogram.hpp"
+#include "PreviewPyramid.hpp"
+#include "ScreenStretch.hpp"
+#include <cmath>
+#include <QMutexLocker>
+#include <utility>
+
+/* ***************************************************************************************************************** */
+// MARK: - ctors & dtors
+/* ***************************************************************************************************************** */
+PreviewRenderer::PreviewRenderer(QObject * parent)
+   : QObject(parent)
+{
+   qRegisterMetaType<Preview>();
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Public methods
+/* ***************************************************************************************************************** */
+auto Preview::isNull() const -> bool
+{
+   return !pyramid;
+}
+
+auto Preview::tilesCovering(int tileLevel, const QRectF & area) const -> QRect
+{
+   if (!pyramid) {
+      return {};
+   }
+   const auto levelSize = pyramid->size(tileLevel);
+   const auto scale     = static_cast<double>(1 << tileLevel) * ViewerTileSize;
+   auto       tileAt    = [scale](double position) { return static_cast<int>(std::floor(position / scale)); };
+   return QRect(QPoint(qMax(0, tileAt(area.left())), qMax(0, tileAt(area.top()))),
+                QPoint(qMin((levelSize.width() - 1) / ViewerTileSize, tileAt(area.right())),
+                       qMin((levelSize.height() - 1) / ViewerTileSize, tileAt(area.bottom()))));
+}
+
+auto Preview::tileArea(int tileLevel, int column, int row) const -> QRect
+{
+   return QRect(column * ViewerTileSize, row * ViewerTileSize, ViewerTileSize, ViewerTileSize)
+     .intersected(QRect(QPoint(0, 0), pyramid->size(tileLevel)));
+}
+
+auto Preview::tileKey(int column, int row) -> quint64
+{
+   return (static_cast<quint64>(static_cast<quint32>(column)) << 32U) | static_cast<quint32>(row);
+}
+
+auto PreviewRenderer::droppedFrames() const -> quint64
+{
+   QMutexLocker locker(&m_requestMutex);
+   return m_droppedFrames;
+}
+
+void PreviewRenderer::prepare(Frame frame, int level, const QRectF & area)
+{
+   Request request;
+   request.frame = std::move(frame);
+   request.level = level;
+   request.area  = area;
+   schedule(std::move(request));
+}
+
+void PreviewRenderer::renderTiles(quint64 generation, int level, const QRectF & area)
+{
+   Request request;
+   request.generation = generation;
+   request.level      = level;
+   request.area       = area;
+   schedule(std::move(request));
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Private methods
+/* ***************************************************************************************************************** */
+void PreviewRenderer::process()
+{
+   Request request;
+   {
+      QMutexLocker locker(&m_requestMutex);
+      request     = std::move(m_request);
+      m_request   = Request();
+      m_scheduled = false;
+   }
+
+   const auto newFrame = !request.frame.isNull();
+   if (newFrame) {
+      m_current.pyramid = std::make_shared<PreviewPyramid>(std::move(request.frame));
+      m_current.generation++;
+      m_current.tiles.clear();
+
+      // The 2 × 2 level has all but the noise of the frame, for a quarter of the cost.
+      Histogram    histogram;
+      const auto & reduced = m_current.pyramid->level(1);
+      if (!reduced.isEmpty()) {
+         histogram.compute(reduced.samples.constData(), reduced.samples.count());
+      }
+      m_current.stretch = ScreenStretch::automatic(histogram).lookupTable(1 << BitDepth16);
+      m_greys.resize(1 << BitDepth8);
+      for (int value = 0; value < m_greys.count(); ++value) {
+         const auto grey = m_current.stretch[value * ((1 << BitDepth8) + 1)]; // the 8 bit value, as 16 bits
+         m_greys[value]  = qRgb(grey, grey, grey);
+      }
+   } else if (m_current.isNull() || request.generation != m_current.generation) {
+      return;
+   }
+
+   if (request.level != m_current.level || m_current.tiles.count() > ViewerTileCacheLimit) {
+      m_current.tiles.clear();
+      m_current.level = request.level;
+   }
+   const auto tiles   = m_current.tilesCovering(m_current.level, request.area);
+   auto       changed = newFrame;
+   for (int row = tiles.top(); row <= tiles.bottom(); ++row) {
+      for (int column = tiles.left(); column <= tiles.right(); ++column) {
+         const auto key = Preview::tileKey(column, row);
+         if (!m_current.tiles.contains(key)) {
+            m_current.tiles.insert(key, renderTile(m_current.tileArea(m_current.level, column, row)));
+            changed = true;
+         }
+      }
+   }
+   if (changed) {
+      emit rendered(m_current);
+   }
+}
+
+auto PreviewRenderer::renderTile(const QRect & area) const -> QImage
+{
+   const auto & pyramid = *m_current.pyramid;
+   const auto & frame   = pyramid.frame();
+   if (m_current.level == 0 && frame.channels() <= 1 && frame.bayerPattern() == Frame::Monochrome &&
+       frame.bytesPerSample() == 1) {
+      // Wrap the frame's memory, which the preview keeps; the colour table does the stretch.
+      const auto * first = frame.constData() + static_cast<qint64>(area.top()) * frame.width() + area.left();
+      QImage tile(first, area.width(), area.height(), static_cast<int>(frame.width()), QImage::Format_Indexed8);
+      tile.setColorTable(m_greys);
+      return tile;
+   }
+
+   PreviewPyramid::Level region;
+   QPoint                from;
+   if (m_current.level == 0) {
+      region = pyramid.region(area);
+   } else {
+      from = area.topLeft();
+   }
+   const auto & pixels  = m_current.level == 0 ? region : m_current.pyramid->level(m_current.level);
+   const auto * stretch = m_current.stretch.constData();
+   QImage       tile(area.size(), pixels.channels == 3 ? QImage::Format_RGB32 : QImage::Format_Grayscale8);
+   for (int y = 0; y < area.height(); ++y) {
+      const auto offset = static_cast<qint64>(from.y() + y) * pixels.width + from.x();
+      if (pixels.channels == 3) {
+         auto *       scanLine = reinterpret_cast<QRgb *>(tile.scanLine(y));
+         const auto * red      = pixels.plane(0) + offset;
+         const auto * green    = pixels.plane(1) + offset;
+         const auto * blue     = pixels.plane(2) + offset;
+         for (int x = 0; x < area.width(); ++x) {
+            scanLine[x] = qRgb(stretch[red[x]], stretch[green[x]], stretch[blue[x]]);
+         }
+      } else {
+         auto *       scanLine = tile.scanLine(y);
+         const auto * grey     = pixels.plane(0) + offset;
+         for (int x = 0; x < area.width(); ++x) {
+            scanLine[x] = stretch[grey[x]];
+         }
+      }
+   }
+   return tile;
+}
+
+void PreviewRenderer::schedule(Request request)
+{
+   QMutexLocker locker(&m_requestMutex);
+   if (m_scheduled) {
+      if (!m_request.frame.isNull()) {
+         if (request.frame.isNull()) {
+            // Tiles of the frame about to be replaced; the one waiting is prepared for the view as it is now.
+            m_request.level = request.level;
+            m_request.area  = request.area;
+            return;
+         }
+         m_droppedFrames++;
+      } else if (request.frame.isNull() && request.generation == m_request.generation &&
+                 request.level == m_request.level) {
+         request.area = request.area.united(m_request.area);
+      }
+      m_request = std::move(request);
+      return;
+   }
+   m_request   = std::move(request);
+   m_scheduled = true;
+   QMetaObject::invokeMethod(
+     this, [this]() { process(); }, Qt::QueuedConnection);
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "Frame.hpp"
+#include <memory>
+#include <QHash>
+#include <QImage>
+#include <QMetaType>
+#include <QMutex>
+#include <QObject>
+#include <QRect>
+#include <QVector>
+
+class PreviewPyramid;
+
+/*! \brief A frame made ready for display: its pyramid, its stretch, and the tiles of one level converted so far.
+ *
+ * Copies are cheap, and share the tiles; a tile of an 8 bit monochrome frame at full resolution wraps the frame's
+ * memory, which the pyramid keeps.
+ */
+struct Preview
+{
+   std::shared_ptr<PreviewPyramid> pyramid;
+   QVector<quint8>                 stretch;         // display value for each 16 bit sample
+   quint64                         generation{ 0 }; // counts the frames prepared
+   int                             level{ 0 };      // of the tiles; 0 for full resolution
+   QHash<quint64, QImage>          tiles;           // by tileKey()
+
+   [[nodiscard]] auto              isNull() const -> bool;
+
+   /*!
+    * The tiles of a level, ViewerTileSize square, that cover an area of the frame.
+    *
+    * @param tileLevel 0 for full resolution, otherwise a level for PreviewPyramid::level().
+    * @param area in frame pixels.
+    * @return The columns & rows, in x & y; empty if the area is off the frame.
+    */
+   [[nodiscard]] auto              tilesCovering(int tileLevel, const QRectF & area) const -> QRect;
+
+   /*!
+    * The position of a tile within the level, clipped to it.
+    */
+   [[nodiscard]] auto              tileArea(int tileLevel, int column, int row) const -> QRect;
+   [[nodiscard]] static auto       tileKey(int column, int row) -> quint64;
+};
+
+Q_DECLARE_METATYPE(Preview)
+
+/*! \brief Prepares frames for display, on a thread of its own.
+ *
+ * For each frame it builds a PreviewPyramid, measures the stretch on the 2 × 2 level, and converts the tiles that cover
+ * the area a viewer shows, so the viewer only draws what it is handed.  Tiles that come on screen later, by panning or
+ * zooming, are asked for with renderTiles().
+ *
+ * Requests are coalesced: one made while another is waiting replaces it, so the renderer never falls behind the
+ * display.  A frame replaced that way is counted as dropped.
+ */
+class PreviewRenderer : public QObject
+{
+   Q_OBJECT
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+   Q_DISABLE_COPY_MOVE(PreviewRenderer)
+#endif
+
+public:
+   explicit PreviewRenderer(QObject * parent = nullptr);
+   ~PreviewRenderer() override = default;
+
+   /*!
+    * The count of frames replaced by a later one before they were prepared.  Safe to call from any thread.
+    */
+   [[nodiscard]] auto droppedFrames() const -> quint64;
+
+   /*!
+    * Prepares a frame, with the tiles of a level that cover an area of it.  Safe to call from any thread; returns at
+    * once.
+    *
+    * @param frame the frame to display.
+    * @param level 0 for full resolution, otherwise a level for PreviewPyramid::level().
+    * @param area the part of the frame on screen, in frame pixels.
+    */
+   void               prepare(Frame frame, int level, const QRectF & area);
+
+   /*!
+    * Converts the tiles of a level that cover an area of a frame already prepared.  Safe to call from any thread;
+    * returns at once.  A request for a frame since replaced is ignored.
+    *
+    * @param generation of the Preview the tiles are for.
+    */
+   void               renderTiles(quint64 generation, int level, const QRectF & area);
+
+signals:
+   /*!
+    * Emitted from the renderer's thread with each frame prepared, and again as more of its tiles are converted.
+    */
+   void rendered(Preview preview);
+
+private:
+   struct Request
+   {
+      Frame   frame; // null for more tiles of the current frame
+      quint64 generation{ 0 };
+      int     level{ 0 };
+      QRectF  area;
+   };
+
+   void               process();
+   [[nodiscard]] auto renderTile(const QRect & area) const -> QImage;
+   void               schedule(Request request);
+
+   mutable QMutex     m_requestMutex;
+   Request            m_request; // the one waiting, if m_scheduled
+   bool               m_scheduled{ false };
+   quint64            m_droppedFrames{ 0 };
+
+   // Only touched on the renderer's thread.
+   Preview            m_current;
+   QVector<QRgb>      m_greys; // the stretch as a colour table, for 8 bit frames
+};
@@ -6,21 +6,23 @@
 
 #include "QHYCCD.hpp"
 
-#include "Config.h"
+#include "DeviceWatcher.hpp"
 #include <QByteArray>
 #include <QDebug>
 #include <qhyccd.h>
 #include <QString>
+#include <utility>
 
 /* ***************************************************************************************************************** */
 // MARK: - ctors & dtors
 /* ***************************************************************************************************************** */
 QHYCCD::QHYCCD(QObject * parent)
    : QObject(parent)
+   , m_ready(false)
 {
 }
 
-QHYCCD::~QHYCCD() {}
+QHYCCD::~QHYCCD() = default;
 
 /* ***************************************************************************************************************** */
 // MARK: - Public methods
@@ -40,7 +42,18 @@ auto QHYCCD::initialize() -> bool
 {
    quint32 qhyResult = InitQHYCCDResource();
    if (qhyResult == QHYCCD_SUCCESS) {
-      populateCameraList();
+      if (!m_deviceWatcher) {
+         m_deviceWatcher = std::make_unique<DeviceWatcher>();
+         // The watcher emits from its own thread, so these are queued onto this object's.
+         QObject::connect(m_deviceWatcher.get(), &DeviceWatcher::cameraAdded, this, &QHYCCD::cameraAdded);
+         QObject::connect(m_deviceWatcher.get(), &DeviceWatcher::cameraRemoved, this, &QHYCCD::cameraRemoved);
+         QObject::connect(m_deviceWatcher.get(), &DeviceWatcher::camerasChanged, this, [this](QStringList cameras) {
+            m_cameras = std::move(cameras);
+            qDebug() << "Cameras found:" << m_cameras.count();
+            emit camerasChanged(m_cameras);
+         });
+      }
+      m_deviceWatcher->start();
       m_ready = true;
    } else {
       qWarning() << "InitQHYCCDResource: failed";
@@ -56,25 +69,11 @@ auto QHYCCD::isReady() const -> bool
 }
 
 /* ***************************************************************************************************************** */
-// MARK: - Private methods
+// MARK: - Public slots
 /* ***************************************************************************************************************** */
-void QHYCCD::populateCameraList()
+void QHYCCD::rescan()
 {
-   m_cameras.clear();
-   quint32 connectedCameraCount = ScanQHYCCD();
-   qDebug() << "Cameras found:" << connectedCameraCount;
-
-   QByteArray nameBuffer(BufferSizeCameraName, 0);
-   quint32    qhyResult{ QHYCCD_ERROR };
-   for (quint32 cameraIndex = 0; cameraIndex < connectedCameraCount; cameraIndex++) {
-      qhyResult = GetQHYCCDId(cameraIndex, nameBuffer.data());
-      if (qhyResult == QHYCCD_SUCCESS) {
-         QLatin1String cameraName(nameBuffer);
-         qDebug() << cameraName;
-         m_cameras.append(cameraName);
-      } else {
-         qWarning() << QString(tr("GetQHYCCDId index[%1] failure")).arg(qhyResult);
-      }
+   if (m_deviceWatcher) {
+      m_deviceWatcher->rescan();
    }
-   emit camerasChanged(m_cameras);
 }
@@ -7,16 +7,21 @@
  */
 
 #include "QHYCamera.hpp"
+#include <memory>
 #include <QByteArray>
 #include <QObject>
 #include <QStringList>
 
+class DeviceWatcher;
+
 /*! \brief This is the interface to the QHYCCD driver.
  *
  * This class is intended to be the sole interface to the QHYCCD driver.  Users of this class should not need to include
  * any header from the library, nor link to either the QHYCCD library or the USB library.
  *
  * Instantiation of this class does not make it usable; before an instance does anything, initialize() must be called.
+ *
+ * Once initialized, cameras being plugged in and unplugged are picked up in the background; see DeviceWatcher.
  */
 class QHYCCD : public QObject
 {
@@ -32,7 +37,7 @@ public:
    ~QHYCCD() override;
 
    /*!
-    * Accessor for the list of connected cameras.
+    * Accessor for the list of connected cameras, as of the last scan.
     * @return The list of camera names attached.
     */
    [[nodiscard]] auto cameras() const -> const QStringList;
@@ -58,13 +63,20 @@ public:
     */
    [[nodiscard]] auto isReady() const -> bool;
 
+public slots:
+   /*!
+    * Asks for the attached cameras to be scanned again soon, say when the user expects a new camera to show up.
+    */
+   void rescan();
+
 signals:
+   void cameraAdded(QString name);
+   void cameraRemoved(QString name);
    void camerasChanged(const QStringList cameras);
    void readyChanged(bool ready);
 
 private:
-   void        populateCameraList();
-
-   QStringList m_cameras;
-   bool        m_ready;
+   std::unique_ptr<DeviceWatcher> m_deviceWatcher;
+   QStringList                    m_cameras;
+   bool                           m_ready;
 };
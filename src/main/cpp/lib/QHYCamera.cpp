@@ -6,29 +6,48 @@
 
 #include "QHYCamera.hpp"
 
+#include "CameraCommandQueue.hpp"
+#include "CameraPipeline.hpp"
+#include "CapabilityCache.hpp"
+#include "DefectMap.hpp"
+#include "DeviceWatcher.hpp"
+#include "ExposureWorker.hpp"
+#include "FitsWriter.hpp"
+#include "FramePool.hpp"
+#include "FrameRing.hpp"
+#include "LiveViewWorker.hpp"
+#include "TransferMeter.hpp"
 #include <QDebug>
+#include <QMutexLocker>
 #include <QStringBuilder>
-#include <QTimer>
+#include <utility>
 
 #include <qhyccd.h>
 
 QHYCamera::QHYCamera(QByteArray name, QObject * parent)
    : QObject(parent)
    , handle(nullptr)
+   , m_commandQueue(std::make_unique<CameraCommandQueue>(QString("Commands %1").arg(QLatin1String(name))))
+   , m_capabilityCache(std::make_unique<CapabilityCache>(name))
+   , m_transferMeter(std::make_shared<TransferMeter>())
+   , m_exposureWorker(new ExposureWorker(m_transferMeter))
+   , m_liveViewWorker(new LiveViewWorker(m_transferMeter))
    , m_id(name)
   , m_model(name.left(name.lastIndexOf('-')))
    , m_transferMode(SingleImage)
    //   , bayerMatrix(0)
+   , m_gain(0.0)
+   , m_offset(0.0)
    , bitDepth(0)
    //   , bitsPerPixel(0)
    //   , chipHeight(0.0)
    //   , chipWidth(0.0)
    //   , filterWheelCapacity(0)
-   , gain(0.0)
    //   , imageHeight(0.0)
    //   , imageWidth(0.0)
    //   , maxFrameLength(0)
-   , offset(0.0)
+   , m_readoutSpeed(-1)
+   , m_usbTraffic(-1)
 //   , pixelHeight(0.0)
 //   , pixelWidth(0.0)
 //   , supports16Bit(false)
@@ -54,13 +73,53 @@ QHYCamera::QHYCamera(QByteArray name, QObject * parent)
 //   , supportsUSBSpeedSetting(false)
 //   , supportsUSBTraffic(false)
 {
+   qRegisterMetaType<Frame>();
+   qRegisterMetaType<FrameQuality>();
+   qRegisterMetaType<QHYCamera::DataTransferMode>();
+   qRegisterMetaType<TransferStatistics>();
+
+   m_exposureThread.setObjectName(QString("Exposure %1").arg(QLatin1String(m_id)));
+   m_exposureWorker->moveToThread(&m_exposureThread);
+   QObject::connect(&m_exposureThread, &QThread::finished, m_exposureWorker, &QObject::deleteLater);
+   QObject::connect(m_exposureWorker,
+                    &ExposureWorker::calibratedFrameReady,
+                    this,
+                    &QHYCamera::calibratedFrameReady,
+                    Qt::DirectConnection);
+   QObject::connect(m_exposureWorker, &ExposureWorker::exposureFailed, this, &QHYCamera::exposureFailed);
+   QObject::connect(m_exposureWorker, &ExposureWorker::exposureProgress, this, &QHYCamera::exposureProgress);
+   // Emitted on the exposure thread, so that a receiver may take the frame there; see frameReady().
+   QObject::connect(
+     m_exposureWorker, &ExposureWorker::frameReady, this, &QHYCamera::frameReady, Qt::DirectConnection);
+   QObject::connect(m_exposureWorker, &ExposureWorker::readoutStarted, this, &QHYCamera::readoutStarted);
+   m_exposureThread.start();
+
+   m_liveViewThread.setObjectName(QString("Live view %1").arg(QLatin1String(m_id)));
+   m_liveViewWorker->moveToThread(&m_liveViewThread);
+   QObject::connect(&m_liveViewThread, &QThread::finished, m_liveViewWorker, &QObject::deleteLater);
+   QObject::connect(m_liveViewWorker, &LiveViewWorker::streamFailed, this, &QHYCamera::liveViewFailed);
+   QObject::connect(
+     m_liveViewWorker, &LiveViewWorker::statisticsChanged, this, &QHYCamera::liveViewStatisticsChanged);
+   QObject::connect(m_liveViewWorker, &LiveViewWorker::streamingChanged, this, &QHYCamera::streamingChanged);
+   m_liveViewThread.start(QThread::HighPriority);
+
+   // Made after the workers it takes frames from, and gone before them.
+   m_pipeline = std::make_unique<CameraPipeline>(*this);
 }
 
 QHYCamera::~QHYCamera() noexcept
 {
-   if (handle != nullptr) {
-      disconnect();
-   }
+   // The close runs after the commands still queued; nobody is left to hear the signals.  It is waited for before the
+   // queue goes, so the commands can still tell they are on it.
+   blockSignals(true);
+   m_commandQueue->enqueue([this]() { return closeCamera(); }).waitForFinished();
+   m_commandQueue.reset();
+   // No more exposures are offered to the pipeline, and its timers stop sampling live view before the stream goes.
+   m_exposureThread.quit();
+   m_exposureThread.wait();
+   m_pipeline.reset();
+   m_liveViewThread.quit();
+   m_liveViewThread.wait();
 }
 
 /* ***************************************************************************************************************** */
@@ -68,112 +127,363 @@ QHYCamera::~QHYCamera() noexcept
 /* ***************************************************************************************************************** */
 auto QHYCamera::capabilities() const-> const Capabilities
 {
+   QMutexLocker locker(&m_stateMutex);
    return m_capabilities;
 }
 
-void QHYCamera::connect()
+auto QHYCamera::connect() -> QFuture<bool>
 {
-   handle = OpenQHYCCD(m_id.data());
-   if (handle != nullptr) {
-      initializeReadModes();
-   }
-   emit connectedChanged(isConnected());
+   return m_commandQueue->enqueue([this]() { return openCamera(); });
 }
 
-void QHYCamera::disconnect()
+auto QHYCamera::disconnect() -> QFuture<bool>
 {
-   if (handle != nullptr) {
-      quint32 qhyResult = CloseQHYCCD(handle);
-      if (qhyResult == QHYCCD_SUCCESS) {
-         handle = nullptr;
-      } else {
-         qWarning() << tr("There was an error disconnecting from %1.").arg(QLatin1String(m_id));
-      }
-   }
-   emit connectedChanged(isConnected());
+   return m_commandQueue->enqueue([this]() { return closeCamera(); });
 }
 
-auto QHYCamera::isConnected() -> bool
+auto QHYCamera::isConnected() const -> bool
 {
+   QMutexLocker locker(&m_stateMutex);
    return handle != nullptr;
 }
 
+auto QHYCamera::isCalibrating() const -> bool
+{
+   return m_exposureWorker->isCalibrating();
+}
+
+auto QHYCamera::isExposing() const -> bool
+{
+   return m_exposureWorker->isBusy();
+}
+
+auto QHYCamera::isStreaming() const -> bool
+{
+   return m_liveViewWorker->isStreaming();
+}
+
+auto QHYCamera::defectMap() const -> std::shared_ptr<const DefectMap>
+{
+   return std::atomic_load(&m_defectMap);
+}
+
+auto QHYCamera::gain() const -> double
+{
+   QMutexLocker locker(&m_stateMutex);
+   return m_gain;
+}
+
 auto QHYCamera::id() const -> QString
 {
    return QString(m_id);
 }
 
+auto QHYCamera::liveFrameRate() const -> double
+{
+   return m_liveViewWorker->achievedFrameRate();
+}
+
+auto QHYCamera::liveFrames() const -> std::shared_ptr<FrameRing>
+{
+   return m_liveViewWorker->frames();
+}
+
+auto QHYCamera::droppedLiveFrames() const -> quint64
+{
+   return m_liveViewWorker->droppedFrames();
+}
+
 auto QHYCamera::model() const -> QString
 {
    return m_model;
 }
 
+auto QHYCamera::offset() const -> double
+{
+   QMutexLocker locker(&m_stateMutex);
+   return m_offset;
+}
+
+auto QHYCamera::pipeline() const -> CameraPipeline *
+{
+   return m_pipeline.get();
+}
+
 auto QHYCamera::readMode() const -> QString
 {
+   QMutexLocker locker(&m_stateMutex);
    return m_readMode;
 }
 
 auto QHYCamera::readModes() const -> QStringList
 {
+   QMutexLocker locker(&m_stateMutex);
    return m_readModes.keys();
 }
 
+void QHYCamera::setBusArbiter(std::shared_ptr<BusArbiter> busArbiter, BusArbiter::Priority priority)
+{
+   m_exposureWorker->setBusArbiter(busArbiter, priority);
+   m_liveViewWorker->setBusArbiter(std::move(busArbiter), priority);
+}
+
+void QHYCamera::setCalibrator(std::shared_ptr<Calibrator> calibrator)
+{
+   m_exposureWorker->setCalibrator(std::move(calibrator));
+}
+
+void QHYCamera::setDefectMap(std::shared_ptr<const DefectMap> defectMap)
+{
+   if (defectMap && !defectMap->save(defectMapPath())) {
+      qWarning() << "The defect map of" << QLatin1String(m_id) << "was not kept; it is only used until the read mode"
+                 << "changes.";
+   }
+   applyDefectMap(std::move(defectMap));
+}
+
+void QHYCamera::setFitsWriter(std::shared_ptr<FitsWriter> fitsWriter)
+{
+   m_exposureWorker->setFitsWriter(std::move(fitsWriter));
+}
+
+void QHYCamera::setFrameScorer(std::shared_ptr<FrameScorer> frameScorer)
+{
+   m_exposureWorker->setFrameScorer(std::move(frameScorer));
+}
+
+auto QHYCamera::setReadoutSpeed(int speed) -> QFuture<bool>
+{
+   return m_commandQueue->enqueue([this, speed]() {
+      m_readoutSpeed = speed;
+      return applyBusSettings(m_capabilities);
+   });
+}
+
+auto QHYCamera::setUSBTraffic(int traffic) -> QFuture<bool>
+{
+   return m_commandQueue->enqueue([this, traffic]() {
+      m_usbTraffic = traffic;
+      return applyBusSettings(m_capabilities);
+   });
+}
+
+auto QHYCamera::transferStatistics() const -> TransferStatistics
+{
+   return m_transferMeter->statistics();
+}
+
 auto QHYCamera::transferMode() const -> DataTransferMode
 {
+   QMutexLocker locker(&m_stateMutex);
    return m_transferMode;
 }
 
 /* ***************************************************************************************************************** */
 // MARK: - Public slots
 /* ***************************************************************************************************************** */
-void QHYCamera::setReadAndTransferModes(QString readMode, QHYCamera::DataTransferMode mode)
-{
-   QTimer::singleShot(0, this, [this, readMode, mode]() {
-      if (isConnected() && !readMode.isEmpty() && m_readMode != readMode) {
-         // if m_readMode has been set, we must disconnect & reconnect the camera.
-         if (!m_readMode.isEmpty()) {
-            disconnect();
-            connect();
-         }
-         if (isConnected()) {
-            if (SetQHYCCDReadMode(handle, m_readModes.value(readMode)) == QHYCCD_SUCCESS) {
+void QHYCamera::cancelExposure()
+{
+   m_exposureWorker->cancel();
+}
+
+auto QHYCamera::setReadAndTransferModes(QString readMode, QHYCamera::DataTransferMode mode) -> QFuture<bool>
+{
+   return m_commandQueue->enqueue([this, readMode, mode]() { return applyReadAndTransferModes(readMode, mode); });
+}
+
+void QHYCamera::startLiveView()
+{
+   if (!isConnected() || readMode().isEmpty()) {
+      emit liveViewFailed(tr("Camera %1 is not ready to stream.").arg(QLatin1String(m_id)));
+   } else if (transferMode() != LiveView) {
+      emit liveViewFailed(tr("Camera %1 is not in live view mode.").arg(QLatin1String(m_id)));
+   } else if (!m_liveViewWorker->isStreaming()) {
+      QMetaObject::invokeMethod(
+        m_liveViewWorker, [this]() { m_liveViewWorker->stream(); }, Qt::QueuedConnection);
+   }
+}
+
+void QHYCamera::stopLiveView()
+{
+   m_pipeline->stopLiveView();
+   m_liveViewWorker->stop();
+}
+
+void QHYCamera::startExposure(double seconds)
+{
+   if (!isConnected() || readMode().isEmpty()) {
+      emit exposureFailed(tr("Camera %1 is not ready to expose.").arg(QLatin1String(m_id)));
+   } else if (transferMode() != SingleImage) {
+      emit exposureFailed(tr("Camera %1 is not in single image mode.").arg(QLatin1String(m_id)));
+   } else if (m_exposureWorker->isBusy()) {
+      emit exposureFailed(tr("Camera %1 is already exposing.").arg(QLatin1String(m_id)));
+   } else {
+      QMetaObject::invokeMethod(
+        m_exposureWorker, [this, seconds]() { m_exposureWorker->expose(seconds); }, Qt::QueuedConnection);
+   }
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Private methods
+/* ***************************************************************************************************************** */
+void QHYCamera::applyDefectMap(std::shared_ptr<const DefectMap> defectMap)
+{
+   m_exposureWorker->setDefectMap(defectMap);
+   m_liveViewWorker->setDefectMap(defectMap);
+   const auto defects = defectMap ? defectMap->count() : 0;
+   std::atomic_store(&m_defectMap, std::move(defectMap));
+   emit defectMapChanged(defects);
+}
+
+auto QHYCamera::applyReadAndTransferModes(const QString & readMode, DataTransferMode mode) -> bool
+{
+   Q_ASSERT(m_commandQueue->isQueueThread());
+   bool success{ false };
+   if (handle != nullptr && !readMode.isEmpty() && (m_readMode != readMode || m_transferMode != mode)) {
+      // if m_readMode has been set, we must disconnect & reconnect the camera.
+      if (!m_readMode.isEmpty()) {
+         closeCamera();
+         openCamera();
+      }
+      if (handle != nullptr) {
+         if (SetQHYCCDReadMode(handle, m_readModes.value(readMode)) == QHYCCD_SUCCESS) {
+            {
+               QMutexLocker locker(&m_stateMutex);
                m_readMode = readMode;
-               emit readModeChanged(readMode);
-               if (SetQHYCCDStreamMode(handle, mode) == QHYCCD_SUCCESS) {
-                  if (InitQHYCCD(handle) == QHYCCD_SUCCESS) {
+            }
+            emit readModeChanged(readMode);
+            if (SetQHYCCDStreamMode(handle, mode) == QHYCCD_SUCCESS) {
+               if (InitQHYCCD(handle) == QHYCCD_SUCCESS) {
+                  {
+                     QMutexLocker locker(&m_stateMutex);
                      m_transferMode = mode;
-                     emit transferModeChanged(mode);
-                     readCameraDetails();
-                  } else {
-                     qWarning() << tr("Could not initialize camera %1").arg(QLatin1String(m_id));
-                     disconnect();
                   }
+                  readCameraDetails();
+                  prepareFramePool();
+                  applyDefectMap(DefectMap::open(defectMapPath()));
+                  success = true;
+                  emit transferModeChanged(mode);
                } else {
-                  qWarning() << tr("Could not set stream mode of camera %1 to %2.").arg(QLatin1String(m_id)).arg(mode);
-                  disconnect();
+                  qWarning() << tr("Could not initialize camera %1").arg(QLatin1String(m_id));
+                  closeCamera();
                }
             } else {
-               qWarning() << tr("Could not set camera %1 read mode to %2 with index %3")
-                               .arg(QLatin1String(m_id))
-                               .arg(readMode)
-                               .arg(m_readModes.value(readMode));
-               disconnect();
+               qWarning() << tr("Could not set stream mode of camera %1 to %2.").arg(QLatin1String(m_id)).arg(mode);
+               closeCamera();
             }
+         } else {
+            qWarning() << tr("Could not set camera %1 read mode to %2 with index %3")
+                            .arg(QLatin1String(m_id))
+                            .arg(readMode)
+                            .arg(m_readModes.value(readMode));
+            closeCamera();
          }
       }
-   });
+   }
+   return success;
+}
+
+auto QHYCamera::applyBusSettings(const Capabilities & capabilities) -> bool
+{
+   Q_ASSERT(m_commandQueue->isQueueThread());
+   // Until the camera is initialized, the settings are only kept; initializeControlValues() applies them.
+   if (handle == nullptr || m_readMode.isEmpty()) {
+      return true;
+   }
+   auto success = true;
+   if (m_readoutSpeed >= 0 && capabilities.supportsHighSpeed) {
+      if (SetQHYCCDParam(handle, CONTROL_SPEED, m_readoutSpeed) != QHYCCD_SUCCESS) {
+         qWarning() << tr("Could not set the speed of camera %1 to %2.").arg(QLatin1String(m_id)).arg(m_readoutSpeed);
+         success = false;
+      }
+   }
+   if (m_usbTraffic >= 0 && capabilities.supportsUSBTraffic) {
+      if (SetQHYCCDParam(handle, CONTROL_USBTRAFFIC, m_usbTraffic) != QHYCCD_SUCCESS) {
+         qWarning()
+           << tr("Could not set the USB traffic of camera %1 to %2.").arg(QLatin1String(m_id)).arg(m_usbTraffic);
+         success = false;
+      }
+   }
+   return success;
+}
+
+auto QHYCamera::closeCamera() -> bool
+{
+   Q_ASSERT(m_commandQueue->isQueueThread());
+   if (handle != nullptr) {
+      // the exposure & live view threads must let go of the handle before it is closed.
+      m_exposureWorker->cancel();
+      m_exposureWorker->prepare(nullptr, nullptr, Frame::Monochrome);
+      m_liveViewWorker->stop();
+      m_liveViewWorker->prepare(nullptr, nullptr, Frame::Monochrome);
+      m_framePool.reset();
+      // Closing, like opening, goes through the watcher, so neither races a scan of the driver's device list.
+      const auto closed = DeviceWatcher::closeCamera([this]() { return CloseQHYCCD(handle) == QHYCCD_SUCCESS; });
+      if (closed) {
+         QMutexLocker locker(&m_stateMutex);
+         handle = nullptr;
+      } else {
+         qWarning() << tr("There was an error disconnecting from %1.").arg(QLatin1String(m_id));
+      }
+   }
+   emit connectedChanged(handle != nullptr);
+   return handle == nullptr;
+}
+
+auto QHYCamera::defectMapPath() const -> QString
+{
+   // Frames are always read unbinned.
+   return DefectMap::path(id(), readMode(), 1);
+}
+
+auto QHYCamera::openCamera() -> bool
+{
+   Q_ASSERT(m_commandQueue->isQueueThread());
+   if (handle == nullptr) {
+      auto * openedHandle = DeviceWatcher::openCamera([this]() { return OpenQHYCCD(m_id.data()); });
+      {
+         QMutexLocker locker(&m_stateMutex);
+         handle = openedHandle;
+      }
+      if (handle != nullptr) {
+         readVersions();
+         initializeReadModes();
+      }
+   }
+   emit connectedChanged(handle != nullptr);
+   return handle != nullptr;
+}
+
+void QHYCamera::initializeControlValues(const Capabilities & capabilities)
+{
+   // These are the camera's current settings rather than its capabilities, so are never cached.
+   {
+      QMutexLocker locker(&m_stateMutex);
+      m_offset = GetQHYCCDParam(handle, CONTROL_OFFSET);
+      m_gain   = GetQHYCCDParam(handle, CONTROL_GAIN);
+   }
+   if (capabilities.supportsTransferBit) {
+      bitDepth = capabilities.supports16Bit ? BitDepth16 : BitDepth8;
+      if (SetQHYCCDParam(handle, CONTROL_TRANSFERBIT, bitDepth) != QHYCCD_SUCCESS) {
+         qWarning() << tr("Could not set camera %1 to %2 bits per pixel.").arg(QLatin1String(m_id)).arg(bitDepth);
+      }
+   }
+   applyBusSettings(capabilities);
 }
 
-/* ***************************************************************************************************************** */
-// MARK: - Private methods
-/* ***************************************************************************************************************** */
 void QHYCamera::initializeReadModes()
 {
    // read modes shouldn't change so once read, do not re-read.
-   if (isConnected() && m_readModes.isEmpty()) {
+   if (handle != nullptr && m_readModes.isEmpty()) {
+      auto cachedReadModes = m_capabilityCache->readModes();
+      if (!cachedReadModes.isEmpty()) {
+         QMutexLocker locker(&m_stateMutex);
+         m_readModes = cachedReadModes;
+         return;
+      }
       quint32 readModeCount = 0;
       if (GetQHYCCDNumberOfReadModes(handle, &readModeCount) != QHYCCD_SUCCESS) {
-         disconnect();
+         closeCamera();
       } else {
          qDebug() << "Found " << readModeCount << " read modes.";
          quint32 readModeIndex = 0;
@@ -181,168 +491,202 @@ void QHYCamera::initializeReadModes()
             QByteArray readModeNameBuffer(BufferSizeReadModeName, 0);
             auto       status = GetQHYCCDReadModeName(handle, readModeIndex, readModeNameBuffer.data());
             if (status == QHYCCD_SUCCESS) {
+               QMutexLocker locker(&m_stateMutex);
                m_readModes[QString(readModeNameBuffer)] = readModeIndex;
                qDebug() << "Found " << QString(readModeNameBuffer) << "read mode.";
             } else {
                qWarning() << tr("GetQHYCCDReadModeName failed with code %1.").arg(status);
-               disconnect();
+               closeCamera();
             }
             readModeIndex++;
          }
+         if (handle != nullptr) {
+            m_capabilityCache->setReadModes(m_readModes);
+         }
       }
    }
 }
 
+void QHYCamera::prepareFramePool()
+{
+   auto bayerPattern = m_capabilities.supportsColor ? static_cast<Frame::BayerPattern>(m_capabilities.bayerMatrix)
+                                                    : Frame::Monochrome;
+   // Frames still held by consumers keep the previous pool alive until they are released.
+   if (m_transferMode == LiveView) {
+      m_framePool = FramePool::create(m_capabilities.maxFrameLength, LiveFrameRingCapacity + LiveFramePoolHeadroom);
+      m_framePool->reserve(LiveFrameRingCapacity);
+      m_exposureWorker->prepare(nullptr, nullptr, bayerPattern);
+      m_liveViewWorker->prepare(handle, m_framePool, bayerPattern);
+   } else {
+      m_framePool = FramePool::create(m_capabilities.maxFrameLength, ExposureFramePoolBuffers);
+      m_framePool->reserve(1);
+      m_liveViewWorker->prepare(nullptr, nullptr, bayerPattern);
+      m_exposureWorker->prepare(handle, m_framePool, bayerPattern);
+   }
+}
+
 void QHYCamera::readCameraDetails()
 {
-   readFirmwareVersion();
-   readFPGAVersion();
-   readChipInfo();
-   readControlValues();
+   // Filled in unlocked, as probing takes a while, then published in one go.  The versions were read on connecting.
+   Capabilities capabilities{};
+   if (!m_capabilityCache->capabilities(m_readMode, &capabilities)) {
+      readChipInfo(capabilities);
+      readControlValues(capabilities);
+      m_capabilityCache->setCapabilities(m_readMode, capabilities);
+   }
+   capabilities.firmwareVersion = m_capabilities.firmwareVersion;
+   capabilities.fpga1Version    = m_capabilities.fpga1Version;
+   capabilities.fpga2Version    = m_capabilities.fpga2Version;
+   initializeControlValues(capabilities);
+   QMutexLocker locker(&m_stateMutex);
+   m_capabilities = capabilities;
 }
 
-void QHYCamera::readChipInfo()
+void QHYCamera::readChipInfo(Capabilities & capabilities)
 {
    if (isConnected()) {
       auto qhyResult = GetQHYCCDChipInfo(handle,
-                                         &m_capabilities.chipWidth,
-                                         &m_capabilities.chipHeight,
-                                         reinterpret_cast<uint32_t *>(&m_capabilities.imageWidth),  // NOLINT
-                                         reinterpret_cast<uint32_t *>(&m_capabilities.imageHeight), // NOLINT
-                                         &m_capabilities.pixelWidth,
-                                         &m_capabilities.pixelHeight,
-                                         reinterpret_cast<uint32_t *>(&m_capabilities.bitsPerPixel)); // NOLINT
+                                         &capabilities.chipWidth,
+                                         &capabilities.chipHeight,
+                                         reinterpret_cast<uint32_t *>(&capabilities.imageWidth),  // NOLINT
+                                         reinterpret_cast<uint32_t *>(&capabilities.imageHeight), // NOLINT
+                                         &capabilities.pixelWidth,
+                                         &capabilities.pixelHeight,
+                                         reinterpret_cast<uint32_t *>(&capabilities.bitsPerPixel)); // NOLINT
       if (qhyResult != QHYCCD_SUCCESS) {
          qWarning() << tr("Error reading chip information for camera %1").arg(QLatin1String(m_id));
       }
    }
 }
 
-void QHYCamera::readControlValues()
+void QHYCamera::readControlValues(Capabilities & capabilities)
 {
    auto qhyResult = IsQHYCCDControlAvailable(handle, CAM_COLOR);
    if (qhyResult == QHYCCD_ERROR) {
-      m_capabilities.supportsColor = false;
+      capabilities.supportsColor = false;
    } else {
-      m_capabilities.supportsColor = true;
-      m_capabilities.bayerMatrix   = static_cast<int>(qhyResult);
+      capabilities.supportsColor = true;
+      capabilities.bayerMatrix   = static_cast<int>(qhyResult);
    }
 
-   m_capabilities.supportsOffset = IsQHYCCDControlAvailable(handle, CONTROL_OFFSET) == QHYCCD_SUCCESS;
-   if (m_capabilities.supportsOffset) {
+   capabilities.supportsOffset = IsQHYCCDControlAvailable(handle, CONTROL_OFFSET) == QHYCCD_SUCCESS;
+   if (capabilities.supportsOffset) {
       qhyResult = GetQHYCCDParamMinMaxStep(handle,
                                            CONTROL_OFFSET,
-                                           &m_capabilities.rangeOffset.min,
-                                           &m_capabilities.rangeOffset.max,
-                                           &m_capabilities.rangeOffset.step);
+                                           &capabilities.rangeOffset.min,
+                                           &capabilities.rangeOffset.max,
+                                           &capabilities.rangeOffset.step);
       if (qhyResult == QHYCCD_ERROR) {
-         m_capabilities.rangeOffset.max  = 0.0;
-         m_capabilities.rangeOffset.min  = 0.0;
-         m_capabilities.rangeOffset.step = 0.0;
+         capabilities.rangeOffset.max  = 0.0;
+         capabilities.rangeOffset.min  = 0.0;
+         capabilities.rangeOffset.step = 0.0;
       }
    }
-   offset                      = GetQHYCCDParam(handle, CONTROL_OFFSET);
 
-   m_capabilities.supportsGain = IsQHYCCDControlAvailable(handle, CONTROL_GAIN) == QHYCCD_SUCCESS;
-   if (m_capabilities.supportsGain) {
+   capabilities.supportsGain = IsQHYCCDControlAvailable(handle, CONTROL_GAIN) == QHYCCD_SUCCESS;
+   if (capabilities.supportsGain) {
       qhyResult = GetQHYCCDParamMinMaxStep(handle,
                                            CONTROL_GAIN,
-                                           &m_capabilities.rangeGain.min,
-                                           &m_capabilities.rangeGain.max,
-                                           &m_capabilities.rangeGain.step);
+                                           &capabilities.rangeGain.min,
+                                           &capabilities.rangeGain.max,
+                                           &capabilities.rangeGain.step);
       if (qhyResult == QHYCCD_ERROR) {
-         m_capabilities.rangeGain.max  = 0.0;
-         m_capabilities.rangeGain.min  = 0.0;
-         m_capabilities.rangeGain.step = 0.0;
+         capabilities.rangeGain.max  = 0.0;
+         capabilities.rangeGain.min  = 0.0;
+         capabilities.rangeGain.step = 0.0;
       }
    }
-   gain = GetQHYCCDParam(handle, CONTROL_GAIN);
 
    if (IsQHYCCDControlAvailable(handle, CAM_BIN1X1MODE) == QHYCCD_SUCCESS) {
-      m_capabilities.binningInfo.binXMaximum = 1;
-      m_capabilities.binningInfo.binYMaximum = 1;
-      m_capabilities.binningInfo.oneByOne    = true;
-      m_capabilities.supportsBinning         = true;
+      capabilities.binningInfo.binXMaximum = 1;
+      capabilities.binningInfo.binYMaximum = 1;
+      capabilities.binningInfo.oneByOne    = true;
+      capabilities.supportsBinning         = true;
    }
    if (IsQHYCCDControlAvailable(handle, CAM_BIN2X2MODE) == QHYCCD_SUCCESS) {
-      m_capabilities.binningInfo.binXMaximum = 2;
-      m_capabilities.binningInfo.binYMaximum = 2;
-      m_capabilities.binningInfo.twoByTwo    = true;
-      m_capabilities.supportsBinning         = true;
+      capabilities.binningInfo.binXMaximum = 2;
+      capabilities.binningInfo.binYMaximum = 2;
+      capabilities.binningInfo.twoByTwo    = true;
+      capabilities.supportsBinning         = true;
    }
    if (IsQHYCCDControlAvailable(handle, CAM_BIN3X3MODE) == QHYCCD_SUCCESS) {
-      m_capabilities.binningInfo.binXMaximum  = 3;
-      m_capabilities.binningInfo.binYMaximum  = 3;
-      m_capabilities.binningInfo.threeByThree = true;
-      m_capabilities.supportsBinning          = true;
+      capabilities.binningInfo.binXMaximum  = 3;
+      capabilities.binningInfo.binYMaximum  = 3;
+      capabilities.binningInfo.threeByThree = true;
+      capabilities.supportsBinning          = true;
    }
    if (IsQHYCCDControlAvailable(handle, CAM_BIN4X4MODE) == QHYCCD_SUCCESS) {
-      m_capabilities.binningInfo.binXMaximum = 4;
-      m_capabilities.binningInfo.binYMaximum = 4;
-      m_capabilities.binningInfo.fourByFour  = true;
-      m_capabilities.supportsBinning         = true;
+      capabilities.binningInfo.binXMaximum = 4;
+      capabilities.binningInfo.binYMaximum = 4;
+      capabilities.binningInfo.fourByFour  = true;
+      capabilities.supportsBinning         = true;
    }
 
-   m_capabilities.supportsHighSpeed  = IsQHYCCDControlAvailable(handle, CONTROL_SPEED) == QHYCCD_SUCCESS;
-   m_capabilities.supportsUSBTraffic = IsQHYCCDControlAvailable(handle, CONTROL_USBTRAFFIC) == QHYCCD_SUCCESS;
-   if (m_capabilities.supportsUSBTraffic) {
+   capabilities.supportsHighSpeed  = IsQHYCCDControlAvailable(handle, CONTROL_SPEED) == QHYCCD_SUCCESS;
+   if (capabilities.supportsHighSpeed) {
+      qhyResult = GetQHYCCDParamMinMaxStep(handle,
+                                           CONTROL_SPEED,
+                                           &capabilities.rangeSpeed.min,
+                                           &capabilities.rangeSpeed.max,
+                                           &capabilities.rangeSpeed.step);
+      if (qhyResult == QHYCCD_ERROR) {
+         capabilities.rangeSpeed.max  = 0.0;
+         capabilities.rangeSpeed.min  = 0.0;
+         capabilities.rangeSpeed.step = 0.0;
+      }
+   }
+   capabilities.supportsUSBTraffic = IsQHYCCDControlAvailable(handle, CONTROL_USBTRAFFIC) == QHYCCD_SUCCESS;
+   if (capabilities.supportsUSBTraffic) {
       qhyResult = GetQHYCCDParamMinMaxStep(handle,
                                            CONTROL_USBTRAFFIC,
-                                           &m_capabilities.rangeUSBTraffic.min,
-                                           &m_capabilities.rangeUSBTraffic.max,
-                                           &m_capabilities.rangeUSBTraffic.step);
+                                           &capabilities.rangeUSBTraffic.min,
+                                           &capabilities.rangeUSBTraffic.max,
+                                           &capabilities.rangeUSBTraffic.step);
       if (qhyResult == QHYCCD_ERROR) {
-         m_capabilities.rangeUSBTraffic.max  = 0.0;
-         m_capabilities.rangeUSBTraffic.min  = 0.0;
-         m_capabilities.rangeUSBTraffic.step = 0.0;
+         capabilities.rangeUSBTraffic.max  = 0.0;
+         capabilities.rangeUSBTraffic.min  = 0.0;
+         capabilities.rangeUSBTraffic.step = 0.0;
       }
    }
 
-   m_capabilities.supportsGPS = IsQHYCCDControlAvailable(handle, CAM_GPS) == QHYCCD_SUCCESS;
+   capabilities.supportsGPS = IsQHYCCDControlAvailable(handle, CAM_GPS) == QHYCCD_SUCCESS;
 
-   if (IsQHYCCDControlAvailable(handle, CONTROL_TRANSFERBIT) == QHYCCD_SUCCESS) {
-      if (IsQHYCCDControlAvailable(handle, CAM_16BITS) == QHYCCD_SUCCESS) {
-         m_capabilities.supports16Bit = true;
-         bitDepth                     = BitDepth16;
-      } else {
-         m_capabilities.supports16Bit = false;
-         bitDepth                     = BitDepth8;
-      }
-      qhyResult = SetQHYCCDParam(handle, CONTROL_TRANSFERBIT, bitDepth);
-   }
+   capabilities.supportsTransferBit = IsQHYCCDControlAvailable(handle, CONTROL_TRANSFERBIT) == QHYCCD_SUCCESS;
+   capabilities.supports16Bit =
+     capabilities.supportsTransferBit && IsQHYCCDControlAvailable(handle, CAM_16BITS) == QHYCCD_SUCCESS;
 
    if (IsQHYCCDControlAvailable(handle, CONTROL_CFWPORT) == QHYCCD_SUCCESS) {
       auto filtersSupported = GetQHYCCDParam(handle, CONTROL_CFWSLOTSNUM);
       if (filtersSupported > 9) {
-         m_capabilities.filterWheelCapacity = 9;
+         capabilities.filterWheelCapacity = 9;
       } else {
-         m_capabilities.filterWheelCapacity = static_cast<int>(filtersSupported);
+         capabilities.filterWheelCapacity = static_cast<int>(filtersSupported);
       }
    }
 
-   m_capabilities.supportsCooler            = IsQHYCCDControlAvailable(handle, CONTROL_COOLER) == QHYCCD_SUCCESS;
-   m_capabilities.supportsHumidity          = IsQHYCCDControlAvailable(handle, CAM_HUMIDITY) == QHYCCD_SUCCESS;
-   m_capabilities.supportsPressure          = IsQHYCCDControlAvailable(handle, CAM_PRESSURE) == QHYCCD_SUCCESS;
-   m_capabilities.supportsMechanicalShutter = IsQHYCCDControlAvailable(handle, CAM_MECHANICALSHUTTER) == QHYCCD_SUCCESS;
-   m_capabilities.supportsTrigger           = IsQHYCCDControlAvailable(handle, CAM_TRIGER_INTERFACE) == QHYCCD_SUCCESS;
-   m_capabilities.supportsShutterMotorHeating =
+   capabilities.supportsCooler            = IsQHYCCDControlAvailable(handle, CONTROL_COOLER) == QHYCCD_SUCCESS;
+   capabilities.supportsHumidity          = IsQHYCCDControlAvailable(handle, CAM_HUMIDITY) == QHYCCD_SUCCESS;
+   capabilities.supportsPressure          = IsQHYCCDControlAvailable(handle, CAM_PRESSURE) == QHYCCD_SUCCESS;
+   capabilities.supportsMechanicalShutter = IsQHYCCDControlAvailable(handle, CAM_MECHANICALSHUTTER) == QHYCCD_SUCCESS;
+   capabilities.supportsTrigger           = IsQHYCCDControlAvailable(handle, CAM_TRIGER_INTERFACE) == QHYCCD_SUCCESS;
+   capabilities.supportsShutterMotorHeating =
      IsQHYCCDControlAvailable(handle, CAM_SHUTTERMOTORHEATING_INTERFACE) == QHYCCD_SUCCESS;
-   m_capabilities.supportsTECOverProtection =
+   capabilities.supportsTECOverProtection =
      IsQHYCCDControlAvailable(handle, CAM_TECOVERPROTECT_INTERFACE) == QHYCCD_SUCCESS;
-   m_capabilities.supportsSignalClamp = IsQHYCCDControlAvailable(handle, CAM_SINGNALCLAMP_INTERFACE) == QHYCCD_SUCCESS;
-   m_capabilities.supportsFPNCalibration =
+   capabilities.supportsSignalClamp = IsQHYCCDControlAvailable(handle, CAM_SINGNALCLAMP_INTERFACE) == QHYCCD_SUCCESS;
+   capabilities.supportsFPNCalibration =
      IsQHYCCDControlAvailable(handle, CAM_CALIBRATEFPN_INTERFACE) == QHYCCD_SUCCESS;
-   m_capabilities.supportsChipTempSensor =
+   capabilities.supportsChipTempSensor =
      IsQHYCCDControlAvailable(handle, CAM_CHIPTEMPERATURESENSOR_INTERFACE) == QHYCCD_SUCCESS;
-   m_capabilities.supportsUSBSpeedSetting =
+   capabilities.supportsUSBSpeedSetting =
      IsQHYCCDControlAvailable(handle, CAM_USBREADOUTSLOWEST_INTERFACE) == QHYCCD_SUCCESS;
-   m_capabilities.supportsChipChamberCyclePump =
+   capabilities.supportsChipChamberCyclePump =
      IsQHYCCDControlAvailable(handle, CONTROL_SensorChamberCycle_PUMP) == QHYCCD_SUCCESS;
 
-   m_capabilities.maxFrameLength = static_cast<int>(GetQHYCCDMemLength(handle));
+   capabilities.maxFrameLength = static_cast<int>(GetQHYCCDMemLength(handle));
 }
 
-void QHYCamera::readFirmwareVersion()
+void QHYCamera::readFirmwareVersion(Capabilities & capabilities)
 {
    if (isConnected()) {
       std::array<quint8, BufferSizeFirmwareVersion> firmwareVersionBuffer{ 0 };
@@ -352,38 +696,38 @@ void QHYCamera::readFirmwareVersion()
          if (year < 10) { // NOLINT
             year += 0x10; // NOLINT
          }
-         m_capabilities.firmwareVersion = QString("20%1-%2-%3")
+         capabilities.firmwareVersion = QString("20%1-%2-%3")
                                             .arg(year)
                                             .arg(firmwareVersionBuffer[0] & ~0xf0U)
                                             .arg(firmwareVersionBuffer[1]); // NOLINT
-         qDebug() << "Firmware version:" << m_capabilities.firmwareVersion;
+         qDebug() << "Firmware version:" << capabilities.firmwareVersion;
       } else {
          qWarning() << "Error reading GetQHYCCDFWVersion";
       }
    }
 }
 
-void QHYCamera::readFPGAVersion()
+void QHYCamera::readFPGAVersion(Capabilities & capabilities)
 {
    if (isConnected()) {
       std::array<quint8, BufferSizeFirmwareVersion> fpgaVersionBuffer{ 0 };
       auto qhyResult = GetQHYCCDFPGAVersion(handle, 0, fpgaVersionBuffer.data());
       if (qhyResult == QHYCCD_SUCCESS) {
-         m_capabilities.fpga1Version = QString("%1-%2-%3-%4")
+         capabilities.fpga1Version = QString("%1-%2-%3-%4")
                                          .arg(fpgaVersionBuffer[0])
                                          .arg(fpgaVersionBuffer[1])
                                          .arg(fpgaVersionBuffer[2])
                                          .arg(fpgaVersionBuffer[3]);
-         qDebug() << "FPGA1 version:" % m_capabilities.fpga1Version;
+         qDebug() << "FPGA1 version:" % capabilities.fpga1Version;
 
          qhyResult = GetQHYCCDFPGAVersion(handle, 1, fpgaVersionBuffer.data());
          if (qhyResult == QHYCCD_SUCCESS) {
-            m_capabilities.fpga2Version = QString("%1-%2-%3-%4")
+            capabilities.fpga2Version = QString("%1-%2-%3-%4")
                                             .arg(fpgaVersionBuffer[0])
                                             .arg(fpgaVersionBuffer[1])
                                             .arg(fpgaVersionBuffer[2])
                                             .arg(fpgaVersionBuffer[3]);
-            qDebug() << "FPGA2 version:" << m_capabilities.fpga2Version;
+            qDebug() << "FPGA2 version:" << capabilities.fpga2Version;
          } else {
             qWarning() << "Error reading second GetQHYCCDFPGAVersion";
          }
@@ -392,6 +736,21 @@ void QHYCamera::readFPGAVersion()
       }
    }
 }
+
+void QHYCamera::readVersions()
+{
+   Capabilities versions{};
+   readFirmwareVersion(versions);
+   readFPGAVersion(versions);
+   {
+      QMutexLocker locker(&m_stateMutex);
+      m_capabilities.firmwareVersion = versions.firmwareVersion;
+      m_capabilities.fpga1Version    = versions.fpga1Version;
+      m_capabilities.fpga2Version    = versions.fpga2Version;
+   }
+   m_capabilityCache->load(versions.firmwareVersion, versions.fpga1Version, versions.fpga2Version);
+}
+
 /* ****************************************************************************************************************** */
 // MARK: - Operators
 /* ****************************************************************************************************************** */
@@ -6,11 +6,30 @@
  * For the license, see the root LICENSE file.
  */
 
+#include "BusArbiter.hpp"
 #include "Config.h"
+#include "Frame.hpp"
+#include "TransferMeter.hpp"
+#include <memory>
 #include <ostream>
+#include <QFuture>
 #include <QMap>
+#include <QMutex>
 #include <QObject>
 #include <QStringList>
+#include <QThread>
+
+class Calibrator;
+class CameraCommandQueue;
+class CameraPipeline;
+class CapabilityCache;
+class DefectMap;
+class ExposureWorker;
+class FitsWriter;
+class FramePool;
+class FrameScorer;
+class FrameRing;
+class LiveViewWorker;
 
 using qhyccd_handle = void;
 
@@ -19,6 +38,13 @@ using qhyccd_handle = void;
  * This class is intended to be the interface to a QHYCCD camera.
  *
  * Instantiation of this class does not make it usable; before an instance does anything, connect() must be called.
+ *
+ * Connecting, disconnecting and changing modes run on the camera's command queue, never on the calling thread; each
+ * returns a QFuture, and the matching signal is emitted once the driver is done.  Those signals may be emitted from the
+ * queue's thread.  The getters are safe to call from any thread.
+ *
+ * What is done with the frames besides showing and saving them, such as star detection or recording, is the business of
+ * the camera's pipeline().
  */
 class QHYCamera : public QObject
 {
@@ -62,6 +88,7 @@ public:
    {
       Range   rangeGain;//d
       Range   rangeOffset;//d
+      Range   rangeSpeed;
       Range   rangeUSBTraffic;//d
       Binning binningInfo; //d
       double  chipHeight; //d
@@ -96,6 +123,7 @@ public:
       bool    supportsShutterMotorHeating; //d
       bool    supportsSignalClamp; //d
       bool    supportsTECOverProtection; //d
+      bool    supportsTransferBit;
       bool    supportsTrigger; //d
       bool    supportsUSBSpeedSetting; //d
       bool    supportsUSBTraffic;//d
@@ -109,49 +137,260 @@ public:
    [[nodiscard]] auto capabilities() const -> const Capabilities;
 
    /*!
-    * Connects to the QHYCCD camera, and returns success.
+    * Queues connecting to the QHYCCD camera; connectedChanged() is emitted when done.
     *
     * \return The success of connecting to the QHYCCD camera.
     */
-   void               connect();
-   void               disconnect();
-   [[nodiscard]] auto isConnected() -> bool;
+   auto               connect() -> QFuture<bool>;
+
+   /*!
+    * Queues disconnecting from the QHYCCD camera; connectedChanged() is emitted when done.
+    *
+    * \return The success of disconnecting from the QHYCCD camera.
+    */
+   auto               disconnect() -> QFuture<bool>;
+   [[nodiscard]] auto isConnected() const -> bool;
+
+   /*!
+    * The bad pixels corrected in every frame, or nullptr if there are none.
+    */
+   [[nodiscard]] auto defectMap() const -> std::shared_ptr<const DefectMap>;
+
+   /*!
+    * The gain setting, CONTROL_GAIN, as the camera reported it when initialized.
+    */
+   [[nodiscard]] auto gain() const -> double;
+
+   /*!
+    * Flag to track if a single frame exposure, or its readout, is in progress.
+    * @return If the camera is exposing.
+    */
+   [[nodiscard]] auto isExposing() const -> bool;
+
+   /*!
+    * If a calibrator is set; see setCalibrator().  Safe to call from any thread.
+    */
+   [[nodiscard]] auto isCalibrating() const -> bool;
+   [[nodiscard]] auto isStreaming() const -> bool;
    [[nodiscard]] auto id() const -> QString;
+
+   /*!
+    * The frame rate of the live view stream, over the last second.
+    */
+   [[nodiscard]] auto liveFrameRate() const -> double;
+
+   /*!
+    * The ring that live view frames are published to; consumers lease frames from it without locking.  Hold on to the
+    * returned pointer for as long as any lease taken from it, as the ring is replaced when the read mode changes.
+    *
+    * @return The ring, or nullptr if the camera is not in the LiveView transfer mode.
+    */
+   [[nodiscard]] auto liveFrames() const -> std::shared_ptr<FrameRing>;
+
+   /*!
+    * The count of live view frames no consumer saw, since the stream started.
+    */
+   [[nodiscard]] auto droppedLiveFrames() const -> quint64;
    [[nodiscard]] auto model() const -> QString;
+
+   /*!
+    * The offset setting, CONTROL_OFFSET, as the camera reported it when initialized.
+    */
+   [[nodiscard]] auto offset() const -> double;
+
+   /*!
+    * The star detection, live stacking, lucky imaging, recording, spooling, defect surveys and master building of this
+    * camera; each starts its thread when first used.  Use it from the camera's thread.
+    */
+   [[nodiscard]] auto pipeline() const -> CameraPipeline *;
    [[nodiscard]] auto readMode() const -> QString;
    [[nodiscard]] auto readModes() const -> QStringList;
+
+   /*!
+    * Sets the arbiter that orders this camera's downloads against those of the other cameras on its USB bus.
+    *
+    * @param busArbiter the arbiter, or nullptr to download without waiting on other cameras.
+    * @param priority Latency for a guide camera, Bulk otherwise.
+    */
+   void               setBusArbiter(std::shared_ptr<BusArbiter> busArbiter, BusArbiter::Priority priority);
+
+   /*!
+    * Sets the calibration for exposures.  While set, every exposure is calibrated on the exposure thread after its
+    * frameReady(), and the result emitted through calibratedFrameReady().  Live view frames are never calibrated.
+    *
+    * @param calibrator the calibration, or nullptr to stop calibrating.
+    */
+   void               setCalibrator(std::shared_ptr<Calibrator> calibrator);
+
+   /*!
+    * Sets the bad pixels corrected in every frame, exposures and live view alike; an exposure as soon as it is
+    * downloaded, a live view frame as it is first leased.  The map is kept for the camera and its read mode, and
+    * applied again whenever the read mode is selected.
+    *
+    * @param defectMap the bad pixels, or nullptr to stop correcting them for now.
+    */
+   void               setDefectMap(std::shared_ptr<const DefectMap> defectMap);
+
+   /*!
+    * Sets the writer every exposure is saved to; its calibrated copy instead, while a calibrator is set.  Frames are
+    * queued to it from the exposure thread, right after frameReady(), so none waits on the GUI thread.  The camera
+    * holds a reference to the writer until another is set.
+    *
+    * @param fitsWriter the writer, or nullptr to stop saving.
+    */
+   void               setFitsWriter(std::shared_ptr<FitsWriter> fitsWriter);
+
+   /*!
+    * Sets the scorer that judges every exposure against the ones before it; see FrameScorer.  Each frame, and its
+    * calibrated copy, carries its FrameQuality, which says whether to keep it.  Live view frames are never scored.
+    *
+    * @param frameScorer the scorer, or nullptr to stop scoring.
+    */
+   void               setFrameScorer(std::shared_ptr<FrameScorer> frameScorer);
+
+   /*!
+    * Queues a change to the readout speed setting, CONTROL_SPEED.  The setting is kept, and applied again whenever the
+    * camera is re-initialized.
+    *
+    * @param speed a value within Capabilities::rangeSpeed, or -1 to leave the driver's default.
+    * @return The success of applying the setting; true if the camera is not yet initialized.
+    */
+   auto               setReadoutSpeed(int speed) -> QFuture<bool>;
+
+   /*!
+    * Queues a change to the USB traffic setting, which throttles the camera's share of the bus; higher values are
+    * slower.  The setting is kept, and applied again whenever the camera is re-initialized.
+    *
+    * @param traffic a value within Capabilities::rangeUSBTraffic, or -1 to leave the driver's default.
+    * @return The success of applying the setting; true if the camera is not yet initialized.
+    */
+   auto               setUSBTraffic(int traffic) -> QFuture<bool>;
+
+   /*!
+    * The totals for every frame this camera has downloaded.
+    */
+   [[nodiscard]] auto transferStatistics() const -> TransferStatistics;
    [[nodiscard]] auto transferMode() const -> DataTransferMode;
 
 public slots:
-   void setReadAndTransferModes(QString readMode, QHYCamera::DataTransferMode mode = SingleImage);
+   /*!
+    * Aborts the exposure in progress, if any.  exposureFailed() is emitted once the camera has stopped.
+    */
+   void cancelExposure();
+
+   /*!
+    * Queues a change of read mode and transfer mode, which re-initializes the camera; readModeChanged() and
+    * transferModeChanged() are emitted when done.
+    *
+    * @param readMode the name of the read mode, one of readModes().
+    * @param mode the transfer mode.
+    * @return The success of the change; false if nothing needed changing.
+    */
+   auto setReadAndTransferModes(QString readMode, QHYCamera::DataTransferMode mode = SingleImage) -> QFuture<bool>;
+
+   /*!
+    * Starts streaming live view frames into liveFrames(), on the live view thread.  The camera must be connected, and
+    * in the LiveView transfer mode.
+    */
+   void startLiveView();
+
+   /*!
+    * Stops live view, and lucky imaging, recording and spooling with it.
+    */
+   void stopLiveView();
+
+   /*!
+    * Starts a single frame exposure on the exposure thread, and returns immediately.  Progress is reported through
+    * exposureProgress() and readoutStarted(), and the image through frameReady().  The camera must be connected, and
+    * in the SingleImage transfer mode.
+    *
+    * @param seconds the exposure duration.
+    */
+   void startExposure(double seconds);
 
 signals:
+   /*!
+    * Emitted with the calibrated copy of an exposure, after its frameReady(), while a calibrator is set.  Like
+    * frameReady(), it is emitted from the exposure thread.
+    */
+   void calibratedFrameReady(Frame frame);
    void connectedChanged(bool connected);
+
+   /*!
+    * Emitted when the bad pixels corrected change; 0 when none are.
+    */
+   void defectMapChanged(int defects);
+   void exposureFailed(QString reason);
+   void exposureProgress(double elapsed, double duration);
+
+   /*!
+    * Emitted when an image has been downloaded.  The pixels belong to the camera's frame pool; release the frame when
+    * done with it so the buffer can be re-used.
+    *
+    * Emitted from the exposure thread: a receiver in another thread has the frame queued to it as usual, while a
+    * direct connection takes it without waiting on that thread's event loop.
+    */
+   void frameReady(Frame frame);
+   void liveViewFailed(QString reason);
+
+   /*!
+    * Emitted once a second while live view runs; never once per frame.
+    */
+   void liveViewStatisticsChanged(double framesPerSecond, quint64 droppedFrames);
+   void readoutStarted();
+   void streamingChanged(bool streaming);
    void readModeChanged(QString readMode);
    void transferModeChanged(QHYCamera::DataTransferMode mode);
 
 private:
+   void                   applyDefectMap(std::shared_ptr<const DefectMap> defectMap);
+   [[nodiscard]] auto     defectMapPath() const -> QString;
+
+   // MARK: These run on the command queue, which is the only writer of the camera state.
+   auto                   applyBusSettings(const Capabilities & capabilities) -> bool;
+   auto                   applyReadAndTransferModes(const QString & readMode, DataTransferMode mode) -> bool;
+   auto                   closeCamera() -> bool;
+   auto                   openCamera() -> bool;
+   void                   initializeControlValues(const Capabilities & capabilities);
    void                   initializeReadModes();
+   void                   prepareFramePool();
    void                   readCameraDetails();
-   void                   readChipInfo();
-   void                   readControlValues();
-   void                   readFirmwareVersion();
-   void                   readFPGAVersion();
-
-   qhyccd_handle *        handle;
-   QByteArray             m_id;
-   QLatin1String          m_model;
-   QString                m_readMode;
-   QMap<QString, quint32> m_readModes;
-   DataTransferMode       m_transferMode;
-   Capabilities           m_capabilities;
-
-   int                    bitDepth;
-   double                 gain;
-   double                 offset;
-   bool                   tecProtectEnabled;
-   bool                   clampSignalEnabled;
-   bool                   slowestDownloadEnabled;
+   void                   readChipInfo(Capabilities & capabilities);
+   void                   readControlValues(Capabilities & capabilities);
+   void                   readFirmwareVersion(Capabilities & capabilities);
+   void                   readFPGAVersion(Capabilities & capabilities);
+   void                   readVersions();
+
+   qhyccd_handle *                     handle;
+   std::unique_ptr<CameraCommandQueue> m_commandQueue;
+   std::unique_ptr<CapabilityCache>    m_capabilityCache;
+   std::shared_ptr<TransferMeter>      m_transferMeter;
+   ExposureWorker *                    m_exposureWorker;
+   QThread                             m_exposureThread;
+   LiveViewWorker *                    m_liveViewWorker;
+   QThread                             m_liveViewThread;
+   std::unique_ptr<CameraPipeline>     m_pipeline;
+   std::shared_ptr<const DefectMap>    m_defectMap;
+   std::shared_ptr<FramePool>          m_framePool;
+   QByteArray                          m_id;
+   QLatin1String                       m_model;
+
+   // Written on the command queue under the lock; read elsewhere under the lock.  The handle is also read unlocked on
+   // the command queue itself.
+   mutable QMutex                      m_stateMutex;
+   QString                             m_readMode;
+   QMap<QString, quint32>              m_readModes;
+   DataTransferMode                    m_transferMode;
+   Capabilities                        m_capabilities;
+
+   double                              m_gain;   // under the lock
+   double                              m_offset; // under the lock
+   int                                 bitDepth;
+   bool                                tecProtectEnabled;
+   bool                                clampSignalEnabled;
+   bool                                slowestDownloadEnabled;
+   int                                 m_readoutSpeed; // only touched on the command queue
+   int                                 m_usbTraffic;   // only touched on the command queue
 };
 
 Q_DECLARE_METATYPE(QHYCamera::DataTransferMode)
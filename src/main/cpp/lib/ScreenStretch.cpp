@@ -0,0 +1,120 @@
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "ScreenStretch.hpp"
+
+#include "Config.h"
+#include "Histogram.hpp"
+#include "ParallelRows.hpp"
+#include <cmath>
+#include <limits>
+
+namespace
+{
+/*!
+ * The midtones transfer function; maps 0 to 0, 1 to 1, and midtones to 0.5.
+ */
+auto midtonesTransfer(double midtones, double value) -> double
+{
+   if (value <= 0.0 || value >= 1.0) {
+      return qBound(0.0, value, 1.0);
+   }
+   return (midtones - 1.0) * value / ((2.0 * midtones - 1.0) * value - midtones);
+}
+
+template <class T>
+void applyTable(const QVector<quint8> & table, const T * samples, qint64 count, quint8 * display)
+{
+   if (samples == nullptr || display == nullptr || count <= 0) {
+      return;
+   }
+   const auto * lookup = table.constData();
+   const auto   blocks = static_cast<int>((count + SampleBlockLength - 1) / SampleBlockLength);
+   parallelRows(blocks, [=](int firstBlock, int lastBlock) {
+      const auto first = static_cast<qint64>(firstBlock) * SampleBlockLength;
+      const auto last  = qMin(count, static_cast<qint64>(lastBlock) * SampleBlockLength);
+      for (auto sample = first; sample < last; ++sample) {
+         display[sample] = lookup[samples[sample]];
+      }
+   });
+}
+} // namespace
+
+/* ***************************************************************************************************************** */
+// MARK: - ctors & dtors
+/* ***************************************************************************************************************** */
+ScreenStretch::ScreenStretch(double shadows, double midtones, double highlights)
+   : m_shadows(qBound(0.0, shadows, 1.0))
+   , m_midtones(qBound(0.0, midtones, 1.0))
+   , m_highlights(qBound(m_shadows, highlights, 1.0))
+{
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Public methods
+/* ***************************************************************************************************************** */
+void ScreenStretch::apply(const quint8 * samples, qint64 count, quint8 * display) const
+{
+   applyTable(lookupTable(1 << BitDepth8), samples, count, display);
+}
+
+void ScreenStretch::apply(const quint16 * samples, qint64 count, quint8 * display) const
+{
+   applyTable(lookupTable(1 << BitDepth16), samples, count, display);
+}
+
+auto ScreenStretch::automatic(const Histogram & histogram) -> ScreenStretch
+{
+   if (histogram.isEmpty() || histogram.binCount() < 2) {
+      return ScreenStretch();
+   }
+   const auto fullScale = static_cast<double>(histogram.binCount() - 1);
+   const auto median    = histogram.median() / fullScale;
+   // A flat frame has no MAD; one step keeps the shadows below the median.
+   const auto sigma   = qMax(histogram.medianAbsoluteDeviation(), 1.0) * MADToSigma / fullScale;
+   const auto shadows = qBound(0.0, median + StretchShadowsClipping * sigma, 1.0);
+   // The midtones that take the median, once the shadows are clipped, to the target background.
+   const auto background = shadows < 1.0 ? (median - shadows) / (1.0 - shadows) : 0.0;
+   if (background <= 0.0 || background >= 1.0) {
+      // A black or saturated frame; its midtones would be 0 or 1, turning everything above the shadows white or black.
+      return ScreenStretch();
+   }
+   return ScreenStretch(shadows, midtonesTransfer(StretchTargetBackground, background), 1.0);
+}
+
+auto ScreenStretch::highlights() const -> double
+{
+   return m_highlights;
+}
+
+auto ScreenStretch::lookupTable(int binCount) const -> QVector<quint8>
+{
+   constexpr auto  White = std::numeric_limits<quint8>::max();
+   QVector<quint8> table(binCount);
+   const auto      fullScale = static_cast<double>(qMax(binCount - 1, 1));
+   const auto      range     = m_highlights - m_shadows;
+   for (int value = 0; value < binCount; ++value) {
+      const auto sample = value / fullScale;
+      double     stretched{ 0.0 };
+      if (sample >= m_highlights) {
+         stretched = 1.0;
+      } else if (sample > m_shadows && range > 0.0) {
+         stretched = midtonesTransfer(m_midtones, (sample - m_shadows) / range);
+      }
+      table[value] = static_cast<quint8>(std::lround(stretched * White));
+   }
+   return table;
+}
+
+auto ScreenStretch::midtones() const -> double
+{
+   return m_midtones;
+}
+
+auto ScreenStretch::shadows() const -> double
+{
+   return m_shadows;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include <QVector>
+
+class Histogram;
+
+/*! \brief A display stretch: shadows clipping, a midtones transfer function, and highlights clipping.
+ *
+ * The three points are fractions of the full sample range.  Samples at or below the shadows point go black, those at
+ * or above the highlights point go white, and the rest follow the midtones transfer function, which maps the midtones
+ * point to half brightness.
+ *
+ * The stretch is never worked out per sample; lookupTable() evaluates it once for every possible sample value, and
+ * apply() is a table lookup per sample.
+ */
+class ScreenStretch
+{
+public:
+   /*!
+    * The identity stretch, which only scales down to 8 bits.
+    */
+   ScreenStretch() = default;
+   ScreenStretch(double shadows, double midtones, double highlights);
+
+   /*!
+    * A stretch that puts the sky background at a quarter brightness, with the shadows clipped a few deviations below
+    * it.  This is the screen transfer function commonly used for linear astronomical data.  A frame whose median is
+    * black or saturated gets the identity stretch.
+    *
+    * @param histogram the histogram of the frame to display.
+    */
+   [[nodiscard]] static auto automatic(const Histogram & histogram) -> ScreenStretch;
+
+   [[nodiscard]] auto        highlights() const -> double;
+   [[nodiscard]] auto        midtones() const -> double;
+   [[nodiscard]] auto        shadows() const -> double;
+
+   /*!
+    * The 8 bit display value for every sample value.
+    *
+    * @param binCount the number of sample values; 256 for 8 bit samples, 65536 for 16 bit.
+    */
+   [[nodiscard]] auto        lookupTable(int binCount) const -> QVector<quint8>;
+
+   /*!
+    * Stretches 8 bit samples to 8 bit display values.
+    *
+    * @param samples the samples.
+    * @param count the number of samples.
+    * @param display count values.
+    */
+   void                      apply(const quint8 * samples, qint64 count, quint8 * display) const;
+
+   /*!
+    * Stretches 16 bit samples to 8 bit display values; see the 8 bit overload.
+    */
+   void                      apply(const quint16 * samples, qint64 count, quint8 * display) const;
+
+private:
+   double m_shadows{ 0.0 };
+   double m_midtones{ 0.5 };
+   double m_highlights{ 1.0 };
+};
@@ -0,0 +1,341 @@
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "SerWriter.hpp"
+
+#include "FrameRing.hpp"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QThread>
+#include <QtEndian>
+
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#endif
+
+namespace
+{
+constexpr int    HeaderLength        = 178;
+constexpr qint64 FrameCountOffset    = 38; // after the file id, LuID, colour id, endianness, width, height & depth
+constexpr int    TextFieldLength     = 40;
+constexpr qint64 TicksPerMillisecond = 10000;                        // SER times are in 100 ns ticks
+constexpr qint64 UnixEpochTicks      = Q_INT64_C(621355968000000000); // from 0001-01-01, where SER times start
+
+enum ColorId
+{
+   Mono      = 0,
+   BayerRGGB = 8,
+   BayerGRBG = 9,
+   BayerGBRG = 10,
+   BayerBGGR = 11,
+   BGR       = 101 // a camera's colour frames are B, G, R
+};
+
+auto colorId(Frame::BayerPattern pattern, quint32 channels) -> qint32
+{
+   if (channels == 3) {
+      return BGR;
+   }
+   switch (pattern) {
+   case Frame::RGGB:
+      return BayerRGGB;
+   case Frame::GRBG:
+      return BayerGRBG;
+   case Frame::GBRG:
+      return BayerGBRG;
+   case Frame::BGGR:
+      return BayerBGGR;
+   default:
+      return Mono;
+   }
+}
+
+auto ticks(qint64 milliseconds) -> qint64
+{
+   return milliseconds * TicksPerMillisecond + UnixEpochTicks;
+}
+
+/*! \brief Fills a header, field by field, in the little endian order SER uses throughout.
+ */
+class HeaderBuilder
+{
+public:
+   void putInt32(qint32 value)
+   {
+      qToLittleEndian(value, m_bytes.data() + m_offset);
+      m_offset += sizeof(value);
+   }
+
+   void putInt64(qint64 value)
+   {
+      qToLittleEndian(value, m_bytes.data() + m_offset);
+      m_offset += sizeof(value);
+   }
+
+   void putText(const QString & text, int length)
+   {
+      const auto latin1 = text.toLatin1().left(length);
+      std::memcpy(m_bytes.data() + m_offset, latin1.constData(), static_cast<size_t>(latin1.size()));
+      m_offset += static_cast<size_t>(length); // the rest stays zero
+   }
+
+   [[nodiscard]] auto bytes() const -> const char *
+   {
+      return reinterpret_cast<const char *>(m_bytes.data()); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+   }
+
+private:
+   std::array<uchar, HeaderLength> m_bytes{};
+   size_t                          m_offset{ 0 };
+};
+} // namespace
+
+/* ***************************************************************************************************************** */
+// MARK: - ctors & dtors
+/* ***************************************************************************************************************** */
+SerWriter::SerWriter(QObject * parent)
+   : QObject(parent)
+   , m_recording(false)
+   , m_stopRequested(false)
+   , m_fileIndex(0)
+   , m_fileLength(0)
+   , m_fileLimit(SerFileLimit)
+   , m_width(0)
+   , m_height(0)
+   , m_bitsPerPixel(0)
+   , m_channels(0)
+   , m_bayerPattern(Frame::Monochrome)
+   , m_frames(0)
+   , m_missed(0)
+   , m_bytes(0)
+   , m_bytesAtLastReport(0)
+{
+}
+
+SerWriter::~SerWriter()
+{
+   close();
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Public methods
+/* ***************************************************************************************************************** */
+auto SerWriter::isRecording() const -> bool
+{
+   return m_recording;
+}
+
+auto SerWriter::open(const QString & directory, const QString & prefix, const Header & header) -> bool
+{
+   if (m_recording) {
+      return false;
+   }
+   if (!QDir().mkpath(directory)) {
+      emit writeFailed(tr("The directory %1 could not be created.").arg(directory));
+      return false;
+   }
+   m_directory         = directory;
+   m_prefix            = prefix;
+   m_started           = QDateTime::currentDateTimeUtc().toString(QString("yyyyMMdd-HHmmss"));
+   m_header            = header;
+   m_fileIndex         = 0;
+   m_frames            = 0;
+   m_missed            = 0;
+   m_bytes             = 0;
+   m_bytesAtLastReport = 0;
+   m_statisticsTimer.start();
+   m_recording = true;
+   emit recordingChanged(true);
+   return true;
+}
+
+void SerWriter::setFileLimit(qint64 bytes)
+{
+   m_fileLimit = bytes;
+}
+
+void SerWriter::stop()
+{
+   m_stopRequested = true;
+}
+
+auto SerWriter::write(const Frame & frame) -> bool
+{
+   if (!m_recording || frame.isNull() || frame.isFloat()) {
+      return false;
+   }
+   if (m_file.isOpen()
+       && (frame.width() != m_width || frame.height() != m_height || frame.bitsPerPixel() != m_bitsPerPixel
+           || frame.channels() != m_channels || frame.bayerPattern() != m_bayerPattern
+           || m_fileLength + frame.length() > m_fileLimit)) {
+      closeFile();
+   }
+   if (!m_file.isOpen() && !openFile(frame)) {
+      return false;
+   }
+
+   // Unbuffered, so this is one write(2) from the pool buffer itself.
+   const auto length  = frame.length();
+   const auto written = m_file.write(reinterpret_cast<const char *>(frame.constData()), length); // NOLINT
+   if (written != length) {
+      emit writeFailed(tr("Writing %1 failed: %2").arg(m_file.fileName(), m_file.errorString()));
+      // The partial frame is cut off; the file is finished with the frames before it.
+      m_file.seek(m_fileLength);
+      closeFile();
+      return false;
+   }
+   m_fileLength += length;
+   m_timestamps.push_back(frame.startTimestamp());
+   ++m_frames;
+   m_bytes += static_cast<quint64>(length);
+   if (m_statisticsTimer.elapsed() >= LiveStatisticsInterval) {
+      reportStatistics();
+   }
+   return true;
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Public slots
+/* ***************************************************************************************************************** */
+auto SerWriter::close() -> bool
+{
+   // Queued behind record(), which a stop() has ended; a stop() before the recording opened is forgotten too.
+   m_stopRequested = false;
+   if (!m_recording) {
+      return true;
+   }
+   const auto finished = !m_file.isOpen() || closeFile();
+   reportStatistics();
+   m_recording = false;
+   emit recordingChanged(false);
+   return finished;
+}
+
+void SerWriter::record(std::shared_ptr<FrameRing> frames)
+{
+   if (!frames || !m_recording) {
+      return;
+   }
+   // Only frames from now on.
+   quint64 lastSequence{ 0 };
+   {
+      auto lease   = frames->latest();
+      lastSequence = lease.isValid() ? lease.frame().sequence() : 0;
+   }
+   while (!m_stopRequested && m_recording) {
+      auto lease = frames->next(lastSequence);
+      if (!lease.isValid()) {
+         QThread::usleep(LiveFramePollInterval);
+         continue;
+      }
+      const auto & frame = lease.frame();
+      if (lastSequence != 0 && frame.sequence() > lastSequence + 1) {
+         m_missed += frame.sequence() - lastSequence - 1;
+      }
+      lastSequence = frame.sequence();
+      // The lease is held through the write; the ring passes over the slot meanwhile.
+      write(frame);
+   }
+}
+
+void SerWriter::writeFrames(const QVector<Frame> & frames)
+{
+   for (const auto & frame : frames) {
+      write(frame);
+   }
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Private methods
+/* ***************************************************************************************************************** */
+auto SerWriter::closeFile() -> bool
+{
+   // The trailer holds each frame's UTC time; the header's count is filled in last, so an unfinished file reads as
+   // empty rather than as frames that are not there.
+   std::vector<qint64> trailer(m_timestamps.size());
+   std::transform(m_timestamps.cbegin(), m_timestamps.cend(), trailer.begin(), [](qint64 milliseconds) {
+      return qToLittleEndian(ticks(milliseconds));
+   });
+   const auto trailerLength = static_cast<qint64>(trailer.size() * sizeof(qint64));
+   auto       finished      = m_file.write(reinterpret_cast<const char *>(trailer.data()), trailerLength) // NOLINT
+                   == trailerLength;
+   // Releases the space reserved beyond the end.
+   finished = finished && m_file.resize(m_fileLength + trailerLength);
+
+   std::array<char, sizeof(qint32)> count{};
+   qToLittleEndian(static_cast<qint32>(m_timestamps.size()), count.data());
+   finished = finished && m_file.seek(FrameCountOffset)
+              && m_file.write(count.data(), count.size()) == static_cast<qint64>(count.size());
+   if (!finished) {
+      emit writeFailed(tr("Finishing %1 failed: %2").arg(m_file.fileName(), m_file.errorString()));
+   }
+   const auto path   = m_file.fileName();
+   const auto frames = static_cast<int>(m_timestamps.size());
+   m_file.close();
+   m_timestamps.clear();
+   if (finished) {
+      emit fileWritten(path, frames);
+   }
+   return finished;
+}
+
+auto SerWriter::openFile(const Frame & first) -> bool
+{
+   const auto name = QString("%1_%2_%3.ser").arg(m_prefix, m_started).arg(++m_fileIndex, 3, 10, QChar('0'));
+   m_file.setFileName(QDir(m_directory).filePath(name));
+   if (m_file.exists() || !m_file.open(QIODevice::WriteOnly | QIODevice::Unbuffered)) {
+      emit writeFailed(tr("%1 could not be created.").arg(m_file.fileName()));
+      return false;
+   }
+#ifdef Q_OS_LINUX
+   // Only reserves the blocks; the file's length stays that of what is written.
+   if (fallocate(m_file.handle(), FALLOC_FL_KEEP_SIZE, 0, m_fileLimit) != 0) {
+      qWarning() << "Could not reserve space for" << m_file.fileName() << "; writing without.";
+   }
+#endif
+
+   m_width        = first.width();
+   m_height       = first.height();
+   m_bitsPerPixel = first.bitsPerPixel();
+   m_channels     = first.channels();
+   m_bayerPattern = first.bayerPattern();
+
+   const auto    now = QDateTime::currentDateTime();
+   HeaderBuilder header;
+   header.putText(QString("LUCAM-RECORDER"), 14);
+   header.putInt32(0); // LuID
+   header.putInt32(colorId(m_bayerPattern, m_channels));
+   header.putInt32(0); // little endian; the readers in use took the specification's flag the other way round
+   header.putInt32(static_cast<qint32>(m_width));
+   header.putInt32(static_cast<qint32>(m_height));
+   header.putInt32(static_cast<qint32>(m_bitsPerPixel));
+   header.putInt32(0); // the frame count, filled in when the file is finished
+   header.putText(m_header.observer, TextFieldLength);
+   header.putText(m_header.instrument, TextFieldLength);
+   header.putText(m_header.telescope, TextFieldLength);
+   header.putInt64(ticks(now.toMSecsSinceEpoch() + static_cast<qint64>(now.offsetFromUtc()) * 1000));
+   header.putInt64(ticks(now.toMSecsSinceEpoch()));
+   if (m_file.write(header.bytes(), HeaderLength) != HeaderLength) {
+      emit writeFailed(tr("Writing %1 failed: %2").arg(m_file.fileName(), m_file.errorString()));
+      m_file.close();
+      return false;
+   }
+   m_fileLength = HeaderLength;
+   return true;
+}
+
+void SerWriter::reportStatistics()
+{
+   const auto elapsed = static_cast<double>(m_statisticsTimer.restart()) / MillisecondsPerSecond;
+   const auto rate    = elapsed > 0.0 ? static_cast<double>(m_bytes - m_bytesAtLastReport) / BytesPerMegabyte / elapsed
+                                      : 0.0;
+   m_bytesAtLastReport = m_bytes;
+   emit statisticsChanged(m_frames, m_missed, rate);
+}
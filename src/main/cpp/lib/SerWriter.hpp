@@ -0,0 +1,157 @@
+#pragma once
+
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "Config.h"
+#include "Frame.hpp"
+#include <atomic>
+#include <memory>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMetaType>
+#include <QObject>
+#include <QString>
+#include <QVector>
+#include <vector>
+
+class FrameRing;
+
+/*! \brief Records live view into SER files, the video container planetary stacking software reads.
+ *
+ * A FITS file per frame costs a file creation and a header per frame, far too much at hundreds of frames a second.  A
+ * SER file is one header, then the frames back to back, then a trailer of their timestamps; so each frame is a single
+ * sequential write, straight from its pool buffer with no copy, and the file system sees one long append.  On Linux,
+ * each file's space is reserved up front with fallocate, so the append never waits on block allocation, and the file
+ * is not fragmented; what is left over is released when the file is closed.
+ *
+ * A file holds frames of one geometry.  Once it reaches SerFileLimit, or the geometry changes, it is closed and the
+ * next is started; files are numbered in order within a recording.  The limit can be lowered with setFileLimit().
+ *
+ * open(), write() and close() may be called from any one thread at a time.  record() is meant for a thread of its own.
+ */
+class SerWriter : public QObject
+{
+   Q_OBJECT
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+   Q_DISABLE_COPY_MOVE(SerWriter)
+#endif
+
+public:
+   /*! \brief The free text fields of the SER header, of up to 40 characters each.
+    */
+   struct Header
+   {
+      QString observer;
+      QString instrument;
+      QString telescope;
+   };
+
+   explicit SerWriter(QObject * parent = nullptr);
+
+   /*!
+    * Closes the file being written, if any.
+    */
+   ~SerWriter() override;
+
+   /*!
+    * Safe to call from any thread.
+    */
+   [[nodiscard]] auto isRecording() const -> bool;
+
+   /*!
+    * Starts a recording; the first file is created by the first frame written.
+    *
+    * @param directory where the files go; it is created if need be.
+    * @param prefix the start of every file name, such as the camera's id.
+    * @return False if a recording is already open, or the directory cannot be created.
+    */
+   auto               open(const QString & directory, const QString & prefix, const Header & header) -> bool;
+
+   /*!
+    * Sets the length a file may reach before the next is started, and the space reserved for each.  Takes effect from
+    * the next frame written.
+    *
+    * @param bytes the limit; SerFileLimit unless set.
+    */
+   void               setFileLimit(qint64 bytes);
+
+   /*!
+    * Requests that record() return; it stays requested until close().  Safe to call from any thread.
+    */
+   void               stop();
+
+   /*!
+    * Appends a frame to the recording.
+    *
+    * @return False if nothing is open, the frame is a float frame, or the write failed.
+    */
+   auto               write(const Frame & frame) -> bool;
+
+public slots:
+   /*!
+    * Finishes the file being written, and ends the recording.
+    *
+    * @return False if the last file could not be finished.
+    */
+   auto close() -> bool;
+
+   /*!
+    * Writes every frame published to a ring, until stop() is called; the recording stays open.
+    */
+   void record(std::shared_ptr<FrameRing> frames);
+
+   /*!
+    * Writes frames chosen elsewhere, such as the best of a LuckyImager window.
+    */
+   void writeFrames(const QVector<Frame> & frames);
+
+signals:
+   /*!
+    * Emitted when a file has been finished.
+    */
+   void fileWritten(QString path, int frames);
+   void recordingChanged(bool recording);
+
+   /*!
+    * Emitted every LiveStatisticsInterval while frames are written.
+    *
+    * @param frames the frames written since the recording was opened.
+    * @param missed the frames overwritten in the ring before they could be written.
+    * @param megabytesPerSecond over the last LiveStatisticsInterval.
+    */
+   void statisticsChanged(quint64 frames, quint64 missed, double megabytesPerSecond);
+   void writeFailed(QString reason);
+
+private:
+   auto                 closeFile() -> bool;
+   auto                 openFile(const Frame & first) -> bool;
+   void                 reportStatistics();
+
+   std::atomic_bool     m_recording;
+   std::atomic_bool     m_stopRequested;
+   QString              m_directory;
+   QString              m_prefix;
+   QString              m_started; // the time the recording was opened, for the file names
+   Header               m_header;
+   QFile                m_file;
+   int                  m_fileIndex;
+   qint64               m_fileLength;
+   qint64               m_fileLimit;
+   std::vector<qint64>  m_timestamps; // of the frames in the file, in milliseconds since the epoch, UTC
+   quint32              m_width;
+   quint32              m_height;
+   quint32              m_bitsPerPixel;
+   quint32              m_channels;
+   Frame::BayerPattern  m_bayerPattern;
+   quint64              m_frames;
+   quint64              m_missed;
+   quint64              m_bytes;
+   quint64              m_bytesAtLastReport;
+   QElapsedTimer        m_statisticsTimer;
+};
+
+Q_DECLARE_METATYPE(SerWriter::Header)
@@ -0,0 +1,143 @@
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "SpoolConverter.hpp"
+
+#include "Config.h"
+#include "FitsWriter.hpp"
+#include "FramePool.hpp"
+#include "SerWriter.hpp"
+#include "SpoolWriter.hpp"
+#include <memory>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+
+namespace
+{
+// Converting is not capture; a short queue is enough to keep the writer threads busy, and spares the frame memory.
+constexpr int FitsQueueLength = 2 * FitsWriterThreads;
+constexpr int PoolBuffers     = FitsQueueLength + FitsWriterThreads + 1; // queued, being written, and being read
+} // namespace
+
+/* ***************************************************************************************************************** */
+// MARK: - Report
+/* ***************************************************************************************************************** */
+auto SpoolConverter::Report::succeeded() const -> bool
+{
+   return error.isEmpty();
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - ctors & dtors
+/* ***************************************************************************************************************** */
+SpoolConverter::SpoolConverter(QObject * parent)
+   : QObject(parent)
+{
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Public methods
+/* ***************************************************************************************************************** */
+auto SpoolConverter::convert(const QString & spool, const QString & directory, Format format) -> Report
+{
+   Report        report;
+   QElapsedTimer timer;
+   timer.start();
+
+   QFile file(spool);
+   if (!file.open(QIODevice::ReadOnly)) {
+      report.error = tr("%1 could not be opened: %2").arg(spool, file.errorString());
+      return report;
+   }
+   QByteArray              block(static_cast<int>(SpoolBlockLength), '\0');
+   auto *                  blockData = reinterpret_cast<const quint8 *>(block.constData()); // NOLINT
+   SpoolWriter::FileHeader header;
+   if (file.read(block.data(), SpoolBlockLength) != SpoolBlockLength
+       || !SpoolWriter::FileHeader::decode(blockData, header)) {
+      report.error = tr("%1 is not a spool file.").arg(spool);
+      return report;
+   }
+   const auto records     = static_cast<int>((file.size() - SpoolBlockLength) / header.recordLength);
+   const auto pixelLength = header.recordLength - SpoolBlockLength;
+   auto       pool        = FramePool::create(pixelLength, PoolBuffers);
+   const auto prefix      = QFileInfo(spool).completeBaseName();
+
+   // The FITS writer reports from its own threads.
+   QMutex     errorMutex;
+   QString    error;
+   auto       fail = [&](const QString & reason) {
+      QMutexLocker locker(&errorMutex);
+      if (error.isEmpty()) {
+         error = reason;
+      }
+   };
+   std::unique_ptr<FitsWriter> fitsWriter;
+   SerWriter                   serWriter;
+   if (format == Fits) {
+      fitsWriter = std::make_unique<FitsWriter>(directory, prefix, FitsQueueLength, FitsWriterThreads);
+      fitsWriter->setInstrument(header.instrument);
+      QObject::connect(
+        fitsWriter.get(),
+        &FitsWriter::writeFailed,
+        [&](const QString & path, const QString & reason) { fail(tr("Writing %1 failed: %2").arg(path, reason)); });
+   } else {
+      QObject::connect(&serWriter, &SerWriter::writeFailed, [&](const QString & reason) { fail(reason); });
+      SerWriter::Header serHeader;
+      serHeader.instrument = header.instrument.camera;
+      if (!serWriter.open(directory, prefix, serHeader)) {
+         report.error = tr("The directory %1 could not be created.").arg(directory);
+         return report;
+      }
+   }
+
+   for (int index = 0; index < records; ++index) {
+      emit progress(index, records);
+      SpoolWriter::RecordHeader record;
+      if (!file.seek(SpoolBlockLength + index * header.recordLength)
+          || file.read(block.data(), SpoolBlockLength) != SpoolBlockLength
+          || !SpoolWriter::RecordHeader::decode(blockData, record) || record.length > pixelLength) {
+         continue;
+      }
+      // FitsWriter turns frames away rather than wait for the disk; here, waiting is the point.
+      while (fitsWriter && fitsWriter->statistics().queued >= FitsQueueLength) {
+         QThread::msleep(1);
+      }
+      auto frame = pool->acquire();
+      if (frame.isNull()) {
+         fail(tr("No memory for a frame of %1 bytes.").arg(pixelLength));
+         break;
+      }
+      if (file.read(reinterpret_cast<char *>(frame.data()), record.length) != record.length) { // NOLINT
+         continue;
+      }
+      frame.setGeometry(header.width, header.height, header.bitsPerPixel, header.channels);
+      frame.setBayerPattern(header.bayerPattern);
+      frame.setExposureDuration(record.exposureDuration);
+      frame.setSequence(record.sequence);
+      frame.setTimestamps(record.startTimestamp, record.readoutTimestamp);
+      if (fitsWriter) {
+         fitsWriter->write(frame);
+      } else {
+         serWriter.write(frame);
+      }
+      ++report.frames;
+      report.bytesRead += record.length;
+      report.skipped = index + 1 - report.frames;
+   }
+   emit progress(records, records);
+
+   // Destroying the FITS writer waits for what it has queued.
+   fitsWriter.reset();
+   serWriter.close();
+   report.error   = error;
+   report.elapsed = timer.elapsed();
+   return report;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include <QObject>
+#include <QString>
+
+/*! \brief Turns spool files, as SpoolWriter writes them, into FITS files or a SER video, once capture is over.
+ *
+ * Every record whose header is whole is converted, in order; records that were never written, as when the
+ * application crashed with writes in flight, are skipped and counted, and do not stop those after them.  A spool left
+ * at its full preallocated length by a crash is read up to its last record.
+ *
+ * Conversion is meant to run at idle priority, on a thread of its own or from the command line, so it never competes
+ * with capture.
+ */
+class SpoolConverter : public QObject
+{
+   Q_OBJECT
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+   Q_DISABLE_COPY_MOVE(SpoolConverter)
+#endif
+
+public:
+   enum Format
+   {
+      Fits, // a file per frame, through FitsWriter
+      Ser   // one video, through SerWriter
+   };
+
+   /*! \brief What a conversion did.
+    */
+   struct Report
+   {
+      QString error; // empty if the spool was converted
+      int     frames{ 0 };
+      int     skipped{ 0 };   // records lost before the last one found
+      qint64  bytesRead{ 0 }; // of pixel data
+      qint64  elapsed{ 0 };   // in milliseconds
+
+      [[nodiscard]] auto succeeded() const -> bool;
+   };
+
+   explicit SpoolConverter(QObject * parent = nullptr);
+   ~SpoolConverter() override = default;
+
+   /*!
+    * Converts a spool file; blocks until done.
+    *
+    * @param spool the spool file.
+    * @param directory where the FITS or SER files go; it is created if need be.
+    * @param format what to write.
+    */
+   auto convert(const QString & spool, const QString & directory, Format format) -> Report;
+
+signals:
+   void progress(int records, int of);
+};
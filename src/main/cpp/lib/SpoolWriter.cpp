@@ -0,0 +1,923 @@
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "SpoolWriter.hpp"
+
+#include "FrameRing.hpp"
+#include <algorithm>
+#include <cstring>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QThread>
+#include <QtEndian>
+
+#ifdef Q_OS_UNIX
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef Q_OS_LINUX
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+// liburing is not needed for the little used here; io_uring_setup, _enter and _register are called directly.  The
+// writes used, IORING_OP_WRITE and its fixed buffer variant, came with IORING_FEAT_RW_CUR_POS, in Linux 5.6.
+#if defined(__NR_io_uring_setup) && defined(IORING_FEAT_RW_CUR_POS)
+#define SPOOLWRITER_URING
+#endif
+#endif
+
+namespace
+{
+constexpr quint32 SpoolFormat         = 1; // raise when the layout of a spool file changes
+constexpr int     MagicLength         = 8;
+constexpr int     MaxStringLength     = 255; // bytes of UTF-8, in a header block
+constexpr char    FileMagic[]         = "QHYSPOOL"; // NOLINT(modernize-avoid-c-arrays)
+constexpr char    RecordMagic[]       = "QHYFRAME"; // NOLINT(modernize-avoid-c-arrays)
+constexpr int     HeaderBufferIndex   = 0;          // among the registered buffers; the pool's follow
+constexpr int     MaxRegisteredBuffers = 1 + LiveFrameRingCapacity + LiveFramePoolHeadroom;
+
+auto roundUp(qint64 value, qint64 multiple) -> qint64
+{
+   return (value + multiple - 1) / multiple * multiple;
+}
+
+/*! \brief Reads and writes the fields of a header block, in little endian order, ending with a checksum of them.
+ */
+class Fields
+{
+public:
+   explicit Fields(quint8 * block)
+      : m_block(block)
+   {
+   }
+
+   template <class T>
+   void put(T value)
+   {
+      qToLittleEndian(value, m_block + m_offset);
+      m_offset += sizeof(T);
+   }
+
+   template <class T>
+   auto get() -> T
+   {
+      const auto value = qFromLittleEndian<T>(m_block + m_offset);
+      m_offset += sizeof(T);
+      return value;
+   }
+
+   void putMagic(const char * magic)
+   {
+      std::memcpy(m_block + m_offset, magic, MagicLength);
+      m_offset += MagicLength;
+   }
+
+   void putString(const QString & value)
+   {
+      const auto bytes = value.toUtf8().left(MaxStringLength);
+      put(static_cast<quint16>(bytes.size()));
+      std::memcpy(m_block + m_offset, bytes.constData(), static_cast<size_t>(bytes.size()));
+      m_offset += static_cast<size_t>(bytes.size());
+   }
+
+   auto getString() -> QString
+   {
+      // Bounded, so a corrupt length cannot read past the block; the checksum catches it afterwards.
+      const auto length = qMin(static_cast<int>(get<quint16>()), MaxStringLength);
+      const auto value  = QString::fromUtf8(reinterpret_cast<const char *>(m_block + m_offset), length); // NOLINT
+      m_offset += static_cast<size_t>(length);
+      return value;
+   }
+
+   auto matchMagic(const char * magic) -> bool
+   {
+      const auto matches = std::memcmp(m_block + m_offset, magic, MagicLength) == 0;
+      m_offset += MagicLength;
+      return matches;
+   }
+
+   void putChecksum()
+   {
+      put(checksum());
+   }
+
+   auto matchChecksum() -> bool
+   {
+      const auto expected = checksum();
+      return get<quint16>() == expected;
+   }
+
+private:
+   [[nodiscard]] auto checksum() const -> quint16
+   {
+      return qChecksum(reinterpret_cast<const char *>(m_block), static_cast<uint>(m_offset)); // NOLINT
+   }
+
+   quint8 * m_block;
+   size_t   m_offset{ 0 };
+};
+
+auto doubleBits(double value) -> quint64
+{
+   quint64 bits{ 0 };
+   std::memcpy(&bits, &value, sizeof(bits));
+   return bits;
+}
+
+auto bitsDouble(quint64 bits) -> double
+{
+   double value{ 0.0 };
+   std::memcpy(&value, &bits, sizeof(value));
+   return value;
+}
+} // namespace
+
+/* ***************************************************************************************************************** */
+// MARK: - Ring
+/* ***************************************************************************************************************** */
+#ifdef SPOOLWRITER_URING
+/*! \brief Just enough of io_uring to queue writes, and to reap their completions, from one thread.
+ */
+class SpoolWriter::Ring
+{
+   Q_DISABLE_COPY(Ring)
+
+public:
+   /*!
+    * @return The ring, or nullptr if the kernel has no io_uring, one too old, or it is not allowed here.
+    */
+   static auto create(unsigned entries) -> std::unique_ptr<Ring>
+   {
+      io_uring_params parameters{};
+      const auto      descriptor = static_cast<int>(syscall(__NR_io_uring_setup, entries, &parameters));
+      if (descriptor < 0) {
+         qWarning() << "io_uring is not available:" << qt_error_string(errno) << "; spooling with pwrite.";
+         return nullptr;
+      }
+      std::unique_ptr<Ring> ring(new Ring(descriptor));
+      if ((parameters.features & IORING_FEAT_RW_CUR_POS) == 0) {
+         qWarning() << "io_uring is too old to write with; spooling with pwrite.";
+         return nullptr;
+      }
+      if (!ring->map(parameters)) {
+         qWarning() << "Could not map the io_uring queues:" << qt_error_string(errno) << "; spooling with pwrite.";
+         return nullptr;
+      }
+      return ring;
+   }
+
+   ~Ring()
+   {
+      if (m_sqes != nullptr) {
+         munmap(m_sqes, m_sqesLength);
+      }
+      if (m_cq != MAP_FAILED && m_cq != m_sq) {
+         munmap(m_cq, m_cqLength);
+      }
+      if (m_sq != MAP_FAILED) {
+         munmap(m_sq, m_sqLength);
+      }
+      ::close(m_descriptor); // what is in flight is finished by the kernel
+   }
+
+   /*!
+    * Replaces the registered buffers; none of them may be in use.
+    */
+   auto registerBuffers(const std::vector<std::pair<const quint8 *, qint64>> & buffers) -> bool
+   {
+      unregisterBuffers();
+      std::vector<iovec> vectors;
+      vectors.reserve(buffers.size());
+      for (const auto & [address, length] : buffers) {
+         vectors.push_back({ const_cast<quint8 *>(address), static_cast<size_t>(length) }); // NOLINT
+      }
+      return syscall(__NR_io_uring_register,
+                     m_descriptor,
+                     IORING_REGISTER_BUFFERS,
+                     vectors.data(),
+                     static_cast<unsigned>(vectors.size()))
+             == 0;
+   }
+
+   /*!
+    * Unpins the registered buffers, if any; none of them may be in use.
+    */
+   void unregisterBuffers()
+   {
+      syscall(__NR_io_uring_register, m_descriptor, IORING_UNREGISTER_BUFFERS, nullptr, 0); // fails if none are
+   }
+
+   /*!
+    * Queues a write, to be submitted by the next submit(); there must be space().
+    *
+    * @param bufferIndex the registered buffer holding the data, or -1.
+    * @param linked if the next write queued must wait for this one, and be cancelled should it fail.
+    */
+   void prepareWrite(int descriptor,
+                     const quint8 * data,
+                     qint64 length,
+                     qint64 offset,
+                     int bufferIndex,
+                     quint64 userData,
+                     bool linked)
+   {
+      const auto tail  = *m_sqTail; // only this thread moves the tail
+      const auto index = tail & m_sqMask;
+      auto &     entry = m_sqes[index]; // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+      entry            = io_uring_sqe{};
+      entry.opcode     = bufferIndex >= 0 ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+      entry.flags      = linked ? IOSQE_IO_LINK : 0;
+      entry.fd         = descriptor;
+      entry.off        = static_cast<quint64>(offset);
+      entry.addr       = reinterpret_cast<quint64>(data); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+      entry.len        = static_cast<quint32>(length);
+      entry.buf_index  = static_cast<quint16>(qMax(bufferIndex, 0));
+      entry.user_data  = userData;
+      m_sqArray[index] = index; // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+      __atomic_store_n(m_sqTail, tail + 1, __ATOMIC_RELEASE);
+      ++m_unsubmitted;
+   }
+
+   /*!
+    * The writes that can be queued before the kernel has taken those queued already.
+    */
+   [[nodiscard]] auto space() const -> unsigned
+   {
+      return m_sqEntries - (*m_sqTail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE));
+   }
+
+   /*!
+    * Hands the queued writes to the kernel.
+    *
+    * @param wait if it should also wait until at least one write has completed.
+    */
+   auto submit(bool wait) -> bool
+   {
+      long result{ 0 };
+      do {
+         result = syscall(__NR_io_uring_enter,
+                          m_descriptor,
+                          m_unsubmitted,
+                          wait ? 1U : 0U,
+                          wait ? IORING_ENTER_GETEVENTS : 0U,
+                          nullptr,
+                          0);
+      } while (result < 0 && errno == EINTR);
+      if (result < 0) {
+         return false;
+      }
+      m_unsubmitted -= static_cast<unsigned>(result);
+      return true;
+   }
+
+   /*!
+    * Calls handler(userData, result) for each completed write; result is the bytes written, or -errno.
+    */
+   template <class Handler>
+   void reap(Handler handler)
+   {
+      auto       head = *m_cqHead; // only this thread moves the head
+      const auto tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+      while (head != tail) {
+         const auto & entry = m_cqes[head & m_cqMask]; // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+         handler(entry.user_data, entry.res);
+         ++head;
+      }
+      __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+   }
+
+private:
+   explicit Ring(int descriptor)
+      : m_descriptor(descriptor)
+   {
+   }
+
+   auto map(const io_uring_params & parameters) -> bool
+   {
+      m_sqLength   = parameters.sq_off.array + parameters.sq_entries * sizeof(quint32);
+      m_cqLength   = parameters.cq_off.cqes + parameters.cq_entries * sizeof(io_uring_cqe);
+      m_sqesLength = parameters.sq_entries * sizeof(io_uring_sqe);
+      const auto single = (parameters.features & IORING_FEAT_SINGLE_MMAP) != 0;
+      if (single) {
+         m_sqLength = m_cqLength = std::max(m_sqLength, m_cqLength);
+      }
+      const auto protection = PROT_READ | PROT_WRITE;
+      const auto flags      = MAP_SHARED | MAP_POPULATE;
+      m_sq                  = mmap(nullptr, m_sqLength, protection, flags, m_descriptor, IORING_OFF_SQ_RING);
+      if (m_sq == MAP_FAILED) {
+         return false;
+      }
+      m_cq = single ? m_sq : mmap(nullptr, m_cqLength, protection, flags, m_descriptor, IORING_OFF_CQ_RING);
+      if (m_cq == MAP_FAILED) {
+         return false;
+      }
+      auto * entries = mmap(nullptr, m_sqesLength, protection, flags, m_descriptor, IORING_OFF_SQES);
+      if (entries == MAP_FAILED) {
+         return false;
+      }
+      m_sqes = static_cast<io_uring_sqe *>(entries);
+
+      auto field = [](void * ring, quint32 offset) {
+         return reinterpret_cast<unsigned *>(static_cast<quint8 *>(ring) + offset); // NOLINT
+      };
+      m_sqHead    = field(m_sq, parameters.sq_off.head);
+      m_sqTail    = field(m_sq, parameters.sq_off.tail);
+      m_sqMask    = *field(m_sq, parameters.sq_off.ring_mask);
+      m_sqArray   = field(m_sq, parameters.sq_off.array);
+      m_sqEntries = parameters.sq_entries;
+      m_cqHead    = field(m_cq, parameters.cq_off.head);
+      m_cqTail    = field(m_cq, parameters.cq_off.tail);
+      m_cqMask    = *field(m_cq, parameters.cq_off.ring_mask);
+      m_cqes      = reinterpret_cast<io_uring_cqe *>(field(m_cq, parameters.cq_off.cqes)); // NOLINT
+      return true;
+   }
+
+   int            m_descriptor;
+   void *         m_sq{ MAP_FAILED };
+   void *         m_cq{ MAP_FAILED };
+   io_uring_sqe * m_sqes{ nullptr };
+   size_t         m_sqLength{ 0 };
+   size_t         m_cqLength{ 0 };
+   size_t         m_sqesLength{ 0 };
+   unsigned *     m_sqHead{ nullptr };
+   unsigned *     m_sqTail{ nullptr };
+   unsigned *     m_sqArray{ nullptr };
+   unsigned       m_sqMask{ 0 };
+   unsigned       m_sqEntries{ 0 };
+   unsigned       m_unsubmitted{ 0 };
+   unsigned *     m_cqHead{ nullptr };
+   unsigned *     m_cqTail{ nullptr };
+   unsigned       m_cqMask{ 0 };
+   io_uring_cqe * m_cqes{ nullptr };
+};
+#else
+class SpoolWriter::Ring
+{
+};
+#endif
+
+/* ***************************************************************************************************************** */
+// MARK: - FileHeader & RecordHeader
+/* ***************************************************************************************************************** */
+auto SpoolWriter::FileHeader::decode(const quint8 * block, FileHeader & header) -> bool
+{
+   Fields fields(const_cast<quint8 *>(block)); // NOLINT(cppcoreguidelines-pro-type-const-cast); only read
+   if (!fields.matchMagic(FileMagic) || fields.get<quint32>() != SpoolFormat) {
+      return false;
+   }
+   header.width           = fields.get<quint32>();
+   header.height          = fields.get<quint32>();
+   header.bitsPerPixel    = fields.get<quint32>();
+   header.channels        = fields.get<quint32>();
+   header.bayerPattern    = static_cast<Frame::BayerPattern>(fields.get<quint32>());
+   header.recordLength    = fields.get<qint64>();
+   auto & instrument      = header.instrument;
+   instrument.camera      = fields.getString();
+   instrument.firmware    = fields.getString();
+   instrument.readMode    = fields.getString();
+   instrument.pixelWidth  = bitsDouble(fields.get<quint64>());
+   instrument.pixelHeight = bitsDouble(fields.get<quint64>());
+   instrument.gain        = bitsDouble(fields.get<quint64>());
+   instrument.offset      = bitsDouble(fields.get<quint64>());
+   instrument.binning     = static_cast<int>(fields.get<quint32>());
+   return fields.matchChecksum() && header.width > 0 && header.height > 0 && header.recordLength > SpoolBlockLength;
+}
+
+void SpoolWriter::FileHeader::encode(quint8 * block) const
+{
+   std::memset(block, 0, static_cast<size_t>(SpoolBlockLength));
+   Fields fields(block);
+   fields.putMagic(FileMagic);
+   fields.put(SpoolFormat);
+   fields.put(width);
+   fields.put(height);
+   fields.put(bitsPerPixel);
+   fields.put(channels);
+   fields.put(static_cast<quint32>(bayerPattern));
+   fields.put(recordLength);
+   fields.putString(instrument.camera);
+   fields.putString(instrument.firmware);
+   fields.putString(instrument.readMode);
+   fields.put(doubleBits(instrument.pixelWidth));
+   fields.put(doubleBits(instrument.pixelHeight));
+   fields.put(doubleBits(instrument.gain));
+   fields.put(doubleBits(instrument.offset));
+   fields.put(static_cast<quint32>(instrument.binning));
+   fields.putChecksum();
+}
+
+auto SpoolWriter::RecordHeader::decode(const quint8 * block, RecordHeader & header) -> bool
+{
+   Fields fields(const_cast<quint8 *>(block)); // NOLINT(cppcoreguidelines-pro-type-const-cast); only read
+   if (!fields.matchMagic(RecordMagic)) {
+      return false;
+   }
+   header.sequence         = fields.get<quint64>();
+   header.startTimestamp   = fields.get<qint64>();
+   header.readoutTimestamp = fields.get<qint64>();
+   header.exposureDuration = bitsDouble(fields.get<quint64>());
+   header.length           = fields.get<qint64>();
+   return fields.matchChecksum() && header.length > 0;
+}
+
+void SpoolWriter::RecordHeader::encode(quint8 * block) const
+{
+   std::memset(block, 0, static_cast<size_t>(SpoolBlockLength));
+   Fields fields(block);
+   fields.putMagic(RecordMagic);
+   fields.put(sequence);
+   fields.put(startTimestamp);
+   fields.put(readoutTimestamp);
+   fields.put(doubleBits(exposureDuration));
+   fields.put(length);
+   fields.putChecksum();
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - ctors & dtors
+/* ***************************************************************************************************************** */
+SpoolWriter::SpoolWriter(QObject * parent)
+   : QObject(parent)
+   , m_spooling(false)
+   , m_stopRequested(false)
+   , m_fileIndex(0)
+   , m_descriptor(-1)
+   , m_fileLength(0)
+   , m_records(0)
+   , m_failed(false)
+   , m_headerBlocks(static_cast<quint8 *>(
+       qMallocAligned(static_cast<size_t>(SpoolBlockLength * SpoolQueueDepth), static_cast<size_t>(SpoolBlockLength))))
+   , m_registering(true)
+   , m_registeredGeneration(0)
+   , m_frames(0)
+   , m_missed(0)
+   , m_bytes(0)
+   , m_bytesAtLastReport(0)
+{
+}
+
+SpoolWriter::~SpoolWriter()
+{
+   close();
+   m_ring.reset();
+   qFreeAligned(m_headerBlocks);
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Public methods
+/* ***************************************************************************************************************** */
+auto SpoolWriter::isAsynchronous() const -> bool
+{
+   return m_ring != nullptr;
+}
+
+auto SpoolWriter::isSpooling() const -> bool
+{
+   return m_spooling;
+}
+
+auto SpoolWriter::open(const QString & directory, const QString & prefix, const FitsWriter::Instrument & instrument)
+  -> bool
+{
+   if (m_spooling) {
+      return false;
+   }
+#ifdef Q_OS_UNIX
+   if (m_headerBlocks == nullptr) {
+      emit writeFailed(tr("Could not allocate the spool's buffers."));
+      return false;
+   }
+   if (!QDir().mkpath(directory)) {
+      emit writeFailed(tr("The directory %1 could not be created.").arg(directory));
+      return false;
+   }
+#ifdef SPOOLWRITER_URING
+   if (!m_ring) {
+      // Each frame takes two entries, its pixels and then its header.
+      m_ring = Ring::create(2 * SpoolQueueDepth);
+   }
+#endif
+   m_directory         = directory;
+   m_prefix            = prefix;
+   m_header.instrument = instrument;
+   m_started           = QDateTime::currentDateTimeUtc().toString(QString("yyyyMMdd-HHmmss"));
+   m_fileIndex         = 0;
+   m_failed            = false;
+   m_registering       = true;
+   m_frames            = 0;
+   m_missed            = 0;
+   m_bytes             = 0;
+   m_bytesAtLastReport = 0;
+   m_statisticsTimer.start();
+   m_spooling = true;
+   emit spoolingChanged(true);
+   return true;
+#else
+   Q_UNUSED(directory)
+   Q_UNUSED(prefix)
+   Q_UNUSED(instrument)
+   emit writeFailed(tr("Spooling is not supported on this platform."));
+   return false;
+#endif
+}
+
+void SpoolWriter::stop()
+{
+   m_stopRequested = true;
+}
+
+auto SpoolWriter::write(const Frame & frame) -> bool
+{
+   if (!m_spooling || frame.isNull() || frame.isFloat()) {
+      return false;
+   }
+   const auto recordLength = SpoolBlockLength + roundUp(frame.length(), SpoolBlockLength);
+   if (m_descriptor >= 0
+       && (frame.width() != m_header.width || frame.height() != m_header.height
+           || frame.bitsPerPixel() != m_header.bitsPerPixel || frame.channels() != m_header.channels
+           || frame.bayerPattern() != m_header.bayerPattern || m_fileLength + recordLength > SpoolFileLimit)) {
+      closeFile();
+   }
+   if (m_descriptor < 0 && !openFile(frame)) {
+      return false;
+   }
+
+   const auto index = freeSlot();
+   auto &     slot  = m_slots.at(static_cast<size_t>(index));
+   slot.frame       = frame;
+   slot.offset      = m_fileLength;
+   m_fileLength += recordLength;
+   ++m_records;
+
+   RecordHeader header;
+   header.sequence         = frame.sequence();
+   header.startTimestamp   = frame.startTimestamp();
+   header.readoutTimestamp = frame.readoutTimestamp();
+   header.exposureDuration = frame.exposureDuration();
+   header.length           = frame.length();
+   header.encode(m_headerBlocks + index * SpoolBlockLength); // NOLINT(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+
+   const auto queued = m_ring ? queue(index) : writeSynchronously(index);
+   if (m_statisticsTimer.elapsed() >= LiveStatisticsInterval) {
+      reportStatistics();
+   }
+   return queued;
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Public slots
+/* ***************************************************************************************************************** */
+auto SpoolWriter::close() -> bool
+{
+   // Queued behind record(), which a stop() has ended; a stop() before the spool opened is forgotten too.
+   m_stopRequested = false;
+   if (!m_spooling) {
+      return true;
+   }
+   const auto finished = (m_descriptor < 0 || closeFile()) && !m_failed;
+   reportStatistics();
+   m_spooling = false;
+   emit spoolingChanged(false);
+   return finished;
+}
+
+void SpoolWriter::record(std::shared_ptr<FrameRing> frames)
+{
+   if (!frames || !m_spooling) {
+      return;
+   }
+   // Only frames from now on.
+   quint64 lastSequence{ 0 };
+   {
+      auto lease   = frames->latest();
+      lastSequence = lease.isValid() ? lease.frame().sequence() : 0;
+   }
+   while (!m_stopRequested && m_spooling) {
+      auto lease = frames->next(lastSequence);
+      if (!lease.isValid()) {
+         // Completions are picked up while waiting, so the buffers go back to the pool promptly.
+         reap(false);
+         QThread::usleep(LiveFramePollInterval);
+         continue;
+      }
+      const auto & frame = lease.frame();
+      if (lastSequence != 0 && frame.sequence() > lastSequence + 1) {
+         m_missed += frame.sequence() - lastSequence - 1;
+      }
+      lastSequence = frame.sequence();
+      // The spool holds its own handle to the frame until the write completes; the lease can go at once.
+      write(frame);
+   }
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Private methods
+/* ***************************************************************************************************************** */
+void SpoolWriter::abandonRing(int error)
+{
+#ifdef SPOOLWRITER_URING
+   qWarning() << "io_uring failed:" << qt_error_string(error) << "; spooling the rest with pwrite.";
+   // Closing the ring has the kernel cancel what it has not started; the writes in flight are counted as failed.
+   m_ring.reset();
+   m_registered.clear();
+   m_registeredBuffers.clear();
+   m_registeredGeneration = 0;
+   for (auto & slot : m_slots) {
+      if (slot.pending > 0) {
+         complete(slot, slot.error != 0 ? slot.error : error);
+      }
+   }
+#else
+   Q_UNUSED(error)
+#endif
+}
+
+auto SpoolWriter::closeFile() -> bool
+{
+   auto finished = true;
+#ifdef Q_OS_UNIX
+   // Waits for the writes in flight; the buffers are unpinned too, rather than left pinned while no spool is open.
+   unregisterBuffers();
+   // The file was allocated in full when created; what follows the last record is given back.
+   if (ftruncate(m_descriptor, m_fileLength) != 0) {
+      qWarning() << "Could not trim" << m_path << ":" << qt_error_string(errno);
+   }
+   finished = ::close(m_descriptor) == 0;
+   if (!finished) {
+      emit writeFailed(tr("Finishing %1 failed: %2").arg(m_path, qt_error_string(errno)));
+   }
+#endif
+   m_descriptor = -1;
+   if (finished) {
+      emit fileWritten(m_path, m_records);
+   }
+   return finished;
+}
+
+void SpoolWriter::complete(Slot & slot, int error)
+{
+   if (error == 0) {
+      ++m_frames;
+      m_bytes += static_cast<quint64>(slot.frame.length());
+   } else {
+      // Without its header, the record is skipped when the spool is converted; the records after it are not.
+      m_failed = true;
+      emit writeFailed(tr("Spooling frame %1 failed: %2").arg(slot.frame.sequence()).arg(qt_error_string(error)));
+   }
+   slot.frame   = Frame(); // the buffer goes back to its pool
+   slot.pending = 0;
+   slot.error   = 0;
+}
+
+void SpoolWriter::drain()
+{
+   // Ends even should io_uring fail, as every write in flight is then given up on.
+   while (std::any_of(m_slots.cbegin(), m_slots.cend(), [](const Slot & slot) { return slot.pending > 0; })) {
+      if (!reap(true)) {
+         break;
+      }
+   }
+}
+
+auto SpoolWriter::freeSlot() -> int
+{
+   for (;;) {
+      const auto found = std::find_if(
+        m_slots.cbegin(), m_slots.cend(), [](const Slot & slot) { return slot.pending == 0 && slot.frame.isNull(); });
+      if (found != m_slots.cend()) {
+         return static_cast<int>(std::distance(m_slots.cbegin(), found));
+      }
+      // Every slot is in flight; the disk sets the pace.  Should io_uring fail, the slots are freed by giving up.
+      reap(true);
+   }
+}
+
+auto SpoolWriter::openFile(const Frame & first) -> bool
+{
+#ifdef Q_OS_UNIX
+   const auto name = QString("%1_%2_%3.spool").arg(m_prefix, m_started).arg(++m_fileIndex, 3, 10, QChar('0'));
+   m_path          = QDir(m_directory).filePath(name);
+   const auto path = QFile::encodeName(m_path);
+   const auto mode = O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC;
+#ifdef O_DIRECT
+   m_descriptor = ::open(path.constData(), mode | O_DIRECT, 0644); // NOLINT(cppcoreguidelines-pro-type-vararg)
+   if (m_descriptor < 0 && errno == EINVAL) {
+      // tmpfs, among others, has no direct I/O.
+      qWarning() << "No direct I/O for" << m_path << "; writing through the page cache.";
+      m_descriptor = ::open(path.constData(), mode, 0644); // NOLINT(cppcoreguidelines-pro-type-vararg)
+   }
+#else
+   m_descriptor = ::open(path.constData(), mode, 0644); // NOLINT(cppcoreguidelines-pro-type-vararg)
+#endif
+   if (m_descriptor < 0) {
+      emit writeFailed(tr("%1 could not be created: %2").arg(m_path, qt_error_string(errno)));
+      return false;
+   }
+#ifdef Q_OS_LINUX
+   // Allocated, not just reserved: writes inside the file's length do not have to extend it, which direct I/O makes
+   // all but synchronous on some file systems.
+   if (fallocate(m_descriptor, 0, 0, SpoolFileLimit) != 0) {
+      qWarning() << "Could not allocate space for" << m_path << "; writing without.";
+   }
+#endif
+
+   m_header.width        = first.width();
+   m_header.height       = first.height();
+   m_header.bitsPerPixel = first.bitsPerPixel();
+   m_header.channels     = first.channels();
+   m_header.bayerPattern = first.bayerPattern();
+   m_header.recordLength = SpoolBlockLength + roundUp(first.length(), SpoolBlockLength);
+
+   // Every slot is idle between files, so the first header block is free to write from.  The geometry is synced, as
+   // the records cannot be read without it.
+   m_header.encode(m_headerBlocks);
+   if (pwrite(m_descriptor, m_headerBlocks, SpoolBlockLength, 0) != SpoolBlockLength
+       || fdatasync(m_descriptor) != 0) {
+      emit writeFailed(tr("Writing %1 failed: %2").arg(m_path, qt_error_string(errno)));
+      ::close(m_descriptor);
+      m_descriptor = -1;
+      return false;
+   }
+   m_fileLength = SpoolBlockLength;
+   m_records    = 0;
+   return true;
+#else
+   Q_UNUSED(first)
+   return false;
+#endif
+}
+
+auto SpoolWriter::queue(int index) -> bool
+{
+#ifdef SPOOLWRITER_URING
+   auto &         slot        = m_slots.at(static_cast<size_t>(index));
+   const auto     bufferIndex = registerBuffer(slot.frame);
+   const auto     headerIndex = m_registeredBuffers.isEmpty() ? -1 : HeaderBufferIndex;
+   const quint8 * header      = m_headerBlocks + index * SpoolBlockLength; // NOLINT
+   const auto     userData    = static_cast<quint64>(index) * 2;
+   // Only short of space when an earlier submit failed, and left its writes queued.
+   while (m_ring && m_ring->space() < 2) {
+      reap(true);
+   }
+   if (!m_ring) {
+      // Given up on while waiting, for the space or to register the buffer.
+      return writeSynchronously(index);
+   }
+   // The header is linked behind the pixels: it is only written once they are, and not at all should they fail.
+   m_ring->prepareWrite(m_descriptor,
+                        slot.frame.constData(),
+                        roundUp(slot.frame.length(), SpoolBlockLength),
+                        slot.offset + SpoolBlockLength,
+                        bufferIndex,
+                        userData,
+                        true);
+   m_ring->prepareWrite(m_descriptor, header, SpoolBlockLength, slot.offset, headerIndex, userData + 1, false);
+   slot.pending = 2;
+   // EAGAIN and EBUSY only mean the kernel is short of resources, or of room for completions, for now.
+   while (!m_ring->submit(false)) {
+      if (errno != EAGAIN && errno != EBUSY) {
+         // The writes stay queued for the next submit, and the slot holds on to the frame until they complete.
+         emit writeFailed(tr("Queueing a write to %1 failed: %2").arg(m_path, qt_error_string(errno)));
+         return false;
+      }
+      reap(false);
+      QThread::usleep(LiveFramePollInterval);
+   }
+   return true;
+#else
+   Q_UNUSED(index)
+   return false;
+#endif
+}
+
+auto SpoolWriter::registerBuffer(const Frame & frame) -> int
+{
+#ifdef SPOOLWRITER_URING
+   if (!m_registering) {
+      return -1;
+   }
+   // A pool's buffers stay mapped for as long as the pool, but a new pool may be given the addresses of an old one's.
+   // A fixed write to such an address would read the old pages, still pinned; so a pool's registrations only stand
+   // for as long as its frames are the ones written.
+   if (frame.poolGeneration() != m_registeredGeneration) {
+      unregisterBuffers();
+      m_registeredGeneration = frame.poolGeneration();
+   }
+   const auto found = m_registeredBuffers.constFind(frame.constData());
+   if (found != m_registeredBuffers.cend()) {
+      return found.value();
+   }
+   if (static_cast<int>(m_registered.size()) >= MaxRegisteredBuffers) {
+      return -1;
+   }
+   // A pool's buffers are all met within the first few frames; each is registered when first met.  Registering
+   // replaces the whole table, which must not be in use meanwhile.
+   drain();
+   if (!m_ring) {
+      return -1;
+   }
+   if (m_registered.empty()) {
+      m_registered.emplace_back(m_headerBlocks, SpoolBlockLength * SpoolQueueDepth);
+   }
+   // Pool buffers are page aligned and mapped in whole pages, so the padding written past the pixels is mapped too.
+   m_registered.emplace_back(frame.constData(), roundUp(frame.capacity(), SpoolBlockLength));
+   if (!m_ring->registerBuffers(m_registered)) {
+      // Usually RLIMIT_MEMLOCK; the writes still work, the kernel pins the pages per write instead.
+      qWarning() << "Could not register the frame buffers with io_uring:" << qt_error_string(errno);
+      m_registering = false;
+      m_registered.clear();
+      m_registeredBuffers.clear();
+      m_registeredGeneration = 0;
+      return -1;
+   }
+   const auto index = static_cast<int>(m_registered.size()) - 1;
+   m_registeredBuffers.insert(frame.constData(), index);
+   return index;
+#else
+   Q_UNUSED(frame)
+   return -1;
+#endif
+}
+
+auto SpoolWriter::reap(bool wait) -> bool
+{
+#ifdef SPOOLWRITER_URING
+   if (!m_ring) {
+      return true;
+   }
+   if (wait && !m_ring->submit(true)) {
+      const auto error = errno;
+      if (error != EAGAIN && error != EBUSY) {
+         // Waiting again would fail again; without giving up on the ring, close() would never return.
+         abandonRing(error);
+         return false;
+      }
+      // Short of resources, or of room for completions; those already in are reaped below, which makes room.
+      QThread::usleep(LiveFramePollInterval);
+   }
+   m_ring->reap([this](quint64 userData, int result) {
+      auto &     slot     = m_slots.at(static_cast<size_t>(userData / 2));
+      const auto isHeader = userData % 2 == 1;
+      const auto expected = isHeader ? SpoolBlockLength : roundUp(slot.frame.length(), SpoolBlockLength);
+      if (result != expected && slot.error == 0) {
+         // A short write is out of space in all but name.
+         slot.error = result < 0 ? -result : ENOSPC;
+      }
+      if (--slot.pending == 0) {
+         complete(slot, slot.error);
+      }
+   });
+   return true;
+#else
+   Q_UNUSED(wait)
+   return true;
+#endif
+}
+
+void SpoolWriter::reportStatistics()
+{
+   const auto elapsed = static_cast<double>(m_statisticsTimer.restart()) / MillisecondsPerSecond;
+   const auto rate    = elapsed > 0.0 ? static_cast<double>(m_bytes - m_bytesAtLastReport) / BytesPerMegabyte / elapsed
+                                      : 0.0;
+   m_bytesAtLastReport = m_bytes;
+   emit statisticsChanged(m_frames, m_missed, rate);
+}
+
+void SpoolWriter::unregisterBuffers()
+{
+#ifdef SPOOLWRITER_URING
+   drain();
+   if (!m_registered.empty() && m_ring) {
+      m_ring->unregisterBuffers();
+   }
+   m_registered.clear();
+   m_registeredBuffers.clear();
+#endif
+   m_registeredGeneration = 0;
+}
+
+auto SpoolWriter::writeSynchronously(int index) -> bool
+{
+#ifdef Q_OS_UNIX
+   auto &         slot   = m_slots.at(static_cast<size_t>(index));
+   const quint8 * header = m_headerBlocks + index * SpoolBlockLength; // NOLINT
+   const auto     length = roundUp(slot.frame.length(), SpoolBlockLength);
+   // As with io_uring, the header only once the pixels are written; a short write is out of space in all but name.
+   errno              = ENOSPC;
+   const auto written = pwrite(m_descriptor, slot.frame.constData(), length, slot.offset + SpoolBlockLength) == length
+                        && pwrite(m_descriptor, header, SpoolBlockLength, slot.offset) == SpoolBlockLength;
+   complete(slot, written ? 0 : errno);
+   return written;
+#else
+   Q_UNUSED(index)
+   return false;
+#endif
+}
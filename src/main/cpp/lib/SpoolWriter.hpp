@@ -0,0 +1,207 @@
+#pragma once
+
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "Config.h"
+#include "FitsWriter.hpp"
+#include "Frame.hpp"
+#include <array>
+#include <atomic>
+#include <memory>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QObject>
+#include <QString>
+#include <utility>
+#include <vector>
+
+class FrameRing;
+
+/*! \brief Spools live view frames, raw, to disk at the least cost per frame; SpoolConverter makes FITS or SER of them.
+ *
+ * A spool file starts with a block describing the camera and the frames' geometry, followed by fixed size records:
+ * a SpoolBlockLength header block, then the pixels, padded to a whole block.  Every record is block aligned, so the
+ * pixels go from their pool buffer to the disk with direct I/O, bypassing the page cache; nothing is copied, and the
+ * cache is not churned by data that will not be read again for hours.  A file's space is allocated when it is
+ * created, SpoolFileLimit at a time, so writes never wait on block allocation.
+ *
+ * On Linux, the writes are queued to io_uring, up to SpoolQueueDepth frames deep, from pool buffers registered with
+ * the kernel while their pool is the one written from, and until the file is finished; the writing thread only waits
+ * when the queue is full.  Where io_uring is not available, is too old, or fails, records are written with pwrite.
+ *
+ * A record's header is only written once its pixels are, so a header on disk vouches for its record; and as records
+ * are fixed size, a lost one does not hide those after it.  Should the application crash, every frame whose write
+ * completed is in the spool, as the page cache is not involved; the kernel also finishes the writes already under way.
+ *
+ * A file holds frames of one geometry; once it is full, or the geometry changes, the next is started.
+ */
+class SpoolWriter : public QObject
+{
+   Q_OBJECT
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+   Q_DISABLE_COPY_MOVE(SpoolWriter)
+#endif
+
+public:
+   /*! \brief The first block of a spool file.
+    */
+   struct FileHeader
+   {
+      quint32                width{ 0 };
+      quint32                height{ 0 };
+      quint32                bitsPerPixel{ 0 };
+      quint32                channels{ 0 };
+      Frame::BayerPattern    bayerPattern{ Frame::Monochrome };
+      qint64                 recordLength{ 0 }; // header and padded pixels
+      FitsWriter::Instrument instrument;        // for the headers of the converted files
+
+      /*!
+       * @return False if the block is not a spool file's header.
+       */
+      [[nodiscard]] static auto decode(const quint8 * block, FileHeader & header) -> bool;
+      void                      encode(quint8 * block) const;
+   };
+
+   /*! \brief The first block of each record.
+    */
+   struct RecordHeader
+   {
+      quint64 sequence{ 0 };
+      qint64  startTimestamp{ 0 };
+      qint64  readoutTimestamp{ 0 };
+      double  exposureDuration{ 0.0 };
+      qint64  length{ 0 }; // of the pixels, unpadded
+
+      /*!
+       * @return False if the block is not a whole record header; a record never written reads as zeros.
+       */
+      [[nodiscard]] static auto decode(const quint8 * block, RecordHeader & header) -> bool;
+      void                      encode(quint8 * block) const;
+   };
+
+   explicit SpoolWriter(QObject * parent = nullptr);
+
+   /*!
+    * Finishes the file being written, if any.
+    */
+   ~SpoolWriter() override;
+
+   /*!
+    * If the writes go through io_uring; only known once the first file is open.
+    */
+   [[nodiscard]] auto isAsynchronous() const -> bool;
+
+   /*!
+    * Safe to call from any thread.
+    */
+   [[nodiscard]] auto isSpooling() const -> bool;
+
+   /*!
+    * Starts a spool; the first file is created by the first frame written.
+    *
+    * @param directory where the files go; it is created if need be.
+    * @param prefix the start of every file name, such as the camera's id.
+    * @param instrument the camera, as its files describe it once converted.
+    * @return False if a spool is already open, or the directory cannot be created.
+    */
+   auto open(const QString & directory, const QString & prefix, const FitsWriter::Instrument & instrument) -> bool;
+
+   /*!
+    * Requests that record() return; it stays requested until close().  Safe to call from any thread.
+    */
+   void               stop();
+
+   /*!
+    * Queues a frame to be written; the frame, and so its buffer, is held until its write completes.
+    *
+    * @return False if nothing is open, the frame is a float frame, or the write could not be queued.
+    */
+   auto               write(const Frame & frame) -> bool;
+
+public slots:
+   /*!
+    * Waits for the queued writes, finishes the file being written, and ends the spool.
+    *
+    * @return False if a write failed since the last close, or the last file could not be finished.
+    */
+   auto close() -> bool;
+
+   /*!
+    * Spools every frame published to a ring, until stop() is called; the spool stays open.
+    */
+   void record(std::shared_ptr<FrameRing> frames);
+
+signals:
+   /*!
+    * Emitted when a file has been finished.
+    */
+   void fileWritten(QString path, int frames);
+   void spoolingChanged(bool spooling);
+
+   /*!
+    * Emitted every LiveStatisticsInterval while frames are written.
+    *
+    * @param frames the frames written since the spool was opened.
+    * @param missed the frames overwritten in the ring before they could be queued.
+    * @param megabytesPerSecond over the last LiveStatisticsInterval.
+    */
+   void statisticsChanged(quint64 frames, quint64 missed, double megabytesPerSecond);
+   void writeFailed(QString reason);
+
+private:
+   struct Slot
+   {
+      Frame  frame;
+      qint64 offset{ 0 };
+      int    pending{ 0 }; // writes not yet completed; the pixels, then the header
+      int    error{ 0 };   // of the first of them to fail
+   };
+   class Ring;
+
+   void                                           abandonRing(int error);
+   auto                                           closeFile() -> bool;
+   void                                           complete(Slot & slot, int error);
+   void                                           drain();
+   auto                                           freeSlot() -> int;
+   auto                                           openFile(const Frame & first) -> bool;
+   auto                                           queue(int slot) -> bool;
+   auto                                           registerBuffer(const Frame & frame) -> int;
+   /*!
+    * @return False if waiting failed, and the ring was given up on.
+    */
+   auto                                           reap(bool wait) -> bool;
+   void                                           reportStatistics();
+   void                                           unregisterBuffers();
+   auto                                           writeSynchronously(int slot) -> bool;
+
+   std::atomic_bool                               m_spooling;
+   std::atomic_bool                               m_stopRequested;
+   QString                                        m_directory;
+   QString                                        m_prefix;
+   QString                                        m_started; // the time the spool was opened, for the file names
+   QString                                        m_path;    // of the file being written
+   int                                            m_fileIndex;
+   int                                            m_descriptor;
+   FileHeader                                     m_header;
+   qint64                                         m_fileLength; // up to the end of the last record queued
+   int                                            m_records;
+   bool                                           m_failed;
+
+   std::unique_ptr<Ring>                          m_ring; // null when writing synchronously
+   std::array<Slot, SpoolQueueDepth>              m_slots;
+   quint8 *                                       m_headerBlocks; // a block per slot, aligned for direct I/O
+   std::vector<std::pair<const quint8 *, qint64>> m_registered; // the header blocks, then pool buffers
+   QHash<const quint8 *, int>                     m_registeredBuffers; // pool buffer to its index in m_registered
+   bool                                           m_registering; // until it fails, for want of locked memory
+   quint64                                        m_registeredGeneration; // of the pool whose buffers are registered
+
+   quint64                                        m_frames;
+   quint64                                        m_missed;
+   quint64                                        m_bytes;
+   quint64                                        m_bytesAtLastReport;
+   QElapsedTimer                                  m_statisticsTimer;
+};
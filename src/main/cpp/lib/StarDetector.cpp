@@ -0,0 +1,527 @@
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "StarDetector.hpp"
+
+#include "Config.h"
+#include "ParallelRows.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <numeric>
+#include <QMetaObject>
+#include <vector>
+
+namespace
+{
+/*! \brief The image stars are searched in; the frame, or the frame summed over cells or channels.
+ */
+struct Luminance
+{
+   const quint8 * pixels{ nullptr };
+   int            frameWidth{ 0 };
+   int            channels{ 1 };
+   int            scale{ 1 }; // frame pixels per luminance pixel, along each axis
+   int            width{ 0 };
+   int            height{ 0 };
+   bool           wide{ false }; // 16 bit samples
+
+   template <class T>
+   [[nodiscard]] auto at(int x, int y) const -> float
+   {
+      const auto * samples = reinterpret_cast<const T *>(pixels); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+      if (scale == 2) {
+         const auto * cell = samples + static_cast<qint64>(2 * y) * frameWidth + 2 * x;
+         return static_cast<float>(cell[0] + cell[1] + cell[frameWidth] + cell[frameWidth + 1]);
+      }
+      if (channels == 3) {
+         const auto * pixel = samples + (static_cast<qint64>(y) * frameWidth + x) * 3;
+         return static_cast<float>(pixel[0] + pixel[1] + pixel[2]);
+      }
+      return static_cast<float>(samples[static_cast<qint64>(y) * frameWidth + x]);
+   }
+
+   [[nodiscard]] auto value(int x, int y) const -> float
+   {
+      return wide ? at<quint16>(x, y) : at<quint8>(x, y);
+   }
+};
+
+/*! \brief The running sums of one connected component.
+ */
+struct Blob
+{
+   double flux{ 0.0 };
+   double sumX{ 0.0 };
+   double sumY{ 0.0 };
+   float  peak{ 0.0F };
+   int    area{ 0 };
+
+   void add(const Blob & other)
+   {
+      flux += other.flux;
+      sumX += other.sumX;
+      sumY += other.sumY;
+      peak = std::max(peak, other.peak);
+      area += other.area;
+   }
+};
+
+/*! \brief What one tile found; blob indices are local to the tile until the seams are joined.
+ */
+struct Tile
+{
+   QRect             area;
+   float             background{ 0.0F };
+   float             noise{ 0.0F };
+   std::vector<Blob> blobs;
+   std::vector<int>  top; // the blob under each pixel of the edge, or -1
+   std::vector<int>  bottom;
+   std::vector<int>  left;
+   std::vector<int>  right;
+};
+
+auto findRoot(std::vector<int> & parents, int index) -> int
+{
+   while (parents[static_cast<size_t>(index)] != index) {
+      auto & parent = parents[static_cast<size_t>(index)];
+      parent        = parents[static_cast<size_t>(parent)]; // halve the path on the way up
+      index         = parent;
+   }
+   return index;
+}
+
+void unite(std::vector<int> & parents, int first, int second)
+{
+   first  = findRoot(parents, first);
+   second = findRoot(parents, second);
+   if (first != second) {
+      parents[static_cast<size_t>(std::max(first, second))] = std::min(first, second);
+   }
+}
+
+auto median(std::vector<float> & values) -> float
+{
+   const auto middle = values.begin() + static_cast<std::ptrdiff_t>(values.size() / 2);
+   std::nth_element(values.begin(), middle, values.end());
+   return *middle;
+}
+
+void searchTile(const Luminance & luminance, Tile & tile)
+{
+   const auto width  = tile.area.width();
+   const auto height = tile.area.height();
+   const auto pixels = static_cast<size_t>(width) * static_cast<size_t>(height);
+
+   std::vector<float> values(pixels);
+   for (int y = 0; y < height; ++y) {
+      auto * row = values.data() + static_cast<size_t>(y) * static_cast<size_t>(width);
+      for (int x = 0; x < width; ++x) {
+         row[x] = luminance.value(tile.area.left() + x, tile.area.top() + y);
+      }
+   }
+
+   // The median and MAD barely move for the few pixels a star covers; a sample of the pixels gives them well enough.
+   std::vector<float> scratch;
+   scratch.reserve(pixels / static_cast<size_t>(StarBackgroundStride) + 1);
+   for (size_t index = 0; index < pixels; index += static_cast<size_t>(StarBackgroundStride)) {
+      scratch.push_back(values[index]);
+   }
+   tile.background = median(scratch);
+   for (auto & value : scratch) {
+      value = std::abs(value - tile.background);
+   }
+   tile.noise           = static_cast<float>(median(scratch) * MADToSigma);
+   const auto threshold = tile.background + static_cast<float>(StarDetectionSigma) * std::max(tile.noise, 1.0F);
+
+   // Two pass labelling; the first pass gives provisional labels and records which ones touch.
+   std::vector<int> labels(pixels, -1);
+   std::vector<int> parents;
+   for (int y = 0; y < height; ++y) {
+      for (int x = 0; x < width; ++x) {
+         const auto index = static_cast<size_t>(y) * static_cast<size_t>(width) + static_cast<size_t>(x);
+         if (values[index] <= threshold) {
+            continue;
+         }
+         auto label = -1;
+         auto join  = [&](int neighbour) {
+            if (neighbour < 0) {
+               return;
+            }
+            if (label < 0) {
+               label = neighbour;
+            } else {
+               unite(parents, label, neighbour);
+            }
+         };
+         if (x > 0) {
+            join(labels[index - 1]);
+         }
+         if (y > 0) {
+            const auto above = index - static_cast<size_t>(width);
+            if (x > 0) {
+               join(labels[above - 1]);
+            }
+            join(labels[above]);
+            if (x < width - 1) {
+               join(labels[above + 1]);
+            }
+         }
+         if (label < 0) {
+            label = static_cast<int>(parents.size());
+            parents.push_back(label);
+         }
+         labels[index] = label;
+      }
+   }
+
+   std::vector<int> blobOf(parents.size(), -1);
+   for (size_t index = 0; index < pixels; ++index) {
+      if (labels[index] < 0) {
+         continue;
+      }
+      auto & blob = blobOf[static_cast<size_t>(findRoot(parents, labels[index]))];
+      if (blob < 0) {
+         blob = static_cast<int>(tile.blobs.size());
+         tile.blobs.emplace_back();
+      }
+      labels[index]        = blob;
+      const auto signal    = values[index] - tile.background;
+      const auto x         = tile.area.left() + static_cast<int>(index % static_cast<size_t>(width));
+      const auto y         = tile.area.top() + static_cast<int>(index / static_cast<size_t>(width));
+      auto &     component = tile.blobs[static_cast<size_t>(blob)];
+      component.flux += signal;
+      component.sumX += static_cast<double>(signal) * x;
+      component.sumY += static_cast<double>(signal) * y;
+      component.peak = std::max(component.peak, signal);
+      component.area++;
+   }
+
+   tile.top.assign(labels.begin(), labels.begin() + width);
+   tile.bottom.assign(labels.end() - width, labels.end());
+   tile.left.resize(static_cast<size_t>(height));
+   tile.right.resize(static_cast<size_t>(height));
+   for (int y = 0; y < height; ++y) {
+      tile.left[static_cast<size_t>(y)]  = labels[static_cast<size_t>(y) * static_cast<size_t>(width)];
+      tile.right[static_cast<size_t>(y)] = labels[static_cast<size_t>(y + 1) * static_cast<size_t>(width) - 1];
+   }
+}
+
+/*!
+ * Joins the blobs on either side of a seam, given the blob under each pixel along both sides.
+ */
+void joinSeam(const std::vector<int> & before, const std::vector<int> & after, std::vector<int> & parents)
+{
+   const auto length = static_cast<int>(before.size());
+   for (int position = 0; position < length; ++position) {
+      if (before[static_cast<size_t>(position)] < 0) {
+         continue;
+      }
+      for (int across = std::max(0, position - 1); across <= std::min(length - 1, position + 1); ++across) {
+         if (after[static_cast<size_t>(across)] >= 0) {
+            unite(parents, before[static_cast<size_t>(position)], after[static_cast<size_t>(across)]);
+         }
+      }
+   }
+}
+
+/*!
+ * Measures a star around the centroid of its blob; false if it is too close to the edge, or is no star.
+ *
+ * The size comes from adaptive moments: the second moments are taken under a Gaussian window that is refitted to the
+ * star until the two agree, then the window's narrowing is divided out.  Unlike plain moments over an aperture, noise
+ * far from the star gets no weight, so faint stars are not measured large.  The HFR is read within an aperture of
+ * StarApertureFactor sigmas of the fitted star.
+ */
+auto measure(const Luminance & luminance, const Blob & blob, float background, Star & star) -> bool
+{
+   auto centreX = blob.sumX / blob.flux;
+   auto centreY = blob.sumY / blob.flux;
+   auto inside  = [&](double radius) {
+      return centreX - radius >= 0.0 && centreY - radius >= 0.0 && centreX + radius < luminance.width - 1
+             && centreY + radius < luminance.height - 1;
+   };
+   // Visits the pixels within a radius of the centre, with their offsets and their signal above the background.
+   auto around = [&](double radius, const auto & visit) {
+      for (auto y = static_cast<int>(std::floor(centreY - radius)); y <= static_cast<int>(std::ceil(centreY + radius));
+           ++y) {
+         for (auto x = static_cast<int>(std::floor(centreX - radius));
+              x <= static_cast<int>(std::ceil(centreX + radius));
+              ++x) {
+            const auto dx = x - centreX;
+            const auto dy = y - centreY;
+            if (dx * dx + dy * dy <= radius * radius) {
+               visit(dx, dy, static_cast<double>(luminance.value(x, y) - background));
+            }
+         }
+      }
+   };
+
+   // The threshold cuts a star at about two sigmas, so the window starts at half the radius of the area found.
+   auto window = std::max(1.0, blob.area / (4.0 * Pi)); // the variance of the window
+   auto major  = 0.0;                           // the variances of the star along its axes
+   auto minor  = 0.0;
+   auto fitted = false;
+   for (int iteration = 0; iteration < StarMomentIterations; ++iteration) {
+      const auto radius = StarWindowSigmas * std::sqrt(window);
+      if (radius > StarMaximumAperture || !inside(radius)) {
+         return false;
+      }
+      double weight{ 0.0 };
+      double sumX{ 0.0 };
+      double sumY{ 0.0 };
+      double xx{ 0.0 };
+      double yy{ 0.0 };
+      double xy{ 0.0 };
+      around(radius, [&](double dx, double dy, double signal) {
+         const auto weighted = signal * std::exp(-(dx * dx + dy * dy) / (2.0 * window));
+         weight += weighted;
+         sumX += weighted * dx;
+         sumY += weighted * dy;
+         xx += weighted * dx * dx;
+         yy += weighted * dy * dy;
+         xy += weighted * dx * dy;
+      });
+      if (weight <= 0.0) {
+         return false;
+      }
+      centreX += sumX / weight;
+      centreY += sumY / weight;
+
+      // The eigenvalues of the windowed moments, and the star variances they come from: m = s w / (s + w).
+      xx /= weight;
+      yy /= weight;
+      xy /= weight;
+      const auto mean     = (xx + yy) / 2.0;
+      const auto spread   = std::sqrt((xx - yy) * (xx - yy) / 4.0 + xy * xy);
+      const auto measured = std::array<double, 2>{ mean + spread, std::max(mean - spread, 0.0) };
+      if (measured[0] >= window) {
+         return false;
+      }
+      major                   = measured[0] * window / (window - measured[0]);
+      minor                   = measured[1] * window / (window - measured[1]);
+      const auto starVariance = (major + minor) / 2.0;
+      fitted                  = std::abs(starVariance - window) < StarMomentTolerance * window;
+      window                  = starVariance;
+      if (fitted) {
+         break;
+      }
+   }
+   const auto aperture = std::max(StarMinimumAperture, StarApertureFactor * std::sqrt(major));
+   if (!fitted || aperture > StarMaximumAperture || !inside(aperture)) {
+      return false;
+   }
+
+   double flux{ 0.0 };
+   double positive{ 0.0 };
+   double sumRadius{ 0.0 };
+   around(aperture, [&](double dx, double dy, double signal) {
+      flux += signal;
+      if (signal > 0.0) {
+         positive += signal;
+         sumRadius += signal * std::sqrt(dx * dx + dy * dy);
+      }
+   });
+   if (flux <= 0.0) {
+      return false;
+   }
+
+   const auto scale  = static_cast<double>(luminance.scale);
+   star.x            = (centreX + 0.5) * scale - 0.5;
+   star.y            = (centreY + 0.5) * scale - 0.5;
+   star.flux         = flux;
+   star.peak         = blob.peak;
+   star.hfr          = sumRadius / positive * scale;
+   star.fwhm         = FWHMPerSigma * std::sqrt((major + minor) / 2.0) * scale;
+   star.eccentricity = major > 0.0 ? std::sqrt(1.0 - minor / major) : 0.0;
+   star.area         = blob.area * luminance.scale * luminance.scale;
+   return true;
+}
+
+auto medianOf(QVector<double> values) -> double
+{
+   if (values.isEmpty()) {
+      return 0.0;
+   }
+   const auto middle = values.begin() + values.count() / 2;
+   std::nth_element(values.begin(), middle, values.end());
+   return *middle;
+}
+} // namespace
+
+/* ***************************************************************************************************************** */
+// MARK: - ctors & dtors
+/* ***************************************************************************************************************** */
+StarDetector::StarDetector(QObject * parent)
+   : QObject(parent)
+   , m_busy(false)
+{
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Public methods
+/* ***************************************************************************************************************** */
+auto StarField::isEmpty() const -> bool
+{
+   return stars.isEmpty();
+}
+
+auto StarDetector::detect(const Frame & frame) -> StarField
+{
+   StarField field;
+   field.sequence = frame.sequence();
+   field.width    = static_cast<int>(frame.width());
+   field.height   = static_cast<int>(frame.height());
+
+   Luminance luminance;
+   luminance.pixels     = frame.constData();
+   luminance.frameWidth = field.width;
+   luminance.channels   = frame.channels() == 3 ? 3 : 1;
+   luminance.scale      = frame.bayerPattern() != Frame::Monochrome && luminance.channels == 1 ? 2 : 1;
+   luminance.width      = field.width / luminance.scale;
+   luminance.height     = field.height / luminance.scale;
+   luminance.wide       = frame.bytesPerSample() == 2;
+   if (frame.isNull() || frame.isFloat() || luminance.width < StarTileSize / 4 || luminance.height < StarTileSize / 4) {
+      return field;
+   }
+
+   // A narrow last column or row of tiles is folded into the one before it, so every tile has a fair background.
+   const auto columns = std::max(1, luminance.width / StarTileSize);
+   const auto rows    = std::max(1, luminance.height / StarTileSize);
+   std::vector<Tile> tiles(static_cast<size_t>(columns) * static_cast<size_t>(rows));
+   for (int row = 0; row < rows; ++row) {
+      for (int column = 0; column < columns; ++column) {
+         auto & tile = tiles[static_cast<size_t>(row) * static_cast<size_t>(columns) + static_cast<size_t>(column)];
+         tile.area = QRect(column * StarTileSize,
+                           row * StarTileSize,
+                           column == columns - 1 ? luminance.width - column * StarTileSize : StarTileSize,
+                           row == rows - 1 ? luminance.height - row * StarTileSize : StarTileSize);
+      }
+   }
+   parallelRows(
+     static_cast<int>(tiles.size()),
+     [&](int firstTile, int lastTile) {
+        for (int tile = firstTile; tile < lastTile; ++tile) {
+           searchTile(luminance, tiles[static_cast<size_t>(tile)]);
+        }
+     },
+     1);
+
+   // Number the blobs across the frame, then join those that meet across a seam.
+   std::vector<int> firstBlob(tiles.size() + 1, 0);
+   for (size_t tile = 0; tile < tiles.size(); ++tile) {
+      firstBlob[tile + 1] = firstBlob[tile] + static_cast<int>(tiles[tile].blobs.size());
+      auto renumber       = [&](std::vector<int> & edge) {
+         for (auto & blob : edge) {
+            blob = blob < 0 ? blob : blob + firstBlob[tile];
+         }
+      };
+      renumber(tiles[tile].top);
+      renumber(tiles[tile].bottom);
+      renumber(tiles[tile].left);
+      renumber(tiles[tile].right);
+   }
+   std::vector<int> parents(static_cast<size_t>(firstBlob.back()));
+   std::iota(parents.begin(), parents.end(), 0);
+   auto tileAt = [&](int column, int row) -> Tile & {
+      return tiles[static_cast<size_t>(row) * static_cast<size_t>(columns) + static_cast<size_t>(column)];
+   };
+   // Whole rows and columns of the frame are compared, so stars across the corner of four tiles are joined too.
+   for (int row = 0; row + 1 < rows; ++row) {
+      std::vector<int> above;
+      std::vector<int> below;
+      for (int column = 0; column < columns; ++column) {
+         above.insert(above.end(), tileAt(column, row).bottom.begin(), tileAt(column, row).bottom.end());
+         below.insert(below.end(), tileAt(column, row + 1).top.begin(), tileAt(column, row + 1).top.end());
+      }
+      joinSeam(above, below, parents);
+   }
+   for (int column = 0; column + 1 < columns; ++column) {
+      std::vector<int> before;
+      std::vector<int> after;
+      for (int row = 0; row < rows; ++row) {
+         before.insert(before.end(), tileAt(column, row).right.begin(), tileAt(column, row).right.end());
+         after.insert(after.end(), tileAt(column + 1, row).left.begin(), tileAt(column + 1, row).left.end());
+      }
+      joinSeam(before, after, parents);
+   }
+
+   std::vector<Blob> blobs(parents.size());
+   for (size_t tile = 0; tile < tiles.size(); ++tile) {
+      for (size_t blob = 0; blob < tiles[tile].blobs.size(); ++blob) {
+         const auto index = firstBlob[tile] + static_cast<int>(blob);
+         blobs[static_cast<size_t>(findRoot(parents, index))].add(tiles[tile].blobs[blob]);
+      }
+   }
+   std::vector<size_t> candidates;
+   for (size_t blob = 0; blob < blobs.size(); ++blob) {
+      if (parents[blob] == static_cast<int>(blob) && blobs[blob].area >= StarMinimumArea
+          && blobs[blob].area <= StarMaximumArea) {
+         candidates.push_back(blob);
+      }
+   }
+
+   std::vector<Star> stars(candidates.size());
+   std::vector<char> measured(candidates.size(), 0);
+   parallelRows(
+     static_cast<int>(candidates.size()),
+     [&](int firstStar, int lastStar) {
+        for (int index = firstStar; index < lastStar; ++index) {
+           const auto & blob    = blobs[candidates[static_cast<size_t>(index)]];
+           const auto   column  = std::min(columns - 1, static_cast<int>(blob.sumX / blob.flux) / StarTileSize);
+           const auto   row     = std::min(rows - 1, static_cast<int>(blob.sumY / blob.flux) / StarTileSize);
+           const auto & tile    = tiles[static_cast<size_t>(row) * static_cast<size_t>(columns)
+                                     + static_cast<size_t>(column)];
+           measured[static_cast<size_t>(index)] =
+             measure(luminance, blob, tile.background, stars[static_cast<size_t>(index)]) ? 1 : 0;
+        }
+     },
+     StarsPerChunk);
+
+   QVector<double> hfrs;
+   QVector<double> fwhms;
+   for (size_t index = 0; index < stars.size(); ++index) {
+      if (measured[index] != 0) {
+         field.stars.append(stars[index]);
+         hfrs.append(stars[index].hfr);
+         fwhms.append(stars[index].fwhm);
+      }
+   }
+   std::sort(field.stars.begin(), field.stars.end(), [](const Star & first, const Star & second) {
+      return first.flux > second.flux;
+   });
+   field.hfr  = medianOf(hfrs);
+   field.fwhm = medianOf(fwhms);
+   return field;
+}
+
+auto StarDetector::isBusy() const -> bool
+{
+   return m_busy;
+}
+
+auto StarDetector::offer(const Frame & frame) -> bool
+{
+   auto idle = false;
+   if (!m_busy.compare_exchange_strong(idle, true)) {
+      return false;
+   }
+   QMetaObject::invokeMethod(
+     this, [this, frame]() { analyze(frame); }, Qt::QueuedConnection);
+   return true;
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Public slots
+/* ***************************************************************************************************************** */
+void StarDetector::analyze(Frame frame)
+{
+   auto field = detect(frame);
+   // Let the buffer go back to the pool before anyone reacts to the result.
+   frame      = Frame();
+   m_busy     = false;
+   emit starsDetected(field);
+}
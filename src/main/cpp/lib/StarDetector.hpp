@@ -0,0 +1,94 @@
+#pragma once
+
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "Frame.hpp"
+#include <atomic>
+#include <QMetaType>
+#include <QObject>
+#include <QVector>
+
+/*! \brief One star found in a frame; positions and sizes are in frame pixels.
+ */
+struct Star
+{
+   double x{ 0.0 }; // the flux weighted centroid
+   double y{ 0.0 };
+   double flux{ 0.0 }; // above the background, in sample units
+   double peak{ 0.0 };
+   double hfr{ 0.0 };          // half flux radius; the flux weighted mean distance from the centroid
+   double fwhm{ 0.0 };         // from the second moments, as for a Gaussian
+   double eccentricity{ 0.0 }; // 0 for a round star, approaching 1 for a trail
+   int    area{ 0 };           // the pixels above the detection threshold
+};
+
+/*! \brief The stars found in one frame.
+ */
+struct StarField
+{
+   quint64       sequence{ 0 }; // of the frame
+   int           width{ 0 };
+   int           height{ 0 };
+   QVector<Star> stars; // brightest first
+   double        hfr{ 0.0 };  // the median of the stars
+   double        fwhm{ 0.0 }; // the median of the stars
+
+   [[nodiscard]] auto isEmpty() const -> bool;
+};
+
+Q_DECLARE_METATYPE(StarField)
+
+/*! \brief Finds the stars of a frame, and measures them for focusing and quality control.
+ *
+ * The frame is cut into tiles that are spread across the global thread pool.  Each tile gets its own background and
+ * noise, from the median and MAD of its pixels, so gradients do not matter; the pixels above the threshold are grouped
+ * into 8-connected components.  Components that touch across a tile seam are then joined, so a star on a seam is found
+ * once.  Each star is measured within an aperture around its centroid, again in parallel.
+ *
+ * A colour mosaic is searched at half size, as the sum of each 2 × 2 cell, so no debayering is needed; a three channel
+ * frame as the sum of its channels.
+ *
+ * An instance lives on a thread of its own and analyzes the frames it is offered, one at a time; detect() may be called
+ * directly from any thread.
+ */
+class StarDetector : public QObject
+{
+   Q_OBJECT
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+   Q_DISABLE_COPY_MOVE(StarDetector)
+#endif
+
+public:
+   explicit StarDetector(QObject * parent = nullptr);
+   ~StarDetector() override = default;
+
+   /*!
+    * Finds and measures the stars of a frame, on the calling thread and the global thread pool.
+    */
+   [[nodiscard]] static auto detect(const Frame & frame) -> StarField;
+
+   /*!
+    * Flag to track if a frame is being analyzed.  Safe to call from any thread.
+    */
+   [[nodiscard]] auto        isBusy() const -> bool;
+
+   /*!
+    * Queues a frame for analysis, unless one is already being analyzed.  Safe to call from any thread.
+    *
+    * @return False if the frame was dropped.
+    */
+   auto                      offer(const Frame & frame) -> bool;
+
+public slots:
+   void analyze(Frame frame);
+
+signals:
+   void starsDetected(StarField field);
+
+private:
+   std::atomic_bool m_busy;
+};
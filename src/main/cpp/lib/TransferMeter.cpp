@@ -0,0 +1,56 @@
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "TransferMeter.hpp"
+
+#include "Config.h"
+#include <QMutexLocker>
+
+/* ***************************************************************************************************************** */
+// MARK: - TransferStatistics
+/* ***************************************************************************************************************** */
+auto TransferStatistics::throughput() const -> double
+{
+   return transferSeconds > 0.0 ? static_cast<double>(bytes) / transferSeconds : 0.0;
+}
+
+auto TransferStatistics::operator-(const TransferStatistics & earlier) const -> TransferStatistics
+{
+   TransferStatistics difference;
+   difference.bytes           = bytes - earlier.bytes;
+   difference.frames          = frames - earlier.frames;
+   difference.stalls          = stalls - earlier.stalls;
+   difference.transferSeconds = transferSeconds - earlier.transferSeconds;
+   difference.waitSeconds     = waitSeconds - earlier.waitSeconds;
+   return difference;
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Public methods
+/* ***************************************************************************************************************** */
+void TransferMeter::record(qint64 bytes, double waitSeconds, double transferSeconds)
+{
+   QMutexLocker locker(&m_mutex);
+   m_statistics.bytes += static_cast<quint64>(bytes);
+   m_statistics.frames++;
+   m_statistics.transferSeconds += transferSeconds;
+   m_statistics.waitSeconds += waitSeconds;
+
+   // A camera's own best rate is the yardstick; any download well below it was held up by something else on the bus.
+   auto throughput = transferSeconds > 0.0 ? static_cast<double>(bytes) / transferSeconds : 0.0;
+   auto stalled    = waitSeconds * MillisecondsPerSecond > BusStallThreshold ||
+                  throughput < m_peakThroughput * BusStallRateFraction;
+   if (stalled) {
+      m_statistics.stalls++;
+   }
+   m_peakThroughput = qMax(m_peakThroughput, throughput);
+}
+
+auto TransferMeter::statistics() const -> TransferStatistics
+{
+   QMutexLocker locker(&m_mutex);
+   return m_statistics;
+}
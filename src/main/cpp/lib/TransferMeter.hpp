@@ -0,0 +1,65 @@
+#pragma once
+
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include <QMetaType>
+#include <QMutex>
+
+/*! \brief Totals for the downloads of one camera.
+ */
+struct TransferStatistics
+{
+   quint64 bytes{ 0 };
+   quint64 frames{ 0 };
+   quint64 stalls{ 0 };            // downloads that waited on the bus, or ran far below the camera's best rate
+   double  transferSeconds{ 0.0 }; // time spent in the driver's download calls
+   double  waitSeconds{ 0.0 };     // time spent waiting for the bus before downloading
+
+   /*!
+    * The download rate while downloading, in bytes per second.
+    */
+   [[nodiscard]] auto throughput() const -> double;
+
+   /*!
+    * The difference between two snapshots of the same camera.
+    */
+   [[nodiscard]] auto operator-(const TransferStatistics & earlier) const -> TransferStatistics;
+};
+
+Q_DECLARE_METATYPE(TransferStatistics)
+
+/*! \brief Accounts for the downloads of one camera.
+ *
+ * Both capture workers of a camera record into the same meter; the scheduler reads snapshots of it.  All methods are
+ * safe to call from any thread.
+ */
+class TransferMeter
+{
+public:
+   TransferMeter() = default;
+   TransferMeter(const TransferMeter &) = delete;
+   TransferMeter(TransferMeter &&)      = delete;
+   ~TransferMeter()                     = default;
+
+   auto               operator=(const TransferMeter &) -> TransferMeter & = delete;
+   auto               operator=(TransferMeter &&) -> TransferMeter & = delete;
+
+   /*!
+    * Records one completed download.
+    *
+    * @param bytes the size of the frame downloaded.
+    * @param waitSeconds how long the download waited for the bus.
+    * @param transferSeconds how long the download took.
+    */
+   void               record(qint64 bytes, double waitSeconds, double transferSeconds);
+   [[nodiscard]] auto statistics() const -> TransferStatistics;
+
+private:
+   mutable QMutex     m_mutex;
+   TransferStatistics m_statistics;
+   double             m_peakThroughput{ 0.0 };
+};
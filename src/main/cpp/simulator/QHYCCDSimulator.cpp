@@ -0,0 +1,431 @@
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "QHYCCDSimulator.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <QDebug>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QVector>
+
+#include <qhyccd.h>
+
+namespace
+{
+constexpr const char * ConfigurationVariable = "QHYCCD_SIMULATOR_CONFIG";
+
+struct Registry
+{
+   std::mutex                                 mutex;
+   QVector<std::shared_ptr<SimulatedCamera>> attached; // plugged in
+   QVector<std::shared_ptr<SimulatedCamera>> open;     // open handles, which outlive unplugging
+   QVector<QByteArray>                        scanned;  // the ids as of the last ScanQHYCCD()
+   bool                                       configured{ false };
+};
+
+auto registry() -> Registry &
+{
+   static Registry instance;
+   return instance;
+}
+
+/*
+ * The caller holds the registry mutex.
+ */
+auto attachedCamera(Registry & state, const QByteArray & id) -> std::shared_ptr<SimulatedCamera>
+{
+   auto found = std::find_if(state.attached.cbegin(), state.attached.cend(), [&id](const auto & camera) {
+      return camera->model().id == id;
+   });
+   return found == state.attached.cend() ? nullptr : *found;
+}
+
+/*
+ * The camera for an open handle, kept alive for the duration of the call even if it is closed meanwhile.
+ */
+auto openCamera(qhyccd_handle * handle) -> std::shared_ptr<SimulatedCamera>
+{
+   auto &                      state = registry();
+   std::lock_guard<std::mutex> locker(state.mutex);
+   auto found = std::find_if(state.open.cbegin(), state.open.cend(), [handle](const auto & camera) {
+      return camera.get() == handle;
+   });
+   return found == state.open.cend() ? nullptr : *found;
+}
+} // namespace
+
+/* ***************************************************************************************************************** */
+// MARK: - Public methods
+/* ***************************************************************************************************************** */
+auto QHYCCDSimulator::addCamera(const CameraModel & model) -> bool
+{
+   auto &                      state = registry();
+   std::lock_guard<std::mutex> locker(state.mutex);
+   state.configured = true;
+   if (attachedCamera(state, model.id)) {
+      return false;
+   }
+   state.attached.append(std::make_shared<SimulatedCamera>(model));
+   return true;
+}
+
+auto QHYCCDSimulator::cameraIds() -> QList<QByteArray>
+{
+   auto &                      state = registry();
+   std::lock_guard<std::mutex> locker(state.mutex);
+   QList<QByteArray>           ids;
+   for (const auto & camera : qAsConst(state.attached)) {
+      ids.append(camera->model().id);
+   }
+   return ids;
+}
+
+auto QHYCCDSimulator::defaultModels() -> QList<CameraModel>
+{
+   CameraModel imaging;
+   imaging.id              = "QHY600M-SIM0001";
+   imaging.width           = 9576;  // NOLINT
+   imaging.height          = 6388;  // NOLINT
+   imaging.pixelWidth      = 3.76;  // NOLINT
+   imaging.pixelHeight     = 3.76;  // NOLINT
+   imaging.readModes       = QStringList{ "Photographic", "High Gain", "Extended Fullwell" };
+   imaging.gainMaximum     = 200;   // NOLINT
+   imaging.supportsCooler  = true;
+   imaging.frameRate       = 4;     // NOLINT
+   imaging.readoutLatency  = 0.9;   // NOLINT
+   imaging.starCount       = 2000;  // NOLINT
+   imaging.seed            = 600;   // NOLINT
+
+   CameraModel colour;
+   colour.id             = "QHY268C-SIM0002";
+   colour.width          = 6280;  // NOLINT
+   colour.height         = 4210;  // NOLINT
+   colour.pixelWidth     = 3.76;  // NOLINT
+   colour.pixelHeight    = 3.76;  // NOLINT
+   colour.bayerPattern   = BAYER_RG;
+   colour.readModes      = QStringList{ "Photographic", "High Gain", "Extended Fullwell", "Extended Fullwell 2CMS" };
+   colour.supportsCooler = true;
+   colour.frameRate      = 7;     // NOLINT
+   colour.readoutLatency = 0.6;   // NOLINT
+   colour.starCount      = 1000;  // NOLINT
+   colour.seed           = 268;   // NOLINT
+
+   CameraModel planetary;
+   planetary.id              = "QHY5III462C-SIM0003";
+   planetary.pixelWidth      = 2.9;   // NOLINT
+   planetary.pixelHeight     = 2.9;   // NOLINT
+   planetary.bayerPattern    = BAYER_RG;
+   planetary.maximumBin      = 2;
+   planetary.frameRate       = 135;   // NOLINT
+   planetary.readoutLatency  = 0.02;  // NOLINT
+   planetary.unstableTraffic = 10;    // NOLINT: so the auto-tuner has a marginal link to find
+   planetary.starCount       = 40;    // NOLINT
+   planetary.ditherPixels    = 2;
+   planetary.seed            = 462;   // NOLINT
+
+   return { imaging, colour, planetary };
+}
+
+auto QHYCCDSimulator::loadConfiguration(const QString & path) -> bool
+{
+   QFile configurationFile(path);
+   if (!configurationFile.open(QIODevice::ReadOnly)) {
+      qWarning() << "Cannot read the simulator configuration" << path;
+      return false;
+   }
+   QJsonParseError parseError{};
+   auto            document = QJsonDocument::fromJson(configurationFile.readAll(), &parseError);
+   if (parseError.error != QJsonParseError::NoError) {
+      qWarning() << "The simulator configuration" << path << "is not valid:" << parseError.errorString();
+      return false;
+   }
+   for (const auto & camera : document.object().value("cameras").toArray()) {
+      auto model = CameraModel::fromJson(camera.toObject());
+      if (!addCamera(model)) {
+         qWarning() << "The simulator configuration repeats the camera id" << model.id;
+      }
+   }
+   auto &                      state = registry();
+   std::lock_guard<std::mutex> locker(state.mutex);
+   state.configured = true;
+   return true;
+}
+
+auto QHYCCDSimulator::removeCamera(const QByteArray & id) -> bool
+{
+   auto &                      state = registry();
+   std::lock_guard<std::mutex> locker(state.mutex);
+   auto                        camera = attachedCamera(state, id);
+   if (!camera) {
+      return false;
+   }
+   camera->unplug();
+   state.attached.removeOne(camera);
+   return true;
+}
+
+void QHYCCDSimulator::removeAllCameras()
+{
+   auto &                      state = registry();
+   std::lock_guard<std::mutex> locker(state.mutex);
+   for (const auto & camera : qAsConst(state.attached)) {
+      camera->unplug();
+   }
+   state.attached.clear();
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - The driver API
+/* ***************************************************************************************************************** */
+uint32_t InitQHYCCDResource()
+{
+   bool configured{ false };
+   {
+      auto &                      state = registry();
+      std::lock_guard<std::mutex> locker(state.mutex);
+      configured = state.configured;
+   }
+   if (!configured) {
+      auto configurationPath = qEnvironmentVariable(ConfigurationVariable);
+      if (configurationPath.isEmpty() || !QHYCCDSimulator::loadConfiguration(configurationPath)) {
+         for (const auto & model : QHYCCDSimulator::defaultModels()) {
+            QHYCCDSimulator::addCamera(model);
+         }
+      }
+   }
+   return QHYCCD_SUCCESS;
+}
+
+uint32_t ReleaseQHYCCDResource()
+{
+   return QHYCCD_SUCCESS;
+}
+
+uint32_t ScanQHYCCD()
+{
+   auto &                      state = registry();
+   std::lock_guard<std::mutex> locker(state.mutex);
+   state.scanned.clear();
+   for (const auto & camera : qAsConst(state.attached)) {
+      state.scanned.append(camera->model().id);
+   }
+   return static_cast<uint32_t>(state.scanned.size());
+}
+
+uint32_t GetQHYCCDId(uint32_t index, char * id)
+{
+   auto &                      state = registry();
+   std::lock_guard<std::mutex> locker(state.mutex);
+   if (index >= static_cast<uint32_t>(state.scanned.size())) {
+      return QHYCCD_ERROR;
+   }
+   qstrcpy(id, state.scanned.at(static_cast<int>(index)).constData());
+   return QHYCCD_SUCCESS;
+}
+
+uint32_t GetQHYCCDModel(char * id, char * model)
+{
+   QByteArray cameraId(id);
+   auto       separator = cameraId.lastIndexOf('-');
+   if (separator <= 0) {
+      return QHYCCD_ERROR;
+   }
+   qstrcpy(model, cameraId.left(separator).constData());
+   return QHYCCD_SUCCESS;
+}
+
+qhyccd_handle * OpenQHYCCD(char * id)
+{
+   auto &                      state = registry();
+   std::lock_guard<std::mutex> locker(state.mutex);
+   auto                        camera = attachedCamera(state, QByteArray(id));
+   if (!camera || state.open.contains(camera)) {
+      return nullptr;
+   }
+   state.open.append(camera);
+   return camera.get();
+}
+
+uint32_t CloseQHYCCD(qhyccd_handle * handle)
+{
+   auto camera = openCamera(handle);
+   if (!camera) {
+      return QHYCCD_ERROR;
+   }
+   camera->cancelExposingAndReadout();
+   camera->stopLive();
+   auto &                      state = registry();
+   std::lock_guard<std::mutex> locker(state.mutex);
+   state.open.removeOne(camera);
+   return QHYCCD_SUCCESS;
+}
+
+uint32_t SetQHYCCDStreamMode(qhyccd_handle * handle, uint8_t mode)
+{
+   auto camera = openCamera(handle);
+   return camera ? camera->setStreamMode(mode) : QHYCCD_ERROR;
+}
+
+uint32_t InitQHYCCD(qhyccd_handle * handle)
+{
+   auto camera = openCamera(handle);
+   return camera ? camera->initialize() : QHYCCD_ERROR;
+}
+
+uint32_t IsQHYCCDControlAvailable(qhyccd_handle * handle, CONTROL_ID controlId)
+{
+   auto camera = openCamera(handle);
+   return camera ? camera->isControlAvailable(controlId) : QHYCCD_ERROR;
+}
+
+uint32_t SetQHYCCDParam(qhyccd_handle * handle, CONTROL_ID controlId, double value)
+{
+   auto camera = openCamera(handle);
+   return camera ? camera->setParameter(controlId, value) : QHYCCD_ERROR;
+}
+
+double GetQHYCCDParam(qhyccd_handle * handle, CONTROL_ID controlId)
+{
+   auto camera = openCamera(handle);
+   return camera ? camera->parameter(controlId) : QHYCCD_ERROR;
+}
+
+uint32_t GetQHYCCDParamMinMaxStep(qhyccd_handle * handle, CONTROL_ID controlId, double * min, double * max, double * step)
+{
+   auto camera = openCamera(handle);
+   return camera ? camera->parameterRange(controlId, min, max, step) : QHYCCD_ERROR;
+}
+
+uint32_t SetQHYCCDResolution(qhyccd_handle * handle, uint32_t x, uint32_t y, uint32_t xsize, uint32_t ysize)
+{
+   auto camera = openCamera(handle);
+   return camera ? camera->setResolution(x, y, xsize, ysize) : QHYCCD_ERROR;
+}
+
+uint32_t SetQHYCCDBinMode(qhyccd_handle * handle, uint32_t wbin, uint32_t hbin)
+{
+   auto camera = openCamera(handle);
+   return camera ? camera->setBinMode(wbin, hbin) : QHYCCD_ERROR;
+}
+
+uint32_t SetQHYCCDBitsMode(qhyccd_handle * handle, uint32_t bits)
+{
+   auto camera = openCamera(handle);
+   return camera ? camera->setBitsMode(bits) : QHYCCD_ERROR;
+}
+
+uint32_t GetQHYCCDMemLength(qhyccd_handle * handle)
+{
+   auto camera = openCamera(handle);
+   return camera ? camera->memoryLength() : 0;
+}
+
+uint32_t ExpQHYCCDSingleFrame(qhyccd_handle * handle)
+{
+   auto camera = openCamera(handle);
+   return camera ? camera->exposeSingleFrame() : QHYCCD_ERROR;
+}
+
+uint32_t GetQHYCCDSingleFrame(qhyccd_handle * handle,
+                              uint32_t *      w,
+                              uint32_t *      h,
+                              uint32_t *      bpp,
+                              uint32_t *      channels,
+                              uint8_t *       imgdata)
+{
+   auto camera = openCamera(handle);
+   return camera ? camera->singleFrame(w, h, bpp, channels, imgdata) : QHYCCD_ERROR;
+}
+
+uint32_t CancelQHYCCDExposingAndReadout(qhyccd_handle * handle)
+{
+   auto camera = openCamera(handle);
+   return camera ? camera->cancelExposingAndReadout() : QHYCCD_ERROR;
+}
+
+uint32_t BeginQHYCCDLive(qhyccd_handle * handle)
+{
+   auto camera = openCamera(handle);
+   return camera ? camera->beginLive() : QHYCCD_ERROR;
+}
+
+uint32_t GetQHYCCDLiveFrame(qhyccd_handle * handle,
+                            uint32_t *      w,
+                            uint32_t *      h,
+                            uint32_t *      bpp,
+                            uint32_t *      channels,
+                            uint8_t *       imgdata)
+{
+   auto camera = openCamera(handle);
+   return camera ? camera->liveFrame(w, h, bpp, channels, imgdata) : QHYCCD_ERROR;
+}
+
+uint32_t StopQHYCCDLive(qhyccd_handle * handle)
+{
+   auto camera = openCamera(handle);
+   return camera ? camera->stopLive() : QHYCCD_ERROR;
+}
+
+uint32_t GetQHYCCDChipInfo(qhyccd_handle * handle,
+                           double *        chipw,
+                           double *        chiph,
+                           uint32_t *      imagew,
+                           uint32_t *      imageh,
+                           double *        pixelw,
+                           double *        pixelh,
+                           uint32_t *      bpp)
+{
+   auto camera = openCamera(handle);
+   return camera ? camera->chipInfo(chipw, chiph, imagew, imageh, pixelw, pixelh, bpp) : QHYCCD_ERROR;
+}
+
+uint32_t GetQHYCCDFWVersion(qhyccd_handle * handle, uint8_t * buf)
+{
+   auto camera = openCamera(handle);
+   return camera ? camera->firmwareVersion(buf) : QHYCCD_ERROR;
+}
+
+uint32_t GetQHYCCDFPGAVersion(qhyccd_handle * handle, uint8_t fpga_index, uint8_t * buf) // NOLINT: the SDK's name
+{
+   auto camera = openCamera(handle);
+   return camera ? camera->fpgaVersion(fpga_index, buf) : QHYCCD_ERROR;
+}
+
+uint32_t GetQHYCCDNumberOfReadModes(qhyccd_handle * handle, uint32_t * numModes)
+{
+   auto camera = openCamera(handle);
+   if (!camera) {
+      return QHYCCD_ERROR;
+   }
+   *numModes = camera->readModeCount();
+   return QHYCCD_SUCCESS;
+}
+
+uint32_t GetQHYCCDReadModeName(qhyccd_handle * handle, uint32_t modeNumber, char * name)
+{
+   auto camera = openCamera(handle);
+   return camera ? camera->readModeName(modeNumber, name) : QHYCCD_ERROR;
+}
+
+uint32_t SetQHYCCDReadMode(qhyccd_handle * handle, uint32_t modeNumber)
+{
+   auto camera = openCamera(handle);
+   return camera ? camera->setReadMode(modeNumber) : QHYCCD_ERROR;
+}
+
+uint32_t GetQHYCCDReadMode(qhyccd_handle * handle, uint32_t * modeNumber)
+{
+   auto camera = openCamera(handle);
+   if (!camera) {
+      return QHYCCD_ERROR;
+   }
+   *modeNumber = camera->readMode();
+   return QHYCCD_SUCCESS;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "SimulatedCamera.hpp"
+#include <QList>
+#include <QString>
+
+/*! \brief Controls the simulated driver: which cameras are plugged in.
+ *
+ * The simulated driver is linked in place of the QHYCCD SDK when the project is configured with
+ * ENABLE_QHYCCD_SIMULATOR=ON.  The application talks to it only through qhyccd.h; tests and benchmarks use this class
+ * to set up the cameras it reports.
+ *
+ * If no camera has been added when InitQHYCCDResource() is called, the models are read from the JSON file named by the
+ * QHYCCD_SIMULATOR_CONFIG environment variable, or, without it, a default set of one monochrome and two colour cameras
+ * is plugged in.  The file holds an object with a "cameras" array; each element is read with CameraModel::fromJson().
+ *
+ * Cameras can be added and removed at any time, to exercise hot plugging; ScanQHYCCD() reports the change.  A removed
+ * camera that is open fails every call until it is closed.
+ */
+class QHYCCDSimulator
+{
+public:
+   QHYCCDSimulator() = delete;
+
+   /*!
+    * Plugs in a camera.
+    *
+    * @param model the camera to simulate.
+    * @return False if a camera with the same id is already plugged in.
+    */
+   static auto addCamera(const CameraModel & model) -> bool;
+
+   /*!
+    * The ids of the cameras that are plugged in, in the order ScanQHYCCD() reports them.
+    */
+   [[nodiscard]] static auto cameraIds() -> QList<QByteArray>;
+
+   /*!
+    * The default camera models, plugged in when nothing else is configured.
+    */
+   [[nodiscard]] static auto defaultModels() -> QList<CameraModel>;
+
+   /*!
+    * Plugs in every camera described by a JSON configuration file.
+    *
+    * @param path the file to read.
+    * @return False if the file cannot be read or is not valid JSON; cameras already added stay.
+    */
+   static auto loadConfiguration(const QString & path) -> bool;
+
+   /*!
+    * Unplugs a camera.
+    *
+    * @param id the id of the camera.
+    * @return False if no camera with that id is plugged in.
+    */
+   static auto removeCamera(const QByteArray & id) -> bool;
+
+   /*!
+    * Unplugs every camera.
+    */
+   static void removeAllCameras();
+};
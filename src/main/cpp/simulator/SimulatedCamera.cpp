@@ -0,0 +1,666 @@
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "SimulatedCamera.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <QJsonArray>
+#include <utility>
+
+namespace
+{
+constexpr double  AmbientTemperature    = 20.0;
+constexpr double  BiasLevel             = 400.0; // ADU, 16 bit scale, at offset 0
+constexpr double  BiasPerOffset         = 8.0;
+constexpr double  FwhmPerSigma          = 2.3548;
+constexpr double  MaximumExposure       = 3600.0 * 1000000.0;
+constexpr double  MaximumGainFactor     = 10.0;
+constexpr double  MicrosecondsPerSecond = 1000000.0;
+constexpr double  Pi                    = 3.14159265358979323846;
+constexpr double  StarRadiusSigmas      = 3.0;
+constexpr int     NoiseTableSize        = 1 << 16; // a power of two, so indices can be masked
+constexpr quint64 TruncationInterval    = 4;       // below the unstable traffic, one live frame in this many is cut
+constexpr quint32 FullBitDepth          = 16;
+
+// Relative response of the red, green & blue sites, so colour sensors show a plausible mosaic.
+constexpr double  RedWeight   = 0.85;
+constexpr double  GreenWeight = 1.0;
+constexpr double  BlueWeight  = 0.7;
+
+auto splitMix(quint64 & state) -> quint64
+{
+   state += 0x9E3779B97F4A7C15ULL;
+   auto mixed = state;
+   mixed      = (mixed ^ (mixed >> 30U)) * 0xBF58476D1CE4E5B9ULL;
+   mixed      = (mixed ^ (mixed >> 27U)) * 0x94D049BB133111EBULL;
+   return mixed ^ (mixed >> 31U);
+}
+
+auto unitRandom(quint64 & state) -> double
+{
+   return static_cast<double>(splitMix(state) >> 11U) * 0x1.0p-53;
+}
+
+auto bayerPatternFromJson(const QJsonValue & value) -> quint32
+{
+   if (value.isDouble()) {
+      return static_cast<quint32>(value.toInt());
+   }
+   static const QStringList names{ "MONO", "GBRG", "GRBG", "BGGR", "RGGB" };
+   return static_cast<quint32>(std::max(0, names.indexOf(value.toString().toUpper())));
+}
+
+/*
+ * The weights of the 2×2 colour filter cell, indexed by (row & 1) * 2 + (column & 1).
+ */
+auto siteWeights(quint32 bayerPattern) -> std::array<double, 4>
+{
+   switch (bayerPattern) {
+   case BAYER_GB:
+      return { GreenWeight, BlueWeight, RedWeight, GreenWeight };
+   case BAYER_GR:
+      return { GreenWeight, RedWeight, BlueWeight, GreenWeight };
+   case BAYER_BG:
+      return { BlueWeight, GreenWeight, GreenWeight, RedWeight };
+   case BAYER_RG:
+      return { RedWeight, GreenWeight, GreenWeight, BlueWeight };
+   default:
+      return { 1.0, 1.0, 1.0, 1.0 };
+   }
+}
+} // namespace
+
+/* ***************************************************************************************************************** */
+// MARK: - CameraModel
+/* ***************************************************************************************************************** */
+auto CameraModel::fromJson(const QJsonObject & json) -> CameraModel
+{
+   CameraModel model;
+   auto        readDouble = [&json](const char * key, double & field) { field = json.value(key).toDouble(field); };
+   auto        readUnsigned = [&json](const char * key, quint32 & field) {
+      field = static_cast<quint32>(json.value(key).toInt(static_cast<int>(field)));
+   };
+
+   if (json.contains("id")) {
+      model.id = json.value("id").toString().toLatin1();
+   }
+   readUnsigned("width", model.width);
+   readUnsigned("height", model.height);
+   readDouble("pixelWidth", model.pixelWidth);
+   readDouble("pixelHeight", model.pixelHeight);
+   readUnsigned("bitDepth", model.bitDepth);
+   if (json.contains("bayerPattern")) {
+      model.bayerPattern = bayerPatternFromJson(json.value("bayerPattern"));
+   }
+   readUnsigned("maximumBin", model.maximumBin);
+   if (json.contains("readModes")) {
+      model.readModes.clear();
+      for (const auto & readMode : json.value("readModes").toArray()) {
+         model.readModes.append(readMode.toString());
+      }
+   }
+   readDouble("gainMinimum", model.gainMinimum);
+   readDouble("gainMaximum", model.gainMaximum);
+   readDouble("gainStep", model.gainStep);
+   readDouble("offsetMinimum", model.offsetMinimum);
+   readDouble("offsetMaximum", model.offsetMaximum);
+   readDouble("offsetStep", model.offsetStep);
+   readDouble("usbTrafficMinimum", model.usbTrafficMinimum);
+   readDouble("usbTrafficMaximum", model.usbTrafficMaximum);
+   readDouble("unstableTraffic", model.unstableTraffic);
+   model.supportsCooler = json.value("supportsCooler").toBool(model.supportsCooler);
+   readDouble("frameRate", model.frameRate);
+   readDouble("readoutLatency", model.readoutLatency);
+   model.starCount = json.value("starCount").toInt(model.starCount);
+   readDouble("fwhm", model.fwhm);
+   readDouble("brightestStar", model.brightestStar);
+   readDouble("skyBackground", model.skyBackground);
+   readDouble("readNoise", model.readNoise);
+   readDouble("ditherPixels", model.ditherPixels);
+   readUnsigned("seed", model.seed);
+
+   if (model.readModes.isEmpty()) {
+      model.readModes.append("Standard");
+   }
+   model.bitDepth   = model.bitDepth > 8 ? FullBitDepth : 8;
+   model.maximumBin = std::clamp(model.maximumBin, 1U, 4U);
+   return model;
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - ctors & dtors
+/* ***************************************************************************************************************** */
+SimulatedCamera::SimulatedCamera(CameraModel model)
+   : m_model(std::move(model))
+   , m_region{ 0, 0, 0, 0 }
+   , m_randomState(m_model.seed)
+   , m_exposureSeconds(1.0)
+   , m_gain(m_model.gainMinimum)
+   , m_offset(m_model.offsetMinimum)
+   , m_speed(0)
+   , m_targetTemperature(AmbientTemperature)
+   , m_usbTraffic(m_model.usbTrafficMinimum)
+   , m_bin(1)
+   , m_bitDepth(m_model.bitDepth)
+   , m_readMode(0)
+   , m_streamMode(0)
+   , m_cancelRequested(false)
+   , m_exposing(false)
+   , m_live(false)
+   , m_unplugged(false)
+{
+   // Faint stars far outnumber bright ones; cubing a uniform deviate gives roughly that distribution.
+   m_stars.reserve(m_model.starCount);
+   for (int starIndex = 0; starIndex < m_model.starCount; ++starIndex) {
+      Star star{};
+      star.x    = unitRandom(m_randomState) * m_model.width;
+      star.y    = unitRandom(m_randomState) * m_model.height;
+      star.flux = m_model.brightestStar * std::pow(unitRandom(m_randomState), 3.0);
+      m_stars.append(star);
+   }
+
+   // Box-Muller, two deviates at a time.
+   m_noise.reserve(NoiseTableSize);
+   while (m_noise.size() < NoiseTableSize) {
+      auto radius = std::sqrt(-2.0 * std::log(1.0 - unitRandom(m_randomState)));
+      auto angle  = 2.0 * Pi * unitRandom(m_randomState);
+      m_noise.append(static_cast<float>(radius * std::cos(angle)));
+      m_noise.append(static_cast<float>(radius * std::sin(angle)));
+   }
+   resetGeometry();
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Public methods
+/* ***************************************************************************************************************** */
+auto SimulatedCamera::model() const -> const CameraModel &
+{
+   return m_model;
+}
+
+void SimulatedCamera::unplug()
+{
+   std::lock_guard<std::mutex> locker(m_mutex);
+   m_unplugged = true;
+   m_cancelled.notify_all();
+}
+
+auto SimulatedCamera::initialize() -> quint32
+{
+   std::lock_guard<std::mutex> locker(m_mutex);
+   if (m_unplugged) {
+      return QHYCCD_ERROR;
+   }
+   m_bin      = 1;
+   m_exposing = false;
+   m_live     = false;
+   resetGeometry();
+   return QHYCCD_SUCCESS;
+}
+
+auto SimulatedCamera::setStreamMode(quint8 mode) -> quint32
+{
+   std::lock_guard<std::mutex> locker(m_mutex);
+   if (m_unplugged || mode > 1 || m_live || m_exposing) {
+      return QHYCCD_ERROR;
+   }
+   m_streamMode = mode;
+   return QHYCCD_SUCCESS;
+}
+
+auto SimulatedCamera::isControlAvailable(CONTROL_ID controlId) const -> quint32
+{
+   std::lock_guard<std::mutex> locker(m_mutex);
+   if (m_unplugged) {
+      return QHYCCD_ERROR;
+   }
+   auto available = [](bool isAvailable) -> quint32 { return isAvailable ? QHYCCD_SUCCESS : QHYCCD_ERROR; };
+   switch (controlId) {
+   case CONTROL_GAIN:
+   case CONTROL_OFFSET:
+   case CONTROL_EXPOSURE:
+   case CONTROL_SPEED:
+   case CONTROL_TRANSFERBIT:
+   case CONTROL_USBTRAFFIC:
+   case CAM_BIN1X1MODE:
+   case CAM_8BITS:
+   case CAM_SINGLEFRAMEMODE:
+   case CAM_LIVEVIDEOMODE:
+      return QHYCCD_SUCCESS;
+   case CAM_BIN2X2MODE:
+      return available(m_model.maximumBin >= 2);
+   case CAM_BIN3X3MODE:
+      return available(m_model.maximumBin >= 3);
+   case CAM_BIN4X4MODE:
+      return available(m_model.maximumBin >= 4);
+   case CAM_16BITS:
+      return available(m_model.bitDepth == FullBitDepth);
+   case CAM_COLOR:
+      // The SDK answers with the BAYER_ID rather than QHYCCD_SUCCESS.
+      return m_model.bayerPattern == 0 ? QHYCCD_ERROR : m_model.bayerPattern;
+   case CONTROL_COOLER:
+   case CONTROL_CURTEMP:
+   case CONTROL_CURPWM:
+   case CONTROL_MANULPWM:
+   case CAM_CHIPTEMPERATURESENSOR_INTERFACE:
+      return available(m_model.supportsCooler);
+   default:
+      return QHYCCD_ERROR;
+   }
+}
+
+auto SimulatedCamera::setParameter(CONTROL_ID controlId, double value) -> quint32
+{
+   double minimum{ 0 };
+   double maximum{ 0 };
+   double step{ 0 };
+   if (parameterRange(controlId, &minimum, &maximum, &step) != QHYCCD_SUCCESS || value < minimum || value > maximum) {
+      return QHYCCD_ERROR;
+   }
+   std::lock_guard<std::mutex> locker(m_mutex);
+   switch (controlId) {
+   case CONTROL_GAIN:
+      m_gain = value;
+      break;
+   case CONTROL_OFFSET:
+      m_offset = value;
+      break;
+   case CONTROL_EXPOSURE:
+      m_exposureSeconds = value / MicrosecondsPerSecond;
+      break;
+   case CONTROL_SPEED:
+      m_speed = value;
+      break;
+   case CONTROL_TRANSFERBIT:
+      m_bitDepth = value > 8 ? FullBitDepth : 8;
+      break;
+   case CONTROL_USBTRAFFIC:
+      m_usbTraffic = value;
+      break;
+   case CONTROL_COOLER:
+      m_targetTemperature = value;
+      break;
+   default:
+      return QHYCCD_ERROR;
+   }
+   return QHYCCD_SUCCESS;
+}
+
+auto SimulatedCamera::parameter(CONTROL_ID controlId) const -> double
+{
+   std::lock_guard<std::mutex> locker(m_mutex);
+   if (m_unplugged) {
+      return QHYCCD_ERROR;
+   }
+   switch (controlId) {
+   case CONTROL_GAIN:
+      return m_gain;
+   case CONTROL_OFFSET:
+      return m_offset;
+   case CONTROL_EXPOSURE:
+      return m_exposureSeconds * MicrosecondsPerSecond;
+   case CONTROL_SPEED:
+      return m_speed;
+   case CONTROL_TRANSFERBIT:
+      return m_bitDepth;
+   case CONTROL_USBTRAFFIC:
+      return m_usbTraffic;
+   case CONTROL_COOLER:
+   case CONTROL_CURTEMP:
+      return m_model.supportsCooler ? m_targetTemperature : AmbientTemperature;
+   case CONTROL_CURPWM:
+      return 0;
+   default:
+      return QHYCCD_ERROR;
+   }
+}
+
+auto SimulatedCamera::parameterRange(CONTROL_ID controlId, double * minimum, double * maximum, double * step) const
+  -> quint32
+{
+   if (isControlAvailable(controlId) != QHYCCD_SUCCESS) {
+      return QHYCCD_ERROR;
+   }
+   auto setRange = [minimum, maximum, step](double rangeMinimum, double rangeMaximum, double rangeStep) -> quint32 {
+      *minimum = rangeMinimum;
+      *maximum = rangeMaximum;
+      *step    = rangeStep;
+      return QHYCCD_SUCCESS;
+   };
+   switch (controlId) {
+   case CONTROL_GAIN:
+      return setRange(m_model.gainMinimum, m_model.gainMaximum, m_model.gainStep);
+   case CONTROL_OFFSET:
+      return setRange(m_model.offsetMinimum, m_model.offsetMaximum, m_model.offsetStep);
+   case CONTROL_EXPOSURE:
+      return setRange(1, MaximumExposure, 1);
+   case CONTROL_SPEED:
+      return setRange(0, 2, 1);
+   case CONTROL_TRANSFERBIT:
+      return setRange(8, m_model.bitDepth, 8);
+   case CONTROL_USBTRAFFIC:
+      return setRange(m_model.usbTrafficMinimum, m_model.usbTrafficMaximum, 1);
+   case CONTROL_COOLER:
+      return setRange(-50, AmbientTemperature, 0.5);
+   default:
+      return QHYCCD_ERROR;
+   }
+}
+
+auto SimulatedCamera::setResolution(quint32 x, quint32 y, quint32 width, quint32 height) -> quint32
+{
+   std::lock_guard<std::mutex> locker(m_mutex);
+   if (m_unplugged || m_live || m_exposing || width == 0 || height == 0 || x + width > m_model.width / m_bin ||
+       y + height > m_model.height / m_bin) {
+      return QHYCCD_ERROR;
+   }
+   m_region = Region{ x, y, width, height };
+   return QHYCCD_SUCCESS;
+}
+
+auto SimulatedCamera::setBinMode(quint32 horizontalBin, quint32 verticalBin) -> quint32
+{
+   std::lock_guard<std::mutex> locker(m_mutex);
+   if (m_unplugged || m_live || m_exposing || horizontalBin != verticalBin || horizontalBin < 1 ||
+       horizontalBin > m_model.maximumBin) {
+      return QHYCCD_ERROR;
+   }
+   m_bin = horizontalBin;
+   resetGeometry();
+   return QHYCCD_SUCCESS;
+}
+
+auto SimulatedCamera::setBitsMode(quint32 bits) -> quint32
+{
+   return setParameter(CONTROL_TRANSFERBIT, bits);
+}
+
+auto SimulatedCamera::memoryLength() const -> quint32
+{
+   return m_model.width * m_model.height * (m_model.bitDepth / 8);
+}
+
+auto SimulatedCamera::exposeSingleFrame() -> quint32
+{
+   std::lock_guard<std::mutex> locker(m_mutex);
+   if (m_unplugged || m_streamMode != 0 || m_exposing) {
+      return QHYCCD_ERROR;
+   }
+   m_exposureStart   = Clock::now();
+   m_exposing        = true;
+   m_cancelRequested = false;
+   return QHYCCD_SUCCESS;
+}
+
+auto SimulatedCamera::singleFrame(quint32 * width, quint32 * height, quint32 * bpp, quint32 * channels, quint8 * pixels)
+  -> quint32
+{
+   std::unique_lock<std::mutex> locker(m_mutex);
+   if (m_unplugged || !m_exposing) {
+      return QHYCCD_ERROR;
+   }
+   auto readoutSeconds = m_exposureSeconds + m_model.readoutLatency * transferScale();
+   auto readoutDone    = m_exposureStart + std::chrono::duration_cast<Clock::duration>(
+                                          std::chrono::duration<double>(readoutSeconds));
+   m_cancelled.wait_until(locker, readoutDone, [this] { return m_cancelRequested || m_unplugged; });
+   m_exposing = false;
+   if (m_cancelRequested || m_unplugged) {
+      return QHYCCD_ERROR;
+   }
+   renderFrame(m_exposureSeconds, pixels);
+   returnGeometry(width, height, bpp, channels);
+   if (m_usbTraffic < m_model.unstableTraffic && nextRandom() % TruncationInterval == 0) {
+      // The transfer came up short; the rows it never delivered are left black.
+      auto rowLength   = static_cast<qint64>(m_region.width) * (m_bitDepth / 8);
+      auto deliveredTo = static_cast<qint64>(nextRandom() % m_region.height);
+      std::fill(pixels + deliveredTo * rowLength, pixels + static_cast<qint64>(m_region.height) * rowLength, 0);
+   }
+   return QHYCCD_SUCCESS;
+}
+
+auto SimulatedCamera::cancelExposingAndReadout() -> quint32
+{
+   std::lock_guard<std::mutex> locker(m_mutex);
+   m_cancelRequested = true;
+   m_cancelled.notify_all();
+   return QHYCCD_SUCCESS;
+}
+
+auto SimulatedCamera::beginLive() -> quint32
+{
+   std::lock_guard<std::mutex> locker(m_mutex);
+   if (m_unplugged || m_streamMode != 1 || m_live) {
+      return QHYCCD_ERROR;
+   }
+   m_live          = true;
+   m_liveNextFrame = Clock::now() + livePeriod();
+   return QHYCCD_SUCCESS;
+}
+
+auto SimulatedCamera::liveFrame(quint32 * width, quint32 * height, quint32 * bpp, quint32 * channels, quint8 * pixels)
+  -> quint32
+{
+   std::lock_guard<std::mutex> locker(m_mutex);
+   auto                        now = Clock::now();
+   if (m_unplugged || !m_live || now < m_liveNextFrame) {
+      return QHYCCD_ERROR;
+   }
+   // Frames the host did not collect in time are gone; the next one is the first to finish after now.
+   auto period  = livePeriod();
+   auto missed  = (now - m_liveNextFrame) / period;
+   m_liveNextFrame += (missed + 1) * period;
+
+   renderFrame(m_exposureSeconds, pixels);
+   returnGeometry(width, height, bpp, channels);
+   if (m_usbTraffic < m_model.unstableTraffic && nextRandom() % TruncationInterval == 0) {
+      // The transfer came up short; the rows it never delivered are left black.
+      auto rowLength   = static_cast<qint64>(m_region.width) * (m_bitDepth / 8);
+      auto deliveredTo = static_cast<qint64>(nextRandom() % m_region.height);
+      std::fill(pixels + deliveredTo * rowLength, pixels + static_cast<qint64>(m_region.height) * rowLength, 0);
+   }
+   return QHYCCD_SUCCESS;
+}
+
+auto SimulatedCamera::stopLive() -> quint32
+{
+   std::lock_guard<std::mutex> locker(m_mutex);
+   m_live = false;
+   return QHYCCD_SUCCESS;
+}
+
+auto SimulatedCamera::chipInfo(double *  chipWidth,
+                               double *  chipHeight,
+                               quint32 * imageWidth,
+                               quint32 * imageHeight,
+                               double *  pixelWidth,
+                               double *  pixelHeight,
+                               quint32 * bpp) const -> quint32
+{
+   std::lock_guard<std::mutex> locker(m_mutex);
+   if (m_unplugged) {
+      return QHYCCD_ERROR;
+   }
+   constexpr double MicronsPerMillimetre = 1000.0;
+   *chipWidth                            = m_model.width * m_model.pixelWidth / MicronsPerMillimetre;
+   *chipHeight                           = m_model.height * m_model.pixelHeight / MicronsPerMillimetre;
+   *imageWidth                           = m_model.width;
+   *imageHeight                          = m_model.height;
+   *pixelWidth                           = m_model.pixelWidth;
+   *pixelHeight                          = m_model.pixelHeight;
+   *bpp                                  = m_bitDepth;
+   return QHYCCD_SUCCESS;
+}
+
+auto SimulatedCamera::firmwareVersion(quint8 * buffer) const -> quint32
+{
+   // Packed as the hardware does: the year, less 2016, & the month share the first byte; the day is the second.
+   buffer[0] = static_cast<quint8>((5U << 4U) | 6U);
+   buffer[1] = 1;
+   return QHYCCD_SUCCESS;
+}
+
+auto SimulatedCamera::fpgaVersion(quint8 index, quint8 * buffer) const -> quint32
+{
+   if (index > 1) {
+      return QHYCCD_ERROR;
+   }
+   buffer[0] = 21; // NOLINT
+   buffer[1] = 6;  // NOLINT
+   buffer[2] = 1;
+   buffer[3] = index;
+   return QHYCCD_SUCCESS;
+}
+
+auto SimulatedCamera::readModeCount() const -> quint32
+{
+   return static_cast<quint32>(m_model.readModes.size());
+}
+
+auto SimulatedCamera::readModeName(quint32 readMode, char * name) const -> quint32
+{
+   if (readMode >= readModeCount()) {
+      return QHYCCD_ERROR;
+   }
+   qstrcpy(name, m_model.readModes.at(static_cast<int>(readMode)).toLatin1().constData());
+   return QHYCCD_SUCCESS;
+}
+
+auto SimulatedCamera::setReadMode(quint32 readMode) -> quint32
+{
+   std::lock_guard<std::mutex> locker(m_mutex);
+   if (m_unplugged || readMode >= readModeCount() || m_live || m_exposing) {
+      return QHYCCD_ERROR;
+   }
+   m_readMode = readMode;
+   return QHYCCD_SUCCESS;
+}
+
+auto SimulatedCamera::readMode() const -> quint32
+{
+   std::lock_guard<std::mutex> locker(m_mutex);
+   return m_readMode;
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Private methods; the callers hold m_mutex.
+/* ***************************************************************************************************************** */
+auto SimulatedCamera::gainFactor() const -> double
+{
+   auto gainRange = m_model.gainMaximum - m_model.gainMinimum;
+   if (gainRange <= 0) {
+      return 1.0;
+   }
+   return 1.0 + (MaximumGainFactor - 1.0) * (m_gain - m_model.gainMinimum) / gainRange;
+}
+
+auto SimulatedCamera::livePeriod() const -> Clock::duration
+{
+   auto seconds = std::max(m_exposureSeconds, transferScale() / m_model.frameRate);
+   return std::max(Clock::duration(1), std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds)));
+}
+
+auto SimulatedCamera::nextRandom() -> quint64
+{
+   return splitMix(m_randomState);
+}
+
+auto SimulatedCamera::transferScale() const -> double
+{
+   // Relative to a full frame at the model's bit depth, with USB traffic 0 and low speed.
+   auto trafficScale = m_model.usbTrafficMaximum > 0 ? 1.0 + m_usbTraffic / m_model.usbTrafficMaximum : 1.0;
+   auto regionScale  = static_cast<double>(m_region.width) * m_region.height * m_bin * m_bin /
+                      (static_cast<double>(m_model.width) * m_model.height);
+   auto depthScale = static_cast<double>(m_bitDepth) / m_model.bitDepth;
+   return trafficScale * regionScale * depthScale / (1.0 + m_speed);
+}
+
+void SimulatedCamera::renderFrame(double exposureSeconds, quint8 * pixels)
+{
+   if (m_bitDepth == FullBitDepth) {
+      renderSamples(exposureSeconds, reinterpret_cast<quint16 *>(pixels), 1.0); // NOLINT: frame buffers are aligned
+   } else {
+      renderSamples(exposureSeconds, pixels, 1.0 / 256.0);
+   }
+}
+
+template<typename Sample>
+void SimulatedCamera::renderSamples(double exposureSeconds, Sample * samples, double scale)
+{
+   constexpr auto maximumValue = static_cast<double>(std::numeric_limits<Sample>::max());
+   const auto     bin          = static_cast<double>(m_bin);
+   const auto     gain         = gainFactor();
+   const auto     sky          = m_model.skyBackground * exposureSeconds * gain * bin * bin;
+   const auto     noiseSigma   = std::sqrt(m_model.readNoise * m_model.readNoise + sky) * scale;
+   const auto     noiseMask    = static_cast<quint64>(m_noise.size() - 1);
+   // Binned pixels mix the colour sites, so only unbinned frames get the mosaic.
+   const auto     weights      = siteWeights(m_bin == 1 ? m_model.bayerPattern : 0);
+
+   std::array<double, 4> levels{};
+   for (size_t site = 0; site < levels.size(); ++site) {
+      levels[site] = (BiasLevel + m_offset * BiasPerOffset + sky * weights[site]) * scale;
+   }
+
+   for (quint32 row = 0; row < m_region.height; ++row) {
+      auto *     line       = samples + static_cast<size_t>(row) * m_region.width;
+      auto       noiseIndex = nextRandom();
+      const auto siteRow    = ((m_region.y + row) & 1U) * 2U;
+      for (quint32 column = 0; column < m_region.width; ++column) {
+         auto level = levels[siteRow + ((m_region.x + column) & 1U)];
+         auto noise = static_cast<double>(m_noise[static_cast<int>((noiseIndex + column) & noiseMask)]);
+         line[column] = static_cast<Sample>(std::clamp(level + noiseSigma * noise, 0.0, maximumValue));
+      }
+   }
+
+   const auto sigma         = m_model.fwhm / FwhmPerSigma / bin;
+   const auto radius        = static_cast<int>(std::ceil(StarRadiusSigmas * sigma));
+   const auto normalization = exposureSeconds * gain * scale / (2.0 * Pi * sigma * sigma);
+   const auto ditherX       = (2.0 * unitRandom(m_randomState) - 1.0) * m_model.ditherPixels;
+   const auto ditherY       = (2.0 * unitRandom(m_randomState) - 1.0) * m_model.ditherPixels;
+   QVector<double> columnProfile(2 * radius + 1);
+   for (const auto & star : m_stars) {
+      auto centreX = (star.x + ditherX) / bin - m_region.x;
+      auto centreY = (star.y + ditherY) / bin - m_region.y;
+      auto left    = std::max(0, static_cast<int>(centreX) - radius);
+      auto right   = std::min(static_cast<int>(m_region.width) - 1, static_cast<int>(centreX) + radius);
+      auto top     = std::max(0, static_cast<int>(centreY) - radius);
+      auto bottom  = std::min(static_cast<int>(m_region.height) - 1, static_cast<int>(centreY) + radius);
+      if (left > right || top > bottom) {
+         continue;
+      }
+      for (int column = left; column <= right; ++column) {
+         auto distance                = column + 0.5 - centreX;
+         columnProfile[column - left] = std::exp(-distance * distance / (2.0 * sigma * sigma));
+      }
+      auto peak = star.flux * normalization;
+      for (int row = top; row <= bottom; ++row) {
+         auto       distance   = row + 0.5 - centreY;
+         auto       rowPeak    = peak * std::exp(-distance * distance / (2.0 * sigma * sigma));
+         auto *     line       = samples + static_cast<size_t>(row) * m_region.width;
+         const auto siteRow    = ((m_region.y + static_cast<quint32>(row)) & 1U) * 2U;
+         for (int column = left; column <= right; ++column) {
+            auto weight = weights[siteRow + ((m_region.x + static_cast<quint32>(column)) & 1U)];
+            auto value  = line[column] + rowPeak * columnProfile[column - left] * weight;
+            line[column] = static_cast<Sample>(std::min(value, maximumValue));
+         }
+      }
+   }
+}
+
+void SimulatedCamera::resetGeometry()
+{
+   m_region = Region{ 0, 0, m_model.width / m_bin, m_model.height / m_bin };
+}
+
+void SimulatedCamera::returnGeometry(quint32 * width, quint32 * height, quint32 * bpp, quint32 * channels) const
+{
+   *width    = m_region.width;
+   *height   = m_region.height;
+   *bpp      = m_bitDepth;
+   *channels = 1;
+}
@@ -0,0 +1,184 @@
+#pragma once
+
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <QByteArray>
+#include <QJsonObject>
+#include <QStringList>
+#include <QVector>
+
+#include <qhyccd.h>
+
+/*! \brief The description of a simulated camera: what the driver reports, and what the synthetic sky looks like.
+ *
+ * Defaults describe a small, fast, 16 bit monochrome camera.  Every field can be set from a JSON object whose keys are
+ * the field names; see fromJson().
+ */
+struct CameraModel
+{
+   QByteArray  id{ "QHYSIM-0001" };       // the id reported by GetQHYCCDId; the model is the text before the last '-'
+   quint32     width{ 1920 };             // sensor width, in pixels
+   quint32     height{ 1080 };            // sensor height, in pixels
+   double      pixelWidth{ 2.9 };         // microns
+   double      pixelHeight{ 2.9 };        // microns
+   quint32     bitDepth{ 16 };            // 8, or 16 when the camera can also transfer 16 bit frames
+   quint32     bayerPattern{ 0 };         // a BAYER_ID, or 0 for a monochrome sensor
+   quint32     maximumBin{ 4 };           // bin modes 1×1 through maximumBin×maximumBin are supported
+   QStringList readModes{ "Standard" };   // one entry per read mode; every mode has the full sensor geometry
+   double      gainMinimum{ 0 };
+   double      gainMaximum{ 100 };
+   double      gainStep{ 1 };
+   double      offsetMinimum{ 0 };
+   double      offsetMaximum{ 255 };
+   double      offsetStep{ 1 };
+   double      usbTrafficMinimum{ 0 };
+   double      usbTrafficMaximum{ 60 };
+   double      unstableTraffic{ 0 };      // live frames sent with less USB traffic are sometimes truncated
+   bool        supportsCooler{ false };
+   double      frameRate{ 30 };           // the fastest live view rate, in frames per second, at USB traffic 0
+   double      readoutLatency{ 0.25 };    // seconds to read out a single frame, at USB traffic 0
+   int         starCount{ 150 };
+   double      fwhm{ 3.5 };               // star size, in unbinned pixels
+   double      brightestStar{ 2.0e6 };    // total flux of the brightest star, in ADU per second at unity gain
+   double      skyBackground{ 200 };      // ADU per second per pixel at unity gain
+   double      readNoise{ 6 };            // ADU, 16 bit scale
+   double      ditherPixels{ 0 };         // each frame shifts the star field by up to this many pixels on each axis
+   quint32     seed{ 1 };                 // the star field is the same every run for the same seed
+
+   /*!
+    * Reads a model from JSON; keys that are missing keep their default.
+    *
+    * @param json the object to read.
+    * @return The model.
+    */
+   [[nodiscard]] static auto fromJson(const QJsonObject & json) -> CameraModel;
+};
+
+/*! \brief One simulated camera, implementing the per-handle half of the simulated driver.
+ *
+ * The methods match the SDK calls of the same name, and return the same status codes.  Frames are synthesized on
+ * readout: a sky background with read and shot noise, and a fixed field of Gaussian stars scaled by exposure and gain.
+ * Single frames take the exposure time plus the readout latency; live view frames arrive at the model's frame rate,
+ * and a frame the host does not collect in time is lost, as it is with the hardware.  Higher USB traffic values slow
+ * both down, and the high speed setting speeds them up; below the model's unstable traffic, some live frames arrive
+ * with their last rows black, as they do over a marginal hub or cable.  So tuning can be exercised.
+ *
+ * All methods are thread safe; a blocking readout can be cancelled from another thread.
+ */
+class SimulatedCamera
+{
+public:
+   explicit SimulatedCamera(CameraModel model);
+   SimulatedCamera(const SimulatedCamera &) = delete;
+   SimulatedCamera(SimulatedCamera &&)      = delete;
+   ~SimulatedCamera()                       = default;
+
+   auto               operator=(const SimulatedCamera &) -> SimulatedCamera & = delete;
+   auto               operator=(SimulatedCamera &&) -> SimulatedCamera & = delete;
+
+   [[nodiscard]] auto model() const -> const CameraModel &;
+
+   /*!
+    * Marks the camera as unplugged; every later call on an open handle fails, as it would with the hardware.
+    */
+   void               unplug();
+
+   auto               initialize() -> quint32;
+   auto               setStreamMode(quint8 mode) -> quint32;
+
+   [[nodiscard]] auto isControlAvailable(CONTROL_ID controlId) const -> quint32;
+   auto               setParameter(CONTROL_ID controlId, double value) -> quint32;
+   [[nodiscard]] auto parameter(CONTROL_ID controlId) const -> double;
+   [[nodiscard]] auto parameterRange(CONTROL_ID controlId, double * minimum, double * maximum, double * step) const
+     -> quint32;
+
+   auto               setResolution(quint32 x, quint32 y, quint32 width, quint32 height) -> quint32;
+   auto               setBinMode(quint32 horizontalBin, quint32 verticalBin) -> quint32;
+   auto               setBitsMode(quint32 bits) -> quint32;
+   [[nodiscard]] auto memoryLength() const -> quint32;
+
+   auto               exposeSingleFrame() -> quint32;
+   auto               singleFrame(quint32 * width, quint32 * height, quint32 * bpp, quint32 * channels, quint8 * pixels)
+     -> quint32;
+   auto               cancelExposingAndReadout() -> quint32;
+
+   auto               beginLive() -> quint32;
+   auto               liveFrame(quint32 * width, quint32 * height, quint32 * bpp, quint32 * channels, quint8 * pixels)
+     -> quint32;
+   auto               stopLive() -> quint32;
+
+   auto               chipInfo(double *  chipWidth,
+                               double *  chipHeight,
+                               quint32 * imageWidth,
+                               quint32 * imageHeight,
+                               double *  pixelWidth,
+                               double *  pixelHeight,
+                               quint32 * bpp) const -> quint32;
+   auto               firmwareVersion(quint8 * buffer) const -> quint32;
+   auto               fpgaVersion(quint8 index, quint8 * buffer) const -> quint32;
+
+   [[nodiscard]] auto readModeCount() const -> quint32;
+   auto               readModeName(quint32 readMode, char * name) const -> quint32;
+   auto               setReadMode(quint32 readMode) -> quint32;
+   [[nodiscard]] auto readMode() const -> quint32;
+
+private:
+   using Clock = std::chrono::steady_clock;
+
+   struct Star
+   {
+      double x;    // unbinned sensor pixels
+      double y;
+      double flux; // ADU per second at unity gain
+   };
+
+   struct Region
+   {
+      quint32 x;
+      quint32 y;
+      quint32 width;
+      quint32 height;
+   };
+
+   [[nodiscard]] auto gainFactor() const -> double;
+   [[nodiscard]] auto livePeriod() const -> Clock::duration;
+   [[nodiscard]] auto nextRandom() -> quint64;
+   [[nodiscard]] auto transferScale() const -> double;
+
+   void               renderFrame(double exposureSeconds, quint8 * pixels);
+   template<typename Sample>
+   void               renderSamples(double exposureSeconds, Sample * samples, double scale);
+   void               resetGeometry();
+   void               returnGeometry(quint32 * width, quint32 * height, quint32 * bpp, quint32 * channels) const;
+
+   const CameraModel       m_model;
+   QVector<Star>           m_stars;
+   QVector<float>          m_noise; // standard normal deviates, read from a random start for each row
+   mutable std::mutex      m_mutex;
+   std::condition_variable m_cancelled;
+   Region                  m_region;
+   Clock::time_point       m_exposureStart;
+   Clock::time_point       m_liveNextFrame;
+   quint64                 m_randomState;
+   double                  m_exposureSeconds;
+   double                  m_gain;
+   double                  m_offset;
+   double                  m_speed;
+   double                  m_targetTemperature;
+   double                  m_usbTraffic;
+   quint32                 m_bin;
+   quint32                 m_bitDepth;
+   quint32                 m_readMode;
+   quint8                  m_streamMode;
+   bool                    m_cancelRequested;
+   bool                    m_exposing;
+   bool                    m_live;
+   bool                    m_unplugged;
+};
@@ -0,0 +1,168 @@
+#pragma once
+
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+/*! \file
+ * The subset of the QHYCCD SDK's qhyccd.h that the application uses, implemented by the simulated driver.
+ *
+ * The names, signatures and enumerator values follow the SDK, so the application compiles unchanged against either.
+ * Only add to this file what the application actually calls.
+ */
+
+#include <stdint.h> // NOLINT(modernize-deprecated-headers): this header mirrors a C API
+
+#define QHYCCD_SUCCESS       0
+#define QHYCCD_ERROR         0xFFFFFFFF
+#define QHYCCD_READ_DIRECTLY 0x2001
+
+typedef void qhyccd_handle; // NOLINT(modernize-use-using)
+
+enum CONTROL_ID
+{
+   CONTROL_BRIGHTNESS = 0,
+   CONTROL_CONTRAST,
+   CONTROL_WBR,
+   CONTROL_WBB,
+   CONTROL_WBG,
+   CONTROL_GAMMA,
+   CONTROL_GAIN,
+   CONTROL_OFFSET,
+   CONTROL_EXPOSURE,
+   CONTROL_SPEED,
+   CONTROL_TRANSFERBIT,
+   CONTROL_CHANNELS,
+   CONTROL_USBTRAFFIC,
+   CONTROL_ROWNOISERE,
+   CONTROL_CURTEMP,
+   CONTROL_CURPWM,
+   CONTROL_MANULPWM,
+   CONTROL_CFWPORT,
+   CONTROL_COOLER,
+   CONTROL_ST4PORT,
+   CAM_COLOR,
+   CAM_BIN1X1MODE,
+   CAM_BIN2X2MODE,
+   CAM_BIN3X3MODE,
+   CAM_BIN4X4MODE,
+   CAM_MECHANICALSHUTTER,
+   CAM_TRIGER_INTERFACE,
+   CAM_TECOVERPROTECT_INTERFACE,
+   CAM_SINGNALCLAMP_INTERFACE,
+   CAM_FINETONE_INTERFACE,
+   CAM_SHUTTERMOTORHEATING_INTERFACE,
+   CAM_CALIBRATEFPN_INTERFACE,
+   CAM_CHIPTEMPERATURESENSOR_INTERFACE,
+   CAM_USBREADOUTSLOWEST_INTERFACE,
+   CAM_8BITS,
+   CAM_16BITS,
+   CAM_GPS,
+   CAM_IGNOREOVERSCAN_INTERFACE,
+   QHYCCD_3A_AUTOBALANCE,
+   QHYCCD_3A_AUTOEXPOSURE,
+   QHYCCD_3A_AUTOFOCUS,
+   CONTROL_AMPV,
+   CONTROL_VCAM,
+   CAM_VIEW_MODE,
+   CONTROL_CFWSLOTSNUM,
+   IS_EXPOSING_DONE,
+   ScreenStretchB,
+   ScreenStretchW,
+   CONTROL_DDR,
+   CAM_LIGHT_PERFORMANCE_MODE,
+   CAM_QHY5II_GUIDE_MODE,
+   DDR_BUFFER_CAPACITY,
+   DDR_BUFFER_READ_THRESHOLD,
+   DefaultGain,
+   DefaultOffset,
+   OutputDataActualBits,
+   OutputDataAlignment,
+   CAM_SINGLEFRAMEMODE,
+   CAM_LIVEVIDEOMODE,
+   CAM_IS_COLOR,
+   hasHardwareFrameCounter,
+   CONTROL_MAX_ID_Error,
+   CAM_HUMIDITY,
+   CAM_PRESSURE,
+   CONTROL_VACUUM_PUMP,
+   CONTROL_SensorChamberCycle_PUMP,
+   CONTROL_MAX_ID
+};
+
+enum BAYER_ID
+{
+   BAYER_GB = 1,
+   BAYER_GR,
+   BAYER_BG,
+   BAYER_RG
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint32_t        InitQHYCCDResource(void);
+uint32_t        ReleaseQHYCCDResource(void);
+uint32_t        ScanQHYCCD(void);
+uint32_t        GetQHYCCDId(uint32_t index, char * id);
+uint32_t        GetQHYCCDModel(char * id, char * model);
+
+qhyccd_handle * OpenQHYCCD(char * id);
+uint32_t        CloseQHYCCD(qhyccd_handle * handle);
+uint32_t        SetQHYCCDStreamMode(qhyccd_handle * handle, uint8_t mode);
+uint32_t        InitQHYCCD(qhyccd_handle * handle);
+
+uint32_t        IsQHYCCDControlAvailable(qhyccd_handle * handle, enum CONTROL_ID controlId);
+uint32_t        SetQHYCCDParam(qhyccd_handle * handle, enum CONTROL_ID controlId, double value);
+double          GetQHYCCDParam(qhyccd_handle * handle, enum CONTROL_ID controlId);
+uint32_t        GetQHYCCDParamMinMaxStep(qhyccd_handle * handle,
+                                         enum CONTROL_ID controlId,
+                                         double *        min,
+                                         double *        max,
+                                         double *        step);
+
+uint32_t        SetQHYCCDResolution(qhyccd_handle * handle, uint32_t x, uint32_t y, uint32_t xsize, uint32_t ysize);
+uint32_t        SetQHYCCDBinMode(qhyccd_handle * handle, uint32_t wbin, uint32_t hbin);
+uint32_t        SetQHYCCDBitsMode(qhyccd_handle * handle, uint32_t bits);
+uint32_t        GetQHYCCDMemLength(qhyccd_handle * handle);
+
+uint32_t        ExpQHYCCDSingleFrame(qhyccd_handle * handle);
+uint32_t        GetQHYCCDSingleFrame(qhyccd_handle * handle,
+                                     uint32_t *      w,
+                                     uint32_t *      h,
+                                     uint32_t *      bpp,
+                                     uint32_t *      channels,
+                                     uint8_t *       imgdata);
+uint32_t        CancelQHYCCDExposingAndReadout(qhyccd_handle * handle);
+
+uint32_t        BeginQHYCCDLive(qhyccd_handle * handle);
+uint32_t        GetQHYCCDLiveFrame(qhyccd_handle * handle,
+                                   uint32_t *      w,
+                                   uint32_t *      h,
+                                   uint32_t *      bpp,
+                                   uint32_t *      channels,
+                                   uint8_t *       imgdata);
+uint32_t        StopQHYCCDLive(qhyccd_handle * handle);
+
+uint32_t        GetQHYCCDChipInfo(qhyccd_handle * handle,
+                                  double *        chipw,
+                                  double *        chiph,
+                                  uint32_t *      imagew,
+                                  uint32_t *      imageh,
+                                  double *        pixelw,
+                                  double *        pixelh,
+                                  uint32_t *      bpp);
+uint32_t        GetQHYCCDFWVersion(qhyccd_handle * handle, uint8_t * buf);
+uint32_t        GetQHYCCDFPGAVersion(qhyccd_handle * handle, uint8_t fpga_index, uint8_t * buf);
+
+uint32_t        GetQHYCCDNumberOfReadModes(qhyccd_handle * handle, uint32_t * numModes);
+uint32_t        GetQHYCCDReadModeName(qhyccd_handle * handle, uint32_t modeNumber, char * name);
+uint32_t        SetQHYCCDReadMode(qhyccd_handle * handle, uint32_t modeNumber);
+uint32_t        GetQHYCCDReadMode(qhyccd_handle * handle, uint32_t * modeNumber);
+
+#ifdef __cplusplus
+}
+#endif
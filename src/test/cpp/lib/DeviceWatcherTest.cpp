@@ -0,0 +1,189 @@
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "DeviceWatcher.hpp"
+
+#include <atomic>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QtTest>
+
+/*! \brief Plugs & unplugs cameras behind a DeviceWatcher, through a scanner the test controls.
+ *
+ * The watcher scans on its own thread and emits from there, so its signals are collected through queued connections
+ * to the test object, and every check waits for the scan it started to finish.
+ */
+class DeviceWatcherTest : public QObject
+{
+   Q_OBJECT
+
+private slots:
+   void init();
+   void changedCamerasAreReported();
+   void firstScanAddsEveryCamera();
+   void noScanWhileCameraIsOpen();
+   void unchangedScanIsSilent();
+   void unpluggedCameraIsRemoved();
+
+private:
+   [[nodiscard]] auto scanner() -> DeviceWatcher::Scanner;
+   void               plugIn(const QStringList & cameras);
+   void               watch(DeviceWatcher & watcher);
+   [[nodiscard]] auto waitForScan(DeviceWatcher & watcher) -> bool;
+
+   QMutex             m_attachedMutex;
+   QStringList        m_attached;
+   std::atomic<int>   m_scans{ 0 };
+   QStringList        m_added;
+   QStringList        m_removed;
+   QList<QStringList> m_changed;
+};
+
+/* ***************************************************************************************************************** */
+// MARK: - Tests
+/* ***************************************************************************************************************** */
+void DeviceWatcherTest::init()
+{
+   plugIn(QStringList());
+   m_scans = 0;
+   m_added.clear();
+   m_removed.clear();
+   m_changed.clear();
+}
+
+void DeviceWatcherTest::changedCamerasAreReported()
+{
+   DeviceWatcher watcher(scanner());
+   watch(watcher);
+   plugIn({ "QHY600M-0001" });
+   QVERIFY(waitForScan(watcher));
+
+   plugIn({ "QHY268C-0002", "QHY5III462C-0003" });
+   QVERIFY(waitForScan(watcher));
+   QTRY_COMPARE(m_changed.count(), 2);
+   QCOMPARE(m_removed, QStringList({ "QHY600M-0001" }));
+   QCOMPARE(m_added, QStringList({ "QHY600M-0001", "QHY268C-0002", "QHY5III462C-0003" }));
+   QCOMPARE(watcher.cameras(), QStringList({ "QHY268C-0002", "QHY5III462C-0003" }));
+}
+
+void DeviceWatcherTest::firstScanAddsEveryCamera()
+{
+   DeviceWatcher watcher(scanner());
+   watch(watcher);
+   QVERIFY(watcher.cameras().isEmpty());
+
+   // Added in the order the driver lists them, not sorted.
+   plugIn({ "QHY600M-0001", "QHY268C-0002" });
+   watcher.start();
+   QTRY_COMPARE(m_changed.count(), 1);
+   watcher.stop();
+   QCOMPARE(m_added, QStringList({ "QHY600M-0001", "QHY268C-0002" }));
+   QVERIFY(m_removed.isEmpty());
+   QCOMPARE(m_changed.first(), QStringList({ "QHY600M-0001", "QHY268C-0002" }));
+   QCOMPARE(watcher.cameras(), m_changed.first());
+}
+
+void DeviceWatcherTest::noScanWhileCameraIsOpen()
+{
+   DeviceWatcher watcher(scanner());
+   watch(watcher);
+   plugIn({ "QHY600M-0001" });
+   QVERIFY(waitForScan(watcher));
+
+   // Any non-null handle will do; the driver is never called.
+   int  camera{ 0 };
+   auto handle = DeviceWatcher::openCamera([&camera]() { return &camera; });
+   QCOMPARE(handle, static_cast<void *>(&camera));
+   plugIn({ "QHY600M-0001", "QHY268C-0002" });
+   const int scans = m_scans;
+   watcher.rescan();
+   QTest::qWait(100);
+   QCOMPARE(int(m_scans), scans);
+   QCOMPARE(watcher.cameras(), QStringList({ "QHY600M-0001" }));
+
+   QVERIFY(DeviceWatcher::closeCamera([]() { return true; }));
+   QVERIFY(waitForScan(watcher));
+   QTRY_COMPARE(watcher.cameras(), QStringList({ "QHY600M-0001", "QHY268C-0002" }));
+}
+
+void DeviceWatcherTest::unchangedScanIsSilent()
+{
+   DeviceWatcher watcher(scanner());
+   watch(watcher);
+   plugIn({ "QHY600M-0001" });
+   QVERIFY(waitForScan(watcher));
+   QVERIFY(waitForScan(watcher));
+
+   // Signals are delivered in order, so once the next change arrives, nothing from the idle scan can still be queued.
+   plugIn({ "QHY600M-0001", "QHY268C-0002" });
+   QVERIFY(waitForScan(watcher));
+   QTRY_COMPARE(m_changed.count(), 2);
+   QCOMPARE(m_added, QStringList({ "QHY600M-0001", "QHY268C-0002" }));
+   QVERIFY(m_removed.isEmpty());
+}
+
+void DeviceWatcherTest::unpluggedCameraIsRemoved()
+{
+   DeviceWatcher watcher(scanner());
+   watch(watcher);
+   plugIn({ "QHY600M-0001", "QHY268C-0002" });
+   QVERIFY(waitForScan(watcher));
+
+   plugIn({ "QHY268C-0002" });
+   QVERIFY(waitForScan(watcher));
+   QTRY_COMPARE(m_removed, QStringList({ "QHY600M-0001" }));
+   QTRY_COMPARE(m_changed.count(), 2);
+   QCOMPARE(m_added.count(), 2);
+   QCOMPARE(m_changed.last(), QStringList({ "QHY268C-0002" }));
+
+   plugIn(QStringList());
+   QVERIFY(waitForScan(watcher));
+   QTRY_COMPARE(m_removed, QStringList({ "QHY600M-0001", "QHY268C-0002" }));
+   QTRY_COMPARE(m_changed.count(), 3);
+   QVERIFY(m_changed.last().isEmpty());
+   QVERIFY(watcher.cameras().isEmpty());
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Private methods
+/* ***************************************************************************************************************** */
+void DeviceWatcherTest::plugIn(const QStringList & cameras)
+{
+   QMutexLocker locker(&m_attachedMutex);
+   m_attached = cameras;
+}
+
+auto DeviceWatcherTest::scanner() -> DeviceWatcher::Scanner
+{
+   return [this]() {
+      QMutexLocker locker(&m_attachedMutex);
+      ++m_scans;
+      return m_attached;
+   };
+}
+
+auto DeviceWatcherTest::waitForScan(DeviceWatcher & watcher) -> bool
+{
+   // A rescan asked for while one is queued is dropped, so each waits for the last to have started.
+   const int scans = m_scans;
+   watcher.rescan();
+   return QTest::qWaitFor([this, scans]() { return m_scans > scans; });
+}
+
+void DeviceWatcherTest::watch(DeviceWatcher & watcher)
+{
+   QObject::connect(&watcher, &DeviceWatcher::cameraAdded, this, [this](const QString & id) { m_added.append(id); });
+   QObject::connect(
+     &watcher, &DeviceWatcher::cameraRemoved, this, [this](const QString & id) { m_removed.append(id); });
+   QObject::connect(&watcher,
+                    &DeviceWatcher::camerasChanged,
+                    this,
+                    [this](const QStringList & cameras) { m_changed.append(cameras); });
+}
+
+QTEST_GUILESS_MAIN(DeviceWatcherTest)
+
+#include "DeviceWatcherTest.moc"
@@ -0,0 +1,209 @@
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "DefectMap.hpp"
+#include "FramePool.hpp"
+#include "FrameRing.hpp"
+
+#include <algorithm>
+#include <QtTest>
+
+namespace
+{
+constexpr qint64 BufferLength = 4096;
+constexpr int    PoolBuffers  = 8;
+} // namespace
+
+/*! \brief Publishes into a FrameRing from the test thread, and checks what consumers get back.
+ */
+class FrameRingTest : public QObject
+{
+   Q_OBJECT
+
+private slots:
+   void abortedWriteIsNotPublished();
+   void consumedFramesAreNotCountedAsOverwritten();
+   void copiedFrameKeepsItsBuffer();
+   void defectsAreCorrectedOnLease();
+   void emptyRingLeasesNothing();
+   void leasedSlotIsSkipped();
+   void nextWalksInOrder();
+   void pinnedRingRefusesWrites();
+   void unreadFramesAreOverwritten();
+
+private:
+   static auto publish(FrameRing & ring) -> quint64;
+};
+
+/* ***************************************************************************************************************** */
+// MARK: - Tests
+/* ***************************************************************************************************************** */
+void FrameRingTest::abortedWriteIsNotPublished()
+{
+   FrameRing ring(3, FramePool::create(BufferLength, PoolBuffers));
+   QVERIFY(ring.beginWrite() != nullptr);
+   ring.abortWrite();
+   QCOMPARE(ring.publishedFrames(), Q_UINT64_C(0));
+   QVERIFY(!ring.latest().isValid());
+   QCOMPARE(publish(ring), Q_UINT64_C(1));
+}
+
+void FrameRingTest::consumedFramesAreNotCountedAsOverwritten()
+{
+   FrameRing ring(2, FramePool::create(BufferLength, PoolBuffers));
+   publish(ring);
+   QVERIFY(ring.next(0).isValid());
+   publish(ring);
+   publish(ring);
+   QCOMPARE(ring.overwrittenFrames(), Q_UINT64_C(0));
+   publish(ring);
+   QCOMPARE(ring.overwrittenFrames(), Q_UINT64_C(1));
+}
+
+void FrameRingTest::copiedFrameKeepsItsBuffer()
+{
+   auto      pool = FramePool::create(BufferLength, PoolBuffers);
+   FrameRing ring(2, pool);
+   publish(ring);
+   Frame kept;
+   {
+      auto lease = ring.latest();
+      QVERIFY(lease.isValid());
+      kept = lease.frame();
+   }
+   const auto * keptPixels = kept.constData();
+
+   // The slot holding the kept frame is re-used without touching its pixels; it draws a fresh buffer instead.
+   publish(ring);
+   publish(ring);
+   QCOMPARE(kept.sequence(), Q_UINT64_C(1));
+   QCOMPARE(kept.constData()[0], quint8{ 1 });
+   auto lease = ring.latest();
+   QCOMPARE(lease.frame().sequence(), Q_UINT64_C(3));
+   QVERIFY(lease.frame().constData() != keptPixels);
+   QCOMPARE(pool->allocatedBuffers(), 3);
+}
+
+void FrameRingTest::defectsAreCorrectedOnLease()
+{
+   // A flat 4 × 4 frame with one hot pixel, at (1, 1).
+   FrameRing ring(2, FramePool::create(BufferLength, PoolBuffers));
+   auto *    frame = ring.beginWrite();
+   QVERIFY(frame != nullptr);
+   frame->setGeometry(4, 4, 8, 1);
+   std::fill(frame->data(), frame->data() + frame->length(), quint8{ 10 });
+   frame->data()[5] = 200;
+   frame->setDefectMap(DefectMap::fromPixels(4, 4, 1, Frame::Monochrome, { 5 }));
+   ring.commitWrite();
+   QCOMPARE(frame->constData()[5], quint8{ 200 });
+
+   // Publishing leaves the pixels as read; the first lease corrects them.
+   auto lease = ring.latest();
+   QCOMPARE(lease.frame().constData()[5], quint8{ 10 });
+   auto again = ring.next(0);
+   QCOMPARE(again.frame().constData()[5], quint8{ 10 });
+   QCOMPARE(*std::max_element(again.frame().constData(), again.frame().constData() + 16), quint8{ 10 });
+}
+
+void FrameRingTest::emptyRingLeasesNothing()
+{
+   FrameRing ring(3, FramePool::create(BufferLength, PoolBuffers));
+   QVERIFY(!ring.latest().isValid());
+   QVERIFY(!ring.next(0).isValid());
+   QVERIFY(ring.latest().frame().isNull());
+}
+
+void FrameRingTest::leasedSlotIsSkipped()
+{
+   FrameRing ring(3, FramePool::create(BufferLength, PoolBuffers));
+   publish(ring);
+   publish(ring);
+   publish(ring);
+   auto oldest = ring.next(0);
+   QCOMPARE(oldest.frame().sequence(), Q_UINT64_C(1));
+
+   // Frames 2 & 3 go first, then 4, while the pinned frame 1 is left alone.
+   publish(ring);
+   publish(ring);
+   publish(ring);
+   QCOMPARE(oldest.frame().sequence(), Q_UINT64_C(1));
+   QCOMPARE(oldest.frame().constData()[0], quint8{ 1 });
+   QCOMPARE(ring.overwrittenFrames(), Q_UINT64_C(3));
+   QCOMPARE(ring.next(1).frame().sequence(), Q_UINT64_C(5));
+
+   oldest.release();
+   QVERIFY(!oldest.isValid());
+   publish(ring);
+   QCOMPARE(ring.next(0).frame().sequence(), Q_UINT64_C(5));
+}
+
+void FrameRingTest::nextWalksInOrder()
+{
+   FrameRing ring(4, FramePool::create(BufferLength, PoolBuffers));
+   publish(ring);
+   publish(ring);
+   publish(ring);
+   quint64 seen = 0;
+   for (quint64 expected = 1; expected <= 3; ++expected) {
+      auto lease = ring.next(seen);
+      QVERIFY(lease.isValid());
+      QCOMPARE(lease.frame().sequence(), expected);
+      seen = lease.frame().sequence();
+   }
+   QVERIFY(!ring.next(seen).isValid());
+   QCOMPARE(ring.latest().frame().sequence(), Q_UINT64_C(3));
+}
+
+void FrameRingTest::pinnedRingRefusesWrites()
+{
+   FrameRing ring(2, FramePool::create(BufferLength, PoolBuffers));
+   publish(ring);
+   publish(ring);
+   auto first  = ring.next(0);
+   auto second = ring.next(1);
+   QVERIFY(first.isValid() && second.isValid());
+
+   // Several consumers may pin the same frame; the slot is free only once they all let go.
+   auto again = ring.latest();
+   QCOMPARE(again.frame().sequence(), Q_UINT64_C(2));
+   QVERIFY(ring.beginWrite() == nullptr);
+   second.release();
+   QVERIFY(ring.beginWrite() == nullptr);
+   again.release();
+   QVERIFY(ring.beginWrite() != nullptr);
+   QCOMPARE(ring.commitWrite(), Q_UINT64_C(3));
+   QCOMPARE(first.frame().sequence(), Q_UINT64_C(1));
+}
+
+void FrameRingTest::unreadFramesAreOverwritten()
+{
+   FrameRing ring(3, FramePool::create(BufferLength, PoolBuffers));
+   for (int frame = 0; frame < 5; ++frame) {
+      publish(ring);
+   }
+   QCOMPARE(ring.publishedFrames(), Q_UINT64_C(5));
+   QCOMPARE(ring.overwrittenFrames(), Q_UINT64_C(2));
+   QCOMPARE(ring.next(0).frame().sequence(), Q_UINT64_C(3));
+   QCOMPARE(ring.latest().frame().sequence(), Q_UINT64_C(5));
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Private methods
+/* ***************************************************************************************************************** */
+auto FrameRingTest::publish(FrameRing & ring) -> quint64
+{
+   auto * frame = ring.beginWrite();
+   if (frame == nullptr) {
+      return 0;
+   }
+   // Marks the pixels with the sequence number the frame is about to get, so a re-used buffer shows.
+   frame->data()[0] = static_cast<quint8>(ring.publishedFrames() + 1);
+   return ring.commitWrite();
+}
+
+QTEST_GUILESS_MAIN(FrameRingTest)
+
+#include "FrameRingTest.moc"
@@ -0,0 +1,144 @@
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "FrameStatistics.hpp"
+#include "Histogram.hpp"
+
+#include <cmath>
+#include <QVector>
+#include <QtTest>
+
+/*! \brief Measures histograms whose statistics are known exactly.
+ */
+class FrameStatisticsTest : public QObject
+{
+   Q_OBJECT
+
+private slots:
+   void constantSamples();
+   void emptyHistogramIsInvalid();
+   void eightBitSaturation();
+   void evenCountTakesTheLowerMedian();
+   void sigmaClipRejectsHotPixels();
+   void uniformSamples();
+};
+
+/* ***************************************************************************************************************** */
+// MARK: - Tests
+/* ***************************************************************************************************************** */
+void FrameStatisticsTest::constantSamples()
+{
+   QVector<quint16> samples(1000, 100);
+   Histogram        histogram;
+   histogram.compute(samples.constData(), samples.count());
+
+   const auto statistics = FrameStatistics::measure(histogram);
+   QVERIFY(statistics.isValid());
+   QCOMPARE(statistics.count, Q_UINT64_C(1000));
+   QCOMPARE(statistics.minimum, 100);
+   QCOMPARE(statistics.maximum, 100);
+   QCOMPARE(statistics.mean, 100.0);
+   QCOMPARE(statistics.median, 100);
+   QCOMPARE(statistics.standardDeviation, 0.0);
+   QCOMPARE(statistics.background, 100.0);
+   QCOMPARE(statistics.noise, 0.0);
+   QCOMPARE(statistics.saturated, Q_UINT64_C(0));
+}
+
+void FrameStatisticsTest::emptyHistogramIsInvalid()
+{
+   QVERIFY(!FrameStatistics::measure(Histogram()).isValid());
+   QVERIFY(!FrameStatistics().isValid());
+}
+
+void FrameStatisticsTest::eightBitSaturation()
+{
+   // 90 samples at 10, and 10 clipped at the top of the 8 bit range.
+   QVector<quint8> samples(100, 10);
+   std::fill(samples.end() - 10, samples.end(), quint8{ 255 });
+   Histogram histogram;
+   histogram.compute(samples.constData(), samples.count());
+   QCOMPARE(histogram.binCount(), 256);
+
+   const auto statistics = FrameStatistics::measure(histogram);
+   QCOMPARE(statistics.saturated, Q_UINT64_C(10));
+   QCOMPARE(statistics.median, 10);
+   QCOMPARE(statistics.mean, 34.5);
+   QCOMPARE(statistics.background, 10.0);
+   QCOMPARE(statistics.noise, 0.0);
+   QCOMPARE(FrameStatistics::measure(histogram, 200).saturated, Q_UINT64_C(10));
+   QCOMPARE(FrameStatistics::measure(histogram, 10).saturated, Q_UINT64_C(100));
+}
+
+void FrameStatisticsTest::evenCountTakesTheLowerMedian()
+{
+   // Half at 1000, half at 2000; the median is the first value reaching half the samples, not their average.
+   QVector<quint16> samples(200, 1000);
+   std::fill(samples.begin() + 100, samples.end(), quint16{ 2000 });
+   Histogram histogram;
+   histogram.compute(samples.constData(), samples.count());
+
+   const auto statistics = FrameStatistics::measure(histogram);
+   QCOMPARE(statistics.median, 1000);
+   QCOMPARE(statistics.mean, 1500.0);
+   QCOMPARE(statistics.standardDeviation, 500.0);
+}
+
+void FrameStatisticsTest::sigmaClipRejectsHotPixels()
+{
+   // A background of 99, 100 & 101 in equal numbers, under ten hot pixels.
+   QVector<quint16> samples;
+   for (int sample = 0; sample < 334; ++sample) {
+      samples << 99 << 100 << 101;
+   }
+   for (int hot = 0; hot < 10; ++hot) {
+      samples << 60000;
+   }
+   Histogram histogram;
+   histogram.compute(samples.constData(), samples.count());
+
+   const auto statistics = FrameStatistics::measure(histogram, 60000);
+   QCOMPARE(statistics.count, Q_UINT64_C(1012));
+   QCOMPARE(statistics.median, 100);
+   QCOMPARE(statistics.maximum, 60000);
+   QCOMPARE(statistics.saturated, Q_UINT64_C(10));
+   QVERIFY(statistics.mean > 680.0);
+   QVERIFY(statistics.standardDeviation > 5000.0);
+
+   // The clipped figures are those of the background alone.
+   QCOMPARE(statistics.background, 100.0);
+   QVERIFY(qAbs(statistics.noise - std::sqrt(2.0 / 3.0)) < 1.0e-9);
+}
+
+void FrameStatisticsTest::uniformSamples()
+{
+   // Ten each of 0 through 9: mean 4.5, variance 8.25.
+   QVector<quint16> samples;
+   for (int copy = 0; copy < 10; ++copy) {
+      for (quint16 value = 0; value < 10; ++value) {
+         samples << value;
+      }
+   }
+   Histogram histogram;
+   histogram.compute(samples.constData(), samples.count());
+
+   const auto statistics = FrameStatistics::measure(histogram);
+   QCOMPARE(statistics.count, Q_UINT64_C(100));
+   QCOMPARE(statistics.minimum, 0);
+   QCOMPARE(statistics.maximum, 9);
+   QCOMPARE(statistics.median, 4);
+   QCOMPARE(statistics.mean, 4.5);
+   QVERIFY(qAbs(statistics.standardDeviation - std::sqrt(8.25)) < 1.0e-9);
+   QCOMPARE(histogram.median(), statistics.median);
+
+   // Nothing lies beyond three sigma of a uniform spread, so clipping keeps every sample.
+   QCOMPARE(statistics.background, 4.0);
+   QVERIFY(qAbs(statistics.noise - statistics.standardDeviation) < 1.0e-9);
+}
+
+QTEST_GUILESS_MAIN(FrameStatisticsTest)
+
+#include "FrameStatisticsTest.moc"
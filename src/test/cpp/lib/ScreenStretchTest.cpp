@@ -0,0 +1,86 @@
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "Histogram.hpp"
+#include "ScreenStretch.hpp"
+
+#include <QVector>
+#include <QtTest>
+
+/*! \brief Checks the automatic stretch on frames whose medians are known.
+ */
+class ScreenStretchTest : public QObject
+{
+   Q_OBJECT
+
+private slots:
+   void blackFrameGetsTheIdentity();
+   void saturatedFrameGetsTheIdentity();
+   void skyGoesToTheTargetBackground();
+
+private:
+   [[nodiscard]] static auto stretchOf(const QVector<quint16> & samples) -> ScreenStretch;
+};
+
+/* ***************************************************************************************************************** */
+// MARK: - Tests
+/* ***************************************************************************************************************** */
+void ScreenStretchTest::blackFrameGetsTheIdentity()
+{
+   // A few hot pixels do not move the median off zero.
+   QVector<quint16> samples(1000, 0);
+   std::fill(samples.begin(), samples.begin() + 10, quint16{ 40000 });
+   const auto stretch = stretchOf(samples);
+   QCOMPARE(stretch.shadows(), 0.0);
+   QCOMPARE(stretch.midtones(), 0.5);
+   QCOMPARE(stretch.highlights(), 1.0);
+
+   // Not a white screen: dim values stay dim.
+   const auto table = stretch.lookupTable(1 << 16);
+   QCOMPARE(table[0], quint8{ 0 });
+   QCOMPARE(table[1000], quint8{ 4 });
+   QCOMPARE(table[65535], quint8{ 255 });
+}
+
+void ScreenStretchTest::saturatedFrameGetsTheIdentity()
+{
+   const auto stretch = stretchOf(QVector<quint16>(1000, 65535));
+   QCOMPARE(stretch.midtones(), 0.5);
+   QCOMPARE(stretch.lookupTable(1 << 16)[32768], quint8{ 128 });
+}
+
+void ScreenStretchTest::skyGoesToTheTargetBackground()
+{
+   // 990 through 1010 in equal numbers; the median is 1000.
+   QVector<quint16> samples;
+   for (int copy = 0; copy < 10; ++copy) {
+      for (quint16 value = 990; value <= 1010; ++value) {
+         samples << value;
+      }
+   }
+   const auto stretch = stretchOf(samples);
+   QVERIFY(stretch.shadows() > 0.0 && stretch.shadows() < 990.0 / 65535.0);
+   QVERIFY(stretch.midtones() > 0.0 && stretch.midtones() < 0.5);
+
+   // The median lands a quarter of the way up the display, and the shadows go black.
+   const auto table = stretch.lookupTable(1 << 16);
+   QCOMPARE(table[1000], quint8{ 64 });
+   QCOMPARE(table[900], quint8{ 0 });
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Private methods
+/* ***************************************************************************************************************** */
+auto ScreenStretchTest::stretchOf(const QVector<quint16> & samples) -> ScreenStretch
+{
+   Histogram histogram;
+   histogram.compute(samples.constData(), samples.count());
+   return ScreenStretch::automatic(histogram);
+}
+
+QTEST_GUILESS_MAIN(ScreenStretchTest)
+
+#include "ScreenStretchTest.moc"
@@ -0,0 +1,162 @@
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "FramePool.hpp"
+#include "SerWriter.hpp"
+
+#include <memory>
+#include <QFile>
+#include <QFileInfo>
+#include <QTemporaryDir>
+#include <QtEndian>
+#include <QtTest>
+
+namespace
+{
+constexpr int     HeaderLength      = 178;
+constexpr int     FrameCountOffset  = 38;
+constexpr quint32 Width             = 4;
+constexpr quint32 Height            = 2;
+constexpr quint32 Depth             = 16;
+constexpr qint64  FrameLength       = Width * Height * Depth / 8;
+constexpr qint64  EpochMilliseconds = Q_INT64_C(1600000000000);
+constexpr qint64  UnixEpochTicks    = Q_INT64_C(621355968000000000); // SER times are 100 ns ticks from 0001-01-01
+} // namespace
+
+/*! \brief Records small synthetic frames into a temporary directory, and reads the SER files back.
+ */
+class SerWriterTest : public QObject
+{
+   Q_OBJECT
+
+private slots:
+   void init();
+   void cleanup();
+   void geometryChangeStartsNewFile();
+   void headerHoldsGeometryAndCount();
+   void trailerHoldsTimestamps();
+   void writesSplitAtFileLimit();
+
+private:
+   [[nodiscard]] auto frame(quint64 sequence, quint32 width = Width) const -> Frame;
+   [[nodiscard]] auto record(SerWriter & writer) -> bool;
+
+   std::unique_ptr<QTemporaryDir> m_directory;
+   std::shared_ptr<FramePool>     m_pool;
+   QStringList                    m_files;
+   QList<int>                     m_frames;
+};
+
+/* ***************************************************************************************************************** */
+// MARK: - Tests
+/* ***************************************************************************************************************** */
+void SerWriterTest::init()
+{
+   m_directory = std::make_unique<QTemporaryDir>();
+   QVERIFY(m_directory->isValid());
+   m_pool = FramePool::create(2 * FrameLength, 4);
+   m_files.clear();
+   m_frames.clear();
+}
+
+void SerWriterTest::cleanup()
+{
+   m_directory.reset();
+}
+
+void SerWriterTest::geometryChangeStartsNewFile()
+{
+   SerWriter writer;
+   QVERIFY(record(writer));
+   QVERIFY(writer.write(frame(1)));
+   QVERIFY(writer.write(frame(2, 2 * Width)));
+   QVERIFY(writer.close());
+   QCOMPARE(m_frames, QList<int>({ 1, 1 }));
+}
+
+void SerWriterTest::headerHoldsGeometryAndCount()
+{
+   SerWriter writer;
+   QVERIFY(record(writer));
+   for (quint64 sequence = 1; sequence <= 3; ++sequence) {
+      QVERIFY(writer.write(frame(sequence)));
+   }
+   QVERIFY(writer.close());
+   QCOMPARE(m_files.count(), 1);
+   QCOMPARE(m_frames, QList<int>({ 3 }));
+
+   QFile file(m_files.first());
+   QVERIFY(file.open(QIODevice::ReadOnly));
+   const auto bytes = file.readAll();
+   // The header, the frames back to back, then one timestamp per frame.
+   QCOMPARE(static_cast<qint64>(bytes.size()), HeaderLength + 3 * FrameLength + 3 * 8);
+   QCOMPARE(bytes.left(14), QByteArray("LUCAM-RECORDER"));
+   const auto * header = reinterpret_cast<const uchar *>(bytes.constData()); // NOLINT
+   QCOMPARE(qFromLittleEndian<qint32>(header + 18), 0); // monochrome
+   QCOMPARE(qFromLittleEndian<qint32>(header + 26), qint32{ Width });
+   QCOMPARE(qFromLittleEndian<qint32>(header + 30), qint32{ Height });
+   QCOMPARE(qFromLittleEndian<qint32>(header + 34), qint32{ Depth });
+   QCOMPARE(qFromLittleEndian<qint32>(header + FrameCountOffset), 3);
+}
+
+void SerWriterTest::trailerHoldsTimestamps()
+{
+   SerWriter writer;
+   QVERIFY(record(writer));
+   QVERIFY(writer.write(frame(1)));
+   QVERIFY(writer.write(frame(2)));
+   QVERIFY(writer.close());
+
+   QFile file(m_files.first());
+   QVERIFY(file.open(QIODevice::ReadOnly));
+   const auto   bytes   = file.readAll();
+   const auto * trailer = reinterpret_cast<const uchar *>(bytes.constData()) + HeaderLength + 2 * FrameLength;
+   QCOMPARE(qFromLittleEndian<qint64>(trailer), (EpochMilliseconds + 1) * 10000 + UnixEpochTicks);
+   QCOMPARE(qFromLittleEndian<qint64>(trailer + 8), (EpochMilliseconds + 2) * 10000 + UnixEpochTicks);
+}
+
+void SerWriterTest::writesSplitAtFileLimit()
+{
+   // Room for two frames a file; the trailer does not count towards the limit.
+   SerWriter writer;
+   writer.setFileLimit(HeaderLength + 2 * FrameLength);
+   QVERIFY(record(writer));
+   for (quint64 sequence = 1; sequence <= 5; ++sequence) {
+      QVERIFY(writer.write(frame(sequence)));
+   }
+   QVERIFY(writer.close());
+   QCOMPARE(m_frames, QList<int>({ 2, 2, 1 }));
+   QCOMPARE(m_files.count(), 3);
+   for (int index = 0; index < m_files.count(); ++index) {
+      QVERIFY(m_files.at(index).endsWith(QString("_%1.ser").arg(index + 1, 3, 10, QChar('0'))));
+      QCOMPARE(QFileInfo(m_files.at(index)).size(), HeaderLength + m_frames.at(index) * (FrameLength + 8));
+   }
+}
+
+/* ***************************************************************************************************************** */
+// MARK: - Private methods
+/* ***************************************************************************************************************** */
+auto SerWriterTest::frame(quint64 sequence, quint32 width) const -> Frame
+{
+   auto next = m_pool->acquire();
+   next.setGeometry(width, Height, Depth, 1);
+   next.setSequence(sequence);
+   next.setTimestamps(EpochMilliseconds + static_cast<qint64>(sequence), EpochMilliseconds);
+   return next;
+}
+
+auto SerWriterTest::record(SerWriter & writer) -> bool
+{
+   QObject::connect(&writer, &SerWriter::fileWritten, this, [this](const QString & path, int frames) {
+      m_files.append(path);
+      m_frames.append(frames);
+   });
+   return writer.open(m_directory->path(), QString("test"), SerWriter::Header());
+}
+
+QTEST_GUILESS_MAIN(SerWriterTest)
+
+#include "SerWriterTest.moc"
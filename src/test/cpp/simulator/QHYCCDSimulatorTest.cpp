@@ -0,0 +1,145 @@
+/**
+ * Copyright © 2021 Timothy Reaves
+ *
+ * For the license, see the root LICENSE file.
+ */
+
+#include "Config.h"
+#include "DeviceWatcher.hpp"
+#include "FrameStatistics.hpp"
+#include "Histogram.hpp"
+#include "QHYCCDSimulator.hpp"
+
+#include <QByteArray>
+#include <QtTest>
+#include <QVector>
+#include <qhyccd.h>
+
+namespace
+{
+constexpr double ExposureMicroseconds = 10000.0;
+
+/*! A small, fast camera, so a frame costs next to nothing. */
+auto testModel(const QByteArray & id) -> CameraModel
+{
+   CameraModel model;
+   model.id             = id;
+   model.width          = 64;
+   model.height         = 48;
+   model.readoutLatency = 0.0;
+   model.starCount      = 3;
+   return model;
+}
+} // namespace
+
+/*! \brief Drives the simulated driver through qhyccd.h, as the application does.
+ *
+ * The driver is one per process, so the tests share it; each starts by setting up the cameras it needs.
+ */
+class QHYCCDSimulatorTest : public QObject
+{
+   Q_OBJECT
+
+private slots:
+   void defaultCamerasArePluggedIn();
+   void openCameraFailsOnceUnplugged();
+   void singleFrameHasTheModelGeometry();
+   void watcherSeesHotPlugging();
+};
+
+/* ***************************************************************************************************************** */
+// MARK: - Tests
+/* ***************************************************************************************************************** */
+void QHYCCDSimulatorTest::defaultCamerasArePluggedIn()
+{
+   // Runs first, before any camera has been added, so the defaults are plugged in.
+   qunsetenv("QHYCCD_SIMULATOR_CONFIG");
+   QCOMPARE(InitQHYCCDResource(), quint32{ QHYCCD_SUCCESS });
+   const auto models = QHYCCDSimulator::defaultModels();
+   QCOMPARE(ScanQHYCCD(), static_cast<quint32>(models.count()));
+
+   QByteArray id(BufferSizeCameraName, 0);
+   for (int index = 0; index < models.count(); ++index) {
+      QCOMPARE(GetQHYCCDId(static_cast<quint32>(index), id.data()), quint32{ QHYCCD_SUCCESS });
+      QCOMPARE(QByteArray(id.constData()), models.at(index).id);
+   }
+   QCOMPARE(GetQHYCCDId(static_cast<quint32>(models.count()), id.data()), quint32{ QHYCCD_ERROR });
+}
+
+void QHYCCDSimulatorTest::openCameraFailsOnceUnplugged()
+{
+   QHYCCDSimulator::removeAllCameras();
+   QVERIFY(QHYCCDSimulator::addCamera(testModel("QHYTEST-0002")));
+   QByteArray id("QHYTEST-0002");
+   auto *     handle = OpenQHYCCD(id.data());
+   QVERIFY(handle != nullptr);
+   QVERIFY(OpenQHYCCD(id.data()) == nullptr);
+   QCOMPARE(InitQHYCCD(handle), quint32{ QHYCCD_SUCCESS });
+
+   QVERIFY(QHYCCDSimulator::removeCamera(id));
+   QCOMPARE(InitQHYCCD(handle), quint32{ QHYCCD_ERROR });
+   QCOMPARE(ExpQHYCCDSingleFrame(handle), quint32{ QHYCCD_ERROR });
+   QCOMPARE(CloseQHYCCD(handle), quint32{ QHYCCD_SUCCESS });
+   QVERIFY(OpenQHYCCD(id.data()) == nullptr);
+}
+
+void QHYCCDSimulatorTest::singleFrameHasTheModelGeometry()
+{
+   QHYCCDSimulator::removeAllCameras();
+   const auto model = testModel("QHYTEST-0003");
+   QVERIFY(QHYCCDSimulator::addCamera(model));
+   QByteArray id(model.id);
+   auto *     handle = OpenQHYCCD(id.data());
+   QVERIFY(handle != nullptr);
+   QCOMPARE(SetQHYCCDStreamMode(handle, 0), quint32{ QHYCCD_SUCCESS });
+   QCOMPARE(InitQHYCCD(handle), quint32{ QHYCCD_SUCCESS });
+   QCOMPARE(SetQHYCCDParam(handle, CONTROL_EXPOSURE, ExposureMicroseconds), quint32{ QHYCCD_SUCCESS });
+
+   QVector<quint8> pixels(static_cast<int>(GetQHYCCDMemLength(handle)));
+   QCOMPARE(pixels.count(), static_cast<int>(model.width * model.height * 2));
+   quint32 width{ 0 };
+   quint32 height{ 0 };
+   quint32 bpp{ 0 };
+   quint32 channels{ 0 };
+   QCOMPARE(ExpQHYCCDSingleFrame(handle), quint32{ QHYCCD_SUCCESS });
+   QCOMPARE(GetQHYCCDSingleFrame(handle, &width, &height, &bpp, &channels, pixels.data()), quint32{ QHYCCD_SUCCESS });
+   QCOMPARE(width, model.width);
+   QCOMPARE(height, model.height);
+   QCOMPARE(bpp, quint32{ 16 });
+   QCOMPARE(channels, quint32{ 1 });
+
+   // The synthetic sky has a background and noise, so the frame is neither black nor flat.
+   Histogram histogram;
+   histogram.compute(reinterpret_cast<const quint16 *>(pixels.constData()), width * height); // NOLINT
+   const auto statistics = FrameStatistics::measure(histogram);
+   QVERIFY(statistics.background > 0.0);
+   QVERIFY(statistics.noise > 0.0);
+   QCOMPARE(CloseQHYCCD(handle), quint32{ QHYCCD_SUCCESS });
+}
+
+void QHYCCDSimulatorTest::watcherSeesHotPlugging()
+{
+   QHYCCDSimulator::removeAllCameras();
+   QVERIFY(QHYCCDSimulator::addCamera(testModel("QHYTEST-0001")));
+
+   // The watcher's default scanner asks the driver, as it does with the SDK.
+   DeviceWatcher watcher;
+   QStringList   added;
+   QStringList   removed;
+   QObject::connect(&watcher, &DeviceWatcher::cameraAdded, this, [&added](const QString & id) { added << id; });
+   QObject::connect(&watcher, &DeviceWatcher::cameraRemoved, this, [&removed](const QString & id) { removed << id; });
+   watcher.rescan();
+   QTRY_COMPARE(added, QStringList({ "QHYTEST-0001" }));
+
+   QVERIFY(QHYCCDSimulator::addCamera(testModel("QHYTEST-0004")));
+   QVERIFY(QHYCCDSimulator::removeCamera("QHYTEST-0001"));
+   watcher.rescan();
+   // Removals are reported before additions.
+   QTRY_COMPARE(added, QStringList({ "QHYTEST-0001", "QHYTEST-0004" }));
+   QCOMPARE(removed, QStringList({ "QHYTEST-0001" }));
+   QCOMPARE(watcher.cameras(), QStringList({ "QHYTEST-0004" }));
+}
+
+QTEST_GUILESS_MAIN(QHYCCDSimulatorTest)
+
+#include "QHYCCDSimulatorTest.moc"